@@ -28,6 +28,7 @@
 
 #include <CoreFoundation/CFArray.h>
 #include <CoreFoundation/CFPriv.h>
+#include <CoreFoundation/CFStorage.h>
 #include "CFInternal.h"
 #include <string.h>
 
@@ -39,8 +40,14 @@ struct __CFArrayBucket {
     const void *_item;
 };
 
+extern unsigned long _CFStorageFastEnumeration(CFStorageRef storage, struct __objcFastEnumerationStateEquivalent *state, void *stackbuffer, unsigned long count);
+CF_PRIVATE void _CFStorageSetWeak(CFStorageRef storage);
+
+/* A deque moves the shorter side of the array on every insertion or removal away from its ends, so large mutable arrays which are edited in the middle switch to a CFStorage B-tree, where such edits are O(log n). Appending or removing at either end stays in the deque, where it is O(1). An array switches back to a deque once it has shrunk to half the threshold.
+*/
 enum {
-    __CF_MAX_BUCKETS_PER_DEQUE = LONG_MAX
+    __CF_MAX_BUCKETS_PER_DEQUE = LONG_MAX,
+    __CF_MIN_BUCKETS_FOR_STORAGE = 262144
 };
 
 CF_INLINE CFIndex __CFArrayDequeRoundUpCapacity(CFIndex capacity) {
@@ -66,6 +73,7 @@ struct __CFArray {
 enum {		/* Bits 0-1 */
     __kCFArrayImmutable = 0,
     __kCFArrayDeque = 2,
+    __kCFArrayStorage = 3
 };
 
 enum {		/* Bits 2-3 */
@@ -138,6 +146,10 @@ CF_INLINE struct __CFArrayBucket *__CFArrayGetBucketAtIndex(CFArrayRef array, CF
     case __kCFArrayImmutable:
     case __kCFArrayDeque:
 	return __CFArrayGetBucketsPtr(array) + idx;
+    case __kCFArrayStorage: {
+	CFStorageRef store = (CFStorageRef)array->_store;
+	return (struct __CFArrayBucket *)CFStorageGetValueAtIndex(store, idx, NULL);
+    }
     }
     return NULL;
 }
@@ -157,6 +169,7 @@ CF_PRIVATE CFArrayCallBacks *__CFArrayGetCallBacks(CFArrayRef array) {
 	result = (CFArrayCallBacks *)((uint8_t *)array + sizeof(struct __CFArray));
 	break;
     case __kCFArrayDeque:
+    case __kCFArrayStorage:
 	result = (CFArrayCallBacks *)((uint8_t *)array + sizeof(struct __CFArray));
 	break;
     }
@@ -192,8 +205,37 @@ CF_INLINE bool __CFArrayCallBacksMatchCFType(const CFArrayCallBacks *c) {
 struct _releaseContext {
     void (*release)(CFAllocatorRef, const void *);
     CFAllocatorRef allocator; 
+    __CFTypeCollectionReleaseBatch *batch;	// non-NULL when release is __CFTypeCollectionRelease
 };
 
+static void __CFArrayStorageRelease(const void *itemptr, void *context) {
+    struct _releaseContext *rc = (struct _releaseContext *)context;
+    if (rc->batch) {
+        __CFTypeCollectionReleaseBatchAdd(rc->batch, *(const void **)itemptr);
+    } else {
+        INVOKE_CALLBACK2(rc->release, rc->allocator, *(const void **)itemptr);
+    }
+    *(const void **)itemptr = NULL; // GC:  clear item to break strong reference.
+}
+
+static void __CFArrayReleaseBuckets(struct __CFArrayBucket *buckets, CFIndex count, void (*release)(CFAllocatorRef, const void *), CFAllocatorRef allocator) {
+    if (__CFTypeCollectionRelease == release) {
+        // decrement everything before finalizing anything; see __CFTypeCollectionReleaseBatch
+        __CFTypeCollectionReleaseBatch batch;
+        __CFTypeCollectionReleaseBatchInit(&batch, allocator, count);
+        for (CFIndex idx = 0; idx < count; idx++) {
+            __CFTypeCollectionReleaseBatchAdd(&batch, buckets[idx]._item);
+            buckets[idx]._item = NULL; // GC:  break strong reference.
+        }
+        __CFTypeCollectionReleaseBatchFinish(&batch);
+        return;
+    }
+    for (CFIndex idx = 0; idx < count; idx++) {
+	INVOKE_CALLBACK2(release, allocator, buckets[idx]._item);
+	buckets[idx]._item = NULL; // GC:  break strong reference.
+    }
+}
+
 static void __CFArrayReleaseValues(CFArrayRef array, CFRange range, bool releaseStorageIfPossible) {
     const CFArrayCallBacks *cb = __CFArrayGetCallBacks(array);
     CFAllocatorRef allocator;
@@ -206,10 +248,7 @@ static void __CFArrayReleaseValues(CFArrayRef array, CFRange range, bool release
             //   2) the slots don't' need to be zeroed
 	    struct __CFArrayBucket *buckets = __CFArrayGetBucketsPtr(array);
 	    allocator = __CFGetAllocator(array);
-	    for (idx = 0; idx < range.length; idx++) {
-		INVOKE_CALLBACK2(cb->release, allocator, buckets[idx + range.location]._item);
-		buckets[idx + range.location]._item = NULL; // GC:  break strong reference.
-	    }
+	    __CFArrayReleaseBuckets(buckets + range.location, range.length, cb->release, allocator);
 	}
 	break;
     case __kCFArrayDeque: {
@@ -218,10 +257,7 @@ static void __CFArrayReleaseValues(CFArrayRef array, CFRange range, bool release
 	    struct __CFArrayBucket *buckets = __CFArrayGetBucketsPtr(array);
 	    if (NULL != cb->release) {
 		allocator = __CFGetAllocator(array);
-		for (idx = 0; idx < range.length; idx++) {
-		    INVOKE_CALLBACK2(cb->release, allocator, buckets[idx + range.location]._item);
-		    buckets[idx + range.location]._item = NULL; // GC:  break strong reference.
-		}
+		__CFArrayReleaseBuckets(buckets + range.location, range.length, cb->release, allocator);
             } else {
 		for (idx = 0; idx < range.length; idx++) {
 		    buckets[idx + range.location]._item = NULL; // GC:  break strong reference.
@@ -236,6 +272,33 @@ static void __CFArrayReleaseValues(CFArrayRef array, CFRange range, bool release
 	}
 	break;
     }
+    case __kCFArrayStorage: {
+	CFStorageRef store = (CFStorageRef)array->_store;
+	if (NULL != cb->release && 0 < range.length && !hasBeenFinalized(array)) {
+	    struct _releaseContext context;
+	    allocator = __CFGetAllocator(array);
+	    context.release = cb->release;
+	    context.allocator = allocator;
+	    context.batch = NULL;
+	    if (__CFTypeCollectionRelease == cb->release) {
+		// as in __CFArrayReleaseBuckets
+		__CFTypeCollectionReleaseBatch batch;
+		__CFTypeCollectionReleaseBatchInit(&batch, allocator, range.length);
+		context.batch = &batch;
+		CFStorageApplyFunction(store, range, (CFStorageApplierFunction)__CFArrayStorageRelease, &context);
+		__CFTypeCollectionReleaseBatchFinish(&batch);
+	    } else {
+		CFStorageApplyFunction(store, range, (CFStorageApplierFunction)__CFArrayStorageRelease, &context);
+	    }
+	}
+	if (releaseStorageIfPossible && 0 == range.location && __CFArrayGetCount(array) == range.length) {
+	    CFRelease(store);
+	    __CFArraySetCount(array, 0);
+	    ((struct __CFArray *)array)->_store = NULL;
+	    __CFBitfieldSetValue(((CFRuntimeBase *)array)->_cfinfo[CF_INFO_BITS], 1, 0, __kCFArrayDeque);
+	}
+	break;
+    }
     }
 }
 
@@ -293,6 +356,9 @@ static CFStringRef __CFArrayCopyDescription(CFTypeRef cf) {
     case __kCFArrayDeque:
 	CFStringAppendFormat(result, NULL, CFSTR("<CFArray %p [%p]>{type = mutable-small, count = %lu, values = (%s"), cf, allocator, (unsigned long)cnt, cnt ? "\n" : "");
 	break;
+    case __kCFArrayStorage:
+	CFStringAppendFormat(result, NULL, CFSTR("<CFArray %p [%p]>{type = mutable-large, count = %lu, values = (%s"), cf, allocator, (unsigned long)cnt, cnt ? "\n" : "");
+	break;
     }
     cb = __CFArrayGetCallBacks(array);
     for (idx = 0; idx < cnt; idx++) {
@@ -553,12 +619,60 @@ CFIndex CFArrayGetCount(CFArrayRef array) {
 }
 
 
+/* Pointer identity scans over the buckets, a run of consecutive buckets at a time; these are the whole range for immutable and deque arrays, and a leaf at a time for the CFStorage ones. The comparisons are made four buckets per step without early exits inside the step, so the compiler can do them as vector compares. Not for ObjC arrays.
+*/
+CF_INLINE const struct __CFArrayBucket *__CFArrayGetConsecutiveBuckets(CFArrayRef array, CFIndex idx, CFIndex *cnt) {
+    if (__kCFArrayStorage == __CFArrayGetType(array)) {
+	CFRange leafRange;
+	const struct __CFArrayBucket *buckets = (const struct __CFArrayBucket *)CFStorageGetConstValueAtIndex((CFStorageRef)array->_store, idx, &leafRange);
+	*cnt = leafRange.location + leafRange.length - idx;
+	return buckets;
+    }
+    *cnt = __CFArrayGetCount(array) - idx;
+    return __CFArrayGetBucketsPtr(array) + idx;
+}
+
+static CFIndex __CFArrayGetFirstIndexOfIdenticalValue(CFArrayRef array, CFRange range, const void *value) {
+    while (0 < range.length) {
+	CFIndex idx = 0, cnt;
+	const struct __CFArrayBucket *buckets = __CFArrayGetConsecutiveBuckets(array, range.location, &cnt);
+	if (range.length < cnt) cnt = range.length;
+	for (; idx + 4 <= cnt; idx += 4) {
+	    if ((buckets[idx]._item == value) | (buckets[idx + 1]._item == value) | (buckets[idx + 2]._item == value) | (buckets[idx + 3]._item == value)) break;
+	}
+	for (; idx < cnt; idx++) {
+	    if (buckets[idx]._item == value) return range.location + idx;
+	}
+	range.location += cnt;
+	range.length -= cnt;
+    }
+    return kCFNotFound;
+}
+
+static CFIndex __CFArrayGetCountOfIdenticalValue(CFArrayRef array, CFRange range, const void *value) {
+    CFIndex count = 0;
+    while (0 < range.length) {
+	CFIndex cnt;
+	const struct __CFArrayBucket *buckets = __CFArrayGetConsecutiveBuckets(array, range.location, &cnt);
+	if (range.length < cnt) cnt = range.length;
+	for (CFIndex idx = 0; idx < cnt; idx++) {
+	    count += (buckets[idx]._item == value);
+	}
+	range.location += cnt;
+	range.length -= cnt;
+    }
+    return count;
+}
+
 CFIndex CFArrayGetCountOfValue(CFArrayRef array, CFRange range, const void *value) {
     CFIndex idx, count = 0;
     __CFGenericValidateType(array, CFArrayGetTypeID());    
     __CFArrayValidateRange(array, range, __PRETTY_FUNCTION__);
     CHECK_FOR_MUTATION(array);
     const CFArrayCallBacks *cb = CF_IS_OBJC(CFArrayGetTypeID(), array) ? &kCFTypeArrayCallBacks : __CFArrayGetCallBacks(array);
+    if (NULL == cb->equal && !CF_IS_OBJC(CFArrayGetTypeID(), array)) {
+	return __CFArrayGetCountOfIdenticalValue(array, range, value);
+    }
     for (idx = 0; idx < range.length; idx++) {
 	const void *item = CFArrayGetValueAtIndex(array, range.location + idx);
 	if (value == item || (cb->equal && INVOKE_CALLBACK2(cb->equal, value, item))) {
@@ -574,6 +688,11 @@ Boolean CFArrayContainsValue(CFArrayRef array, CFRange range, const void *value)
     __CFArrayValidateRange(array, range, __PRETTY_FUNCTION__);
     CHECK_FOR_MUTATION(array);
     const CFArrayCallBacks *cb = CF_IS_OBJC(CFArrayGetTypeID(), array) ? &kCFTypeArrayCallBacks : __CFArrayGetCallBacks(array);
+    if (!CF_IS_OBJC(CFArrayGetTypeID(), array)) {
+	// Most lookups are for a value which is in the array itself; find those without calling out to equal
+	if (kCFNotFound != __CFArrayGetFirstIndexOfIdenticalValue(array, range, value)) return true;
+	if (NULL == cb->equal) return false;
+    }
     for (idx = 0; idx < range.length; idx++) {
 	const void *item = CFArrayGetValueAtIndex(array, range.location + idx);
 	if (value == item || (cb->equal && INVOKE_CALLBACK2(cb->equal, value, item))) {
@@ -611,6 +730,11 @@ void CFArrayGetValues(CFArrayRef array, CFRange range, const void **values) {
 	case __kCFArrayDeque:
 	    objc_memmove_collectable(values, __CFArrayGetBucketsPtr(array) + range.location, range.length * sizeof(struct __CFArrayBucket));
 	    break;
+	case __kCFArrayStorage: {
+	    CFStorageRef store = (CFStorageRef)array->_store;
+	    CFStorageGetValues(store, range, values);
+	    break;
+	}
 	}
     }
 }
@@ -637,6 +761,9 @@ CF_EXPORT unsigned long _CFArrayFastEnumeration(CFArrayRef array, struct __objcF
             return array->_count;
         }
         return 0;
+    case __kCFArrayStorage:
+        state->mutationsPtr = (unsigned long *)&array->_mutations;
+        return _CFStorageFastEnumeration((CFStorageRef)array->_store, state, stackbuffer, count);
     }
     return 0;
 }
@@ -661,12 +788,19 @@ CFIndex CFArrayGetFirstIndexOfValue(CFArrayRef array, CFRange range, const void
     __CFArrayValidateRange(array, range, __PRETTY_FUNCTION__);
     CHECK_FOR_MUTATION(array);
     const CFArrayCallBacks *cb = CF_IS_OBJC(CFArrayGetTypeID(), array) ? &kCFTypeArrayCallBacks : __CFArrayGetCallBacks(array);
+    CFIndex identical = kCFNotFound;
+    if (!CF_IS_OBJC(CFArrayGetTypeID(), array)) {
+	// Only values before the first identical one need to be compared with equal
+	identical = __CFArrayGetFirstIndexOfIdenticalValue(array, range, value);
+	if (NULL == cb->equal) return identical;
+	if (kCFNotFound != identical) range.length = identical - range.location;
+    }
     for (idx = 0; idx < range.length; idx++) {
 	const void *item = CFArrayGetValueAtIndex(array, range.location + idx);
 	if (value == item || (cb->equal && INVOKE_CALLBACK2(cb->equal, value, item)))
 	    return idx + range.location;
     }
-    return kCFNotFound;
+    return identical;
 }
 
 CFIndex CFArrayGetLastIndexOfValue(CFArrayRef array, CFRange range, const void *value) {
@@ -858,6 +992,48 @@ static void __CFArrayRepositionDequeRegions(CFMutableArrayRef array, CFRange ran
     }
 }
 
+static void __CFArrayHandleOutOfMemory(CFTypeRef obj, CFIndex numBytes);
+
+static void __CFArrayConvertDequeToStore(CFMutableArrayRef array) {
+    struct __CFArrayDeque *deque = (struct __CFArrayDeque *)array->_store;
+    struct __CFArrayBucket *src = (struct __CFArrayBucket *)((uint8_t *)deque + sizeof(struct __CFArrayDeque) + deque->_leftIdx * sizeof(struct __CFArrayBucket));
+    CFStorageRef store;
+    CFIndex count = __CFArrayGetCount(array);
+    CFAllocatorRef allocator = __CFGetAllocator(array);
+    Boolean collectableMemory = CF_IS_COLLECTABLE_ALLOCATOR(allocator);
+    if (collectableMemory) auto_zone_retain(objc_collectableZone(), deque);
+    store = (CFStorageRef)CFStorageCreate(allocator, sizeof(const void *));
+    if (! isStrongMemory(array)) _CFStorageSetWeak(store);
+    if (__CFOASafe) __CFSetLastAllocationEventName(store, "CFArray (store-storage)");
+    __CFAssignWithWriteBarrier((void **)&array->_store, (void *)store);
+    CFStorageInsertValues(store, CFRangeMake(0, count));
+    CFStorageReplaceValues(store, CFRangeMake(0, count), src);
+    if (collectableMemory) auto_zone_release(objc_collectableZone(), deque);
+    else CFAllocatorDeallocate(allocator, deque);
+    __CFBitfieldSetValue(((CFRuntimeBase *)array)->_cfinfo[CF_INFO_BITS], 1, 0, __kCFArrayStorage);
+}
+
+static void __CFArrayConvertStoreToDeque(CFMutableArrayRef array) {
+    CFStorageRef store = (CFStorageRef)array->_store;
+    struct __CFArrayDeque *deque;
+    struct __CFArrayBucket *dst;
+    CFIndex count = CFStorageGetCount(store);
+    CFIndex capacity = __CFArrayDequeRoundUpCapacity(count);
+    CFIndex size = sizeof(struct __CFArrayDeque) + capacity * sizeof(struct __CFArrayBucket);
+    CFAllocatorRef allocator = __CFGetAllocator(array);
+    deque = (struct __CFArrayDeque *)CFAllocatorAllocate(allocator, size, isStrongMemory(array) ? __kCFAllocatorGCScannedMemory : 0);
+    if (NULL == deque) __CFArrayHandleOutOfMemory(array, size);
+    if (__CFOASafe) __CFSetLastAllocationEventName(deque, "CFArray (store-deque)");
+    deque->_leftIdx = (capacity - count) / 2;
+    deque->_capacity = capacity;
+    dst = (struct __CFArrayBucket *)((uint8_t *)deque + sizeof(struct __CFArrayDeque) + deque->_leftIdx * sizeof(struct __CFArrayBucket));
+    CFStorageGetValues(store, CFRangeMake(0, count), dst);
+    __CFAssignWithWriteBarrier((void **)&array->_store, (void *)deque);
+    if (CF_IS_COLLECTABLE_ALLOCATOR(allocator)) auto_zone_release(objc_collectableZone(), deque);
+    CFRelease(store);
+    __CFBitfieldSetValue(((CFRuntimeBase *)array)->_cfinfo[CF_INFO_BITS], 1, 0, __kCFArrayDeque);
+}
+
 static void __CFArrayHandleOutOfMemory(CFTypeRef obj, CFIndex numBytes) {
     CFStringRef msg = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("Attempt to allocate %ld bytes for CFArray failed"), numBytes);
     {
@@ -957,7 +1133,17 @@ void _CFArrayReplaceValues(CFMutableArrayRef array, CFRange range, const void **
 	__CFArrayReleaseValues(array, range, false);
     }
     // region B elements are now "dead"
-    if (0) {
+    if (__kCFArrayStorage == __CFArrayGetType(array)) {
+	CFStorageRef store = (CFStorageRef)array->_store;
+	// replace the range, copy in new values
+	if (range.length < newCount) {
+	    CFStorageInsertValues(store, CFRangeMake(range.location + range.length, newCount - range.length));
+	} else if (newCount < range.length) {
+	    CFStorageDeleteValues(store, CFRangeMake(range.location + newCount, range.length - newCount));
+	}
+	if (futureCnt <= __CF_MIN_BUCKETS_FOR_STORAGE / 2) {
+	    __CFArrayConvertStoreToDeque(array);
+	}
     } else if (NULL == array->_store) {
 	if (0) {
 	} else if (0 <= futureCnt) {
@@ -973,14 +1159,24 @@ void _CFArrayReplaceValues(CFMutableArrayRef array, CFRange range, const void **
 	}
     } else {		// Deque
 	// reposition regions A and C for new region B elements in gap
-	if (0) {
+	if (__CF_MIN_BUCKETS_FOR_STORAGE <= futureCnt && range.length != newCount && 0 < range.location && range.location + range.length < cnt) {
+	    CFStorageRef store;
+	    __CFArrayConvertDequeToStore(array);
+	    store = (CFStorageRef)array->_store;
+	    if (range.length < newCount) {
+		CFStorageInsertValues(store, CFRangeMake(range.location + range.length, newCount - range.length));
+	    } else if (newCount < range.length) {
+		CFStorageDeleteValues(store, CFRangeMake(range.location + newCount, range.length - newCount));
+	    }
 	} else if (range.length != newCount) {
 	    __CFArrayRepositionDequeRegions(array, range, newCount);
 	}
     }
     // copy in new region B elements
     if (0 < newCount) {
-	if (0) {
+	if (__kCFArrayStorage == __CFArrayGetType(array)) {	// GC: write barrier handled by CFStorage.
+	    CFStorageRef store = (CFStorageRef)array->_store;
+	    CFStorageReplaceValues(store, CFRangeMake(range.location, newCount), newv);
 	} else {	// Deque
 	    struct __CFArrayDeque *deque = (struct __CFArrayDeque *)array->_store;
 	    struct __CFArrayBucket *raw_buckets = (struct __CFArrayBucket *)((uint8_t *)deque + sizeof(struct __CFArrayDeque));
@@ -1071,6 +1267,133 @@ void CFArraySortValues(CFMutableArrayRef array, CFRange range, CFComparatorFunct
     if (values != buffer) CFAllocatorDeallocate(kCFAllocatorSystemDefault, values);
 }
 
+struct __CFArraySortKey {
+    const void *value;	// first, so that __CFArrayCompareValues() can compare these
+    uint64_t key;
+};
+
+struct _akeyContext {
+    CFArraySortKeyType keyType;
+    CFArrayKeyExtractorFunction extractor;
+    CFComparatorFunction func;
+    void *context;
+};
+
+// Returns the key of the value mapped to a UInt64 which has the same order
+static uint64_t __CFArrayGetSortKey(const void *value, struct _akeyContext *context) {
+    union { SInt64 s; Float64 f; UInt64 u; } key = {0};
+    if (NULL != context->extractor) {
+	INVOKE_CALLBACK3(context->extractor, value, &key, context->context);
+    } else if (kCFArraySortKeyStringPrefix == context->keyType) {
+	UniChar chars[4] = {0, 0, 0, 0};
+	CFStringGetCharacters((CFStringRef)value, CFRangeMake(0, __CFMin(CFStringGetLength((CFStringRef)value), 4)), chars);
+	key.u = ((uint64_t)chars[0] << 48) | ((uint64_t)chars[1] << 32) | ((uint64_t)chars[2] << 16) | (uint64_t)chars[3];
+    } else {
+	CFNumberGetValue((CFNumberRef)value, (kCFArraySortKeyFloat64 == context->keyType) ? kCFNumberFloat64Type : kCFNumberSInt64Type, &key);
+    }
+    switch (context->keyType) {
+    case kCFArraySortKeySInt64:
+	return key.u ^ 0x8000000000000000ULL;
+    case kCFArraySortKeyFloat64:
+	if (0.0 == key.f) return 0x8000000000000000ULL;	// -0.0 and 0.0 are equal
+	return (key.u & 0x8000000000000000ULL) ? ~key.u : (key.u | 0x8000000000000000ULL);
+    }
+    return key.u;
+}
+
+static CFComparisonResult __CFArrayCompareKeys(const void *v1, const void *v2, struct _akeyContext *context) {
+    uint64_t key1 = __CFArrayGetSortKey(v1, context), key2 = __CFArrayGetSortKey(v2, context);
+    if (key1 != key2) return (key1 < key2) ? kCFCompareLessThan : kCFCompareGreaterThan;
+    if (NULL == context->func) return kCFCompareEqualTo;
+    return (CFComparisonResult)(INVOKE_CALLBACK3(context->func, v1, v2, context->context));
+}
+
+// LSD radix sort on the keys, a byte at a time; bytes which are the same in every key are skipped
+static void __CFArrayRadixSortKeys(struct __CFArraySortKey *keys, struct __CFArraySortKey *tmp, CFIndex cnt) {
+    CFIndex counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for (CFIndex idx = 0; idx < cnt; idx++) {
+	uint64_t key = keys[idx].key;
+	for (CFIndex byte = 0; byte < 8; byte++) {
+	    counts[byte][(key >> (byte * 8)) & 0xFF]++;
+	}
+    }
+    struct __CFArraySortKey *src = keys, *dst = tmp;
+    for (CFIndex byte = 0; byte < 8; byte++) {
+	CFIndex *bucketCounts = counts[byte];
+	if (cnt == bucketCounts[(src[0].key >> (byte * 8)) & 0xFF]) continue;
+	CFIndex offset = 0;
+	for (CFIndex bucket = 0; bucket < 256; bucket++) {
+	    CFIndex c = bucketCounts[bucket];
+	    bucketCounts[bucket] = offset;
+	    offset += c;
+	}
+	for (CFIndex idx = 0; idx < cnt; idx++) {
+	    dst[bucketCounts[(src[idx].key >> (byte * 8)) & 0xFF]++] = src[idx];
+	}
+	struct __CFArraySortKey *t = src;
+	src = dst;
+	dst = t;
+    }
+    if (src != keys) memmove(keys, src, cnt * sizeof(struct __CFArraySortKey));
+}
+
+void CFArraySortValuesUsingKey(CFMutableArrayRef array, CFRange range, CFArraySortKeyType keyType, CFArrayKeyExtractorFunction extractor, CFComparatorFunction comparator, void *context) {
+    FAULT_CALLBACK((void **)&(extractor));
+    FAULT_CALLBACK((void **)&(comparator));
+    __CFArrayValidateRange(array, range, __PRETTY_FUNCTION__);
+    CFAssert2(kCFArraySortKeySInt64 <= keyType && keyType <= kCFArraySortKeyStringPrefix, __kCFLogAssertion, "%s(): unknown key type %ld", __PRETTY_FUNCTION__, (long)keyType);
+    struct _akeyContext ctx;
+    ctx.keyType = keyType;
+    ctx.extractor = extractor;
+    ctx.func = comparator;
+    ctx.context = context;
+    Boolean immutable = false;
+    const CFArrayCallBacks *cb = NULL;
+    if (CF_IS_OBJC(CFArrayGetTypeID(), array)) {
+        BOOL result;
+        result = CF_OBJC_CALLV((NSMutableArray *)array, isKindOfClass:[NSMutableArray class]);
+        immutable = !result;
+        cb = &kCFTypeArrayCallBacks;
+    } else {
+        immutable = (__kCFArrayImmutable == __CFArrayGetType(array));
+        cb = __CFArrayGetCallBacks(array);
+    }
+    if (immutable || range.length < 2) {
+	return;
+    }
+    if ((cb->retain && !cb->release) || (!cb->retain && cb->release)) {
+	// values can't be put back with CFArrayReplaceValues(); let CFArraySortValues() exchange them in place
+	CFArraySortValues(array, range, (CFComparatorFunction)__CFArrayCompareKeys, &ctx);
+	return;
+    }
+    // implemented abstractly, careful!
+    const void **values = (const void **)CFAllocatorAllocate(kCFAllocatorSystemDefault, range.length * sizeof(void *), 0); // GC OK
+    struct __CFArraySortKey *keys = (struct __CFArraySortKey *)CFAllocatorAllocate(kCFAllocatorSystemDefault, 2 * range.length * sizeof(struct __CFArraySortKey), 0); // GC OK
+    if (NULL == values || NULL == keys) __CFArrayHandleOutOfMemory(array, range.length * (sizeof(void *) + 2 * sizeof(struct __CFArraySortKey)));
+    CFArrayGetValues(array, range, values);
+    for (CFIndex idx = 0; idx < range.length; idx++) {
+	keys[idx].value = values[idx];
+	keys[idx].key = __CFArrayGetSortKey(values[idx], &ctx);
+    }
+    __CFArrayRadixSortKeys(keys, keys + range.length, range.length);
+    if (NULL != comparator) {
+	struct _acompareContext tieCtx;
+	tieCtx.func = comparator;
+	tieCtx.context = context;
+	for (CFIndex idx = 0, run; idx < range.length; idx += run) {
+	    for (run = 1; idx + run < range.length && keys[idx + run].key == keys[idx].key; run++);
+	    if (1 < run) CFMergeSortArray(keys + idx, run, sizeof(struct __CFArraySortKey), (CFComparatorFunction)__CFArrayCompareValues, &tieCtx);
+	}
+    }
+    for (CFIndex idx = 0; idx < range.length; idx++) {
+	values[idx] = keys[idx].value;
+    }
+    CFArrayReplaceValues(array, range, values, range.length);
+    CFAllocatorDeallocate(kCFAllocatorSystemDefault, keys);
+    CFAllocatorDeallocate(kCFAllocatorSystemDefault, values);
+}
+
 CFIndex CFArrayBSearchValues(CFArrayRef array, CFRange range, const void *value, CFComparatorFunction comparator, void *context) {
     FAULT_CALLBACK((void **)&(comparator));
     __CFArrayValidateRange(array, range, __PRETTY_FUNCTION__);
@@ -662,6 +662,76 @@ void CFArrayExchangeValuesAtIndices(CFMutableArrayRef theArray, CFIndex idx1, CF
 CF_EXPORT
 void CFArraySortValues(CFMutableArrayRef theArray, CFRange range, CFComparatorFunction comparator, void *context);
 
+/*!
+	@typedef CFArraySortKeyType
+	The kinds of fixed-width key by which CFArraySortValuesUsingKey()
+	can sort.
+	@constant kCFArraySortKeySInt64 The key is an SInt64. By default it
+		is the value of a CFNumber, as given by CFNumberGetValue()
+		with kCFNumberSInt64Type.
+	@constant kCFArraySortKeyFloat64 The key is a Float64. By default it
+		is the value of a CFNumber, as given by CFNumberGetValue()
+		with kCFNumberFloat64Type. The order of NaNs is undefined.
+	@constant kCFArraySortKeyStringPrefix The key is a UInt64 holding a
+		prefix of a string, such that ordering prefixes as unsigned
+		integers agrees with the order of the strings. By default it
+		is the first four UTF-16 characters of a CFString, from the
+		most significant bits down, padded with zeros; this agrees
+		with comparators which order strings by their UTF-16
+		characters.
+*/
+typedef CF_ENUM(CFIndex, CFArraySortKeyType) {
+    kCFArraySortKeySInt64 = 0,
+    kCFArraySortKeyFloat64 = 1,
+    kCFArraySortKeyStringPrefix = 2
+};
+
+/*!
+	@typedef CFArrayKeyExtractorFunction
+	Type of the callback function used by CFArraySortValuesUsingKey()
+		to get the sort key of a value.
+	@param value The value from the array.
+	@param key A pointer to the SInt64, Float64 or UInt64, according to
+		the key type, in which the key of the value is to be stored.
+	@param context The user-defined context parameter given to the sort
+		function.
+*/
+typedef void (*CFArrayKeyExtractorFunction)(const void *value, void *key, void *context);
+
+/*!
+	@function CFArraySortValuesUsingKey
+	Sorts the values in the array by a fixed-width key, which is
+	extracted once per value; the values are then sorted by radix
+	sort, without a function call per comparison. The sort is
+	stable.
+	@param theArray The array whose values are to be sorted. If this
+		parameter is not a valid mutable CFArray, the behavior is
+		undefined.
+	@param range The range of values within the array to sort. If the
+		range location or end point (defined by the location plus
+		length minus 1) is outside the index space of the array (0
+		to N-1 inclusive, where N is the count of the array), the
+		behavior is undefined. If the range length is negative, the
+		behavior is undefined. The range may be empty (length 0).
+	@param keyType The kind of key by which the values are sorted. If
+		this parameter is not one of the CFArraySortKeyType
+		constants, the behavior is undefined.
+	@param extractor The function which gets the key of a value, or
+		NULL to use the default for the key type, in which case
+		the values must all be CFNumbers or all be CFStrings, as
+		the key type requires.
+	@param comparator The function which orders values whose keys are
+		equal, or NULL to leave them in their original order. The
+		comparator must agree with the keys: if the key of one
+		value is less than that of another, the comparator must
+		find the first value less than the second.
+	@param context A pointer-sized user-defined value, which is passed
+		as the last parameter to the extractor and comparator
+		functions, but is otherwise unused by this function.
+*/
+CF_EXPORT
+void CFArraySortValuesUsingKey(CFMutableArrayRef theArray, CFRange range, CFArraySortKeyType keyType, CFArrayKeyExtractorFunction extractor, CFComparatorFunction comparator, void *context);
+
 /*!
 	@function CFArrayAppendArray
 	Adds the values from an array to another array.
@@ -620,6 +620,7 @@ void *CFAllocatorAllocate(CFAllocatorRef allocator, CFIndex size, CFOptionFlags
 		newptr = (void *)INVOKE_CALLBACK3(allocateFunc, size, hint, allocator->_context.info);
 	}
     }
+    __CFAllocationProfilerAllocate(newptr, size);
     return newptr;
 }
 
@@ -655,6 +656,7 @@ void *CFAllocatorReallocate(CFAllocatorRef allocator, void *ptr, CFIndex newsize
 	if (allocateFunc) {
 		newptr = (void *)INVOKE_CALLBACK3(allocateFunc, newsize, hint, allocator->_context.info);
 	}
+	__CFAllocationProfilerAllocate(newptr, newsize);
 	return newptr;
     }
     if (NULL != ptr && 0 == newsize) {
@@ -670,6 +672,7 @@ void *CFAllocatorReallocate(CFAllocatorRef allocator, void *ptr, CFIndex newsize
 #endif
 	deallocateFunc = __CFAllocatorGetDeallocateFunction(&allocator->_context);
 	if (NULL != deallocateFunc) {
+	    __CFAllocationProfilerDeallocate(ptr);
 	    INVOKE_CALLBACK2(deallocateFunc, ptr, allocator->_context.info);
 	}
 	return NULL;
@@ -682,7 +685,10 @@ void *CFAllocatorReallocate(CFAllocatorRef allocator, void *ptr, CFIndex newsize
 #endif
     reallocateFunc = __CFAllocatorGetReallocateFunction(&allocator->_context);
     if (NULL == reallocateFunc) return NULL;
+    // Forget the old block first; once reallocated its address may be handed out again
+    __CFAllocationProfilerDeallocate(ptr);
     newptr = (void *)INVOKE_CALLBACK4(reallocateFunc, ptr, newsize, hint, allocator->_context.info);
+    __CFAllocationProfilerAllocate(newptr, newsize);
     return newptr;
 }
 
@@ -716,6 +722,7 @@ void CFAllocatorDeallocate(CFAllocatorRef allocator, void *ptr) {
 #endif
     deallocateFunc = __CFAllocatorGetDeallocateFunction(&allocator->_context);
     if (NULL != ptr && NULL != deallocateFunc) {
+	__CFAllocationProfilerDeallocate(ptr);
 	INVOKE_CALLBACK2(deallocateFunc, ptr, allocator->_context.info);
     }
 }
@@ -785,6 +792,191 @@ void CFAllocatorGetContext(CFAllocatorRef allocator, CFAllocatorContext *context
     context->preferredSize = __CFAllocatorGetPreferredSizeFunction(&allocator->_context);
 }
 
+/* Arena allocator. Each allocation is preceded by a 16 byte header
+   holding its rounded size, so that reallocations which cannot grow in
+   place know how much to copy; 16 bytes also preserves the alignment CF
+   objects expect. Only the most recent allocation in the current block
+   can grow in place or be given back.
+*/
+
+#define __kCFArenaDefaultBlockSize	(64 * 1024)
+#define __kCFArenaMinBlockSize		4096
+#define __kCFArenaHeaderSize		16
+
+typedef struct __CFArenaBlock {
+    struct __CFArenaBlock *_next;
+    CFIndex _size;			// usable bytes following the block header
+} __CFArenaBlock;
+
+#define __kCFArenaBlockHeaderSize	((sizeof(__CFArenaBlock) + 0xF) & ~0xF)
+
+typedef struct {
+    CFLock_t _lock;
+    CFOptionFlags _flags;
+    CFIndex _blockSize;
+    __CFArenaBlock *_blocks;		// current bump block first, then older and oversized blocks
+    uint8_t *_cursor;
+    uint8_t *_limit;
+    uint8_t *_last;			// most recent bump allocation, or NULL
+} __CFArena;
+
+CF_INLINE CFIndex __CFArenaRoundSize(CFIndex size) {
+    return (size + 0xF) & ~0xF;
+}
+
+CF_INLINE uint8_t *__CFArenaBlockBytes(__CFArenaBlock *block) {
+    return (uint8_t *)block + __kCFArenaBlockHeaderSize;
+}
+
+static __CFArenaBlock *__CFArenaBlockCreate(CFIndex size) {
+    __CFArenaBlock *block = (__CFArenaBlock *)malloc(__kCFArenaBlockHeaderSize + size);
+    if (NULL == block) return NULL;
+    block->_next = NULL;
+    block->_size = size;
+    return block;
+}
+
+// Must be called with the arena lock held
+static void *__CFArenaAllocateLocked(__CFArena *arena, CFIndex size) {
+    CFIndex need = __kCFArenaHeaderSize + __CFArenaRoundSize(size);
+    uint8_t *result;
+    if (need <= arena->_limit - arena->_cursor) {
+	result = arena->_cursor;
+	arena->_cursor += need;
+	arena->_last = result + __kCFArenaHeaderSize;
+    } else if (need > arena->_blockSize / 4) {
+	// Oversized requests get a block of their own, queued behind the
+	// current one so that its free space is not abandoned.
+	__CFArenaBlock *block = __CFArenaBlockCreate(need);
+	if (NULL == block) return NULL;
+	if (NULL != arena->_blocks) {
+	    block->_next = arena->_blocks->_next;
+	    arena->_blocks->_next = block;
+	} else {
+	    arena->_blocks = block;
+	}
+	result = __CFArenaBlockBytes(block);
+    } else {
+	__CFArenaBlock *block = __CFArenaBlockCreate(arena->_blockSize);
+	if (NULL == block) return NULL;
+	block->_next = arena->_blocks;
+	arena->_blocks = block;
+	result = __CFArenaBlockBytes(block);
+	arena->_cursor = result + need;
+	arena->_limit = result + arena->_blockSize;
+	arena->_last = result + __kCFArenaHeaderSize;
+    }
+    *(CFIndex *)result = need - __kCFArenaHeaderSize;
+    return result + __kCFArenaHeaderSize;
+}
+
+static void *__CFArenaAllocate(CFIndex size, CFOptionFlags hint, void *info) {
+    __CFArena *arena = (__CFArena *)info;
+    __CFLock(&arena->_lock);
+    void *result = __CFArenaAllocateLocked(arena, size);
+    __CFUnlock(&arena->_lock);
+    return result;
+}
+
+static void *__CFArenaReallocate(void *ptr, CFIndex newsize, CFOptionFlags hint, void *info) {
+    __CFArena *arena = (__CFArena *)info;
+    CFIndex oldSize = *(CFIndex *)((uint8_t *)ptr - __kCFArenaHeaderSize);
+    CFIndex roundedSize = __CFArenaRoundSize(newsize);
+    void *result = ptr;
+    __CFLock(&arena->_lock);
+    if (roundedSize <= oldSize) {
+	if (ptr == arena->_last) {
+	    arena->_cursor = (uint8_t *)ptr + roundedSize;
+	    *(CFIndex *)((uint8_t *)ptr - __kCFArenaHeaderSize) = roundedSize;
+	}
+    } else if (ptr == arena->_last && roundedSize <= arena->_limit - (uint8_t *)ptr) {
+	arena->_cursor = (uint8_t *)ptr + roundedSize;
+	*(CFIndex *)((uint8_t *)ptr - __kCFArenaHeaderSize) = roundedSize;
+    } else {
+	result = __CFArenaAllocateLocked(arena, newsize);
+	if (NULL != result) memmove(result, ptr, oldSize);
+    }
+    __CFUnlock(&arena->_lock);
+    return result;
+}
+
+static void __CFArenaDeallocate(void *ptr, void *info) {
+    __CFArena *arena = (__CFArena *)info;
+    __CFLock(&arena->_lock);
+    if (ptr == arena->_last) {
+	arena->_cursor = (uint8_t *)ptr - __kCFArenaHeaderSize;
+	arena->_last = NULL;
+    }
+    __CFUnlock(&arena->_lock);
+}
+
+static CFIndex __CFArenaPreferredSize(CFIndex size, CFOptionFlags hint, void *info) {
+    return __CFArenaRoundSize(size);
+}
+
+static void __CFArenaFreeBlocks(__CFArenaBlock *block) {
+    while (NULL != block) {
+	__CFArenaBlock *next = block->_next;
+	free(block);
+	block = next;
+    }
+}
+
+static void __CFArenaRelease(const void *info) {
+    __CFArena *arena = (__CFArena *)info;
+    __CFArenaFreeBlocks(arena->_blocks);
+    free(arena);
+}
+
+CFAllocatorRef CFAllocatorCreateArena(CFIndex blockSize, CFAllocatorArenaOptions flags) {
+    CFAssert2(0 <= blockSize, __kCFLogAssertion, "%s(): block size (%d) cannot be less than zero", __PRETTY_FUNCTION__, blockSize);
+    __CFArena *arena = (__CFArena *)calloc(1, sizeof(__CFArena));
+    if (NULL == arena) return NULL;
+    if (0 == blockSize) blockSize = __kCFArenaDefaultBlockSize;
+    if (blockSize < __kCFArenaMinBlockSize) blockSize = __kCFArenaMinBlockSize;
+    CF_LOCK_INIT_FOR_STRUCTS(arena->_lock);
+    arena->_flags = flags;
+    arena->_blockSize = __CFArenaRoundSize(blockSize);
+    CFAllocatorContext context = {0, arena, NULL, __CFArenaRelease, NULL, __CFArenaAllocate, __CFArenaReallocate, __CFArenaDeallocate, __CFArenaPreferredSize};
+    CFAllocatorRef allocator = __CFAllocatorCreate(kCFAllocatorSystemDefault, &context);
+    if (NULL == allocator) free(arena);
+    return allocator;
+}
+
+void CFAllocatorArenaReset(CFAllocatorRef allocator) {
+    __CFGenericValidateType(allocator, __kCFAllocatorTypeID);
+    CFAssert1(__CFArenaAllocate == allocator->_context.allocate, __kCFLogAssertion, "%s(): allocator is not an arena", __PRETTY_FUNCTION__);
+    __CFArena *arena = (__CFArena *)allocator->_context.info;
+    __CFLock(&arena->_lock);
+    // Keep one regular block around so that a reused arena does not
+    // go straight back to malloc.
+    __CFArenaBlock *keep = NULL, *block = arena->_blocks;
+    while (NULL != block) {
+	__CFArenaBlock *next = block->_next;
+	if (NULL == keep && block->_size == arena->_blockSize) {
+	    keep = block;
+	    keep->_next = NULL;
+	} else {
+	    free(block);
+	}
+	block = next;
+    }
+    arena->_blocks = keep;
+    arena->_cursor = keep ? __CFArenaBlockBytes(keep) : NULL;
+    arena->_limit = keep ? __CFArenaBlockBytes(keep) + keep->_size : NULL;
+    arena->_last = NULL;
+    __CFUnlock(&arena->_lock);
+}
+
+CF_PRIVATE Boolean __CFAllocatorIsObjectOwningArena(CFAllocatorRef allocator) {
+#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI
+    if (allocator->_base._cfisa != __CFISAForTypeID(__kCFAllocatorTypeID)) {	// malloc_zone_t *
+	return false;
+    }
+#endif
+    return (__CFArenaAllocate == allocator->_context.allocate) && (((__CFArena *)allocator->_context.info)->_flags & kCFAllocatorArenaOwnsObjects);
+}
+
 CF_PRIVATE void *_CFAllocatorAllocateGC(CFAllocatorRef allocator, CFIndex size, CFOptionFlags hint)
 {
     if (CF_IS_COLLECTABLE_ALLOCATOR(allocator))
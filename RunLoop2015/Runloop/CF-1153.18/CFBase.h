@@ -568,6 +568,36 @@ CFIndex CFAllocatorGetPreferredSizeForSize(CFAllocatorRef allocator, CFIndex siz
 CF_EXPORT
 void CFAllocatorGetContext(CFAllocatorRef allocator, CFAllocatorContext *context);
 
+/*
+	Arena allocators hand out memory by bumping a pointer through
+	blocks of blockSize bytes (0 selects a default size). Deallocation
+	only returns memory when it frees the most recent allocation;
+	all other memory is kept until CFAllocatorArenaReset() is called
+	or the allocator is destroyed. Both operations take time
+	proportional to the number of blocks, not the number of
+	allocations. Requests larger than a quarter of the block size get
+	their own block.
+
+	With kCFAllocatorArenaOwnsObjects, the arena owns the CF objects
+	created with it. Objects do not retain the allocator, and when one
+	of them is deallocated its finalizer is not run. Releasing the root
+	of an object graph therefore does not walk the graph: the memory is
+	reclaimed all at once by resetting or releasing the arena. Every
+	object the graph references must itself live in the arena, because
+	references to objects outside it are never released. The owner must
+	keep the arena alive while any of its objects are in use, and
+	must not reset it until then either.
+*/
+typedef CF_OPTIONS(CFOptionFlags, CFAllocatorArenaOptions) {
+    kCFAllocatorArenaOwnsObjects = (1UL << 0)
+};
+
+CF_EXPORT
+CFAllocatorRef CFAllocatorCreateArena(CFIndex blockSize, CFAllocatorArenaOptions flags);
+
+CF_EXPORT
+void CFAllocatorArenaReset(CFAllocatorRef arena);
+
 
 /* Polymorphic CF functions */
 
@@ -588,6 +618,24 @@ void CFRelease(CFTypeRef cf);
 CF_EXPORT
 CFTypeRef CFAutorelease(CFTypeRef CF_RELEASES_ARGUMENT arg) CF_AVAILABLE(10_9, 7_0);
 
+/*
+	Release pools batch the releases of objects passed to CFAutorelease().
+	CFReleasePoolPush() starts a pool on the calling thread and returns
+	a token for it; CFReleasePoolPop() releases, newest first, every
+	object autoreleased on that thread since the matching push, including
+	those in pools pushed later and not yet popped. Pools must be popped
+	on the thread that pushed them. CFRunLoopRun() and
+	CFRunLoopRunInMode() drain a pool before waiting for events and at the
+	end of each pass, so objects autoreleased in run loop callouts do not
+	outlive the pass. Outside any pool, CFAutorelease() does nothing and
+	the object is never released.
+*/
+CF_EXPORT
+void *CFReleasePoolPush(void);
+
+CF_EXPORT
+void CFReleasePoolPop(void *pool);
+
 CF_EXPORT
 CFIndex CFGetRetainCount(CFTypeRef cf);
 
@@ -399,6 +399,58 @@ CF_INLINE Boolean __CFBasicHashHasHashCache(CFConstBasicHashRef ht) {
 #endif
 }
 
+// Compact tables are those with at most __CFBasicHashTableSizes[__kCFBasicHashCompactMaxBucketsIdx]
+// buckets. They keep the values, keys, hashes and counts of all buckets in a
+// single block, in that order, and are searched by a sequential scan instead
+// of by hashing, so every bucket of them can be filled.
+#define __kCFBasicHashCompactMaxBucketsIdx 2
+
+CF_INLINE Boolean __CFBasicHashIsCompactIndex(CFIndex num_buckets_idx) {
+    return (0 < num_buckets_idx && num_buckets_idx <= __kCFBasicHashCompactMaxBucketsIdx);
+}
+
+CF_INLINE Boolean __CFBasicHashIsCompact(CFConstBasicHashRef ht) {
+    return __CFBasicHashIsCompactIndex(ht->bits.num_buckets_idx);
+}
+
+// Allocates the zero-filled single block of a compact table and carves it
+// into its stores; the block itself is the value store.
+static CFBasicHashValue *__CFBasicHashAllocateCompactStores(CFAllocatorRef allocator, CFConstBasicHashRef ht, CFIndex num_buckets, uint8_t counts_width, Boolean strong, CFBasicHashValue **keys, void **counts, uintptr_t **hashes) {
+    CFIndex bucket_size = sizeof(CFBasicHashValue);
+    if (ht->bits.keys_offset) bucket_size += sizeof(CFBasicHashValue);
+    if (__CFBasicHashHasHashCache(ht)) bucket_size += sizeof(uintptr_t);
+    if (ht->bits.counts_offset) bucket_size += (1 << counts_width);
+    uint8_t *block = (uint8_t *)__CFBasicHashAllocateMemory2(allocator, num_buckets, bucket_size, strong, false);
+    if (!block) return NULL;
+    __SetLastAllocationEventName(block, "CFBasicHash (compact-store)");
+    memset(block, 0, num_buckets * bucket_size);
+    uint8_t *next = block + num_buckets * sizeof(CFBasicHashValue);
+    *keys = NULL;
+    *counts = NULL;
+    *hashes = NULL;
+    if (ht->bits.keys_offset) {
+        *keys = (CFBasicHashValue *)next;
+        next += num_buckets * sizeof(CFBasicHashValue);
+    }
+    if (__CFBasicHashHasHashCache(ht)) {
+        *hashes = (uintptr_t *)next;
+        next += num_buckets * sizeof(uintptr_t);
+    }
+    if (ht->bits.counts_offset) {
+        *counts = (void *)next;
+    }
+    return (CFBasicHashValue *)block;
+}
+
+CF_INLINE void __CFBasicHashDeallocateStores(CFAllocatorRef allocator, Boolean compact, CFBasicHashValue *values, CFBasicHashValue *keys, void *counts, uintptr_t *hashes) {
+    if (CF_IS_COLLECTABLE_ALLOCATOR(allocator)) return;
+    CFAllocatorDeallocate(allocator, values);
+    if (compact) return;
+    CFAllocatorDeallocate(allocator, keys);
+    CFAllocatorDeallocate(allocator, counts);
+    CFAllocatorDeallocate(allocator, hashes);
+}
+
 CF_INLINE uintptr_t __CFBasicHashImportValue(CFConstBasicHashRef ht, uintptr_t stack_value) {
     uintptr_t (*func)(CFAllocatorRef, uintptr_t) = (uintptr_t (*)(CFAllocatorRef, uintptr_t))CFBasicHashCallBackPtrs[ht->bits.__vret];
     if (!func || ht->bits.null_rc) return stack_value;
@@ -427,6 +479,10 @@ CF_INLINE void __CFBasicHashEjectKey(CFConstBasicHashRef ht, uintptr_t stack_key
     func(alloc, stack_key);
 }
 
+CF_INLINE Boolean __CFBasicHashEjectsTypeCollectionRelease(CFConstBasicHashRef ht, uint64_t rel) {
+    return !ht->bits.null_rc && (void *)__CFTypeCollectionRelease == CFBasicHashCallBackPtrs[rel];
+}
+
 CF_INLINE CFStringRef __CFBasicHashDescValue(CFConstBasicHashRef ht, uintptr_t stack_value) {
     CFStringRef (*func)(uintptr_t) = (CFStringRef (*)(uintptr_t))CFBasicHashCallBackPtrs[ht->bits.__vdes];
     if (!func) return CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("<%p>"), (void *)stack_value);
@@ -489,6 +545,14 @@ CF_INLINE void __CFBasicHashSetCounts(CFBasicHashRef ht, void *ptr) {
     __AssignWithWriteBarrier(&ht->pointers[ht->bits.counts_offset], ptr);
 }
 
+CF_INLINE uintptr_t *__CFBasicHashGetHashes(CFConstBasicHashRef ht) {
+    return (uintptr_t *)ht->pointers[ht->bits.hashes_offset];
+}
+
+CF_INLINE void __CFBasicHashSetHashes(CFBasicHashRef ht, uintptr_t *ptr) {
+    __AssignWithWriteBarrier(&ht->pointers[ht->bits.hashes_offset], ptr);
+}
+
 CF_INLINE uintptr_t __CFBasicHashGetValue(CFConstBasicHashRef ht, CFIndex idx) {
     uintptr_t val = __CFBasicHashGetValues(ht)[idx].neutral;
     if (__CFBasicHashSubABZero == val) return 0UL;
@@ -566,7 +630,47 @@ CF_INLINE uintptr_t __CFBasicHashGetSlotCount(CFConstBasicHashRef ht, CFIndex id
     return 0;
 }
 
+static void __CFBasicHashBumpCompactCounts(CFBasicHashRef ht) {
+    if (3 == ht->bits.counts_width) HALT;
+    CFAllocatorRef allocator = CFGetAllocator(ht);
+    CFIndex num_buckets = __CFBasicHashTableSizes[ht->bits.num_buckets_idx];
+    CFBasicHashValue *old_values = __CFBasicHashGetValues(ht);
+    CFBasicHashValue *old_keys = (ht->bits.keys_offset) ? __CFBasicHashGetKeys(ht) : NULL;
+    uintptr_t *old_hashes = __CFBasicHashHasHashCache(ht) ? __CFBasicHashGetHashes(ht) : NULL;
+    uintptr_t old_counts[num_buckets];
+    for (CFIndex idx = 0; idx < num_buckets; idx++) {
+        old_counts[idx] = __CFBasicHashGetSlotCount(ht, idx);
+    }
+
+    CFBasicHashValue *new_keys = NULL;
+    void *new_counts = NULL;
+    uintptr_t *new_hashes = NULL;
+    CFBasicHashValue *new_values = __CFBasicHashAllocateCompactStores(allocator, ht, num_buckets, ht->bits.counts_width + 1, CFBasicHashHasStrongValues(ht) || CFBasicHashHasStrongKeys(ht), &new_keys, &new_counts, &new_hashes);
+    if (!new_values) HALT;
+    ht->bits.counts_width++;
+    __CFBasicHashSetValues(ht, new_values);
+    if (new_keys) __CFBasicHashSetKeys(ht, new_keys);
+    __CFBasicHashSetCounts(ht, new_counts);
+    if (new_hashes) __CFBasicHashSetHashes(ht, new_hashes);
+
+    for (CFIndex idx = 0; idx < num_buckets; idx++) {
+        __CFBasicHashSetValue(ht, idx, old_values[idx].neutral, true, true);
+        if (new_keys) __CFBasicHashSetKey(ht, idx, old_keys[idx].neutral, true, true);
+        if (new_hashes) new_hashes[idx] = old_hashes[idx];
+        switch (ht->bits.counts_width) {
+        case 1: ((uint16_t *)new_counts)[idx] = old_counts[idx]; break;
+        case 2: ((uint32_t *)new_counts)[idx] = old_counts[idx]; break;
+        case 3: ((uint64_t *)new_counts)[idx] = old_counts[idx]; break;
+        }
+    }
+    __CFBasicHashDeallocateStores(allocator, true, old_values, old_keys, NULL, old_hashes);
+}
+
 CF_INLINE void __CFBasicHashBumpCounts(CFBasicHashRef ht) {
+    if (__CFBasicHashIsCompact(ht)) {
+        __CFBasicHashBumpCompactCounts(ht);
+        return;
+    }
     void *counts = __CFBasicHashGetCounts(ht);
     CFAllocatorRef allocator = CFGetAllocator(ht);
     switch (ht->bits.counts_width) {
@@ -685,17 +789,10 @@ CF_INLINE void __CFBasicHashDecSlotCount(CFBasicHashRef ht, CFIndex idx) {
     }
 }
 
-CF_INLINE uintptr_t *__CFBasicHashGetHashes(CFConstBasicHashRef ht) {
-    return (uintptr_t *)ht->pointers[ht->bits.hashes_offset];
-}
-
-CF_INLINE void __CFBasicHashSetHashes(CFBasicHashRef ht, uintptr_t *ptr) {
-    __AssignWithWriteBarrier(&ht->pointers[ht->bits.hashes_offset], ptr);
-}
-
 
 // to expose the load factor, expose this function to customization
 CF_INLINE CFIndex __CFBasicHashGetCapacityForNumBuckets(CFConstBasicHashRef ht, CFIndex num_buckets_idx) {
+    if (__CFBasicHashIsCompactIndex(num_buckets_idx)) return __CFBasicHashTableSizes[num_buckets_idx];
     return __CFBasicHashTableCapacities[num_buckets_idx];
 }
 
@@ -784,6 +881,30 @@ static uintptr_t __CFBasicHashFold(uintptr_t dividend, uint8_t idx) {
 #endif
 
 
+#define FIND_BUCKET_NAME		___CFBasicHashFindBucket_Compact
+#define FIND_BUCKET_HASH_STYLE		0
+#define FIND_BUCKET_FOR_REHASH		0
+#define FIND_BUCKET_FOR_INDIRECT_KEY	0
+#include "CFBasicHashFindBucket.m"
+
+#define FIND_BUCKET_NAME		___CFBasicHashFindBucket_Compact_NoCollision
+#define FIND_BUCKET_HASH_STYLE		0
+#define FIND_BUCKET_FOR_REHASH		1
+#define FIND_BUCKET_FOR_INDIRECT_KEY	0
+#include "CFBasicHashFindBucket.m"
+
+#define FIND_BUCKET_NAME		___CFBasicHashFindBucket_Compact_Indirect
+#define FIND_BUCKET_HASH_STYLE		0
+#define FIND_BUCKET_FOR_REHASH		0
+#define FIND_BUCKET_FOR_INDIRECT_KEY	1
+#include "CFBasicHashFindBucket.m"
+
+#define FIND_BUCKET_NAME		___CFBasicHashFindBucket_Compact_Indirect_NoCollision
+#define FIND_BUCKET_HASH_STYLE		0
+#define FIND_BUCKET_FOR_REHASH		1
+#define FIND_BUCKET_FOR_INDIRECT_KEY	1
+#include "CFBasicHashFindBucket.m"
+
 #define FIND_BUCKET_NAME		___CFBasicHashFindBucket_Linear
 #define FIND_BUCKET_HASH_STYLE		1
 #define FIND_BUCKET_FOR_REHASH		0
@@ -862,6 +983,9 @@ CF_INLINE CFBasicHashBucket __CFBasicHashFindBucket(CFConstBasicHashRef ht, uint
         CFBasicHashBucket result = {kCFNotFound, 0UL, 0UL, 0};
         return result;
     }
+    if (__CFBasicHashIsCompact(ht)) {
+        return ht->bits.indirect_keys ? ___CFBasicHashFindBucket_Compact_Indirect(ht, stack_key) : ___CFBasicHashFindBucket_Compact(ht, stack_key);
+    }
     if (ht->bits.indirect_keys) {
         switch (ht->bits.hash_style) {
         case __kCFBasicHashLinearHashingValue: return ___CFBasicHashFindBucket_Linear_Indirect(ht, stack_key);
@@ -884,6 +1008,9 @@ CF_INLINE CFIndex __CFBasicHashFindBucket_NoCollision(CFConstBasicHashRef ht, ui
     if (0 == ht->bits.num_buckets_idx) {
         return kCFNotFound;
     }
+    if (__CFBasicHashIsCompact(ht)) {
+        return ht->bits.indirect_keys ? ___CFBasicHashFindBucket_Compact_Indirect_NoCollision(ht, stack_key, key_hash) : ___CFBasicHashFindBucket_Compact_NoCollision(ht, stack_key, key_hash);
+    }
     if (ht->bits.indirect_keys) {
         switch (ht->bits.hash_style) {
         case __kCFBasicHashLinearHashingValue: return ___CFBasicHashFindBucket_Linear_Indirect_NoCollision(ht, stack_key, key_hash);
@@ -1065,6 +1192,7 @@ static void __CFBasicHashDrain(CFBasicHashRef ht, Boolean forFinalization) {
 #endif
 
     CFIndex old_num_buckets = __CFBasicHashTableSizes[ht->bits.num_buckets_idx];
+    Boolean old_compact = __CFBasicHashIsCompact(ht);
 
     CFAllocatorRef allocator = CFGetAllocator(ht);
     Boolean nullify = (!forFinalization || !CF_IS_COLLECTABLE_ALLOCATOR(allocator));
@@ -1088,6 +1216,13 @@ static void __CFBasicHashDrain(CFBasicHashRef ht, Boolean forFinalization) {
         if (nullify) __CFBasicHashSetHashes(ht, NULL);
     }
 
+    // Contents released with __CFTypeCollectionRelease go through one batch, so that
+    // everything is decremented before anything is finalized
+    Boolean batchValues = __CFBasicHashEjectsTypeCollectionRelease(ht, ht->bits.__vrel);
+    Boolean batchKeys = old_keys && __CFBasicHashEjectsTypeCollectionRelease(ht, ht->bits.__krel);
+    __CFTypeCollectionReleaseBatch batch;
+    if (batchValues || batchKeys) __CFTypeCollectionReleaseBatchInit(&batch, allocator, (batchValues && batchKeys ? 2 : 1) * ht->bits.used_buckets);
+
     if (nullify) {
         ht->bits.mutations++;
         ht->bits.num_buckets_idx = 0;
@@ -1101,22 +1236,27 @@ static void __CFBasicHashDrain(CFBasicHashRef ht, Boolean forFinalization) {
                 uintptr_t old_value = stack_value;
                 if (__CFBasicHashSubABZero == old_value) old_value = 0UL;
                 if (__CFBasicHashSubABOne == old_value) old_value = ~0UL;
-                __CFBasicHashEjectValue(ht, old_value);
+                if (batchValues) {
+                    __CFTypeCollectionReleaseBatchAdd(&batch, (CFTypeRef)old_value);
+                } else {
+                    __CFBasicHashEjectValue(ht, old_value);
+                }
                 if (old_keys) {
                     uintptr_t old_key = old_keys[idx].neutral;
                     if (__CFBasicHashSubABZero == old_key) old_key = 0UL;
                     if (__CFBasicHashSubABOne == old_key) old_key = ~0UL;
-                    __CFBasicHashEjectKey(ht, old_key);
+                    if (batchKeys) {
+                        __CFTypeCollectionReleaseBatchAdd(&batch, (CFTypeRef)old_key);
+                    } else {
+                        __CFBasicHashEjectKey(ht, old_key);
+                    }
                 }
             }
         }
 
-    if (!CF_IS_COLLECTABLE_ALLOCATOR(allocator)) {
-        CFAllocatorDeallocate(allocator, old_values);
-        CFAllocatorDeallocate(allocator, old_keys);
-        CFAllocatorDeallocate(allocator, old_counts);
-        CFAllocatorDeallocate(allocator, old_hashes);
-    }
+    if (batchValues || batchKeys) __CFTypeCollectionReleaseBatchFinish(&batch);
+
+    __CFBasicHashDeallocateStores(allocator, old_compact, old_values, old_keys, old_counts, old_hashes);
 
 #if ENABLE_MEMORY_COUNTERS
     int64_t size_now = OSAtomicAdd64Barrier((int64_t) CFBasicHashGetSize(ht, true), & __CFBasicHashTotalSize);
@@ -1149,7 +1289,11 @@ static void __CFBasicHashRehash(CFBasicHashRef ht, CFIndex newItemCount) {
     void *new_counts = NULL;
     uintptr_t *new_hashes = NULL;
 
-    if (0 < new_num_buckets) {
+    Boolean old_compact = __CFBasicHashIsCompact(ht);
+    if (__CFBasicHashIsCompactIndex(new_num_buckets_idx)) {
+        new_values = __CFBasicHashAllocateCompactStores(CFGetAllocator(ht), ht, new_num_buckets, ht->bits.counts_width, CFBasicHashHasStrongValues(ht) || CFBasicHashHasStrongKeys(ht), &new_keys, &new_counts, &new_hashes);
+        if (!new_values) HALT;
+    } else if (0 < new_num_buckets) {
         new_values = (CFBasicHashValue *)__CFBasicHashAllocateMemory(ht, new_num_buckets, sizeof(CFBasicHashValue), CFBasicHashHasStrongValues(ht), 0);
         if (!new_values) HALT;
         __SetLastAllocationEventName(new_values, "CFBasicHash (value-store)");
@@ -1231,13 +1375,7 @@ static void __CFBasicHashRehash(CFBasicHashRef ht, CFIndex newItemCount) {
         }
     }
 
-    CFAllocatorRef allocator = CFGetAllocator(ht);
-    if (!CF_IS_COLLECTABLE_ALLOCATOR(allocator)) {
-        CFAllocatorDeallocate(allocator, old_values);
-        CFAllocatorDeallocate(allocator, old_keys);
-        CFAllocatorDeallocate(allocator, old_counts);
-        CFAllocatorDeallocate(allocator, old_hashes);
-    }
+    __CFBasicHashDeallocateStores(CFGetAllocator(ht), old_compact, old_values, old_keys, old_counts, old_hashes);
 
     if (COCOA_HASHTABLE_REHASH_END_ENABLED()) COCOA_HASHTABLE_REHASH_END(ht, CFBasicHashGetNumBuckets(ht), CFBasicHashGetSize(ht, true));
 
@@ -1471,7 +1609,9 @@ CF_PRIVATE size_t CFBasicHashGetSize(CFConstBasicHashRef ht, Boolean total) {
     if (__CFBasicHashHasHashCache(ht)) size += sizeof(uintptr_t *);
     if (total) {
         CFIndex num_buckets = __CFBasicHashTableSizes[ht->bits.num_buckets_idx];
-        if (0 < num_buckets) {
+        if (__CFBasicHashIsCompact(ht)) {
+            size += malloc_size(__CFBasicHashGetValues(ht));
+        } else if (0 < num_buckets) {
             size += malloc_size(__CFBasicHashGetValues(ht));
             if (ht->bits.keys_offset) size += malloc_size(__CFBasicHashGetKeys(ht));
             if (ht->bits.counts_offset) size += malloc_size(__CFBasicHashGetCounts(ht));
@@ -1488,7 +1628,7 @@ CF_PRIVATE CFStringRef CFBasicHashCopyDescription(CFConstBasicHashRef ht, Boolea
         const char *cb_type = "custom";
         CFStringAppendFormat(result, NULL, CFSTR("%@hash cache = %s, strong values = %s, strong keys = %s, cb = %s,\n"), prefix, (__CFBasicHashHasHashCache(ht) ? "yes" : "no"), (CFBasicHashHasStrongValues(ht) ? "yes" : "no"), (CFBasicHashHasStrongKeys(ht) ? "yes" : "no"), cb_type);
         CFStringAppendFormat(result, NULL, CFSTR("%@num bucket index = %d, num buckets = %ld, capacity = %ld, num buckets used = %u,\n"), prefix, ht->bits.num_buckets_idx, CFBasicHashGetNumBuckets(ht), (long)CFBasicHashGetCapacity(ht), ht->bits.used_buckets);
-        CFStringAppendFormat(result, NULL, CFSTR("%@counts width = %d, finalized = %s,\n"), prefix,((ht->bits.counts_offset) ? (1 << ht->bits.counts_width) : 0), (ht->bits.finalized ? "yes" : "no"));
+        CFStringAppendFormat(result, NULL, CFSTR("%@counts width = %d, compact = %s, finalized = %s,\n"), prefix,((ht->bits.counts_offset) ? (1 << ht->bits.counts_width) : 0), (__CFBasicHashIsCompact(ht) ? "yes" : "no"), (ht->bits.finalized ? "yes" : "no"));
         CFStringAppendFormat(result, NULL, CFSTR("%@num mutations = %ld, num deleted = %ld, size = %ld, total size = %ld,\n"), prefix, (long)ht->bits.mutations, (long)ht->bits.deleted, CFBasicHashGetSize(ht, false), CFBasicHashGetSize(ht, true));
         CFStringAppendFormat(result, NULL, CFSTR("%@values ptr = %p, keys ptr = %p, counts ptr = %p, hashes ptr = %p,\n"), prefix, __CFBasicHashGetValues(ht), ((ht->bits.keys_offset) ? __CFBasicHashGetKeys(ht) : NULL), ((ht->bits.counts_offset) ? __CFBasicHashGetCounts(ht) : NULL), (__CFBasicHashHasHashCache(ht) ? __CFBasicHashGetHashes(ht) : NULL));
     }
@@ -1660,7 +1800,11 @@ CF_PRIVATE CFBasicHashRef CFBasicHashCreateCopy(CFAllocatorRef allocator, CFCons
     void *new_counts = NULL;
     uintptr_t *new_hashes = NULL;
 
-    if (0 < new_num_buckets) {
+    if (__CFBasicHashIsCompact(src_ht)) {
+        Boolean strong = (CFBasicHashHasStrongValues(src_ht) || CFBasicHashHasStrongKeys(src_ht)) && !(kCFUseCollectableAllocator && !CF_IS_COLLECTABLE_ALLOCATOR(allocator));
+        new_values = __CFBasicHashAllocateCompactStores(allocator, src_ht, new_num_buckets, src_ht->bits.counts_width, strong, &new_keys, &new_counts, &new_hashes);
+        if (!new_values) return NULL;
+    } else if (0 < new_num_buckets) {
         Boolean strongValues = CFBasicHashHasStrongValues(src_ht) && !(kCFUseCollectableAllocator && !CF_IS_COLLECTABLE_ALLOCATOR(allocator));
         Boolean strongKeys = CFBasicHashHasStrongKeys(src_ht) && !(kCFUseCollectableAllocator && !CF_IS_COLLECTABLE_ALLOCATOR(allocator));
         new_values = (CFBasicHashValue *)__CFBasicHashAllocateMemory2(allocator, new_num_buckets, sizeof(CFBasicHashValue), strongValues, 0);
@@ -48,13 +48,25 @@ FIND_BUCKET_NAME (CFConstBasicHashRef ht, uintptr_t stack_key
 ) {
     uint8_t num_buckets_idx = ht->bits.num_buckets_idx;
     uintptr_t num_buckets = __CFBasicHashTableSizes[num_buckets_idx];
-#if FIND_BUCKET_FOR_REHASH
+#if FIND_BUCKET_HASH_STYLE == 0	// compact tables
+    // The hash code is only needed to check against the hash cache; placement
+    // in a compact table does not depend on it.
+#if !FIND_BUCKET_FOR_REHASH
+    CFHashCode hash_code = (__CFBasicHashHasHashCache(ht)) ? __CFBasicHashHashKey(ht, stack_key) : 0;
+#endif
+#elif FIND_BUCKET_FOR_REHASH
     CFHashCode hash_code = key_hash ? key_hash : __CFBasicHashHashKey(ht, stack_key);
 #else
     CFHashCode hash_code = __CFBasicHashHashKey(ht, stack_key);
 #endif
 
-#if FIND_BUCKET_HASH_STYLE == 1	// __kCFBasicHashLinearHashingValue
+#if FIND_BUCKET_HASH_STYLE == 0	// compact tables
+    // Sequential scan
+    // probe[i] = i, i = 0 .. num_buckets - 1
+    // Adds always fill the first empty or deleted bucket, so no entry
+    // lives past the first empty bucket and the scan can stop there.
+    uintptr_t h1 = 0;
+#elif FIND_BUCKET_HASH_STYLE == 1	// __kCFBasicHashLinearHashingValue
     // Linear probing, with c = 1
     // probe[0] = h1(k)
     // probe[i] = (h1(k) + i * c) mod num_buckets, i = 1 .. num_buckets - 1
@@ -150,7 +162,7 @@ FIND_BUCKET_NAME (CFConstBasicHashRef ht, uintptr_t stack_key
 #endif
         }
 
-#if FIND_BUCKET_HASH_STYLE == 1	// __kCFBasicHashLinearHashingValue
+#if FIND_BUCKET_HASH_STYLE == 0 || FIND_BUCKET_HASH_STYLE == 1	// compact tables, __kCFBasicHashLinearHashingValue
         probe += 1;
         if (num_buckets <= probe) {
             probe -= num_buckets;
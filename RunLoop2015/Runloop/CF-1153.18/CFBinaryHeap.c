@@ -52,6 +52,11 @@ struct __CFBinaryHeap {
     CFBinaryHeapCallBacks _callbacks;
     CFBinaryHeapCompareContext _context;
     struct __CFBinaryHeapBucket *_buckets;
+    CFIndex _arityShift;	/* log2 of the number of children of a node: 1, or 2 for a 4-ary heap */
+    CFIndex *_handles;		/* handle of the value in each bucket; NULL unless handles are tracked */
+    CFIndex *_positions;	/* bucket of each handle's value, or -2 - (next free handle) for a free handle */
+    CFIndex _handleCount;	/* number of handles ever given out; fewer than _capacity */
+    CFIndex _freeHandle;	/* first free handle below _handleCount, or -1 */
 };
 
 CF_INLINE CFIndex __CFBinaryHeapCount(CFBinaryHeapRef heap) {
@@ -108,6 +113,76 @@ CF_INLINE UInt32 __CFBinaryHeapMutableVarietyFromFlags(UInt32 flags) {
     return __CFBitfieldGetValue(flags, 1, 0);
 }
 
+CF_INLINE Boolean __CFBinaryHeapGreater(CFBinaryHeapRef heap, const void *item1, const void *item2) {
+    CFComparisonResult (*compare)(const void *, const void *, void *) = heap->_callbacks.compare;
+    return compare ? (kCFCompareGreaterThan == compare(item1, item2, heap->_context.info)) : (item1 > item2);
+}
+
+CF_INLINE CFIndex __CFBinaryHeapHandleAtIndex(CFBinaryHeapRef heap, CFIndex idx) {
+    return heap->_handles ? heap->_handles[idx] : kCFNotFound;
+}
+
+CF_INLINE void __CFBinaryHeapSetBucket(CFBinaryHeapRef heap, CFIndex idx, const void *item, CFIndex handle) {
+    __CFAssignWithWriteBarrier((void **)&heap->_buckets[idx]._item, (void *)item);
+    if (heap->_handles) {
+	heap->_handles[idx] = handle;
+	heap->_positions[handle] = idx;
+    }
+}
+
+static CFIndex __CFBinaryHeapAllocateHandle(CFBinaryHeapRef heap) {
+    CFIndex handle = heap->_freeHandle;
+    if (0 <= handle) {
+	heap->_freeHandle = -2 - heap->_positions[handle];
+	return handle;
+    }
+    return heap->_handleCount++;
+}
+
+static void __CFBinaryHeapFreeHandle(CFBinaryHeapRef heap, CFIndex handle) {
+    heap->_positions[handle] = -2 - heap->_freeHandle;
+    heap->_freeHandle = handle;
+}
+
+/* Moves parents down into the hole at idx while they are greater than item, then puts item (and its handle) in the hole.
+*/
+static void __CFBinaryHeapSiftUp(CFBinaryHeapRef heap, CFIndex idx, const void *item, CFIndex handle) {
+    CFIndex shift = heap->_arityShift;
+    while (0 < idx) {
+	CFIndex pidx = (idx - 1) >> shift;
+	void *parent = heap->_buckets[pidx]._item;
+	if (!__CFBinaryHeapGreater(heap, parent, item)) break;
+	__CFBinaryHeapSetBucket(heap, idx, parent, __CFBinaryHeapHandleAtIndex(heap, pidx));
+	idx = pidx;
+    }
+    __CFBinaryHeapSetBucket(heap, idx, item, handle);
+}
+
+/* Moves the least child up into the hole at idx while it is less than item, then puts item (and its handle) in the hole. The children of a 4-ary heap's node are the 32 bytes of one cache line on 64-bit.
+*/
+static void __CFBinaryHeapSiftDown(CFBinaryHeapRef heap, CFIndex idx, const void *item, CFIndex handle) {
+    CFIndex shift = heap->_arityShift;
+    CFIndex cnt = __CFBinaryHeapCount(heap);
+    for (;;) {
+	CFIndex cidx = (idx << shift) + 1;
+	if (cnt <= cidx) break;
+	CFIndex lim = __CFMin(cidx + ((CFIndex)1 << shift), cnt);
+	CFIndex midx = cidx;
+	void *least = heap->_buckets[cidx]._item;
+	for (cidx++; cidx < lim; cidx++) {
+	    void *child = heap->_buckets[cidx]._item;
+	    if (__CFBinaryHeapGreater(heap, least, child)) {
+		midx = cidx;
+		least = child;
+	    }
+	}
+	if (!__CFBinaryHeapGreater(heap, item, least)) break;
+	__CFBinaryHeapSetBucket(heap, idx, least, __CFBinaryHeapHandleAtIndex(heap, midx));
+	idx = midx;
+    }
+    __CFBinaryHeapSetBucket(heap, idx, item, handle);
+}
+
 static Boolean __CFBinaryHeapEqual(CFTypeRef cf1, CFTypeRef cf2) {
     CFBinaryHeapRef heap1 = (CFBinaryHeapRef)cf1;
     CFBinaryHeapRef heap2 = (CFBinaryHeapRef)cf2;
@@ -186,6 +261,10 @@ static void __CFBinaryHeapDeallocate(CFTypeRef cf) {
 // CF: does not release the context info
     if (__CFBinaryHeapMutableVariety(heap) == kCFBinaryHeapMutable) {
 	_CFAllocatorDeallocateGC(allocator, heap->_buckets);
+	if (heap->_handles) {
+	    _CFAllocatorDeallocateGC(allocator, heap->_handles);
+	    _CFAllocatorDeallocateGC(allocator, heap->_positions);
+	}
     }
 }
 
@@ -209,7 +288,7 @@ CFTypeID CFBinaryHeapGetTypeID(void) {
     return __kCFBinaryHeapTypeID;
 }
 
-static CFBinaryHeapRef __CFBinaryHeapInit(CFAllocatorRef allocator, UInt32 flags, CFIndex capacity, const void **values, CFIndex numValues, const CFBinaryHeapCallBacks *callBacks, const CFBinaryHeapCompareContext *compareContext) {
+static CFBinaryHeapRef __CFBinaryHeapInit(CFAllocatorRef allocator, UInt32 flags, CFOptionFlags options, CFIndex capacity, const void **values, CFIndex numValues, const CFBinaryHeapCallBacks *callBacks, const CFBinaryHeapCompareContext *compareContext) {
     CFBinaryHeapRef memory;
     CFIndex idx;
     CFIndex size;
@@ -227,8 +306,8 @@ static CFBinaryHeapRef __CFBinaryHeapInit(CFAllocatorRef allocator, UInt32 flags
     if (NULL == memory) {
 	return NULL;
     }
-	__CFBinaryHeapSetCapacity(memory, __CFBinaryHeapRoundUpCapacity(1));
-	__CFBinaryHeapSetNumBuckets(memory, __CFBinaryHeapNumBucketsForCapacity(__CFBinaryHeapRoundUpCapacity(1)));
+	__CFBinaryHeapSetCapacity(memory, __CFBinaryHeapRoundUpCapacity(numValues));
+	__CFBinaryHeapSetNumBuckets(memory, __CFBinaryHeapNumBucketsForCapacity(__CFBinaryHeapRoundUpCapacity(numValues)));
 	void *buckets = _CFAllocatorAllocateGC(allocator, __CFBinaryHeapNumBuckets(memory) * sizeof(struct __CFBinaryHeapBucket), isStrongMemory_Heap(memory) ? __kCFAllocatorGCScannedMemory : 0);
 	__CFAssignWithWriteBarrier((void **)&memory->_buckets, buckets);
 	if (__CFOASafe) __CFSetLastAllocationEventName(memory->_buckets, "CFBinaryHeap (store)");
@@ -236,6 +315,16 @@ static CFBinaryHeapRef __CFBinaryHeapInit(CFAllocatorRef allocator, UInt32 flags
 	    CFRelease(memory);
 	    return NULL;
 	}
+    memory->_arityShift = (options & kCFBinaryHeapFourAry) ? 2 : 1;
+    memory->_freeHandle = -1;
+    if (options & kCFBinaryHeapTracksHandles) {
+	memory->_handles = (CFIndex *)_CFAllocatorAllocateGC(allocator, __CFBinaryHeapNumBuckets(memory) * sizeof(CFIndex), 0);
+	memory->_positions = (CFIndex *)_CFAllocatorAllocateGC(allocator, __CFBinaryHeapNumBuckets(memory) * sizeof(CFIndex), 0);
+	if (NULL == memory->_handles || NULL == memory->_positions) {
+	    CFRelease(memory);
+	    return NULL;
+	}
+    }
     __CFBinaryHeapSetNumBucketsUsed(memory, 0);
     __CFBinaryHeapSetCount(memory, 0);
     if (NULL != callBacks) {
@@ -252,20 +341,37 @@ static CFBinaryHeapRef __CFBinaryHeapInit(CFAllocatorRef allocator, UInt32 flags
     if (compareContext) memcpy(&memory->_context, compareContext, sizeof(CFBinaryHeapCompareContext));
 // CF: retain info for proper operation
     __CFBinaryHeapSetMutableVariety(memory, kCFBinaryHeapMutable);
+    // Heapify bottom-up, which is O(n), rather than adding the values one at a time, which is O(n log n)
     for (idx = 0; idx < numValues; idx++) {
-	CFBinaryHeapAddValue(memory, values[idx]);
+	const void *value = values[idx];
+	if (memory->_callbacks.retain) value = memory->_callbacks.retain(allocator, value);
+	__CFBinaryHeapSetBucket(memory, idx, value, idx);
+    }
+    __CFBinaryHeapSetNumBucketsUsed(memory, numValues);
+    __CFBinaryHeapSetCount(memory, numValues);
+    if (memory->_handles) memory->_handleCount = numValues;
+    if (1 < numValues) {
+	for (idx = (numValues - 2) >> memory->_arityShift; 0 <= idx; idx--) {
+	    __CFBinaryHeapSiftDown(memory, idx, memory->_buckets[idx]._item, __CFBinaryHeapHandleAtIndex(memory, idx));
+	}
     }
     __CFBinaryHeapSetMutableVariety(memory, __CFBinaryHeapMutableVarietyFromFlags(flags));
     return memory;
 }
 
 CFBinaryHeapRef CFBinaryHeapCreate(CFAllocatorRef allocator, CFIndex capacity, const CFBinaryHeapCallBacks *callBacks, const CFBinaryHeapCompareContext *compareContext) {
-   return __CFBinaryHeapInit(allocator, kCFBinaryHeapMutable, capacity, NULL, 0, callBacks, compareContext);
+   return __CFBinaryHeapInit(allocator, kCFBinaryHeapMutable, 0, capacity, NULL, 0, callBacks, compareContext);
+}
+
+CFBinaryHeapRef CFBinaryHeapCreateWithValues(CFAllocatorRef allocator, CFOptionFlags options, const void **values, CFIndex numValues, const CFBinaryHeapCallBacks *callBacks, const CFBinaryHeapCompareContext *compareContext) {
+    CFAssert1(0 == numValues || NULL != values, __kCFLogAssertion, "%s(): pointer to values may not be NULL", __PRETTY_FUNCTION__);
+    return __CFBinaryHeapInit(allocator, kCFBinaryHeapMutable, options, numValues, values, numValues, callBacks, compareContext);
 }
 
 CFBinaryHeapRef CFBinaryHeapCreateCopy(CFAllocatorRef allocator, CFIndex capacity, CFBinaryHeapRef heap) {
    __CFGenericValidateType(heap, CFBinaryHeapGetTypeID());
-    return __CFBinaryHeapInit(allocator, kCFBinaryHeapMutable, capacity, (const void **)heap->_buckets, __CFBinaryHeapCount(heap), &(heap->_callbacks), &(heap->_context));
+    CFOptionFlags options = ((2 == heap->_arityShift) ? kCFBinaryHeapFourAry : 0) | (heap->_handles ? kCFBinaryHeapTracksHandles : 0);
+    return __CFBinaryHeapInit(allocator, kCFBinaryHeapMutable, options, capacity, (const void **)heap->_buckets, __CFBinaryHeapCount(heap), &(heap->_callbacks), &(heap->_context));
 }
 
 CFIndex CFBinaryHeapGetCount(CFBinaryHeapRef heap) {
@@ -362,11 +468,15 @@ static void __CFBinaryHeapGrow(CFBinaryHeapRef heap, CFIndex numNewValues) {
     __CFAssignWithWriteBarrier((void **)&heap->_buckets, buckets);
     if (__CFOASafe) __CFSetLastAllocationEventName(heap->_buckets, "CFBinaryHeap (store)");
     if (NULL == heap->_buckets) HALT;
+    if (heap->_handles) {
+	heap->_handles = (CFIndex *)_CFAllocatorReallocateGC(allocator, heap->_handles, __CFBinaryHeapNumBuckets(heap) * sizeof(CFIndex), 0);
+	heap->_positions = (CFIndex *)_CFAllocatorReallocateGC(allocator, heap->_positions, __CFBinaryHeapNumBuckets(heap) * sizeof(CFIndex), 0);
+	if (NULL == heap->_handles || NULL == heap->_positions) HALT;
+    }
 }
 
-void CFBinaryHeapAddValue(CFBinaryHeapRef heap, const void *value) {
-    CFIndex idx, pidx;
-    CFIndex cnt;
+CFIndex CFBinaryHeapAddValueWithHandle(CFBinaryHeapRef heap, const void *value) {
+    CFIndex cnt, handle;
     CFAllocatorRef allocator = CFGetAllocator(heap);
     __CFGenericValidateType(heap, CFBinaryHeapGetTypeID());
     switch (__CFBinaryHeapMutableVariety(heap)) {
@@ -376,57 +486,82 @@ void CFBinaryHeapAddValue(CFBinaryHeapRef heap, const void *value) {
 	break;
     }
     cnt = __CFBinaryHeapCount(heap);
-    idx = cnt;
     __CFBinaryHeapSetNumBucketsUsed(heap, cnt + 1);
     __CFBinaryHeapSetCount(heap, cnt + 1);
-    CFComparisonResult (*compare)(const void *, const void *, void *) = heap->_callbacks.compare;
-    pidx = (idx - 1) >> 1;
-    while (0 < idx) {
-	void *item = heap->_buckets[pidx]._item;
-	if ((!compare && item <= value) || (compare && kCFCompareGreaterThan != compare(item, value, heap->_context.info))) break;
-	__CFAssignWithWriteBarrier((void **)&heap->_buckets[idx]._item, item);
-	idx = pidx;
-	pidx = (idx - 1) >> 1;
-    }
+    handle = heap->_handles ? __CFBinaryHeapAllocateHandle(heap) : kCFNotFound;
     if (heap->_callbacks.retain) {
-	__CFAssignWithWriteBarrier((void **)&heap->_buckets[idx]._item, (void *)heap->_callbacks.retain(allocator, (void *)value));
-    } else {
-	__CFAssignWithWriteBarrier((void **)&heap->_buckets[idx]._item, (void *)value);
+	value = heap->_callbacks.retain(allocator, (void *)value);
     }
+    __CFBinaryHeapSiftUp(heap, cnt, value, handle);
+    return handle;
+}
+
+void CFBinaryHeapAddValue(CFBinaryHeapRef heap, const void *value) {
+    (void)CFBinaryHeapAddValueWithHandle(heap, value);
 }
 
 void CFBinaryHeapRemoveMinimumValue(CFBinaryHeapRef heap) {
-    void *val;
-    CFIndex idx, cidx;
     CFIndex cnt;
-    CFAllocatorRef allocator;
     __CFGenericValidateType(heap, CFBinaryHeapGetTypeID());
     cnt = __CFBinaryHeapCount(heap);
     if (0 == cnt) return;
-    idx = 0;
+    if (heap->_handles) CFBinaryHeapRemoveValue(heap, heap->_handles[0]);
+    else {
+	__CFBinaryHeapSetNumBucketsUsed(heap, cnt - 1);
+	__CFBinaryHeapSetCount(heap, cnt - 1);
+	if (heap->_callbacks.release)
+	    heap->_callbacks.release(CFGetAllocator(heap), heap->_buckets[0]._item);
+	__CFBinaryHeapSiftDown(heap, 0, heap->_buckets[cnt - 1]._item, kCFNotFound);
+    }
+}
+
+// Puts the value with the given handle, which has been taken out of bucket idx, back where it belongs
+static void __CFBinaryHeapReposition(CFBinaryHeapRef heap, CFIndex idx, const void *value, CFIndex handle) {
+    if (0 < idx && __CFBinaryHeapGreater(heap, heap->_buckets[(idx - 1) >> heap->_arityShift]._item, value)) {
+	__CFBinaryHeapSiftUp(heap, idx, value, handle);
+    } else {
+	__CFBinaryHeapSiftDown(heap, idx, value, handle);
+    }
+}
+
+const void *CFBinaryHeapGetValueForHandle(CFBinaryHeapRef heap, CFIndex handle) {
+    __CFGenericValidateType(heap, CFBinaryHeapGetTypeID());
+    CFAssert1(NULL != heap->_handles, __kCFLogAssertion, "%s(): binary heap does not track handles", __PRETTY_FUNCTION__);
+    CFAssert2(0 <= handle && handle < heap->_handleCount && 0 <= heap->_positions[handle], __kCFLogAssertion, "%s(): handle (%d) is not in use", __PRETTY_FUNCTION__, handle);
+    return heap->_buckets[heap->_positions[handle]]._item;
+}
+
+void CFBinaryHeapUpdateValue(CFBinaryHeapRef heap, CFIndex handle, const void *value) {
+    CFAllocatorRef allocator = CFGetAllocator(heap);
+    __CFGenericValidateType(heap, CFBinaryHeapGetTypeID());
+    CFAssert1(NULL != heap->_handles, __kCFLogAssertion, "%s(): binary heap does not track handles", __PRETTY_FUNCTION__);
+    CFAssert2(0 <= handle && handle < heap->_handleCount && 0 <= heap->_positions[handle], __kCFLogAssertion, "%s(): handle (%d) is not in use", __PRETTY_FUNCTION__, handle);
+    CFIndex idx = heap->_positions[handle];
+    void *old = heap->_buckets[idx]._item;
+    if (heap->_callbacks.retain) {
+	value = heap->_callbacks.retain(allocator, (void *)value);
+    }
+    if (heap->_callbacks.release) {
+	heap->_callbacks.release(allocator, old);
+    }
+    __CFBinaryHeapReposition(heap, idx, value, handle);
+}
+
+void CFBinaryHeapRemoveValue(CFBinaryHeapRef heap, CFIndex handle) {
+    CFIndex idx, cnt;
+    __CFGenericValidateType(heap, CFBinaryHeapGetTypeID());
+    CFAssert1(NULL != heap->_handles, __kCFLogAssertion, "%s(): binary heap does not track handles", __PRETTY_FUNCTION__);
+    CFAssert2(0 <= handle && handle < heap->_handleCount && 0 <= heap->_positions[handle], __kCFLogAssertion, "%s(): handle (%d) is not in use", __PRETTY_FUNCTION__, handle);
+    cnt = __CFBinaryHeapCount(heap);
+    idx = heap->_positions[handle];
     __CFBinaryHeapSetNumBucketsUsed(heap, cnt - 1);
     __CFBinaryHeapSetCount(heap, cnt - 1);
-    CFComparisonResult (*compare)(const void *, const void *, void *) = heap->_callbacks.compare;
-    allocator = CFGetAllocator(heap);
     if (heap->_callbacks.release)
-	heap->_callbacks.release(allocator, heap->_buckets[idx]._item);
-    val = heap->_buckets[cnt - 1]._item;
-    cidx = (idx << 1) + 1;
-    while (cidx < __CFBinaryHeapCount(heap)) {
-	void *item = heap->_buckets[cidx]._item;
-	if (cidx + 1 < __CFBinaryHeapCount(heap)) {
-	    void *item2 = heap->_buckets[cidx + 1]._item;
-	    if ((!compare && item > item2) || (compare && kCFCompareGreaterThan == compare(item, item2, heap->_context.info))) {
-		cidx++;
-		item = item2;
-	    }
-	}
-	if ((!compare && item > val) || (compare && kCFCompareGreaterThan == compare(item, val, heap->_context.info))) break;
-	__CFAssignWithWriteBarrier((void **)&heap->_buckets[idx]._item, item);
-	idx = cidx;
-	cidx = (idx << 1) + 1;
+	heap->_callbacks.release(CFGetAllocator(heap), heap->_buckets[idx]._item);
+    __CFBinaryHeapFreeHandle(heap, handle);
+    if (idx < cnt - 1) {
+	__CFBinaryHeapReposition(heap, idx, heap->_buckets[cnt - 1]._item, heap->_handles[cnt - 1]);
     }
-    __CFAssignWithWriteBarrier((void **)&heap->_buckets[idx]._item, val);
 }
 
 void CFBinaryHeapRemoveAllValues(CFBinaryHeapRef heap) {
@@ -439,5 +574,7 @@ void CFBinaryHeapRemoveAllValues(CFBinaryHeapRef heap) {
 	    heap->_callbacks.release(CFGetAllocator(heap), heap->_buckets[idx]._item);
     __CFBinaryHeapSetNumBucketsUsed(heap, 0);
     __CFBinaryHeapSetCount(heap, 0);
+    heap->_handleCount = 0;
+    heap->_freeHandle = -1;
 }
 
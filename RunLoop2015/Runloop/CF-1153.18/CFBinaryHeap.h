@@ -102,6 +102,23 @@ typedef void (*CFBinaryHeapApplierFunction)(const void *val, void *context);
 */
 typedef struct __CFBinaryHeap * CFBinaryHeapRef;
 
+/*!
+	@typedef CFBinaryHeapOptions
+	Options for CFBinaryHeapCreateWithValues().
+	@constant kCFBinaryHeapFourAry Each node of the heap has four
+		children rather than two. The heap is half as deep, and the
+		children of a node are adjacent in memory, which suits large
+		heaps and cheap compare callbacks.
+	@constant kCFBinaryHeapTracksHandles The heap gives each value a
+		handle, which CFBinaryHeapAddValueWithHandle() returns, and
+		keeps track of where each handle's value is, so that the
+		value can be updated or removed wherever it is in the heap.
+*/
+typedef CF_OPTIONS(CFOptionFlags, CFBinaryHeapOptions) {
+    kCFBinaryHeapFourAry = (1UL << 0),
+    kCFBinaryHeapTracksHandles = (1UL << 1)
+};
+
 /*!
 	@function CFBinaryHeapGetTypeID
 	Returns the type identifier of all CFBinaryHeap instances.
@@ -181,6 +198,33 @@ CF_EXPORT CFBinaryHeapRef	CFBinaryHeapCreate(CFAllocatorRef allocator, CFIndex c
 */
 CF_EXPORT CFBinaryHeapRef	CFBinaryHeapCreateCopy(CFAllocatorRef allocator, CFIndex capacity, CFBinaryHeapRef heap);
 
+/*!
+	@function CFBinaryHeapCreateWithValues
+	Creates a new mutable binary heap with the given options and values.
+		The heap is built from the values in O(n) time, rather than the
+		O(n log n) time of adding the values one at a time.
+	@param allocator The CFAllocator which should be used to allocate
+		memory for the binary heap and its storage for values. This
+		parameter may be NULL in which case the current default
+		CFAllocator is used. If this reference is not a valid
+		CFAllocator, the behavior is undefined.
+	@param options A bitwise-or of CFBinaryHeapOptions, or 0.
+	@param values A C array of the pointer-sized values to be in the
+		binary heap. The values are retained by the binary heap using
+		the retain callback. If there are values, and this parameter
+		is not a valid pointer to a C array of at least numValues
+		pointers, the behavior is undefined. If the heap tracks
+		handles, the value at index i of this array has handle i.
+	@param numValues The number of values to copy from the values C
+		array into the binary heap. If this parameter is negative, the
+		behavior is undefined.
+	@param callBacks A pointer to a CFBinaryHeapCallBacks structure, as
+		for CFBinaryHeapCreate().
+	@param compareContext A pointer to a CFBinaryHeapCompareContext structure.
+	@result A reference to the new CFBinaryHeap.
+*/
+CF_EXPORT CFBinaryHeapRef	CFBinaryHeapCreateWithValues(CFAllocatorRef allocator, CFOptionFlags options, const void **values, CFIndex numValues, const CFBinaryHeapCallBacks *callBacks, const CFBinaryHeapCompareContext *compareContext);
+
 /*!
 	@function CFBinaryHeapGetCount
 	Returns the number of values currently in the binary heap.
@@ -288,6 +332,61 @@ CF_EXPORT void		CFBinaryHeapApplyFunction(CFBinaryHeapRef heap, CFBinaryHeapAppl
 */
 CF_EXPORT void		CFBinaryHeapAddValue(CFBinaryHeapRef heap, const void *value);
 
+/*!
+	@function CFBinaryHeapAddValueWithHandle
+	Adds the value to the binary heap, as CFBinaryHeapAddValue() does, and
+		returns its handle.
+	@param heap The binary heap to which the value is to be added. If this parameter is not a
+		valid mutable CFBinaryHeap, the behavior is undefined.
+	@param value The value to add to the binary heap.
+	@result The handle of the value, which stays the same until the value is
+		removed from the heap, or kCFNotFound if the heap was not created
+		with kCFBinaryHeapTracksHandles. Handles of removed values are
+		reused. Copies of the heap give their values new handles.
+*/
+CF_EXPORT CFIndex	CFBinaryHeapAddValueWithHandle(CFBinaryHeapRef heap, const void *value);
+
+/*!
+	@function CFBinaryHeapGetValueForHandle
+	Returns the value with the given handle.
+	@param heap The binary heap to be queried. If this parameter is not a
+		valid CFBinaryHeap created with kCFBinaryHeapTracksHandles, the
+		behavior is undefined.
+	@param handle The handle of a value in the binary heap. If it is not,
+		the behavior is undefined.
+	@result The value with the handle.
+*/
+CF_EXPORT const void *	CFBinaryHeapGetValueForHandle(CFBinaryHeapRef heap, CFIndex handle);
+
+/*!
+	@function CFBinaryHeapUpdateValue
+	Replaces the value with the given handle, and moves it to its place in
+		the heap; the handle stays the same. Passing the same value again
+		re-establishes its place after whatever the compare callback
+		looks at has changed, which is how a priority is decreased or
+		increased. This takes O(log n) time.
+	@param heap The binary heap to be changed. If this parameter is not a
+		valid mutable CFBinaryHeap created with kCFBinaryHeapTracksHandles,
+		the behavior is undefined.
+	@param handle The handle of a value in the binary heap. If it is not,
+		the behavior is undefined.
+	@param value The new value. It is retained, and the old value is
+		released, using the callbacks of the heap.
+*/
+CF_EXPORT void		CFBinaryHeapUpdateValue(CFBinaryHeapRef heap, CFIndex handle, const void *value);
+
+/*!
+	@function CFBinaryHeapRemoveValue
+	Removes the value with the given handle from the binary heap, in
+		O(log n) time.
+	@param heap The binary heap from which the value is to be removed. If this
+		parameter is not a valid mutable CFBinaryHeap created with
+		kCFBinaryHeapTracksHandles, the behavior is undefined.
+	@param handle The handle of a value in the binary heap. If it is not,
+		the behavior is undefined.
+*/
+CF_EXPORT void		CFBinaryHeapRemoveValue(CFBinaryHeapRef heap, CFIndex handle);
+
 /*!
 	@function CFBinaryHeapRemoveMinimumValue
 	Removes the minimum value from the binary heap.
@@ -27,6 +27,7 @@
 */
 
 #include <CoreFoundation/CFBitVector.h>
+#include <CoreFoundation/CFByteOrder.h>
 #include "CFInternal.h"
 #include <string.h>
 
@@ -151,10 +152,11 @@ static Boolean __CFBitVectorEqual(CFTypeRef cf1, CFTypeRef cf2) {
     cnt = __CFBitVectorCount(bv1);
     if (cnt != __CFBitVectorCount(bv2)) return false;
     if (0 == cnt) return true;
-    for (idx = 0; idx < (cnt / __CF_BITS_PER_BUCKET) + 1; idx++) {
-	__CFBitVectorBucket val1 = bv1->_buckets[idx];
-	__CFBitVectorBucket val2 = bv2->_buckets[idx];
-	if (val1 != val2) return false;
+    idx = cnt / __CF_BITS_PER_BUCKET;
+    if (0 != memcmp(bv1->_buckets, bv2->_buckets, idx * sizeof(__CFBitVectorBucket))) return false;
+    if (cnt & __CF_BITS_PER_BUCKET_MASK) {
+	__CFBitVectorBucket mask = __CFBitBucketMask(0, (cnt & __CF_BITS_PER_BUCKET_MASK) - 1);
+	if ((bv1->_buckets[idx] & mask) != (bv2->_buckets[idx] & mask)) return false;
     }
     return true;
 }
@@ -315,6 +317,134 @@ static void __CFBitVectorInternalMap(CFMutableBitVectorRef bv, CFRange range, __
     }
 }
 
+/* Whole-byte stretches of a range are handled 64 bits at a time by the
+   kernels below instead of going through a mapper call per bucket; the
+   fragmentary buckets at either end still go through __CFBitVectorInternalMap.
+   Words are loaded with memcpy since a range need not start on a word boundary,
+   and are byte-swapped to big-endian only where bit order matters (the index
+   scans), since bit 0 is the most significant bit of bucket 0. */
+typedef uint64_t __CFBitVectorWord;
+
+enum {
+    __CF_BYTES_PER_WORD = sizeof(__CFBitVectorWord),
+    __CF_BITS_PER_WORD = __CF_BITS_PER_BYTE * sizeof(__CFBitVectorWord)
+};
+
+CF_INLINE __CFBitVectorWord __CFBitVectorLoadWord(const uint8_t *bytes) {
+    __CFBitVectorWord word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+CF_INLINE void __CFBitVectorStoreWord(uint8_t *bytes, __CFBitVectorWord word) {
+    memcpy(bytes, &word, sizeof(word));
+}
+
+/* Splits range into leading bits up to a bucket boundary, a run of whole
+   buckets [*firstBucket, *firstBucket + *nBuckets), and trailing bits. */
+CF_INLINE void __CFBitVectorSplitRange(CFRange range, CFRange *head, CFIndex *firstBucket, CFIndex *nBuckets, CFRange *tail) {
+    CFIndex bitOfBucket = range.location & (__CF_BITS_PER_BUCKET - 1);
+    CFIndex headLength = bitOfBucket ? __CFMin(__CF_BITS_PER_BUCKET - bitOfBucket, range.length) : 0;
+    CFIndex rest = range.length - headLength;
+    *head = CFRangeMake(range.location, headLength);
+    *firstBucket = (range.location + headLength) / __CF_BITS_PER_BUCKET;
+    *nBuckets = rest / __CF_BITS_PER_BUCKET;
+    *tail = CFRangeMake(range.location + headLength + *nBuckets * __CF_BITS_PER_BUCKET, rest - *nBuckets * __CF_BITS_PER_BUCKET);
+}
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+/* Nibble-lookup population count (pshufb), summed with psadbw; handles the
+   32-byte blocks of bytes and returns how many bytes it consumed. */
+static CFIndex __CFBitVectorPopCountAVX2(const uint8_t *bytes, CFIndex nBytes, CFIndex *consumed) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+    __m256i total = _mm256_setzero_si256();
+    CFIndex idx;
+    for (idx = 0; idx + 32 <= nBytes; idx += 32) {
+	__m256i v = _mm256_loadu_si256((const __m256i *)(bytes + idx));
+	__m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, lowMask));
+	__m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask));
+	total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+    *consumed = idx;
+    return (CFIndex)(_mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1) + _mm256_extract_epi64(total, 2) + _mm256_extract_epi64(total, 3));
+}
+#endif
+
+static CFIndex __CFBitVectorPopCount(const uint8_t *bytes, CFIndex nBytes) {
+    CFIndex idx = 0, count = 0;
+#if defined(__AVX2__)
+    if (256 <= nBytes) count = __CFBitVectorPopCountAVX2(bytes, nBytes, &idx);
+#endif
+    for (; idx + __CF_BYTES_PER_WORD <= nBytes; idx += __CF_BYTES_PER_WORD) {
+	count += __builtin_popcountll(__CFBitVectorLoadWord(bytes + idx));
+    }
+    for (; idx < nBytes; idx++) {
+	count += __builtin_popcount(bytes[idx]);
+    }
+    return count;
+}
+
+/* Returns the byte offset within bytes of the first bucket that has a bit
+   equal to value, or nBytes if there is none. */
+static CFIndex __CFBitVectorScanForward(const uint8_t *bytes, CFIndex nBytes, CFBit value, CFIndex *bitOfBucket) {
+    __CFBitVectorWord skip = value ? 0 : ~(__CFBitVectorWord)0;
+    CFIndex idx;
+    for (idx = 0; idx + __CF_BYTES_PER_WORD <= nBytes; idx += __CF_BYTES_PER_WORD) {
+	__CFBitVectorWord word = __CFBitVectorLoadWord(bytes + idx);
+	if (word != skip) {
+	    word = CFSwapInt64BigToHost(value ? word : ~word);
+	    CFIndex bit = __builtin_clzll(word);
+	    *bitOfBucket = bit & __CF_BITS_PER_BUCKET_MASK;
+	    return idx + bit / __CF_BITS_PER_BUCKET;
+	}
+    }
+    for (; idx < nBytes; idx++) {
+	uint8_t byte = value ? bytes[idx] : (uint8_t)~bytes[idx];
+	if (byte) {
+	    *bitOfBucket = __builtin_clz(byte) - (int)(__CF_BITS_PER_BYTE * (sizeof(unsigned int) - 1));
+	    return idx;
+	}
+    }
+    return nBytes;
+}
+
+/* Mirror of __CFBitVectorScanForward: the offset of the last bucket that
+   has a bit equal to value, or -1. */
+static CFIndex __CFBitVectorScanBackward(const uint8_t *bytes, CFIndex nBytes, CFBit value, CFIndex *bitOfBucket) {
+    __CFBitVectorWord skip = value ? 0 : ~(__CFBitVectorWord)0;
+    CFIndex idx = nBytes;
+    for (; __CF_BYTES_PER_WORD <= idx; idx -= __CF_BYTES_PER_WORD) {
+	__CFBitVectorWord word = __CFBitVectorLoadWord(bytes + idx - __CF_BYTES_PER_WORD);
+	if (word != skip) {
+	    word = CFSwapInt64BigToHost(value ? word : ~word);
+	    CFIndex bit = __CF_BITS_PER_WORD - 1 - __builtin_ctzll(word);
+	    *bitOfBucket = bit & __CF_BITS_PER_BUCKET_MASK;
+	    return idx - __CF_BYTES_PER_WORD + bit / __CF_BITS_PER_BUCKET;
+	}
+    }
+    while (idx--) {
+	uint8_t byte = value ? bytes[idx] : (uint8_t)~bytes[idx];
+	if (byte) {
+	    *bitOfBucket = __CF_BITS_PER_BYTE - 1 - __builtin_ctz(byte);
+	    return idx;
+	}
+    }
+    return -1;
+}
+
+static void __CFBitVectorFlipBytes(uint8_t *bytes, CFIndex nBytes) {
+    CFIndex idx;
+    for (idx = 0; idx + __CF_BYTES_PER_WORD <= nBytes; idx += __CF_BYTES_PER_WORD) {
+	__CFBitVectorStoreWord(bytes + idx, ~__CFBitVectorLoadWord(bytes + idx));
+    }
+    for (; idx < nBytes; idx++) {
+	bytes[idx] = ~bytes[idx];
+    }
+}
+
 struct _occursContext {
     CFBit value;
     CFIndex count;
@@ -337,10 +467,14 @@ CFIndex CFBitVectorGetCountOfBit(CFBitVectorRef bv, CFRange range, CFBit value)
     __CFGenericValidateType(bv, CFBitVectorGetTypeID());
     __CFBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
     if (0 == range.length) return 0;
-    context.value = value;
-    context.count = 0;
-    __CFBitVectorInternalMap((CFMutableBitVectorRef)bv, range, (__CFInternalMapper)__CFBitVectorCountBits, &context);
-    return context.count;
+    CFRange head, tail;
+    CFIndex firstBucket, nBuckets;
+    __CFBitVectorSplitRange(range, &head, &firstBucket, &nBuckets, &tail);
+    context.value = 1;
+    context.count = __CFBitVectorPopCount(bv->_buckets + firstBucket, nBuckets * sizeof(__CFBitVectorBucket));
+    __CFBitVectorInternalMap((CFMutableBitVectorRef)bv, head, (__CFInternalMapper)__CFBitVectorCountBits, &context);
+    __CFBitVectorInternalMap((CFMutableBitVectorRef)bv, tail, (__CFInternalMapper)__CFBitVectorCountBits, &context);
+    return value ? context.count : range.length - context.count;
 }
 
 Boolean CFBitVectorContainsBit(CFBitVectorRef bv, CFRange range, CFBit value) {
@@ -411,25 +545,37 @@ void CFBitVectorGetBits(CFBitVectorRef bv, CFRange range, uint8_t *bytes) {
 }
 
 CFIndex CFBitVectorGetFirstIndexOfBit(CFBitVectorRef bv, CFRange range, CFBit value) {
-    CFIndex idx;
+    CFRange head, tail;
+    CFIndex idx, firstBucket, nBuckets, bucketIdx, bitOfBucket;
     __CFGenericValidateType(bv, CFBitVectorGetTypeID());
     __CFBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
-    for (idx = 0; idx < range.length; idx++) {
-	if (value == CFBitVectorGetBitAtIndex(bv, range.location + idx)) {
-	    return range.location + idx;
-	}
+    value = value ? 1 : 0;
+    __CFBitVectorSplitRange(range, &head, &firstBucket, &nBuckets, &tail);
+    for (idx = head.location; idx < head.location + head.length; idx++) {
+	if (value == __CFBitVectorBit(bv->_buckets, idx)) return idx;
+    }
+    bucketIdx = __CFBitVectorScanForward(bv->_buckets + firstBucket, nBuckets, value, &bitOfBucket);
+    if (bucketIdx < nBuckets) return (firstBucket + bucketIdx) * __CF_BITS_PER_BUCKET + bitOfBucket;
+    for (idx = tail.location; idx < tail.location + tail.length; idx++) {
+	if (value == __CFBitVectorBit(bv->_buckets, idx)) return idx;
     }
     return kCFNotFound;
 }
 
 CFIndex CFBitVectorGetLastIndexOfBit(CFBitVectorRef bv, CFRange range, CFBit value) {
-    CFIndex idx;
+    CFRange head, tail;
+    CFIndex idx, firstBucket, nBuckets, bucketIdx, bitOfBucket;
     __CFGenericValidateType(bv, CFBitVectorGetTypeID());
     __CFBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
-    for (idx = range.length; idx--;) {
-	if (value == CFBitVectorGetBitAtIndex(bv, range.location + idx)) {
-	    return range.location + idx;
-	}
+    value = value ? 1 : 0;
+    __CFBitVectorSplitRange(range, &head, &firstBucket, &nBuckets, &tail);
+    for (idx = tail.location + tail.length; tail.location < idx--;) {
+	if (value == __CFBitVectorBit(bv->_buckets, idx)) return idx;
+    }
+    bucketIdx = __CFBitVectorScanBackward(bv->_buckets + firstBucket, nBuckets, value, &bitOfBucket);
+    if (0 <= bucketIdx) return (firstBucket + bucketIdx) * __CF_BITS_PER_BUCKET + bitOfBucket;
+    for (idx = head.location + head.length; head.location < idx--;) {
+	if (value == __CFBitVectorBit(bv->_buckets, idx)) return idx;
     }
     return kCFNotFound;
 }
@@ -488,7 +634,12 @@ void CFBitVectorFlipBits(CFMutableBitVectorRef bv, CFRange range) {
     __CFBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
     CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
     if (0 == range.length) return;
-    __CFBitVectorInternalMap(bv, range, __CFBitVectorFlipBits, NULL);
+    CFRange head, tail;
+    CFIndex firstBucket, nBuckets;
+    __CFBitVectorSplitRange(range, &head, &firstBucket, &nBuckets, &tail);
+    __CFBitVectorInternalMap(bv, head, __CFBitVectorFlipBits, NULL);
+    __CFBitVectorFlipBytes(bv->_buckets + firstBucket, nBuckets * sizeof(__CFBitVectorBucket));
+    __CFBitVectorInternalMap(bv, tail, __CFBitVectorFlipBits, NULL);
 }
 
 void CFBitVectorSetBitAtIndex(CFMutableBitVectorRef bv, CFIndex idx, CFBit value) {
@@ -503,11 +654,13 @@ void CFBitVectorSetBits(CFMutableBitVectorRef bv, CFRange range, CFBit value) {
     __CFBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
     CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable , __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
     if (0 == range.length) return;
-    if (value) {
-	__CFBitVectorInternalMap(bv, range, __CFBitVectorOneBits, NULL);
-    } else {
-	__CFBitVectorInternalMap(bv, range, __CFBitVectorZeroBits, NULL);
-    }
+    CFRange head, tail;
+    CFIndex firstBucket, nBuckets;
+    __CFInternalMapper mapper = value ? __CFBitVectorOneBits : __CFBitVectorZeroBits;
+    __CFBitVectorSplitRange(range, &head, &firstBucket, &nBuckets, &tail);
+    __CFBitVectorInternalMap(bv, head, mapper, NULL);
+    memset(bv->_buckets + firstBucket, (value ? ~0 : 0), nBuckets * sizeof(__CFBitVectorBucket));
+    __CFBitVectorInternalMap(bv, tail, mapper, NULL);
 }
 
 void CFBitVectorSetAllBits(CFMutableBitVectorRef bv, CFBit value) {
@@ -527,5 +680,1235 @@ void CFBitVectorSetAllBits(CFMutableBitVectorRef bv, CFBit value) {
     memset(bv->_buckets, (value ? ~0 : 0), nBuckets);
 }
 
+enum {
+    __kCFBitVectorAnd = 0,
+    __kCFBitVectorOr,
+    __kCFBitVectorXor,
+    __kCFBitVectorAndNot
+};
+
+#define __CFBitVectorCombineLoop(T, LOAD, STORE, SIZE, OP) \
+    for (; idx + (SIZE) <= nBytes; idx += (SIZE)) { \
+	T a = LOAD(dst + idx), b = LOAD(src + idx); \
+	STORE(dst + idx, (T)(OP)); \
+    }
+
+#define __CFBitVectorLoadByte(P) (*(P))
+#define __CFBitVectorStoreByte(P, V) (*(P) = (V))
+
+static void __CFBitVectorCombineBytes(uint8_t *dst, const uint8_t *src, CFIndex nBytes, int op) {
+    CFIndex idx = 0;
+    switch (op) {
+    case __kCFBitVectorAnd:
+	__CFBitVectorCombineLoop(__CFBitVectorWord, __CFBitVectorLoadWord, __CFBitVectorStoreWord, __CF_BYTES_PER_WORD, a & b);
+	__CFBitVectorCombineLoop(uint8_t, __CFBitVectorLoadByte, __CFBitVectorStoreByte, 1, a & b);
+	break;
+    case __kCFBitVectorOr:
+	__CFBitVectorCombineLoop(__CFBitVectorWord, __CFBitVectorLoadWord, __CFBitVectorStoreWord, __CF_BYTES_PER_WORD, a | b);
+	__CFBitVectorCombineLoop(uint8_t, __CFBitVectorLoadByte, __CFBitVectorStoreByte, 1, a | b);
+	break;
+    case __kCFBitVectorXor:
+	__CFBitVectorCombineLoop(__CFBitVectorWord, __CFBitVectorLoadWord, __CFBitVectorStoreWord, __CF_BYTES_PER_WORD, a ^ b);
+	__CFBitVectorCombineLoop(uint8_t, __CFBitVectorLoadByte, __CFBitVectorStoreByte, 1, a ^ b);
+	break;
+    case __kCFBitVectorAndNot:
+	__CFBitVectorCombineLoop(__CFBitVectorWord, __CFBitVectorLoadWord, __CFBitVectorStoreWord, __CF_BYTES_PER_WORD, a & ~b);
+	__CFBitVectorCombineLoop(uint8_t, __CFBitVectorLoadByte, __CFBitVectorStoreByte, 1, a & ~b);
+	break;
+    }
+}
+
+#undef __CFBitVectorCombineLoop
+#undef __CFBitVectorLoadByte
+#undef __CFBitVectorStoreByte
+
+/* Combines the first min(count(bv), count(otherBV)) bits of bv with those of
+   otherBV in place; bits of bv past the end of otherBV combine with 0. */
+static void __CFBitVectorCombine(CFMutableBitVectorRef bv, CFBitVectorRef otherBV, int op) {
+    CFIndex cnt, otherCnt, nBuckets, leftover;
+    __CFGenericValidateType(bv, CFBitVectorGetTypeID());
+    __CFGenericValidateType(otherBV, CFBitVectorGetTypeID());
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    cnt = __CFBitVectorCount(bv);
+    otherCnt = __CFMin(cnt, __CFBitVectorCount(otherBV));
+    nBuckets = otherCnt / __CF_BITS_PER_BUCKET;
+    leftover = otherCnt & __CF_BITS_PER_BUCKET_MASK;
+    __CFBitVectorCombineBytes(bv->_buckets, otherBV->_buckets, nBuckets * sizeof(__CFBitVectorBucket), op);
+    if (0 < leftover) {
+	__CFBitVectorBucket mask = __CFBitBucketMask(0, leftover - 1);
+	__CFBitVectorBucket other = otherBV->_buckets[nBuckets] & mask;
+	__CFBitVectorCombineBytes(bv->_buckets + nBuckets, &other, 1, op);
+    }
+    if (__kCFBitVectorAnd == op && otherCnt < cnt) {
+	CFBitVectorSetBits(bv, CFRangeMake(otherCnt, cnt - otherCnt), 0);
+    }
+}
+
+void CFBitVectorAnd(CFMutableBitVectorRef bv, CFBitVectorRef otherBV) {
+    __CFBitVectorCombine(bv, otherBV, __kCFBitVectorAnd);
+}
+
+void CFBitVectorOr(CFMutableBitVectorRef bv, CFBitVectorRef otherBV) {
+    __CFBitVectorCombine(bv, otherBV, __kCFBitVectorOr);
+}
+
+void CFBitVectorXor(CFMutableBitVectorRef bv, CFBitVectorRef otherBV) {
+    __CFBitVectorCombine(bv, otherBV, __kCFBitVectorXor);
+}
+
+void CFBitVectorAndNot(CFMutableBitVectorRef bv, CFBitVectorRef otherBV) {
+    __CFBitVectorCombine(bv, otherBV, __kCFBitVectorAndNot);
+}
+
 #undef __CFBitVectorValidateRange
 
+#pragma mark -
+#pragma mark CFCompressedBitVector
+
+/* A CFCompressedBitVector keeps the bits of a vector of up to 2^32 bits in
+   65536-bit chunks keyed by the high 16 bits of the index; chunks with no bits
+   set are not stored. Each stored chunk is a container in one of three forms:
+   a sorted array of the low 16 bits of the set indexes (at most 4096 of them),
+   a 1024-word bitmap (bit n of the chunk is bit n % 64 of word n / 64), or a
+   sorted array of [first, last] runs. Single-bit edits keep the current form,
+   moving between array and bitmap only at the 4096 threshold; range edits,
+   boolean operations, immutable copies and CFCompressedBitVectorCompact()
+   re-choose whichever form is smallest for the chunk's contents. */
+
+enum {
+    __kCFBitContainerArray = 0,
+    __kCFBitContainerBitmap = 1,
+    __kCFBitContainerRun = 2
+};
+
+enum {
+    __CF_BITS_PER_CONTAINER = 65536,
+    __CF_WORDS_PER_CONTAINER = 1024,
+    __CF_MAX_CONTAINER_ARRAY = 4096
+};
+
+enum {
+    __kCFBitOpClear = 0,
+    __kCFBitOpSet,
+    __kCFBitOpFlip
+};
+
+#if __LP64__
+#define __CF_MAX_COMPRESSED_BIT_COUNT ((CFIndex)1 << 32)
+#else
+#define __CF_MAX_COMPRESSED_BIT_COUNT LONG_MAX
+#endif
+
+typedef struct {
+    uint16_t _key;		/* index >> 16 of the chunk */
+    uint8_t _type;
+    uint8_t _borrowed;		/* _data points into the backing data and is not owned */
+    uint32_t _cardinality;	/* number of bits set, 1 ... 65536 */
+    uint32_t _length;		/* number of values, words or runs in _data */
+    uint32_t _capacity;		/* bytes allocated for _data */
+    void *_data;
+} __CFBitContainer;
+
+struct __CFCompressedBitVector {
+    CFRuntimeBase _base;
+    CFIndex _count;		/* number of bits */
+    CFIndex _capacity;		/* maximum number of bits, or 0 for no limit (mutable) */
+    CFIndex _numContainers;
+    CFIndex _containerCapacity;
+    __CFBitContainer *_containers;	/* sorted by _key */
+    CFDataRef _backing;		/* serialized image borrowed containers point into */
+};
+
+#if defined(DEBUG)
+CF_INLINE void __CFCompressedBitVectorValidateRange(CFCompressedBitVectorRef bv, CFRange range, const char *func) {
+    CFAssert2(0 <= range.location && range.location < bv->_count, __kCFLogAssertion, "%s(): range.location index (%d) out of bounds", func, range.location);
+    CFAssert2(0 <= range.length, __kCFLogAssertion, "%s(): range.length (%d) cannot be less than zero", func, range.length);
+    CFAssert2(range.location + range.length <= bv->_count, __kCFLogAssertion, "%s(): ending index (%d) out of bounds", func, range.location + range.length);
+}
+#else
+#define __CFCompressedBitVectorValidateRange(bf,r,f)
+#endif
+
+CF_INLINE CFIndex __CFBitContainerEntrySize(uint8_t type) {
+    switch (type) {
+    case __kCFBitContainerBitmap: return sizeof(uint64_t);
+    case __kCFBitContainerRun: return 2 * sizeof(uint16_t);
+    }
+    return sizeof(uint16_t);
+}
+
+CF_INLINE uint8_t __CFBitReverseByte(uint8_t b) {
+    b = (uint8_t)(((b & 0xF0) >> 4) | ((b & 0x0F) << 4));
+    b = (uint8_t)(((b & 0xCC) >> 2) | ((b & 0x33) << 2));
+    b = (uint8_t)(((b & 0xAA) >> 1) | ((b & 0x55) << 1));
+    return b;
+}
+
+/* Index of the first value >= v */
+static int32_t __CFBitArrayLowerBound(const uint16_t *values, int32_t n, int32_t v) {
+    int32_t lo = 0, hi = n;
+    while (lo < hi) {
+	int32_t mid = (lo + hi) / 2;
+	if (values[mid] < v) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Index of the last run starting at or before v, or -1 */
+static int32_t __CFBitRunFind(const uint16_t *runs, int32_t n, int32_t v) {
+    int32_t lo = 0, hi = n;
+    while (lo < hi) {
+	int32_t mid = (lo + hi) / 2;
+	if (runs[2 * mid] <= v) lo = mid + 1; else hi = mid;
+    }
+    return lo - 1;
+}
+
+CF_INLINE uint64_t __CFBitmapWordMask(int32_t w, int32_t lo, int32_t hi) {
+    uint64_t mask = ~(uint64_t)0;
+    if (w == (lo >> 6)) mask &= ~(uint64_t)0 << (lo & 63);
+    if (w == (hi >> 6)) mask &= ~(uint64_t)0 >> (63 - (hi & 63));
+    return mask;
+}
+
+static void __CFBitmapApplyRange(uint64_t *words, int32_t lo, int32_t hi, int op) {
+    int32_t w;
+    for (w = lo >> 6; w <= (hi >> 6); w++) {
+	uint64_t mask = __CFBitmapWordMask(w, lo, hi);
+	switch (op) {
+	case __kCFBitOpClear: words[w] &= ~mask; break;
+	case __kCFBitOpSet: words[w] |= mask; break;
+	case __kCFBitOpFlip: words[w] ^= mask; break;
+	}
+    }
+}
+
+/* First bit at or after from which is set (invert == 0) or clear (invert == ~0),
+   or __CF_BITS_PER_CONTAINER */
+static int32_t __CFBitmapNext(const uint64_t *words, int32_t from, uint64_t invert) {
+    int32_t w;
+    uint64_t word;
+    if (__CF_BITS_PER_CONTAINER <= from) return __CF_BITS_PER_CONTAINER;
+    w = from >> 6;
+    word = (words[w] ^ invert) & (~(uint64_t)0 << (from & 63));
+    while (0 == word) {
+	if (__CF_WORDS_PER_CONTAINER == ++w) return __CF_BITS_PER_CONTAINER;
+	word = words[w] ^ invert;
+    }
+    return (w << 6) + __builtin_ctzll(word);
+}
+
+/* Last bit at or before from which is set (invert == 0) or clear (invert == ~0), or -1 */
+static int32_t __CFBitmapPrev(const uint64_t *words, int32_t from, uint64_t invert) {
+    int32_t w;
+    uint64_t word;
+    if (from < 0) return -1;
+    w = from >> 6;
+    word = (words[w] ^ invert) & (~(uint64_t)0 >> (63 - (from & 63)));
+    while (0 == word) {
+	if (--w < 0) return -1;
+	word = words[w] ^ invert;
+    }
+    return (w << 6) + 63 - __builtin_clzll(word);
+}
+
+static void __CFBitContainerGetBitmap(const __CFBitContainer *c, uint64_t *words) {
+    const uint16_t *values = (const uint16_t *)c->_data;
+    uint32_t idx;
+    if (__kCFBitContainerBitmap == c->_type) {
+	memmove(words, c->_data, __CF_WORDS_PER_CONTAINER * sizeof(uint64_t));
+	return;
+    }
+    memset(words, 0, __CF_WORDS_PER_CONTAINER * sizeof(uint64_t));
+    if (__kCFBitContainerArray == c->_type) {
+	for (idx = 0; idx < c->_length; idx++) {
+	    words[values[idx] >> 6] |= (uint64_t)1 << (values[idx] & 63);
+	}
+    } else {
+	for (idx = 0; idx < c->_length; idx++) {
+	    __CFBitmapApplyRange(words, values[2 * idx], values[2 * idx + 1], __kCFBitOpSet);
+	}
+    }
+}
+
+/* Makes _data owned and at least size bytes, keeping its contents; an
+   allocation much larger than needed is given back. */
+static void *__CFBitContainerResize(CFAllocatorRef allocator, __CFBitContainer *c, CFIndex size) {
+    void *data;
+    if (!c->_borrowed && NULL != c->_data && size <= (CFIndex)c->_capacity && (CFIndex)c->_capacity <= 2 * size + 64) return c->_data;
+    if (c->_borrowed || NULL == c->_data) {
+	data = CFAllocatorAllocate(allocator, size, 0);
+	if (NULL != data && NULL != c->_data) memmove(data, c->_data, __CFMin(size, (CFIndex)c->_length * __CFBitContainerEntrySize(c->_type)));
+    } else {
+	data = CFAllocatorReallocate(allocator, c->_data, size, 0);
+    }
+    if (NULL == data) HALT;
+    if (__CFOASafe) __CFSetLastAllocationEventName(data, "CFCompressedBitVector (container)");
+    c->_data = data;
+    c->_capacity = (uint32_t)size;
+    c->_borrowed = 0;
+    return data;
+}
+
+static void __CFBitContainerFree(CFAllocatorRef allocator, __CFBitContainer *c) {
+    if (!c->_borrowed && NULL != c->_data) CFAllocatorDeallocate(allocator, c->_data);
+    c->_data = NULL;
+}
+
+static void __CFBitContainerStoreArray(CFAllocatorRef allocator, __CFBitContainer *c, const uint16_t *values, uint32_t n) {
+    uint16_t *data = (uint16_t *)__CFBitContainerResize(allocator, c, n * sizeof(uint16_t));
+    memmove(data, values, n * sizeof(uint16_t));
+    c->_type = __kCFBitContainerArray;
+    c->_length = n;
+    c->_cardinality = n;
+}
+
+/* Stores words into c in whichever form is smallest. Returns false, leaving c
+   as it was, if no bits are set. */
+static Boolean __CFBitContainerStoreBitmap(CFAllocatorRef allocator, __CFBitContainer *c, const uint64_t *words) {
+    uint32_t cardinality = 0, nRuns = 0, n = 0;
+    uint64_t prev = 0;
+    CFIndex idx, runSize, arraySize, bitmapSize = __CF_WORDS_PER_CONTAINER * sizeof(uint64_t);
+    for (idx = 0; idx < __CF_WORDS_PER_CONTAINER; idx++) {
+	uint64_t word = words[idx];
+	cardinality += __builtin_popcountll(word);
+	nRuns += __builtin_popcountll(word & ~((word << 1) | (prev >> 63)));
+	prev = word;
+    }
+    if (0 == cardinality) return false;
+    runSize = nRuns * 2 * sizeof(uint16_t);
+    arraySize = (cardinality <= __CF_MAX_CONTAINER_ARRAY) ? cardinality * sizeof(uint16_t) : bitmapSize;
+    if (runSize < arraySize && runSize < bitmapSize) {
+	uint16_t *runs = (uint16_t *)__CFBitContainerResize(allocator, c, runSize);
+	int32_t first = __CFBitmapNext(words, 0, 0);
+	while (first < __CF_BITS_PER_CONTAINER) {
+	    int32_t end = __CFBitmapNext(words, first, ~(uint64_t)0);
+	    runs[n++] = (uint16_t)first;
+	    runs[n++] = (uint16_t)(end - 1);
+	    first = __CFBitmapNext(words, end, 0);
+	}
+	c->_type = __kCFBitContainerRun;
+	c->_length = nRuns;
+    } else if (cardinality <= __CF_MAX_CONTAINER_ARRAY) {
+	uint16_t *values = (uint16_t *)__CFBitContainerResize(allocator, c, arraySize);
+	for (idx = 0; idx < __CF_WORDS_PER_CONTAINER; idx++) {
+	    uint64_t word = words[idx];
+	    while (word) {
+		values[n++] = (uint16_t)((idx << 6) + __builtin_ctzll(word));
+		word &= word - 1;
+	    }
+	}
+	c->_type = __kCFBitContainerArray;
+	c->_length = cardinality;
+    } else {
+	memmove(__CFBitContainerResize(allocator, c, bitmapSize), words, bitmapSize);
+	c->_type = __kCFBitContainerBitmap;
+	c->_length = __CF_WORDS_PER_CONTAINER;
+    }
+    c->_cardinality = cardinality;
+    return true;
+}
+
+static void __CFBitContainerCopy(CFAllocatorRef allocator, __CFBitContainer *dst, const __CFBitContainer *src) {
+    CFIndex size = src->_length * __CFBitContainerEntrySize(src->_type);
+    *dst = *src;
+    dst->_data = CFAllocatorAllocate(allocator, size, 0);
+    if (NULL == dst->_data) HALT;
+    if (__CFOASafe) __CFSetLastAllocationEventName(dst->_data, "CFCompressedBitVector (container)");
+    memmove(dst->_data, src->_data, size);
+    dst->_capacity = (uint32_t)size;
+    dst->_borrowed = 0;
+}
+
+static Boolean __CFBitContainerContains(const __CFBitContainer *c, int32_t low) {
+    const uint16_t *values = (const uint16_t *)c->_data;
+    int32_t idx;
+    switch (c->_type) {
+    case __kCFBitContainerArray:
+	idx = __CFBitArrayLowerBound(values, c->_length, low);
+	return idx < (int32_t)c->_length && values[idx] == low;
+    case __kCFBitContainerBitmap:
+	return (((const uint64_t *)c->_data)[low >> 6] >> (low & 63)) & 1;
+    }
+    idx = __CFBitRunFind(values, c->_length, low);
+    return 0 <= idx && low <= values[2 * idx + 1];
+}
+
+static uint32_t __CFBitContainerCountRange(const __CFBitContainer *c, int32_t lo, int32_t hi) {
+    const uint16_t *values = (const uint16_t *)c->_data;
+    uint32_t count = 0;
+    int32_t idx;
+    if (0 == lo && __CF_BITS_PER_CONTAINER - 1 == hi) return c->_cardinality;
+    switch (c->_type) {
+    case __kCFBitContainerArray:
+	return __CFBitArrayLowerBound(values, c->_length, hi + 1) - __CFBitArrayLowerBound(values, c->_length, lo);
+    case __kCFBitContainerBitmap:
+	for (idx = lo >> 6; idx <= (hi >> 6); idx++) {
+	    count += __builtin_popcountll(((const uint64_t *)c->_data)[idx] & __CFBitmapWordMask(idx, lo, hi));
+	}
+	return count;
+    }
+    for (idx = __CFMax(__CFBitRunFind(values, c->_length, lo), 0); idx < (int32_t)c->_length && values[2 * idx] <= hi; idx++) {
+	int32_t first = __CFMax(values[2 * idx], lo), last = __CFMin(values[2 * idx + 1], hi);
+	if (first <= last) count += last - first + 1;
+    }
+    return count;
+}
+
+/* The Next functions return __CF_BITS_PER_CONTAINER and the Prev functions -1
+   when there is no such bit. */
+static int32_t __CFBitContainerNextSet(const __CFBitContainer *c, int32_t from) {
+    const uint16_t *values = (const uint16_t *)c->_data;
+    int32_t idx;
+    switch (c->_type) {
+    case __kCFBitContainerArray:
+	idx = __CFBitArrayLowerBound(values, c->_length, from);
+	return (idx < (int32_t)c->_length) ? values[idx] : __CF_BITS_PER_CONTAINER;
+    case __kCFBitContainerBitmap:
+	return __CFBitmapNext((const uint64_t *)c->_data, from, 0);
+    }
+    idx = __CFBitRunFind(values, c->_length, from);
+    if (0 <= idx && from <= values[2 * idx + 1]) return from;
+    idx++;
+    return (idx < (int32_t)c->_length) ? values[2 * idx] : __CF_BITS_PER_CONTAINER;
+}
+
+static int32_t __CFBitContainerPrevSet(const __CFBitContainer *c, int32_t from) {
+    const uint16_t *values = (const uint16_t *)c->_data;
+    int32_t idx;
+    switch (c->_type) {
+    case __kCFBitContainerArray:
+	idx = __CFBitArrayLowerBound(values, c->_length, from + 1) - 1;
+	return (0 <= idx) ? values[idx] : -1;
+    case __kCFBitContainerBitmap:
+	return __CFBitmapPrev((const uint64_t *)c->_data, from, 0);
+    }
+    idx = __CFBitRunFind(values, c->_length, from);
+    return (0 <= idx) ? __CFMin(values[2 * idx + 1], from) : -1;
+}
+
+static int32_t __CFBitContainerNextClear(const __CFBitContainer *c, int32_t from) {
+    const uint16_t *values = (const uint16_t *)c->_data;
+    int32_t idx;
+    switch (c->_type) {
+    case __kCFBitContainerArray:
+	for (idx = __CFBitArrayLowerBound(values, c->_length, from); idx < (int32_t)c->_length && values[idx] == from; idx++) from++;
+	return from;
+    case __kCFBitContainerBitmap:
+	return __CFBitmapNext((const uint64_t *)c->_data, from, ~(uint64_t)0);
+    }
+    for (idx = __CFBitRunFind(values, c->_length, from); 0 <= idx && idx < (int32_t)c->_length && values[2 * idx] <= from && from <= values[2 * idx + 1]; idx++) {
+	from = values[2 * idx + 1] + 1;
+    }
+    return from;
+}
+
+static int32_t __CFBitContainerPrevClear(const __CFBitContainer *c, int32_t from) {
+    const uint16_t *values = (const uint16_t *)c->_data;
+    int32_t idx;
+    switch (c->_type) {
+    case __kCFBitContainerArray:
+	for (idx = __CFBitArrayLowerBound(values, c->_length, from + 1) - 1; 0 <= idx && values[idx] == from; idx--) from--;
+	return from;
+    case __kCFBitContainerBitmap:
+	return __CFBitmapPrev((const uint64_t *)c->_data, from, ~(uint64_t)0);
+    }
+    for (idx = __CFBitRunFind(values, c->_length, from); 0 <= idx && values[2 * idx] <= from && from <= values[2 * idx + 1]; idx--) {
+	from = values[2 * idx] - 1;
+    }
+    return from;
+}
+
+/* Combines b into a; returns false if a is left with no bits set, in which case
+   its contents are unspecified and the caller should drop it. scratch holds
+   two bitmaps' worth of words, and is shared by all the containers of one
+   combine rather than put on the stack. */
+static Boolean __CFBitContainerCombine(CFAllocatorRef allocator, __CFBitContainer *a, const __CFBitContainer *b, int op, uint64_t *scratch) {
+    uint64_t *wa = scratch, *wb = scratch + __CF_WORDS_PER_CONTAINER;
+    uint16_t *buffer = (uint16_t *)scratch;	/* the array cases need no bitmaps */
+    uint32_t idx, n = 0;
+    if (__kCFBitVectorAnd == op && (__kCFBitContainerArray == a->_type || __kCFBitContainerArray == b->_type)) {
+	/* Intersection with an array is at most as large as the array */
+	const __CFBitContainer *array = (__kCFBitContainerArray == a->_type) ? a : b;
+	const __CFBitContainer *other = (array == a) ? b : a;
+	const uint16_t *values = (const uint16_t *)array->_data;
+	for (idx = 0; idx < array->_length; idx++) {
+	    if (__CFBitContainerContains(other, values[idx])) buffer[n++] = values[idx];
+	}
+	if (0 == n) return false;
+	__CFBitContainerStoreArray(allocator, a, buffer, n);
+	return true;
+    }
+    if (__kCFBitVectorOr == op && __kCFBitContainerArray == a->_type && __kCFBitContainerArray == b->_type && a->_length + b->_length <= __CF_MAX_CONTAINER_ARRAY) {
+	const uint16_t *va = (const uint16_t *)a->_data, *vb = (const uint16_t *)b->_data;
+	uint32_t ia = 0, ib = 0;
+	while (ia < a->_length || ib < b->_length) {
+	    if (ib == b->_length || (ia < a->_length && va[ia] < vb[ib])) {
+		buffer[n++] = va[ia++];
+	    } else if (ia == a->_length || vb[ib] < va[ia]) {
+		buffer[n++] = vb[ib++];
+	    } else {
+		buffer[n++] = va[ia++];
+		ib++;
+	    }
+	}
+	__CFBitContainerStoreArray(allocator, a, buffer, n);
+	return true;
+    }
+    __CFBitContainerGetBitmap(a, wa);
+    if (__kCFBitContainerBitmap == b->_type) {
+	wb = (uint64_t *)b->_data;
+    } else {
+	__CFBitContainerGetBitmap(b, wb);
+    }
+    switch (op) {
+    case __kCFBitVectorAnd:
+	for (idx = 0; idx < __CF_WORDS_PER_CONTAINER; idx++) wa[idx] &= wb[idx];
+	break;
+    case __kCFBitVectorOr:
+	for (idx = 0; idx < __CF_WORDS_PER_CONTAINER; idx++) wa[idx] |= wb[idx];
+	break;
+    case __kCFBitVectorXor:
+	for (idx = 0; idx < __CF_WORDS_PER_CONTAINER; idx++) wa[idx] ^= wb[idx];
+	break;
+    case __kCFBitVectorAndNot:
+	for (idx = 0; idx < __CF_WORDS_PER_CONTAINER; idx++) wa[idx] &= ~wb[idx];
+	break;
+    }
+    return __CFBitContainerStoreBitmap(allocator, a, wa);
+}
+
+static Boolean __CFCompressedBitVectorFindContainer(CFCompressedBitVectorRef bv, uint16_t key, CFIndex *idx) {
+    CFIndex lo = 0, hi = bv->_numContainers;
+    while (lo < hi) {
+	CFIndex mid = (lo + hi) / 2;
+	if (bv->_containers[mid]._key < key) lo = mid + 1; else hi = mid;
+    }
+    *idx = lo;
+    return lo < bv->_numContainers && bv->_containers[lo]._key == key;
+}
+
+static void __CFCompressedBitVectorInsertContainer(CFMutableCompressedBitVectorRef bv, CFIndex idx, const __CFBitContainer *c) {
+    if (bv->_numContainers == bv->_containerCapacity) {
+	CFIndex capacity = bv->_containerCapacity ? 2 * bv->_containerCapacity : 4;
+	__CFBitContainer *containers = (__CFBitContainer *)CFAllocatorReallocate(CFGetAllocator(bv), bv->_containers, capacity * sizeof(__CFBitContainer), 0);
+	if (NULL == containers) HALT;
+	if (__CFOASafe) __CFSetLastAllocationEventName(containers, "CFCompressedBitVector (store)");
+	bv->_containers = containers;
+	bv->_containerCapacity = capacity;
+    }
+    memmove(bv->_containers + idx + 1, bv->_containers + idx, (bv->_numContainers - idx) * sizeof(__CFBitContainer));
+    bv->_containers[idx] = *c;
+    bv->_numContainers++;
+}
+
+static void __CFCompressedBitVectorRemoveContainer(CFMutableCompressedBitVectorRef bv, CFIndex idx) {
+    __CFBitContainerFree(CFGetAllocator(bv), &bv->_containers[idx]);
+    memmove(bv->_containers + idx, bv->_containers + idx + 1, (bv->_numContainers - idx - 1) * sizeof(__CFBitContainer));
+    bv->_numContainers--;
+}
+
+/* Applies op to bits [lo, hi] of the chunk with the given key */
+static void __CFCompressedBitVectorApplyToChunk(CFMutableCompressedBitVectorRef bv, uint16_t key, int32_t lo, int32_t hi, int op) {
+    CFAllocatorRef allocator = CFGetAllocator(bv);
+    uint64_t words[__CF_WORDS_PER_CONTAINER];
+    __CFBitContainer tmp = {0};
+    CFIndex idx;
+    Boolean found = __CFCompressedBitVectorFindContainer(bv, key, &idx);
+    __CFBitContainer *c = found ? &bv->_containers[idx] : &tmp;
+    if (!found && __kCFBitOpClear == op) return;
+    tmp._key = key;
+    if (0 == lo && __CF_BITS_PER_CONTAINER - 1 == hi && __kCFBitOpFlip != op) {
+	uint16_t *runs;
+	if (__kCFBitOpClear == op) {
+	    __CFCompressedBitVectorRemoveContainer(bv, idx);
+	    return;
+	}
+	runs = (uint16_t *)__CFBitContainerResize(allocator, c, 2 * sizeof(uint16_t));
+	runs[0] = 0;
+	runs[1] = __CF_BITS_PER_CONTAINER - 1;
+	c->_type = __kCFBitContainerRun;
+	c->_length = 1;
+	c->_cardinality = __CF_BITS_PER_CONTAINER;
+    } else {
+	if (found) __CFBitContainerGetBitmap(c, words); else memset(words, 0, sizeof(words));
+	__CFBitmapApplyRange(words, lo, hi, op);
+	if (!__CFBitContainerStoreBitmap(allocator, c, words)) {
+	    if (found) __CFCompressedBitVectorRemoveContainer(bv, idx);
+	    return;
+	}
+    }
+    if (!found) __CFCompressedBitVectorInsertContainer(bv, idx, &tmp);
+}
+
+static void __CFCompressedBitVectorApplyToRange(CFMutableCompressedBitVectorRef bv, CFRange range, int op) {
+    CFIndex loc = range.location, end = range.location + range.length;
+    while (loc < end) {
+	CFIndex chunkEnd = __CFMin(end, (loc | (__CF_BITS_PER_CONTAINER - 1)) + 1);
+	__CFCompressedBitVectorApplyToChunk(bv, (uint16_t)(loc >> 16), (int32_t)(loc & (__CF_BITS_PER_CONTAINER - 1)), (int32_t)((chunkEnd - 1) & (__CF_BITS_PER_CONTAINER - 1)), op);
+	loc = chunkEnd;
+    }
+}
+
+/* Clears every bit at or after idx */
+static void __CFCompressedBitVectorClearFrom(CFMutableCompressedBitVectorRef bv, CFIndex idx) {
+    CFIndex cidx, chunkEnd = (idx + __CF_BITS_PER_CONTAINER - 1) & ~(CFIndex)(__CF_BITS_PER_CONTAINER - 1);
+    if (idx < chunkEnd) __CFCompressedBitVectorApplyToRange(bv, CFRangeMake(idx, chunkEnd - idx), __kCFBitOpClear);
+    if (chunkEnd < __CF_MAX_COMPRESSED_BIT_COUNT) {
+	__CFCompressedBitVectorFindContainer(bv, (uint16_t)(chunkEnd >> 16), &cidx);
+    } else {
+	cidx = bv->_numContainers;
+    }
+    while (cidx < bv->_numContainers) __CFBitContainerFree(CFGetAllocator(bv), &bv->_containers[--bv->_numContainers]);
+}
+
+static void __CFCompressedBitVectorSetBit(CFMutableCompressedBitVectorRef bv, CFIndex index, CFBit value) {
+    CFAllocatorRef allocator = CFGetAllocator(bv);
+    uint16_t key = (uint16_t)(index >> 16);
+    int32_t low = (int32_t)(index & (__CF_BITS_PER_CONTAINER - 1));
+    __CFBitContainer *c;
+    CFIndex idx;
+    if (!__CFCompressedBitVectorFindContainer(bv, key, &idx)) {
+	__CFBitContainer tmp = {0};
+	uint16_t value16 = (uint16_t)low;
+	if (!value) return;
+	tmp._key = key;
+	__CFBitContainerStoreArray(allocator, &tmp, &value16, 1);
+	__CFCompressedBitVectorInsertContainer(bv, idx, &tmp);
+	return;
+    }
+    c = &bv->_containers[idx];
+    if (__CFBitContainerContains(c, low) == (value ? true : false)) return;
+    switch (c->_type) {
+    case __kCFBitContainerArray: {
+	uint16_t *values = (uint16_t *)c->_data;
+	int32_t pos = __CFBitArrayLowerBound(values, c->_length, low);
+	if (!value) {
+	    if (1 == c->_length) {
+		__CFCompressedBitVectorRemoveContainer(bv, idx);
+		return;
+	    }
+	    memmove(values + pos, values + pos + 1, (c->_length - pos - 1) * sizeof(uint16_t));
+	    c->_length--;
+	    c->_cardinality--;
+	    return;
+	}
+	if (c->_length == __CF_MAX_CONTAINER_ARRAY) break;
+	if (c->_capacity < (c->_length + 1) * sizeof(uint16_t)) {
+	    values = (uint16_t *)__CFBitContainerResize(allocator, c, __CFMin(2 * (c->_length + 1), __CF_MAX_CONTAINER_ARRAY) * sizeof(uint16_t));
+	}
+	memmove(values + pos + 1, values + pos, (c->_length - pos) * sizeof(uint16_t));
+	values[pos] = (uint16_t)low;
+	c->_length++;
+	c->_cardinality++;
+	return;
+    }
+    case __kCFBitContainerBitmap:
+	/* Dropping to the array threshold goes through the general path to convert */
+	if (value || __CF_MAX_CONTAINER_ARRAY < c->_cardinality - 1) {
+	    ((uint64_t *)c->_data)[low >> 6] ^= (uint64_t)1 << (low & 63);
+	    if (value) c->_cardinality++; else c->_cardinality--;
+	    return;
+	}
+	break;
+    }
+    __CFCompressedBitVectorApplyToChunk(bv, key, low, low, value ? __kCFBitOpSet : __kCFBitOpClear);
+}
+
+static Boolean __CFCompressedBitVectorEqual(CFTypeRef cf1, CFTypeRef cf2) {
+    CFCompressedBitVectorRef bv1 = (CFCompressedBitVectorRef)cf1;
+    CFCompressedBitVectorRef bv2 = (CFCompressedBitVectorRef)cf2;
+    uint64_t *words = NULL;
+    Boolean result = true;
+    CFIndex idx;
+    if (bv1->_count != bv2->_count || bv1->_numContainers != bv2->_numContainers) return false;
+    for (idx = 0; result && idx < bv1->_numContainers; idx++) {
+	const __CFBitContainer *c1 = &bv1->_containers[idx], *c2 = &bv2->_containers[idx];
+	if (c1->_key != c2->_key || c1->_cardinality != c2->_cardinality) {
+	    result = false;
+	    break;
+	}
+	if (c1->_type == c2->_type && c1->_length == c2->_length && 0 == memcmp(c1->_data, c2->_data, c1->_length * __CFBitContainerEntrySize(c1->_type))) continue;
+	/* The same bits may be held in different forms */
+	if (NULL == words) {
+	    words = (uint64_t *)CFAllocatorAllocate(kCFAllocatorSystemDefault, 2 * __CF_WORDS_PER_CONTAINER * sizeof(uint64_t), 0);
+	    if (NULL == words) HALT;
+	}
+	__CFBitContainerGetBitmap(c1, words);
+	__CFBitContainerGetBitmap(c2, words + __CF_WORDS_PER_CONTAINER);
+	result = (0 == memcmp(words, words + __CF_WORDS_PER_CONTAINER, __CF_WORDS_PER_CONTAINER * sizeof(uint64_t)));
+    }
+    if (words) CFAllocatorDeallocate(kCFAllocatorSystemDefault, words);
+    return result;
+}
+
+static CFHashCode __CFCompressedBitVectorHash(CFTypeRef cf) {
+    CFCompressedBitVectorRef bv = (CFCompressedBitVectorRef)cf;
+    return bv->_count;
+}
+
+static CFStringRef __CFCompressedBitVectorCopyDescription(CFTypeRef cf) {
+    static const char *const __CFBitContainerTypeNames[] = {"array", "bitmap", "run"};
+    CFCompressedBitVectorRef bv = (CFCompressedBitVectorRef)cf;
+    CFMutableStringRef result;
+    CFIndex idx;
+    result = CFStringCreateMutable(kCFAllocatorSystemDefault, 0);
+    CFStringAppendFormat(result, NULL, CFSTR("<CFCompressedBitVector %p [%p]>{count = %lu, containers = (\n"), cf, CFGetAllocator(bv), (unsigned long)bv->_count);
+    for (idx = 0; idx < bv->_numContainers; idx++) {
+	const __CFBitContainer *c = &bv->_containers[idx];
+	CFStringAppendFormat(result, NULL, CFSTR("\t%lu : %s, %u bits set\n"), (unsigned long)c->_key << 16, __CFBitContainerTypeNames[c->_type], (unsigned int)c->_cardinality);
+    }
+    CFStringAppend(result, CFSTR(")}"));
+    return result;
+}
+
+static void __CFCompressedBitVectorDeallocate(CFTypeRef cf) {
+    CFMutableCompressedBitVectorRef bv = (CFMutableCompressedBitVectorRef)cf;
+    CFAllocatorRef allocator = CFGetAllocator(bv);
+    CFIndex idx;
+    for (idx = 0; idx < bv->_numContainers; idx++) __CFBitContainerFree(allocator, &bv->_containers[idx]);
+    if (bv->_containers) CFAllocatorDeallocate(allocator, bv->_containers);
+    if (bv->_backing) CFRelease(bv->_backing);
+}
+
+static CFTypeID __kCFCompressedBitVectorTypeID = _kCFRuntimeNotATypeID;
+
+static const CFRuntimeClass __CFCompressedBitVectorClass = {
+    _kCFRuntimeScannedObject,
+    "CFCompressedBitVector",
+    NULL,	// init
+    NULL,	// copy
+    __CFCompressedBitVectorDeallocate,
+    __CFCompressedBitVectorEqual,
+    __CFCompressedBitVectorHash,
+    NULL,	// 
+    __CFCompressedBitVectorCopyDescription
+};
+
+CFTypeID CFCompressedBitVectorGetTypeID(void) {
+    static dispatch_once_t initOnce;
+    dispatch_once(&initOnce, ^{ __kCFCompressedBitVectorTypeID = _CFRuntimeRegisterClass(&__CFCompressedBitVectorClass); });
+    return __kCFCompressedBitVectorTypeID;
+}
+
+static CFMutableCompressedBitVectorRef __CFCompressedBitVectorInit(CFAllocatorRef allocator, CFOptionFlags flags, CFIndex capacity, CFIndex numBits) {
+    CFMutableCompressedBitVectorRef memory;
+    CFIndex size;
+    CFAssert2(0 <= capacity && capacity <= __CF_MAX_COMPRESSED_BIT_COUNT, __kCFLogAssertion, "%s(): capacity (%d) out of range", __PRETTY_FUNCTION__, capacity);
+    CFAssert2(0 <= numBits && numBits <= __CF_MAX_COMPRESSED_BIT_COUNT, __kCFLogAssertion, "%s(): numBits (%d) out of range", __PRETTY_FUNCTION__, numBits);
+    CFAssert3(0 == capacity || numBits <= capacity, __kCFLogAssertion, "%s(): capacity (%d) must be greater than or equal to the number of bits (%d)", __PRETTY_FUNCTION__, capacity, numBits);
+    size = sizeof(struct __CFCompressedBitVector) - sizeof(CFRuntimeBase);
+    memory = (CFMutableCompressedBitVectorRef)_CFRuntimeCreateInstance(allocator, CFCompressedBitVectorGetTypeID(), size, NULL);
+    if (NULL == memory) {
+	return NULL;
+    }
+    memory->_count = numBits;
+    memory->_capacity = capacity;
+    __CFBitVectorSetMutableVariety(memory, __CFBitVectorMutableVarietyFromFlags(flags));
+    return memory;
+}
+
+static void __CFCompressedBitVectorReserveContainers(CFMutableCompressedBitVectorRef bv, CFIndex capacity) {
+    if (capacity <= bv->_containerCapacity) return;
+    bv->_containers = (__CFBitContainer *)CFAllocatorReallocate(CFGetAllocator(bv), bv->_containers, capacity * sizeof(__CFBitContainer), 0);
+    if (NULL == bv->_containers) HALT;
+    if (__CFOASafe) __CFSetLastAllocationEventName(bv->_containers, "CFCompressedBitVector (store)");
+    bv->_containerCapacity = capacity;
+}
+
+CFCompressedBitVectorRef CFCompressedBitVectorCreate(CFAllocatorRef allocator, const uint8_t *bytes, CFIndex numBits) {
+    CFMutableCompressedBitVectorRef result = __CFCompressedBitVectorInit(allocator, kCFBitVectorImmutable, 0, numBits);
+    uint64_t words[__CF_WORDS_PER_CONTAINER];
+    CFIndex base;
+    if (NULL == result || NULL == bytes) return result;
+    /* bytes are laid out as for CFBitVector, bit 0 being the most significant bit of bytes[0] */
+    for (base = 0; base < numBits; base += __CF_BITS_PER_CONTAINER) {
+	const uint8_t *chunk = bytes + base / __CF_BITS_PER_BYTE;
+	CFIndex nBits = __CFMin(numBits - base, __CF_BITS_PER_CONTAINER);
+	CFIndex idx, nBytes = (nBits + __CF_BITS_PER_BYTE - 1) / __CF_BITS_PER_BYTE;
+	__CFBitContainer tmp = {0};
+	memset(words, 0, sizeof(words));
+	for (idx = 0; idx < nBytes; idx++) {
+	    uint8_t b = chunk[idx];
+	    if (idx == nBits / __CF_BITS_PER_BYTE) b &= (uint8_t)(0xFF << (__CF_BITS_PER_BYTE - (nBits & __CF_BITS_PER_BYTE_MASK)));
+	    if (b) words[idx >> 3] |= (uint64_t)__CFBitReverseByte(b) << (__CF_BITS_PER_BYTE * (idx & 7));
+	}
+	tmp._key = (uint16_t)(base >> 16);
+	if (__CFBitContainerStoreBitmap(allocator, &tmp, words)) __CFCompressedBitVectorInsertContainer(result, result->_numContainers, &tmp);
+    }
+    return result;
+}
+
+CFMutableCompressedBitVectorRef CFCompressedBitVectorCreateMutable(CFAllocatorRef allocator, CFIndex capacity) {
+    return __CFCompressedBitVectorInit(allocator, kCFBitVectorMutable, capacity, 0);
+}
+
+static CFMutableCompressedBitVectorRef __CFCompressedBitVectorCreateCopy(CFAllocatorRef allocator, CFOptionFlags flags, CFIndex capacity, CFCompressedBitVectorRef bv) {
+    CFMutableCompressedBitVectorRef result = __CFCompressedBitVectorInit(allocator, flags, capacity, bv->_count);
+    uint64_t words[__CF_WORDS_PER_CONTAINER];
+    CFIndex idx;
+    if (NULL == result) return NULL;
+    __CFCompressedBitVectorReserveContainers(result, bv->_numContainers);
+    for (idx = 0; idx < bv->_numContainers; idx++) {
+	__CFBitContainer *c = &result->_containers[idx];
+	if (kCFBitVectorImmutable == flags) {
+	    /* An immutable copy will not change again, so pick the smallest form now */
+	    memset(c, 0, sizeof(*c));
+	    c->_key = bv->_containers[idx]._key;
+	    __CFBitContainerGetBitmap(&bv->_containers[idx], words);
+	    __CFBitContainerStoreBitmap(allocator, c, words);
+	} else {
+	    __CFBitContainerCopy(allocator, c, &bv->_containers[idx]);
+	}
+    }
+    result->_numContainers = bv->_numContainers;
+    return result;
+}
+
+CFCompressedBitVectorRef CFCompressedBitVectorCreateCopy(CFAllocatorRef allocator, CFCompressedBitVectorRef bv) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    return __CFCompressedBitVectorCreateCopy(allocator, kCFBitVectorImmutable, 0, bv);
+}
+
+CFMutableCompressedBitVectorRef CFCompressedBitVectorCreateMutableCopy(CFAllocatorRef allocator, CFIndex capacity, CFCompressedBitVectorRef bv) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    return __CFCompressedBitVectorCreateCopy(allocator, kCFBitVectorMutable, capacity, bv);
+}
+
+CFIndex CFCompressedBitVectorGetCount(CFCompressedBitVectorRef bv) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    return bv->_count;
+}
+
+CFIndex CFCompressedBitVectorGetCountOfBit(CFCompressedBitVectorRef bv, CFRange range, CFBit value) {
+    CFIndex idx, last, count = 0;
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    __CFCompressedBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
+    if (0 == range.length) return 0;
+    last = range.location + range.length - 1;
+    __CFCompressedBitVectorFindContainer(bv, (uint16_t)(range.location >> 16), &idx);
+    for (; idx < bv->_numContainers && bv->_containers[idx]._key <= (last >> 16); idx++) {
+	CFIndex base = (CFIndex)bv->_containers[idx]._key << 16;
+	int32_t lo = (int32_t)((base < range.location) ? range.location - base : 0);
+	int32_t hi = (int32_t)((last < base + __CF_BITS_PER_CONTAINER - 1) ? last - base : __CF_BITS_PER_CONTAINER - 1);
+	count += __CFBitContainerCountRange(&bv->_containers[idx], lo, hi);
+    }
+    return value ? count : range.length - count;
+}
+
+CFIndex CFCompressedBitVectorGetFirstIndexOfBit(CFCompressedBitVectorRef bv, CFRange range, CFBit value) {
+    CFIndex idx, last, loc;
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    __CFCompressedBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
+    if (0 == range.length) return kCFNotFound;
+    last = range.location + range.length - 1;
+    if (value) {
+	__CFCompressedBitVectorFindContainer(bv, (uint16_t)(range.location >> 16), &idx);
+	for (; idx < bv->_numContainers && bv->_containers[idx]._key <= (last >> 16); idx++) {
+	    CFIndex base = (CFIndex)bv->_containers[idx]._key << 16;
+	    int32_t lo = (int32_t)((base < range.location) ? range.location - base : 0);
+	    int32_t found = __CFBitContainerNextSet(&bv->_containers[idx], lo);
+	    if (found < __CF_BITS_PER_CONTAINER) return (base + found <= last) ? base + found : kCFNotFound;
+	}
+	return kCFNotFound;
+    }
+    /* A chunk without a container is all zeros */
+    for (loc = range.location; loc <= last; loc = (loc | (__CF_BITS_PER_CONTAINER - 1)) + 1) {
+	CFIndex base = loc & ~(CFIndex)(__CF_BITS_PER_CONTAINER - 1);
+	int32_t found;
+	if (!__CFCompressedBitVectorFindContainer(bv, (uint16_t)(loc >> 16), &idx)) return loc;
+	found = __CFBitContainerNextClear(&bv->_containers[idx], (int32_t)(loc - base));
+	if (found < __CF_BITS_PER_CONTAINER) return (base + found <= last) ? base + found : kCFNotFound;
+    }
+    return kCFNotFound;
+}
+
+CFIndex CFCompressedBitVectorGetLastIndexOfBit(CFCompressedBitVectorRef bv, CFRange range, CFBit value) {
+    CFIndex idx, last, loc;
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    __CFCompressedBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
+    if (0 == range.length) return kCFNotFound;
+    last = range.location + range.length - 1;
+    if (value) {
+	if (!__CFCompressedBitVectorFindContainer(bv, (uint16_t)(last >> 16), &idx)) idx--;
+	for (; 0 <= idx && (range.location >> 16) <= bv->_containers[idx]._key; idx--) {
+	    CFIndex base = (CFIndex)bv->_containers[idx]._key << 16;
+	    int32_t hi = (int32_t)((last < base + __CF_BITS_PER_CONTAINER - 1) ? last - base : __CF_BITS_PER_CONTAINER - 1);
+	    int32_t found = __CFBitContainerPrevSet(&bv->_containers[idx], hi);
+	    if (0 <= found) return (range.location <= base + found) ? base + found : kCFNotFound;
+	}
+	return kCFNotFound;
+    }
+    for (loc = last; range.location <= loc; loc = (loc & ~(CFIndex)(__CF_BITS_PER_CONTAINER - 1)) - 1) {
+	CFIndex base = loc & ~(CFIndex)(__CF_BITS_PER_CONTAINER - 1);
+	int32_t found;
+	if (!__CFCompressedBitVectorFindContainer(bv, (uint16_t)(loc >> 16), &idx)) return loc;
+	found = __CFBitContainerPrevClear(&bv->_containers[idx], (int32_t)(loc - base));
+	if (0 <= found) return (range.location <= base + found) ? base + found : kCFNotFound;
+    }
+    return kCFNotFound;
+}
+
+Boolean CFCompressedBitVectorContainsBit(CFCompressedBitVectorRef bv, CFRange range, CFBit value) {
+    return (CFCompressedBitVectorGetFirstIndexOfBit(bv, range, value) != kCFNotFound) ? true : false;
+}
+
+CFBit CFCompressedBitVectorGetBitAtIndex(CFCompressedBitVectorRef bv, CFIndex idx) {
+    CFIndex cidx;
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    CFAssert2(0 <= idx && idx < bv->_count, __kCFLogAssertion, "%s(): index (%d) out of bounds", __PRETTY_FUNCTION__, idx);
+    if (!__CFCompressedBitVectorFindContainer(bv, (uint16_t)(idx >> 16), &cidx)) return 0;
+    return __CFBitContainerContains(&bv->_containers[cidx], (int32_t)(idx & (__CF_BITS_PER_CONTAINER - 1))) ? 1 : 0;
+}
+
+void CFCompressedBitVectorGetBits(CFCompressedBitVectorRef bv, CFRange range, uint8_t *bytes) {
+    CFIndex idx, last;
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    __CFCompressedBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
+    if (0 == range.length) return;
+    memset(bytes, 0, (range.length + __CF_BITS_PER_BYTE - 1) / __CF_BITS_PER_BYTE);
+    last = range.location + range.length - 1;
+    __CFCompressedBitVectorFindContainer(bv, (uint16_t)(range.location >> 16), &idx);
+    for (; idx < bv->_numContainers && bv->_containers[idx]._key <= (last >> 16); idx++) {
+	const __CFBitContainer *c = &bv->_containers[idx];
+	CFIndex base = (CFIndex)c->_key << 16;
+	int32_t lo = (int32_t)((base < range.location) ? range.location - base : 0);
+	int32_t hi = (int32_t)((last < base + __CF_BITS_PER_CONTAINER - 1) ? last - base : __CF_BITS_PER_CONTAINER - 1);
+	int32_t found;
+	for (found = __CFBitContainerNextSet(c, lo); found <= hi; found = __CFBitContainerNextSet(c, found + 1)) {
+	    CFIndex offset = base + found - range.location;
+	    bytes[offset / __CF_BITS_PER_BYTE] |= (uint8_t)(0x80 >> (offset & __CF_BITS_PER_BYTE_MASK));
+	}
+    }
+}
+
+void CFCompressedBitVectorSetCount(CFMutableCompressedBitVectorRef bv, CFIndex count) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    CFAssert2(0 <= count && count <= __CF_MAX_COMPRESSED_BIT_COUNT, __kCFLogAssertion, "%s(): count (%d) out of range", __PRETTY_FUNCTION__, count);
+    if (0 != bv->_capacity) {
+	CFAssert1(count <= bv->_capacity, __kCFLogAssertion, "%s(): fixed-capacity bit vector is full", __PRETTY_FUNCTION__);
+	if (bv->_capacity < count) HALT;
+    }
+    /* Bits past the end are always clear, so growing needs no work */
+    if (count < bv->_count) __CFCompressedBitVectorClearFrom(bv, count);
+    bv->_count = count;
+}
+
+void CFCompressedBitVectorFlipBitAtIndex(CFMutableCompressedBitVectorRef bv, CFIndex idx) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    CFAssert2(0 <= idx && idx < bv->_count, __kCFLogAssertion, "%s(): index (%d) out of bounds", __PRETTY_FUNCTION__, idx);
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    __CFCompressedBitVectorSetBit(bv, idx, CFCompressedBitVectorGetBitAtIndex(bv, idx) ? 0 : 1);
+}
+
+void CFCompressedBitVectorFlipBits(CFMutableCompressedBitVectorRef bv, CFRange range) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    __CFCompressedBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    __CFCompressedBitVectorApplyToRange(bv, range, __kCFBitOpFlip);
+}
+
+void CFCompressedBitVectorSetBitAtIndex(CFMutableCompressedBitVectorRef bv, CFIndex idx, CFBit value) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    CFAssert2(0 <= idx && idx < bv->_count, __kCFLogAssertion, "%s(): index (%d) out of bounds", __PRETTY_FUNCTION__, idx);
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    __CFCompressedBitVectorSetBit(bv, idx, value);
+}
+
+void CFCompressedBitVectorSetBits(CFMutableCompressedBitVectorRef bv, CFRange range, CFBit value) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    __CFCompressedBitVectorValidateRange(bv, range, __PRETTY_FUNCTION__);
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    __CFCompressedBitVectorApplyToRange(bv, range, value ? __kCFBitOpSet : __kCFBitOpClear);
+}
+
+void CFCompressedBitVectorSetAllBits(CFMutableCompressedBitVectorRef bv, CFBit value) {
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    if (value) {
+	__CFCompressedBitVectorApplyToRange(bv, CFRangeMake(0, bv->_count), __kCFBitOpSet);
+    } else {
+	__CFCompressedBitVectorClearFrom(bv, 0);
+    }
+}
+
+/* Same semantics as __CFBitVectorCombine(); containers are merged by key in a
+   single pass into a new container list. */
+static void __CFCompressedBitVectorCombine(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV, int op) {
+    CFAllocatorRef allocator = CFGetAllocator(bv);
+    CFIndex i = 0, j = 0, k = 0, na, nb;
+    __CFBitContainer *result;
+    uint64_t *scratch = NULL;
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    __CFGenericValidateType(otherBV, CFCompressedBitVectorGetTypeID());
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    if (bv == otherBV) {
+	if (__kCFBitVectorXor == op || __kCFBitVectorAndNot == op) __CFCompressedBitVectorClearFrom(bv, 0);
+	return;
+    }
+    na = bv->_numContainers;
+    nb = otherBV->_numContainers;
+    result = (__CFBitContainer *)CFAllocatorAllocate(allocator, __CFMax(na + nb, 1) * sizeof(__CFBitContainer), 0);
+    if (NULL == result) HALT;
+    if (__CFOASafe) __CFSetLastAllocationEventName(result, "CFCompressedBitVector (store)");
+    while (i < na || j < nb) {
+	__CFBitContainer *a = (i < na) ? &bv->_containers[i] : NULL;
+	const __CFBitContainer *b = (j < nb) ? &otherBV->_containers[j] : NULL;
+	if (NULL == b || (NULL != a && a->_key < b->_key)) {
+	    if (__kCFBitVectorAnd == op) __CFBitContainerFree(allocator, a); else result[k++] = *a;
+	    i++;
+	} else if (NULL == a || b->_key < a->_key) {
+	    if (__kCFBitVectorOr == op || __kCFBitVectorXor == op) __CFBitContainerCopy(allocator, &result[k++], b);
+	    j++;
+	} else {
+	    if (NULL == scratch) {
+		scratch = (uint64_t *)CFAllocatorAllocate(kCFAllocatorSystemDefault, 2 * __CF_WORDS_PER_CONTAINER * sizeof(uint64_t), 0);
+		if (NULL == scratch) HALT;
+	    }
+	    if (__CFBitContainerCombine(allocator, a, b, op, scratch)) result[k++] = *a; else __CFBitContainerFree(allocator, a);
+	    i++;
+	    j++;
+	}
+    }
+    if (scratch) CFAllocatorDeallocate(kCFAllocatorSystemDefault, scratch);
+    if (bv->_containers) CFAllocatorDeallocate(allocator, bv->_containers);
+    bv->_containers = result;
+    bv->_numContainers = k;
+    bv->_containerCapacity = __CFMax(na + nb, 1);
+    if (bv->_count < otherBV->_count) __CFCompressedBitVectorClearFrom(bv, bv->_count);
+}
+
+void CFCompressedBitVectorAnd(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV) {
+    __CFCompressedBitVectorCombine(bv, otherBV, __kCFBitVectorAnd);
+}
+
+void CFCompressedBitVectorOr(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV) {
+    __CFCompressedBitVectorCombine(bv, otherBV, __kCFBitVectorOr);
+}
+
+void CFCompressedBitVectorXor(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV) {
+    __CFCompressedBitVectorCombine(bv, otherBV, __kCFBitVectorXor);
+}
+
+void CFCompressedBitVectorAndNot(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV) {
+    __CFCompressedBitVectorCombine(bv, otherBV, __kCFBitVectorAndNot);
+}
+
+void CFCompressedBitVectorCompact(CFMutableCompressedBitVectorRef bv) {
+    CFAllocatorRef allocator = CFGetAllocator(bv);
+    uint64_t words[__CF_WORDS_PER_CONTAINER];
+    CFIndex idx;
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    CFAssert1(__CFBitVectorMutableVariety(bv) == kCFBitVectorMutable, __kCFLogAssertion, "%s(): bit vector is immutable", __PRETTY_FUNCTION__);
+    for (idx = 0; idx < bv->_numContainers; idx++) {
+	__CFBitContainerGetBitmap(&bv->_containers[idx], words);
+	__CFBitContainerStoreBitmap(allocator, &bv->_containers[idx], words);
+    }
+}
+
+/* Serialized form, all fields little-endian:
+	header		magic, version, reserved, count, number of containers, reserved
+	descriptors	one per container: key, type, reserved, cardinality, length, offset
+	payloads	each at its 8-byte-aligned offset from the start of the image
+   Payloads are the containers' _data verbatim (on a little-endian host), so an
+   image can be used in place. */
+typedef struct {
+    uint32_t _magic;
+    uint16_t _version;
+    uint16_t _reserved;
+    uint64_t _count;
+    uint32_t _numContainers;
+    uint32_t _reserved2;
+} __CFCompressedBitVectorHeader;
+
+typedef struct {
+    uint16_t _key;
+    uint8_t _type;
+    uint8_t _reserved;
+    uint32_t _cardinality;
+    uint32_t _length;
+    uint32_t _offset;
+} __CFCompressedBitVectorDescriptor;
+
+#define __kCFCompressedBitVectorMagic 0x56424643	/* "CFBV" */
+#define __kCFCompressedBitVectorVersion 1
+
+static void __CFBitContainerCopySwapped(uint8_t type, void *dst, const void *src, uint32_t length) {
+    uint32_t idx;
+    if (__kCFBitContainerBitmap == type) {
+	for (idx = 0; idx < length; idx++) {
+	    uint64_t word;
+	    memmove(&word, (const uint64_t *)src + idx, sizeof(word));
+	    word = CFSwapInt64(word);
+	    memmove((uint64_t *)dst + idx, &word, sizeof(word));
+	}
+    } else {
+	uint32_t n = (__kCFBitContainerRun == type) ? 2 * length : length;
+	for (idx = 0; idx < n; idx++) {
+	    uint16_t value;
+	    memmove(&value, (const uint16_t *)src + idx, sizeof(value));
+	    value = CFSwapInt16(value);
+	    memmove((uint16_t *)dst + idx, &value, sizeof(value));
+	}
+    }
+}
+
+CFDataRef CFCompressedBitVectorCreateData(CFAllocatorRef allocator, CFCompressedBitVectorRef bv) {
+    __CFCompressedBitVectorHeader header;
+    Boolean swap = (CFByteOrderGetCurrent() != CFByteOrderLittleEndian);
+    CFIndex idx, size, offset;
+    uint8_t *bytes;
+    CFDataRef result;
+    __CFGenericValidateType(bv, CFCompressedBitVectorGetTypeID());
+    allocator = (NULL == allocator) ? __CFGetDefaultAllocator() : allocator;
+    size = sizeof(header) + bv->_numContainers * sizeof(__CFCompressedBitVectorDescriptor);
+    for (idx = 0; idx < bv->_numContainers; idx++) {
+	size = (size + 7) & ~7;
+	size += bv->_containers[idx]._length * __CFBitContainerEntrySize(bv->_containers[idx]._type);
+    }
+    bytes = (uint8_t *)CFAllocatorAllocate(allocator, size, 0);
+    if (NULL == bytes) return NULL;
+    if (__CFOASafe) __CFSetLastAllocationEventName(bytes, "CFData (CFCompressedBitVector)");
+    memset(bytes, 0, size);
+    memset(&header, 0, sizeof(header));
+    header._magic = CFSwapInt32HostToLittle(__kCFCompressedBitVectorMagic);
+    header._version = CFSwapInt16HostToLittle(__kCFCompressedBitVectorVersion);
+    header._count = CFSwapInt64HostToLittle(bv->_count);
+    header._numContainers = CFSwapInt32HostToLittle((uint32_t)bv->_numContainers);
+    memmove(bytes, &header, sizeof(header));
+    offset = sizeof(header) + bv->_numContainers * sizeof(__CFCompressedBitVectorDescriptor);
+    for (idx = 0; idx < bv->_numContainers; idx++) {
+	const __CFBitContainer *c = &bv->_containers[idx];
+	__CFCompressedBitVectorDescriptor descriptor;
+	offset = (offset + 7) & ~7;
+	memset(&descriptor, 0, sizeof(descriptor));
+	descriptor._key = CFSwapInt16HostToLittle(c->_key);
+	descriptor._type = c->_type;
+	descriptor._cardinality = CFSwapInt32HostToLittle(c->_cardinality);
+	descriptor._length = CFSwapInt32HostToLittle(c->_length);
+	descriptor._offset = CFSwapInt32HostToLittle((uint32_t)offset);
+	memmove(bytes + sizeof(header) + idx * sizeof(descriptor), &descriptor, sizeof(descriptor));
+	if (swap) {
+	    __CFBitContainerCopySwapped(c->_type, bytes + offset, c->_data, c->_length);
+	} else {
+	    memmove(bytes + offset, c->_data, c->_length * __CFBitContainerEntrySize(c->_type));
+	}
+	offset += c->_length * __CFBitContainerEntrySize(c->_type);
+    }
+    result = CFDataCreateWithBytesNoCopy(allocator, bytes, size, allocator);
+    if (NULL == result) CFAllocatorDeallocate(allocator, bytes);
+    return result;
+}
+
+/* True if the payload of c, in host order and within the image, holds what
+   its descriptor says: array values strictly increasing, runs in order with
+   first <= last and no overlap, and bitmap and run cardinalities as stored. */
+static Boolean __CFBitContainerIsWellFormed(const __CFBitContainer *c) {
+    const uint16_t *values = (const uint16_t *)c->_data;
+    uint32_t idx, cardinality = 0;
+    switch (c->_type) {
+    case __kCFBitContainerArray:
+	for (idx = 1; idx < c->_length; idx++) {
+	    if (values[idx] <= values[idx - 1]) return false;
+	}
+	return true;
+    case __kCFBitContainerBitmap:
+	for (idx = 0; idx < __CF_WORDS_PER_CONTAINER; idx++) {
+	    cardinality += __builtin_popcountll(((const uint64_t *)c->_data)[idx]);
+	}
+	return cardinality == c->_cardinality;
+    }
+    for (idx = 0; idx < c->_length; idx++) {
+	if (values[2 * idx + 1] < values[2 * idx] || (0 < idx && values[2 * idx] <= values[2 * idx - 1])) return false;
+	cardinality += values[2 * idx + 1] - values[2 * idx] + 1;
+    }
+    return cardinality == c->_cardinality;
+}
+
+CFCompressedBitVectorRef CFCompressedBitVectorCreateWithData(CFAllocatorRef allocator, CFDataRef data) {
+    __CFCompressedBitVectorHeader header;
+    CFMutableCompressedBitVectorRef result;
+    const uint8_t *bytes;
+    CFIndex idx, length = CFDataGetLength(data), numContainers, payloadStart;
+    uint64_t count;
+    Boolean borrow;
+    CFDataRef image;
+    if (length < (CFIndex)sizeof(header)) return NULL;
+    memmove(&header, CFDataGetBytePtr(data), sizeof(header));
+    if (__kCFCompressedBitVectorMagic != CFSwapInt32LittleToHost(header._magic) || __kCFCompressedBitVectorVersion != CFSwapInt16LittleToHost(header._version)) return NULL;
+    count = CFSwapInt64LittleToHost(header._count);
+    numContainers = CFSwapInt32LittleToHost(header._numContainers);
+    if ((uint64_t)__CF_MAX_COMPRESSED_BIT_COUNT < count || __CF_BITS_PER_CONTAINER < numContainers) return NULL;
+    payloadStart = sizeof(header) + numContainers * sizeof(__CFCompressedBitVectorDescriptor);
+    if (length < payloadStart) return NULL;
+    /* Containers are used in place when the image's byte order and alignment
+       allow. They then point into an immutable copy of data, which is data
+       itself, retained, unless data is mutable or does not own its bytes. */
+    image = (CFByteOrderGetCurrent() == CFByteOrderLittleEndian) ? CFDataCreateCopy(CFGetAllocator(data), data) : (CFDataRef)CFRetain(data);
+    bytes = CFDataGetBytePtr(image);
+    borrow = (CFByteOrderGetCurrent() == CFByteOrderLittleEndian) && 0 == ((uintptr_t)bytes & 7);
+    result = __CFCompressedBitVectorInit(allocator, kCFBitVectorImmutable, 0, (CFIndex)count);
+    if (NULL == result) {
+	CFRelease(image);
+	return NULL;
+    }
+    __CFCompressedBitVectorReserveContainers(result, numContainers);
+    if (borrow) result->_backing = (CFDataRef)CFRetain(image);
+    for (idx = 0; idx < numContainers; idx++) {
+	__CFCompressedBitVectorDescriptor descriptor;
+	__CFBitContainer c = {0};
+	CFIndex offset, size;
+	memmove(&descriptor, bytes + sizeof(header) + idx * sizeof(descriptor), sizeof(descriptor));
+	c._key = CFSwapInt16LittleToHost(descriptor._key);
+	c._type = descriptor._type;
+	c._cardinality = CFSwapInt32LittleToHost(descriptor._cardinality);
+	c._length = CFSwapInt32LittleToHost(descriptor._length);
+	offset = CFSwapInt32LittleToHost(descriptor._offset);
+	size = c._length * __CFBitContainerEntrySize(c._type);
+	if (__kCFBitContainerRun < c._type || 0 == c._length || 0 == c._cardinality || __CF_BITS_PER_CONTAINER < c._cardinality ||
+	    (__kCFBitContainerArray == c._type && (__CF_MAX_CONTAINER_ARRAY < c._length || c._length != c._cardinality)) ||
+	    (__kCFBitContainerBitmap == c._type && __CF_WORDS_PER_CONTAINER != c._length) ||
+	    (__kCFBitContainerRun == c._type && __CF_BITS_PER_CONTAINER / 2 < c._length) ||
+	    (0 < idx && c._key <= result->_containers[idx - 1]._key) || (CFIndex)count <= ((CFIndex)c._key << 16) ||
+	    (offset & 7) || offset < payloadStart || length < offset + size) {
+	    CFRelease(result);
+	    CFRelease(image);
+	    return NULL;
+	}
+	if (borrow) {
+	    c._data = (void *)(bytes + offset);
+	    c._borrowed = 1;
+	} else {
+	    c._data = CFAllocatorAllocate(CFGetAllocator(result), size, 0);
+	    if (NULL == c._data) HALT;
+	    if (__CFOASafe) __CFSetLastAllocationEventName(c._data, "CFCompressedBitVector (container)");
+	    c._capacity = (uint32_t)size;
+	    if (CFByteOrderGetCurrent() == CFByteOrderLittleEndian) {
+		memmove(c._data, bytes + offset, size);
+	    } else {
+		__CFBitContainerCopySwapped(c._type, c._data, bytes + offset, c._length);
+	    }
+	}
+	// Owned before it is checked, so that a malformed container is freed with the vector
+	result->_containers[result->_numContainers++] = c;
+	if (!__CFBitContainerIsWellFormed(&c)) {
+	    CFRelease(result);
+	    CFRelease(image);
+	    return NULL;
+	}
+    }
+    CFRelease(image);
+    /* The last chunk may run past count; bits there are never read as set. */
+    if (0 < result->_numContainers && (count & (__CF_BITS_PER_CONTAINER - 1))) {
+	const __CFBitContainer *last = &result->_containers[result->_numContainers - 1];
+	if (((CFIndex)last->_key << 16) + __CF_BITS_PER_CONTAINER > (CFIndex)count && 0 < __CFBitContainerCountRange(last, (int32_t)(count & (__CF_BITS_PER_CONTAINER - 1)), __CF_BITS_PER_CONTAINER - 1)) {
+	    __CFCompressedBitVectorClearFrom(result, (CFIndex)count);
+	}
+    }
+    return result;
+}
+
+#undef __CFCompressedBitVectorValidateRange
+#undef __CF_MAX_COMPRESSED_BIT_COUNT
+
@@ -29,6 +29,7 @@
 #define __COREFOUNDATION_CFBITVECTOR__ 1
 
 #include <CoreFoundation/CFBase.h>
+#include <CoreFoundation/CFData.h>
 
 CF_IMPLICIT_BRIDGING_ENABLED
 CF_EXTERN_C_BEGIN
@@ -60,6 +61,61 @@ CF_EXPORT void		CFBitVectorSetBitAtIndex(CFMutableBitVectorRef bv, CFIndex idx,
 CF_EXPORT void		CFBitVectorSetBits(CFMutableBitVectorRef bv, CFRange range, CFBit value);
 CF_EXPORT void		CFBitVectorSetAllBits(CFMutableBitVectorRef bv, CFBit value);
 
+/* Combine bv in place with otherBV; bits of bv past the end of otherBV
+   are combined with 0, and the count of bv is left unchanged. */
+CF_EXPORT void		CFBitVectorAnd(CFMutableBitVectorRef bv, CFBitVectorRef otherBV);
+CF_EXPORT void		CFBitVectorOr(CFMutableBitVectorRef bv, CFBitVectorRef otherBV);
+CF_EXPORT void		CFBitVectorXor(CFMutableBitVectorRef bv, CFBitVectorRef otherBV);
+CF_EXPORT void		CFBitVectorAndNot(CFMutableBitVectorRef bv, CFBitVectorRef otherBV);
+
+/* CFCompressedBitVector has the same interface as CFBitVector, for vectors
+   of up to 2^32 bits whose set bits are sparse or clustered. Storage is kept
+   in 65536-bit chunks, each as a sorted array, a bitmap or a list of runs,
+   and is proportional to the bits set rather than to the count. A capacity
+   other than 0 is the most bits a mutable vector may hold, as for a
+   fixed-capacity CFData; setting a larger count is an error. */
+typedef const struct __CFCompressedBitVector * CFCompressedBitVectorRef;
+typedef struct __CFCompressedBitVector * CFMutableCompressedBitVectorRef;
+
+CF_EXPORT CFTypeID	CFCompressedBitVectorGetTypeID(void);
+CF_EXPORT CFCompressedBitVectorRef	CFCompressedBitVectorCreate(CFAllocatorRef allocator, const UInt8 *bytes, CFIndex numBits);
+CF_EXPORT CFCompressedBitVectorRef	CFCompressedBitVectorCreateCopy(CFAllocatorRef allocator, CFCompressedBitVectorRef bv);
+CF_EXPORT CFMutableCompressedBitVectorRef	CFCompressedBitVectorCreateMutable(CFAllocatorRef allocator, CFIndex capacity);
+CF_EXPORT CFMutableCompressedBitVectorRef	CFCompressedBitVectorCreateMutableCopy(CFAllocatorRef allocator, CFIndex capacity, CFCompressedBitVectorRef bv);
+CF_EXPORT CFIndex	CFCompressedBitVectorGetCount(CFCompressedBitVectorRef bv);
+CF_EXPORT CFIndex	CFCompressedBitVectorGetCountOfBit(CFCompressedBitVectorRef bv, CFRange range, CFBit value);
+CF_EXPORT Boolean	CFCompressedBitVectorContainsBit(CFCompressedBitVectorRef bv, CFRange range, CFBit value);
+CF_EXPORT CFBit		CFCompressedBitVectorGetBitAtIndex(CFCompressedBitVectorRef bv, CFIndex idx);
+CF_EXPORT void		CFCompressedBitVectorGetBits(CFCompressedBitVectorRef bv, CFRange range, UInt8 *bytes);
+CF_EXPORT CFIndex	CFCompressedBitVectorGetFirstIndexOfBit(CFCompressedBitVectorRef bv, CFRange range, CFBit value);
+CF_EXPORT CFIndex	CFCompressedBitVectorGetLastIndexOfBit(CFCompressedBitVectorRef bv, CFRange range, CFBit value);
+CF_EXPORT void		CFCompressedBitVectorSetCount(CFMutableCompressedBitVectorRef bv, CFIndex count);
+CF_EXPORT void		CFCompressedBitVectorFlipBitAtIndex(CFMutableCompressedBitVectorRef bv, CFIndex idx);
+CF_EXPORT void		CFCompressedBitVectorFlipBits(CFMutableCompressedBitVectorRef bv, CFRange range);
+CF_EXPORT void		CFCompressedBitVectorSetBitAtIndex(CFMutableCompressedBitVectorRef bv, CFIndex idx, CFBit value);
+CF_EXPORT void		CFCompressedBitVectorSetBits(CFMutableCompressedBitVectorRef bv, CFRange range, CFBit value);
+CF_EXPORT void		CFCompressedBitVectorSetAllBits(CFMutableCompressedBitVectorRef bv, CFBit value);
+CF_EXPORT void		CFCompressedBitVectorAnd(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV);
+CF_EXPORT void		CFCompressedBitVectorOr(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV);
+CF_EXPORT void		CFCompressedBitVectorXor(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV);
+CF_EXPORT void		CFCompressedBitVectorAndNot(CFMutableCompressedBitVectorRef bv, CFCompressedBitVectorRef otherBV);
+
+/* Single-bit edits keep each chunk's current form; this re-chooses the
+   smallest form for every chunk, as range edits and immutable copies do. */
+CF_EXPORT void		CFCompressedBitVectorCompact(CFMutableCompressedBitVectorRef bv);
+
+/* Flattens bv into a little-endian image, for writing to a file or storing
+   as a CFData in a property list. */
+CF_EXPORT CFDataRef	CFCompressedBitVectorCreateData(CFAllocatorRef allocator, CFCompressedBitVectorRef bv);
+
+/* Creates an immutable compressed bit vector from an image made by
+   CFCompressedBitVectorCreateData(), or returns NULL if data is not one or
+   any chunk in it is malformed. On a little-endian host, with data 8-byte
+   aligned, the chunks are read in place rather than copied, so a
+   memory-mapped image stays mapped; data is retained, or copied first if it
+   is mutable or does not own its bytes, as CFDataCreateCopy() does. */
+CF_EXPORT CFCompressedBitVectorRef	CFCompressedBitVectorCreateWithData(CFAllocatorRef allocator, CFDataRef data);
+
 CF_EXTERN_C_END
 CF_IMPLICIT_BRIDGING_DISABLED
 
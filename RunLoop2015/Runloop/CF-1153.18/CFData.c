@@ -28,8 +28,14 @@
 
 #include <CoreFoundation/CFData.h>
 #include <CoreFoundation/CFPriv.h>
+#include <CoreFoundation/CFURL.h>
 #include "CFInternal.h"
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 
 
@@ -55,12 +61,29 @@ CF_INLINE unsigned long __CFPageSize() {
 }
 #endif
 
+#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI || DEPLOYMENT_TARGET_LINUX
+#include <sys/mman.h>
+#define __CFDATA_SUPPORTS_MAPPING 1
+#endif
+
+#if DEPLOYMENT_TARGET_LINUX
+// Large growable stores live in anonymous mappings so that growing them is a page table update (mremap) rather than a copy
+#if !defined(MREMAP_MAYMOVE)
+#define MREMAP_MAYMOVE 1
+extern void *mremap(void *old_address, size_t old_size, size_t new_size, int flags, ...);
+#endif
+#define __CFDATA_SUPPORTS_VM_GROWTH 1
+#endif
+
 #define INLINE_BYTES_THRESHOLD ((4 * __CFPageSize()) - sizeof(struct __CFData) - 15)
 
 struct __CFData {
     CFRuntimeBase _base;
     CFIndex _length;	/* number of bytes */
     CFIndex _capacity;	/* maximum number of bytes */
+    uint32_t _growthFactor;	/* percent of the old capacity to grow to; 0 for the default policy (mutable) */
+    Boolean _bytesInVM;	/* bytes are an anonymous VM mapping, unmapped on deallocation (mutable) */
+    CFDataRef _backing;	/* immutable data whose bytes these are, retained; NULL if the bytes are not shared */
     CFAllocatorRef _bytesDeallocator;	/* used only for immutable; if NULL, no deallocation */
     uint8_t *_bytes;	/* compaction: direct access to _bytes is only valid when data is not inline */
 };
@@ -70,6 +93,7 @@ struct __CFData {
  Bit 1 = growable
  Bit 2 = bytes inline
  Bit 3 = use given CFAllocator
+ Bit 4 = bytes are a read-only file mapping, unmapped on deallocation
  Bit 5 = allocate collectable memory
  
  Bits 1-0 are used for mutability variation
@@ -83,6 +107,7 @@ enum {
     __kCFMutableVarietyMask = 0x03,
     __kCFBytesInline = 0x04,
     __kCFUseAllocator = 0x08,
+    __kCFBytesMapped = 0x10,
     __kCFAllocatesCollectable = 0x20,
 };
 
@@ -99,6 +124,8 @@ CF_INLINE Boolean __CFDataIsGrowable(CFDataRef data) {return __CFDataGetInfoBit(
 CF_INLINE Boolean __CFDataBytesInline(CFDataRef data) {return __CFDataGetInfoBit(data, __kCFBytesInline);}
 CF_INLINE Boolean __CFDataUseAllocator(CFDataRef data) {return __CFDataGetInfoBit(data, __kCFUseAllocator);}
 CF_INLINE Boolean __CFDataAllocatesCollectable(CFDataRef data) {return __CFDataGetInfoBit(data, __kCFAllocatesCollectable);}
+CF_INLINE Boolean __CFDataBytesMapped(CFDataRef data) {return __CFDataGetInfoBit(data, __kCFBytesMapped);}
+CF_INLINE Boolean __CFDataBytesInVM(CFDataRef data) {return data->_bytesInVM;}
 
 CF_INLINE UInt32 __CFMutableVariety(const void *cf) {
     return __CFBitfieldGetValue(((const CFRuntimeBase *)cf)->_cfinfo[CF_INFO_BITS], 1, 0);
@@ -119,6 +146,14 @@ CF_INLINE void __CFDataSetInline(CFDataRef data, Boolean flag) {
     __CFBitfieldSetValue(((CFRuntimeBase *)data)->_cfinfo[CF_INFO_BITS], 2, 2, (flag ? 1 : 0));
 }
 
+CF_INLINE void __CFDataSetBytesMapped(CFDataRef data, Boolean flag) {
+    __CFBitfieldSetValue(((CFRuntimeBase *)data)->_cfinfo[CF_INFO_BITS], 4, 4, (flag ? 1 : 0));
+}
+
+CF_INLINE void __CFDataSetBytesInVM(CFMutableDataRef data, Boolean flag) {
+    data->_bytesInVM = flag;
+}
+
 CF_INLINE Boolean __CFDataNeedsToZero(CFDataRef data) {
     return __CFBitfieldGetValue(((CFRuntimeBase *)data)->_cfinfo[CF_INFO_BITS], 6, 6);
 }
@@ -182,6 +217,24 @@ CF_INLINE CFIndex __CFDataRoundUpCapacity(CFIndex capacity) {
     }
 }
 
+/* Stores at least this large are kept in anonymous VM where supported; huge page hints start at the second threshold */
+#define VM_THRESHOLD (1ULL << 21)
+#define HUGE_PAGE_THRESHOLD (1ULL << 25)
+#define MAX_GROWTH_FACTOR 800
+
+/* Geometric growth by a per-instance factor; capacity is the minimum required */
+CF_INLINE CFIndex __CFDataRoundUpCapacityForData(CFDataRef data, CFIndex capacity) {
+    uint32_t factor = data->_growthFactor;
+    if (0 == factor) return __CFDataRoundUpCapacity(capacity);
+    CFIndex oldCapacity = __CFDataCapacity(data);
+    CFIndex extra = (CFIndex)factor - 100;
+    CFIndex grown = oldCapacity + (oldCapacity / 100) * extra + ((oldCapacity % 100) * extra) / 100;
+    if (grown < capacity) grown = capacity;
+    if (grown < 16) grown = 16;
+    grown = (grown + 15) & ~(CFIndex)15;
+    return __CFMin(grown, CFDATA_MAX_SIZE);
+}
+
 CF_INLINE CFIndex __CFDataNumBytesForCapacity(CFIndex capacity) {
     return capacity;
 }
@@ -301,6 +354,23 @@ static void __CFDataDeallocate(CFTypeRef cf) {
     CFMutableDataRef data = (CFMutableDataRef)cf;
     if (!__CFDataBytesInline(data)) {
 	CFAllocatorRef deallocator = data->_bytesDeallocator;
+	// Shared bytes have kCFAllocatorNull as their deallocator; the backing data owns them
+	if (data->_backing) {
+	    CFRelease(data->_backing);
+	    data->_backing = NULL;
+	}
+#if __CFDATA_SUPPORTS_VM_GROWTH
+	if (__CFDataBytesInVM(data)) {
+	    munmap(data->_bytes, __CFDataNumBytes(data));
+	    __CFDataSetBytesInVM(data, false);
+	    data->_bytes = NULL;
+	    return;
+	}
+#endif
+#if __CFDATA_SUPPORTS_MAPPING
+	// The deallocator of mapped bytes is kCFAllocatorNull
+	if (__CFDataBytesMapped(data)) munmap(data->_bytes, __CFDataLength(data));
+#endif
 	if (deallocator != NULL) {
 	    _CFAllocatorDeallocateGC(deallocator, data->_bytes);
 	    CFRelease(deallocator);
@@ -319,7 +389,7 @@ static void __CFDataDeallocate(CFTypeRef cf) {
 static CFTypeID __kCFDataTypeID = _kCFRuntimeNotATypeID;
 
 static const CFRuntimeClass __CFDataClass = {
-    _kCFRuntimeScannedObject,
+    _kCFRuntimeScannedObject | _kCFRuntimeFinalizesOnAnyThread,
     "CFData",
     NULL,	// init
     NULL,	// copy
@@ -410,6 +480,7 @@ static CFMutableDataRef __CFDataInit(CFAllocatorRef allocator, CFOptionFlags fla
             } else {
 	        memory->_bytesDeallocator = (CFAllocatorRef)CFRetain(bytesDeallocator);
             }
+	    __CFRuntimeNoteFinalizerAllocator(memory, bytesDeallocator);
 	}
 	if (CF_IS_COLLECTABLE_ALLOCATOR(bytesDeallocator) && !(0)) {
 	    // we assume that the no-copy memory is GC-allocated with a retain count of (at least) 1 and we should release it now instead of waiting until __CFDataDeallocate.
@@ -455,11 +526,113 @@ CFDataRef CFDataCreateWithBytesNoCopy(CFAllocatorRef allocator, const uint8_t *b
     return __CFDataInit(allocator, kCFImmutable, length, bytes, length, bytesDeallocator);
 }
 
+/* Bytes of an immutable data never change, so other datas can point at them for as long as they keep the data alive. That holds only for bytes the data owns: inline, mapped, borrowed from a backing data, or allocated by CF (NULL deallocator) or handed over with a real deallocator. Bytes lent with kCFAllocatorNull may go away while the data lives on, so they are copied, as CFStringCreateCopy does. */
+CF_INLINE Boolean __CFDataCanShareBytes(CFDataRef data, CFRange range) {
+    if (__CFDataIsMutable(data) || __CFDataAllocatesCollectable(data) || range.length <= 0) return false;
+    if (__CFDataBytesInline(data) || __CFDataBytesMapped(data) || data->_backing) return true;
+    return kCFAllocatorNull != data->_bytesDeallocator;
+}
+
+/* Creates a data whose bytes are the given range of data's, without copying them. A mutable result gets its own bytes on its first mutation; until then its capacity is its length (growable) or the given capacity (fixed). */
+static CFMutableDataRef __CFDataCreateSharingBytes(CFAllocatorRef allocator, CFOptionFlags flags, CFIndex capacity, CFDataRef data, CFRange range) {
+    CFDataRef backing = data->_backing ? data->_backing : data;
+    CFMutableDataRef memory = __CFDataInit(allocator, flags, range.length, CFDataGetBytePtr(data) + range.location, range.length, kCFAllocatorNull);
+    if (NULL == memory) return NULL;
+    if (__CFDataIsMutable(memory)) {
+	CFIndex numBytes = __CFDataIsGrowable(memory) ? range.length : capacity;
+	__CFDataSetCapacity(memory, numBytes);
+	__CFDataSetNumBytes(memory, numBytes);
+    }
+    memory->_backing = (CFDataRef)CFRetain(backing);
+    // Releasing the backing data may free its bytes
+    __CFRuntimeNoteFinalizerAllocator(memory, __CFGetAllocator(backing));
+    __CFRuntimeNoteFinalizerAllocator(memory, backing->_bytesDeallocator);
+    return memory;
+}
+
+/* Gives a mutable data that shares its bytes its own copy of them. The backing data is returned, still retained, so that callers which may be handed pointers into the old bytes can keep them alive; the caller must release it. */
+static CFDataRef __CFDataUnshareBytes(CFMutableDataRef data) {
+    CFDataRef backing = data->_backing;
+    CFAllocatorRef deallocator = data->_bytesDeallocator;
+    CFIndex length = __CFDataLength(data);
+    CFIndex capacity = __CFDataIsGrowable(data) ? __CFDataRoundUpCapacityForData(data, length) : __CFDataCapacity(data);
+    CFIndex numBytes = __CFDataNumBytesForCapacity(capacity);
+    void *bytes = __CFDataAllocate(data, numBytes * sizeof(uint8_t), false);
+    if (NULL == bytes) __CFDataHandleOutOfMemory(data, numBytes * sizeof(uint8_t));
+    memmove(bytes, data->_bytes, length);
+    data->_backing = NULL;
+    data->_bytesDeallocator = NULL;
+    if (deallocator) CFRelease(deallocator);
+    __CFDataSetCapacity(data, capacity);
+    __CFDataSetNumBytes(data, numBytes);
+    __CFDataSetNeedsToZero(data, true);
+    __CFAssignWithWriteBarrier((void **)&data->_bytes, bytes);
+    if (__CFOASafe) __CFSetLastAllocationEventName(data->_bytes, "CFData (store)");
+    return backing;
+}
+
+CF_INLINE void __CFDataEnsureUniqueBytes(CFMutableDataRef data) {
+    if (data->_backing) CFRelease(__CFDataUnshareBytes(data));
+}
+
 CFDataRef CFDataCreateCopy(CFAllocatorRef allocator, CFDataRef data) {
     CFIndex length = CFDataGetLength(data);
+    if (__CFDataCanShareBytes(data, CFRangeMake(0, length))) {
+	if ((allocator ? allocator : __CFGetDefaultAllocator()) == __CFGetAllocator(data)) return (CFDataRef)CFRetain(data);
+	return __CFDataCreateSharingBytes(allocator, kCFImmutable, length, data, CFRangeMake(0, length));
+    }
     return __CFDataInit(allocator, kCFImmutable, length, CFDataGetBytePtr(data), length, NULL);
 }
 
+CFDataRef CFDataCreateWithSubrange(CFAllocatorRef allocator, CFDataRef data, CFRange range) {
+    __CFGenericValidateType(data, CFDataGetTypeID());
+    __CFDataValidateRange(data, range, __PRETTY_FUNCTION__);
+    if (__CFDataCanShareBytes(data, range)) {
+	return __CFDataCreateSharingBytes(allocator, kCFImmutable, range.length, data, range);
+    }
+    return __CFDataInit(allocator, kCFImmutable, range.length, CFDataGetBytePtr(data) + range.location, range.length, NULL);
+}
+
+// from CFUtilities.c
+CF_PRIVATE Boolean _CFReadMappedFromFile(CFStringRef path, Boolean map, Boolean uncached, void **outBytes, CFIndex *outLength, CFErrorRef *errorPtr);
+
+CFDataRef CFDataCreateWithContentsOfFileMapped(CFAllocatorRef allocator, CFURLRef url, CFDataMappingOptions options) {
+    CFURLRef absoluteURL = CFURLCopyAbsoluteURL(url);
+#if DEPLOYMENT_TARGET_WINDOWS
+    CFStringRef path = CFURLCopyFileSystemPath(absoluteURL, kCFURLWindowsPathStyle);
+#else
+    CFStringRef path = CFURLCopyFileSystemPath(absoluteURL, kCFURLPOSIXPathStyle);
+#endif
+    void *bytes = NULL;
+    CFIndex length = 0;
+    Boolean success;
+    CFRelease(absoluteURL);
+    if (NULL == path) return NULL;
+    success = _CFReadMappedFromFile(path, true, (options & kCFDataMappingUncached) ? true : false, &bytes, &length, NULL);
+    CFRelease(path);
+    if (!success) return NULL;
+    if (0 == length) {
+	// Nothing was mapped; an empty file gets a small malloc block
+	free(bytes);
+	return CFDataCreate(allocator, NULL, 0);
+    }
+#if __CFDATA_SUPPORTS_MAPPING
+    if (options & kCFDataMappingSequential) madvise(bytes, length, MADV_SEQUENTIAL);
+    if (options & kCFDataMappingRandom) madvise(bytes, length, MADV_RANDOM);
+    if (options & kCFDataMappingWillNeed) madvise(bytes, length, MADV_WILLNEED);
+    CFMutableDataRef result = __CFDataInit(allocator, kCFImmutable, length, (const uint8_t *)bytes, length, kCFAllocatorNull);
+    if (NULL == result) {
+	munmap(bytes, length);
+	return NULL;
+    }
+    __CFDataSetBytesMapped(result, true);
+    return result;
+#else
+    // No mapping on this platform; the file was read into a malloc block
+    return CFDataCreateWithBytesNoCopy(allocator, (const uint8_t *)bytes, length, kCFAllocatorMalloc);
+#endif
+}
+
 CFMutableDataRef CFDataCreateMutable(CFAllocatorRef allocator, CFIndex capacity) {
     // Do not allow magic allocator for now for mutable datas, because it
     // isn't remembered for proper handling later when growth of the buffer
@@ -475,7 +648,14 @@ CFMutableDataRef CFDataCreateMutableCopy(CFAllocatorRef allocator, CFIndex capac
     // isn't remembered for proper handling later when growth of the buffer
     // has to occur.
     Boolean wasMagic = (0);
-    CFMutableDataRef r = (CFMutableDataRef) __CFDataInit(allocator, (0 == capacity) ? kCFMutable : kCFFixedMutable, capacity, CFDataGetBytePtr(data), CFDataGetLength(data), NULL);
+    CFIndex length = CFDataGetLength(data);
+    CFMutableDataRef r;
+    if (__CFDataCanShareBytes(data, CFRangeMake(0, length)) && (0 == capacity || length <= capacity)) {
+	// Share until the first mutation
+	r = __CFDataCreateSharingBytes(allocator, (0 == capacity) ? kCFMutable : kCFFixedMutable, capacity, data, CFRangeMake(0, length));
+    } else {
+	r = (CFMutableDataRef) __CFDataInit(allocator, (0 == capacity) ? kCFMutable : kCFFixedMutable, capacity, CFDataGetBytePtr(data), length, NULL);
+    }
     if (wasMagic) CFMakeCollectable(r);
     return r;
 }
@@ -496,6 +676,7 @@ const uint8_t *CFDataGetBytePtr(CFDataRef data) {
 uint8_t *CFDataGetMutableBytePtr(CFMutableDataRef data) {
     CF_OBJC_FUNCDISPATCHV(CFDataGetTypeID(), uint8_t *, (NSMutableData *)data, mutableBytes);
     CFAssert1(__CFDataIsMutable(data), __kCFLogAssertion, "%s(): data is immutable", __PRETTY_FUNCTION__);
+    __CFDataEnsureUniqueBytes(data);
     // compaction: if inline, always do the computation.
     return __CFDataBytesInline(data) ? (uint8_t *)__CFDataInlineBytesPtr(data) : data->_bytes;
 }
@@ -506,17 +687,55 @@ void CFDataGetBytes(CFDataRef data, CFRange range, uint8_t *buffer) {
     memmove(buffer, CFDataGetBytePtr(data) + range.location, range.length);
 }
 
-/* Allocates new block of data with at least numNewValues more bytes than the current length. If clear is true, the new bytes up to at least the new length with be zeroed. */
-static void __CFDataGrow(CFMutableDataRef data, CFIndex numNewValues, Boolean clear) {
+#if __CFDATA_SUPPORTS_VM_GROWTH
+/* Moves the store into (or grows it within) an anonymous mapping of numBytes, which must be a multiple of the page size. Pages past the old mapping come back zero-filled. Returns NULL on failure, leaving the old store in place. */
+static void *__CFDataGrowVM(CFMutableDataRef data, CFIndex oldLength, CFIndex numBytes) {
+    void *oldBytes = data->_bytes;
+    void *bytes;
+    if (__CFDataBytesInVM(data)) {
+	bytes = mremap(oldBytes, __CFDataNumBytes(data), numBytes, MREMAP_MAYMOVE);
+	if (MAP_FAILED == bytes) return NULL;
+    } else {
+	bytes = mmap(NULL, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (MAP_FAILED == bytes) return NULL;
+	if (oldBytes) {
+	    memmove(bytes, oldBytes, oldLength);
+	    free(oldBytes);
+	}
+	__CFDataSetBytesInVM(data, true);
+    }
+#if defined(MADV_HUGEPAGE)
+    if (numBytes >= HUGE_PAGE_THRESHOLD) madvise(bytes, numBytes, MADV_HUGEPAGE);
+#endif
+    return bytes;
+}
+#endif
+
+/* Replaces the store with one of at least capacity bytes, preserving the current contents. If clear is true, the bytes from the current length up to newLength will be zeroed. */
+static void __CFDataGrowToCapacity(CFMutableDataRef data, CFIndex capacity, CFIndex newLength, Boolean clear) {
     CFIndex oldLength = __CFDataLength(data);
-    CFIndex newLength = oldLength + numNewValues;
-    if (newLength > CFDATA_MAX_SIZE || newLength < 0) __CFDataHandleOutOfMemory(data, newLength * sizeof(uint8_t));
-    CFIndex capacity = __CFDataRoundUpCapacity(newLength);
     CFIndex numBytes = __CFDataNumBytesForCapacity(capacity);
     CFAllocatorRef allocator = CFGetAllocator(data);
     void *bytes = NULL;
     void *oldBytes = data->_bytes;
     Boolean allocateCleared = clear && __CFDataShouldAllocateCleared(data, numBytes);
+#if __CFDATA_SUPPORTS_VM_GROWTH
+    if (!__CFDataUseAllocator(data) && !__CFDataAllocatesCollectable(data) && (__CFDataBytesInVM(data) || numBytes >= VM_THRESHOLD)) {
+	CFIndex pageSize = __CFPageSize();
+	CFIndex oldNumBytes = __CFDataBytesInVM(data) ? __CFDataNumBytes(data) : oldLength;
+	numBytes = (numBytes + pageSize - 1) & ~(pageSize - 1);
+	capacity = numBytes;
+	bytes = __CFDataGrowVM(data, oldLength, numBytes);
+	if (NULL == bytes) __CFDataHandleOutOfMemory(data, numBytes * sizeof(uint8_t));
+	// Only the part of the old store past the length can hold stale bytes; fresh pages are zero
+	if (clear && oldLength < newLength) memset((uint8_t *)bytes + oldLength, 0, __CFMin(newLength, oldNumBytes) - oldLength);
+	__CFDataSetCapacity(data, capacity);
+	__CFDataSetNumBytes(data, numBytes);
+	__CFDataSetNeedsToZero(data, true);
+	__CFAssignWithWriteBarrier((void **)&data->_bytes, bytes);
+	return;
+    }
+#endif
     if (allocateCleared && !__CFDataUseAllocator(data) && (oldLength == 0 || (newLength / oldLength) > 4)) {
 	// If the length that needs to be zeroed is significantly greater than the length of the data, then calloc/memmove is probably more efficient than realloc/memset.
 	bytes = __CFDataAllocate(data, numBytes * sizeof(uint8_t), true);
@@ -543,11 +762,39 @@ static void __CFDataGrow(CFMutableDataRef data, CFIndex numNewValues, Boolean cl
     if (__CFOASafe) __CFSetLastAllocationEventName(data->_bytes, "CFData (store)");
 }
 
+/* Allocates new block of data with at least numNewValues more bytes than the current length. If clear is true, the new bytes up to at least the new length with be zeroed. */
+static void __CFDataGrow(CFMutableDataRef data, CFIndex numNewValues, Boolean clear) {
+    CFIndex oldLength = __CFDataLength(data);
+    CFIndex newLength = oldLength + numNewValues;
+    if (newLength > CFDATA_MAX_SIZE || newLength < 0) __CFDataHandleOutOfMemory(data, newLength * sizeof(uint8_t));
+    __CFDataGrowToCapacity(data, __CFDataRoundUpCapacityForData(data, newLength), newLength, clear);
+}
+
+void CFDataReserveCapacity(CFMutableDataRef data, CFIndex capacity) {
+    __CFGenericValidateType(data, CFDataGetTypeID());
+    CFAssert1(__CFDataIsMutable(data), __kCFLogAssertion, "%s(): data is immutable", __PRETTY_FUNCTION__);
+    if (capacity > CFDATA_MAX_SIZE || capacity < 0) __CFDataHandleOutOfMemory(data, capacity * sizeof(uint8_t));
+    if (!__CFDataIsGrowable(data) || capacity <= __CFDataCapacity(data)) return;
+    __CFDataEnsureUniqueBytes(data);
+    __CFDataGrowToCapacity(data, capacity, __CFDataLength(data), false);
+}
+
+void CFDataSetGrowthFactor(CFMutableDataRef data, CFIndex percent) {
+    __CFGenericValidateType(data, CFDataGetTypeID());
+    CFAssert1(__CFDataIsMutable(data), __kCFLogAssertion, "%s(): data is immutable", __PRETTY_FUNCTION__);
+    if (percent <= 100) {
+	data->_growthFactor = 0;
+    } else {
+	data->_growthFactor = (uint32_t)__CFMin(percent, MAX_GROWTH_FACTOR);
+    }
+}
+
 void CFDataSetLength(CFMutableDataRef data, CFIndex newLength) {
     CFIndex oldLength, capacity;
     Boolean isGrowable;
     CF_OBJC_FUNCDISPATCHV(CFDataGetTypeID(), void, (NSMutableData *)data, setLength:(NSUInteger)newLength);
     CFAssert1(__CFDataIsMutable(data), __kCFLogAssertion, "%s(): data is immutable", __PRETTY_FUNCTION__);
+    __CFDataEnsureUniqueBytes(data);
     oldLength = __CFDataLength(data);
     capacity = __CFDataCapacity(data);
     isGrowable = __CFDataIsGrowable(data);
@@ -605,6 +852,8 @@ void CFDataReplaceBytes(CFMutableDataRef data, CFRange range, const uint8_t *new
     CFIndex newCount = len - range.length + newLength;
     if (newCount < 0) HALT;
 
+    // newBytes may point into shared bytes, so keep them alive until they have been copied
+    CFDataRef sharedBacking = data->_backing ? __CFDataUnshareBytes(data) : NULL;
     uint8_t *bytePtr = (uint8_t *)CFDataGetMutableBytePtr(data);
     uint8_t *srcBuf = (uint8_t *)newBytes;
     switch (__CFMutableVariety(data)) {
@@ -631,6 +880,7 @@ void CFDataReplaceBytes(CFMutableDataRef data, CFRange range, const uint8_t *new
         memmove(bytePtr + range.location, srcBuf, newLength * sizeof(uint8_t));
     }
     if (srcBuf != newBytes) free(srcBuf);
+    if (sharedBacking) CFRelease(sharedBacking);
     __CFDataSetNumBytesUsed(data, newCount);
     __CFDataSetLength(data, newCount);
 }
@@ -683,16 +933,15 @@ static void _computeGoodSubstringShift(const uint8_t *needle, int needleLength,
     }
 }
 
-static const uint8_t * __CFDataSearchBoyerMoore(const CFDataRef data, const uint8_t *haystack, unsigned long haystackLength, const uint8_t *needle, unsigned long needleLength, Boolean backwards) {
-    unsigned long badCharacterShift[UCHAR_MAX + 1] = {0};
-    unsigned long *goodSubstringShift = (unsigned long *)malloc(needleLength * sizeof(unsigned long));
+/* Fills in the bad character and good substring tables for a Boyer-Moore search of needle in the given direction. goodSubstringShift must have room for needleLength entries. */
+static void __CFDataComputeBoyerMooreTables(CFTypeRef obj, const uint8_t *needle, unsigned long needleLength, Boolean backwards, unsigned long badCharacterShift[UCHAR_MAX + 1], unsigned long *goodSubstringShift) {
     unsigned long *suffixLengths = (unsigned long *)malloc(needleLength * sizeof(unsigned long));
-    if (!goodSubstringShift || !suffixLengths) {
-	__CFDataHandleOutOfMemory(data, needleLength * sizeof(unsigned long));
+    if (!suffixLengths) {
+	__CFDataHandleOutOfMemory(obj, needleLength * sizeof(unsigned long));
     }
     
     if(backwards) {
-	for (int i = 0; i < sizeof(badCharacterShift) / sizeof(*badCharacterShift); i++)
+	for (int i = 0; i < UCHAR_MAX + 1; i++)
 	    badCharacterShift[i] = needleLength;
 	
 	for (int i = needleLength - 1; i >= 0; i--)
@@ -701,7 +950,7 @@ static const uint8_t * __CFDataSearchBoyerMoore(const CFDataRef data, const uint
 	// To get the correct shift table for backwards search reverse the needle, compute the forwards shift table, and then reverse the result.
 	uint8_t *needleCopy = (uint8_t *)malloc(needleLength * sizeof(uint8_t));
 	if (!needleCopy) {
-	    __CFDataHandleOutOfMemory(data, needleLength * sizeof(uint8_t));
+	    __CFDataHandleOutOfMemory(obj, needleLength * sizeof(uint8_t));
 	}
 	memmove(needleCopy, needle, needleLength);
 	REVERSE_BUFFER(uint8_t, needleCopy, needleLength);
@@ -709,7 +958,7 @@ static const uint8_t * __CFDataSearchBoyerMoore(const CFDataRef data, const uint
 	REVERSE_BUFFER(unsigned long, goodSubstringShift, needleLength);
 	free(needleCopy);
     } else {
-	for (int i = 0; i < sizeof(badCharacterShift) / sizeof(*badCharacterShift); i++)
+	for (int i = 0; i < UCHAR_MAX + 1; i++)
 	    badCharacterShift[i] = needleLength;
 	
 	for (int i = 0; i < needleLength; i++)
@@ -718,6 +967,10 @@ static const uint8_t * __CFDataSearchBoyerMoore(const CFDataRef data, const uint
 	_computeGoodSubstringShift(needle, needleLength, goodSubstringShift, suffixLengths);
     }
     
+    free(suffixLengths);
+}
+
+static const uint8_t * __CFDataSearchBoyerMoore(const uint8_t *haystack, unsigned long haystackLength, const uint8_t *needle, unsigned long needleLength, Boolean backwards, const unsigned long *badCharacterShift, const unsigned long *goodSubstringShift) {
     const uint8_t *scan_needle;
     const uint8_t *scan_haystack;
     const uint8_t *result = NULL;
@@ -754,19 +1007,120 @@ static const uint8_t * __CFDataSearchBoyerMoore(const CFDataRef data, const uint
 	    result = (scan_haystack + 1);
 	}
     }
-    
+    return result;
+}
+
+/* Needles up to this length are found by filtering candidate positions on their first and last bytes; longer ones use Boyer-Moore */
+#define SHORT_NEEDLE_MAX 32
+
+static const uint8_t *__CFDataSearchByte(const uint8_t *haystack, unsigned long haystackLength, uint8_t byte, Boolean backwards) {
+    if (!backwards) return (const uint8_t *)memchr(haystack, byte, haystackLength);
+    for (const uint8_t *scan = haystack + haystackLength; scan-- > haystack;) {
+	if (*scan == byte) return scan;
+    }
+    return NULL;
+}
+
+CF_INLINE Boolean __CFDataMatchesShortNeedleAt(const uint8_t *candidate, const uint8_t *needle, unsigned long needleLength) {
+    return candidate[0] == needle[0] && candidate[needleLength - 1] == needle[needleLength - 1] && 0 == memcmp(candidate + 1, needle + 1, needleLength - 2);
+}
+
+#if defined(__SSE2__)
+/* Compare 16 candidates at once: one load at the candidate and one at its last byte. Candidate i of the block is bit i of the mask. */
+#define __CFDATA_SEARCH_VECTOR 1
+#define __kCFDataCandidateMaskStride 1
+#define __CFDataCandidateMaskSetUp(first, last) \
+    const __m128i firstBytes = _mm_set1_epi8((char)(first)); \
+    const __m128i lastBytes = _mm_set1_epi8((char)(last))
+#define __CFDataCandidateMask(start) ((uint64_t)(unsigned)_mm_movemask_epi8(_mm_and_si128( \
+	    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(haystack + (start))), firstBytes), \
+	    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(haystack + (start) + needleLength - 1)), lastBytes))))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+/* NEON has no movemask; narrowing each 16-bit lane of the comparison by 4 leaves a nibble per byte in 64 bits. Candidate i of the block is bit 4i + 3 of the mask. */
+#define __CFDATA_SEARCH_VECTOR 1
+#define __kCFDataCandidateMaskStride 4
+#define __CFDataCandidateMaskSetUp(first, last) \
+    const uint8x16_t firstBytes = vdupq_n_u8(first); \
+    const uint8x16_t lastBytes = vdupq_n_u8(last)
+#define __CFDataCandidateMask(start) (0x8888888888888888ULL & vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8( \
+	    vceqq_u8(vld1q_u8(haystack + (start)), firstBytes), \
+	    vceqq_u8(vld1q_u8(haystack + (start) + needleLength - 1), lastBytes))), 4)), 0))
+#endif
+
+/* needleLength must be at least 2 and no greater than haystackLength */
+static const uint8_t *__CFDataSearchShortNeedle(const uint8_t *haystack, unsigned long haystackLength, const uint8_t *needle, unsigned long needleLength, Boolean backwards) {
+    // Candidates are the offsets 0 through lastStart
+    unsigned long lastStart = haystackLength - needleLength;
+#if __CFDATA_SEARCH_VECTOR
+    __CFDataCandidateMaskSetUp(needle[0], needle[needleLength - 1]);
+#endif
+    if (!backwards) {
+	unsigned long idx = 0;
+#if __CFDATA_SEARCH_VECTOR
+	for (; idx + 16 <= lastStart + 1; idx += 16) {
+	    uint64_t mask = __CFDataCandidateMask(idx);
+	    while (mask) {
+		unsigned long candidate = idx + __builtin_ctzll(mask) / __kCFDataCandidateMaskStride;
+		if (0 == memcmp(haystack + candidate + 1, needle + 1, needleLength - 2)) return haystack + candidate;
+		mask &= mask - 1;
+	    }
+	}
+#endif
+	for (; idx <= lastStart; idx++) {
+	    if (__CFDataMatchesShortNeedleAt(haystack + idx, needle, needleLength)) return haystack + idx;
+	}
+    } else {
+	// Number of candidates not yet examined, counting down from lastStart
+	unsigned long remaining = lastStart + 1;
+#if __CFDATA_SEARCH_VECTOR
+	for (; remaining >= 16; remaining -= 16) {
+	    unsigned long blockStart = remaining - 16;
+	    uint64_t mask = __CFDataCandidateMask(blockStart);
+	    while (mask) {
+		unsigned bit = 63 - __builtin_clzll(mask);
+		unsigned long candidate = blockStart + bit / __kCFDataCandidateMaskStride;
+		if (0 == memcmp(haystack + candidate + 1, needle + 1, needleLength - 2)) return haystack + candidate;
+		mask &= ~(1ULL << bit);
+	    }
+	}
+#endif
+	while (remaining-- > 0) {
+	    if (__CFDataMatchesShortNeedleAt(haystack + remaining, needle, needleLength)) return haystack + remaining;
+	}
+    }
+    return NULL;
+}
+
+#if __CFDATA_SEARCH_VECTOR
+#undef __CFDATA_SEARCH_VECTOR
+#undef __kCFDataCandidateMaskStride
+#undef __CFDataCandidateMaskSetUp
+#undef __CFDataCandidateMask
+#endif
+
+/* Picks a strategy by needle length. tables are precomputed Boyer-Moore tables for long needles (bad character shifts followed by good substring shifts), or NULL to build them for this search. */
+static const uint8_t *__CFDataSearch(CFTypeRef obj, const uint8_t *haystack, unsigned long haystackLength, const uint8_t *needle, unsigned long needleLength, Boolean backwards, const unsigned long *tables) {
+    if (1 == needleLength) {
+	return __CFDataSearchByte(haystack, haystackLength, needle[0], backwards);
+    } else if (needleLength <= SHORT_NEEDLE_MAX) {
+	return __CFDataSearchShortNeedle(haystack, haystackLength, needle, needleLength, backwards);
+    } else if (tables) {
+	return __CFDataSearchBoyerMoore(haystack, haystackLength, needle, needleLength, backwards, tables, tables + UCHAR_MAX + 1);
+    }
+    unsigned long badCharacterShift[UCHAR_MAX + 1];
+    unsigned long *goodSubstringShift = (unsigned long *)malloc(needleLength * sizeof(unsigned long));
+    if (!goodSubstringShift) {
+	__CFDataHandleOutOfMemory(obj, needleLength * sizeof(unsigned long));
+    }
+    __CFDataComputeBoyerMooreTables(obj, needle, needleLength, backwards, badCharacterShift, goodSubstringShift);
+    const uint8_t *result = __CFDataSearchBoyerMoore(haystack, haystackLength, needle, needleLength, backwards, badCharacterShift, goodSubstringShift);
     free(goodSubstringShift);
-    free(suffixLengths);
-    
     return result;
 }
 
-CFRange _CFDataFindBytes(CFDataRef data, CFDataRef dataToFind, CFRange searchRange, CFDataSearchFlags compareOptions) {
-    const uint8_t *fullHaystack = CFDataGetBytePtr(data);
-    const uint8_t *needle = CFDataGetBytePtr(dataToFind);
-    unsigned long fullHaystackLength = CFDataGetLength(data);
-    unsigned long needleLength = CFDataGetLength(dataToFind);
-    
+/* Clamps searchRange to the haystack and applies the anchored option. Returns false if the needle cannot occur in the range. */
+static Boolean __CFDataPrepareSearchRange(unsigned long fullHaystackLength, unsigned long needleLength, CFRange *searchRangePtr, CFDataSearchFlags compareOptions) {
+    CFRange searchRange = *searchRangePtr;
     if(compareOptions & kCFDataSearchAnchored) {
 	if(searchRange.length > needleLength) {
 	    if(compareOptions & kCFDataSearchBackwards) {
@@ -778,13 +1132,22 @@ CFRange _CFDataFindBytes(CFDataRef data, CFDataRef dataToFind, CFRange searchRan
     if(searchRange.length > fullHaystackLength - searchRange.location) {
 	searchRange.length = fullHaystackLength - searchRange.location;
     }
+    *searchRangePtr = searchRange;
+    return !(searchRange.length < needleLength || fullHaystackLength == 0 || needleLength == 0);
+}
+
+CFRange _CFDataFindBytes(CFDataRef data, CFDataRef dataToFind, CFRange searchRange, CFDataSearchFlags compareOptions) {
+    const uint8_t *fullHaystack = CFDataGetBytePtr(data);
+    const uint8_t *needle = CFDataGetBytePtr(dataToFind);
+    unsigned long fullHaystackLength = CFDataGetLength(data);
+    unsigned long needleLength = CFDataGetLength(dataToFind);
     
-    if(searchRange.length < needleLength || fullHaystackLength == 0 || needleLength == 0) {
+    if (!__CFDataPrepareSearchRange(fullHaystackLength, needleLength, &searchRange, compareOptions)) {
 	return CFRangeMake(kCFNotFound, 0);
     }
 	
     const uint8_t *haystack = fullHaystack + searchRange.location;
-    const uint8_t *searchResult = __CFDataSearchBoyerMoore(data, haystack, searchRange.length, needle, needleLength, (compareOptions & kCFDataSearchBackwards) != 0);
+    const uint8_t *searchResult = __CFDataSearch(data, haystack, searchRange.length, needle, needleLength, (compareOptions & kCFDataSearchBackwards) != 0, NULL);
     CFIndex resultLocation = (searchResult == NULL) ? kCFNotFound : searchRange.location + (searchResult - haystack);
     
     return CFRangeMake(resultLocation, resultLocation == kCFNotFound ? 0: needleLength);
@@ -799,8 +1162,98 @@ CFRange CFDataFind(CFDataRef data, CFDataRef dataToFind, CFRange searchRange, CF
     return _CFDataFindBytes(data, dataToFind, searchRange, compareOptions);
 }
 
+#pragma mark -
+#pragma mark CFDataSearcher
+
+/* A searcher owns a copy of its needle and, for needles too long for the short needle filter, the Boyer-Moore tables for its direction, so repeated searches skip all setup. */
+struct __CFDataSearcher {
+    CFRuntimeBase _base;
+    CFDataSearchFlags _options;
+    CFIndex _needleLength;
+    uint8_t *_needle;
+    unsigned long *_badCharacterShift;	/* UCHAR_MAX + 1 entries, followed by the good substring table; NULL for short needles */
+};
+
+static void __CFDataSearcherDeallocate(CFTypeRef cf) {
+    struct __CFDataSearcher *searcher = (struct __CFDataSearcher *)cf;
+    CFAllocatorRef allocator = __CFGetAllocator(searcher);
+    if (searcher->_needle) CFAllocatorDeallocate(allocator, searcher->_needle);
+    if (searcher->_badCharacterShift) CFAllocatorDeallocate(allocator, searcher->_badCharacterShift);
+}
+
+static CFStringRef __CFDataSearcherCopyDescription(CFTypeRef cf) {
+    CFDataSearcherRef searcher = (CFDataSearcherRef)cf;
+    return CFStringCreateWithFormat(CFGetAllocator(searcher), NULL, CFSTR("<CFDataSearcher %p [%p]>{needle length = %ld, options = 0x%lx}"), cf, CFGetAllocator(searcher), (long)searcher->_needleLength, (unsigned long)searcher->_options);
+}
+
+static CFTypeID __kCFDataSearcherTypeID = _kCFRuntimeNotATypeID;
+
+static const CFRuntimeClass __CFDataSearcherClass = {
+    0,
+    "CFDataSearcher",
+    NULL,	// init
+    NULL,	// copy
+    __CFDataSearcherDeallocate,
+    NULL,	// equal
+    NULL,	// hash
+    NULL,	//
+    __CFDataSearcherCopyDescription
+};
+
+CFTypeID CFDataSearcherGetTypeID(void) {
+    static dispatch_once_t initOnce;
+    dispatch_once(&initOnce, ^{ __kCFDataSearcherTypeID = _CFRuntimeRegisterClass(&__CFDataSearcherClass); });
+    return __kCFDataSearcherTypeID;
+}
+
+CFDataSearcherRef CFDataSearcherCreate(CFAllocatorRef allocator, CFDataRef dataToFind, CFDataSearchFlags compareOptions) {
+    __CFGenericValidateType(dataToFind, CFDataGetTypeID());
+    CFIndex needleLength = CFDataGetLength(dataToFind);
+    struct __CFDataSearcher *memory = (struct __CFDataSearcher *)_CFRuntimeCreateInstance(allocator, CFDataSearcherGetTypeID(), sizeof(struct __CFDataSearcher) - sizeof(CFRuntimeBase), NULL);
+    if (NULL == memory) {
+	return NULL;
+    }
+    allocator = __CFGetAllocator(memory);
+    memory->_options = compareOptions;
+    memory->_needleLength = needleLength;
+    memory->_needle = NULL;
+    memory->_badCharacterShift = NULL;
+    if (0 < needleLength) {
+	memory->_needle = (uint8_t *)CFAllocatorAllocate(allocator, needleLength, 0);
+	if (NULL == memory->_needle) __CFDataHandleOutOfMemory(memory, needleLength);
+	if (__CFOASafe) __CFSetLastAllocationEventName(memory->_needle, "CFDataSearcher (needle)");
+	memmove(memory->_needle, CFDataGetBytePtr(dataToFind), needleLength);
+    }
+    if (SHORT_NEEDLE_MAX < needleLength) {
+	CFIndex size = (UCHAR_MAX + 1 + needleLength) * sizeof(unsigned long);
+	memory->_badCharacterShift = (unsigned long *)CFAllocatorAllocate(allocator, size, 0);
+	if (NULL == memory->_badCharacterShift) __CFDataHandleOutOfMemory(memory, size);
+	if (__CFOASafe) __CFSetLastAllocationEventName(memory->_badCharacterShift, "CFDataSearcher (tables)");
+	__CFDataComputeBoyerMooreTables(memory, memory->_needle, needleLength, (compareOptions & kCFDataSearchBackwards) != 0, memory->_badCharacterShift, memory->_badCharacterShift + UCHAR_MAX + 1);
+    }
+    return memory;
+}
+
+CFRange CFDataSearcherFind(CFDataSearcherRef searcher, CFDataRef data, CFRange searchRange) {
+    __CFGenericValidateType(searcher, CFDataSearcherGetTypeID());
+    __CFGenericValidateType(data, CFDataGetTypeID());
+    __CFDataValidateRange(data, searchRange, __PRETTY_FUNCTION__);
+    unsigned long needleLength = searcher->_needleLength;
+    const uint8_t *needle = searcher->_needle;
+    if (!__CFDataPrepareSearchRange(CFDataGetLength(data), needleLength, &searchRange, searcher->_options)) {
+	return CFRangeMake(kCFNotFound, 0);
+    }
+    
+    const uint8_t *haystack = CFDataGetBytePtr(data) + searchRange.location;
+    const uint8_t *searchResult = __CFDataSearch(searcher, haystack, searchRange.length, needle, needleLength, (searcher->_options & kCFDataSearchBackwards) != 0, searcher->_badCharacterShift);
+    CFIndex resultLocation = (searchResult == NULL) ? kCFNotFound : searchRange.location + (searchResult - haystack);
+    
+    return CFRangeMake(resultLocation, resultLocation == kCFNotFound ? 0: needleLength);
+}
+
 #undef __CFDataValidateRange
 #undef __CFGenericValidateMutabilityFlags
 #undef INLINE_BYTES_THRESHOLD
 #undef CFDATA_MAX_SIZE
 #undef REVERSE_BUFFER
+#undef SHORT_NEEDLE_MAX
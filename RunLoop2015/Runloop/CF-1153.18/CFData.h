@@ -48,6 +48,11 @@ CFDataRef CFDataCreateWithBytesNoCopy(CFAllocatorRef allocator, const UInt8 *byt
 
 CF_EXPORT
 CFDataRef CFDataCreateCopy(CFAllocatorRef allocator, CFDataRef theData);
+    /* Copies of immutable datas share their bytes; mutable copies made with CFDataCreateMutableCopy share them until their first mutation */
+
+CF_EXPORT
+CFDataRef CFDataCreateWithSubrange(CFAllocatorRef allocator, CFDataRef theData, CFRange range);
+    /* If theData is immutable the result shares its bytes rather than copying them, and keeps theData alive for as long as it exists. */
 
 CF_EXPORT
 CFMutableDataRef CFDataCreateMutable(CFAllocatorRef allocator, CFIndex capacity);
@@ -82,6 +87,14 @@ void CFDataReplaceBytes(CFMutableDataRef theData, CFRange range, const UInt8 *ne
 CF_EXPORT
 void CFDataDeleteBytes(CFMutableDataRef theData, CFRange range);
 
+CF_EXPORT
+void CFDataReserveCapacity(CFMutableDataRef theData, CFIndex capacity);
+    /* Grows the store of a growable data to hold at least capacity bytes without changing its length, so that appends up to that size do not reallocate. Has no effect on fixed-capacity datas. */
+
+CF_EXPORT
+void CFDataSetGrowthFactor(CFMutableDataRef theData, CFIndex percent);
+    /* Sets the geometric growth of a growable data: each time the store fills, it grows to percent% of its previous capacity (150 grows by half). Values of 100 or less restore the default policy. */
+
 typedef CF_OPTIONS(CFOptionFlags, CFDataSearchFlags) {
     kCFDataSearchBackwards = 1UL << 0,
     kCFDataSearchAnchored = 1UL << 1
@@ -90,6 +103,20 @@ typedef CF_OPTIONS(CFOptionFlags, CFDataSearchFlags) {
 CF_EXPORT
 CFRange CFDataFind(CFDataRef theData, CFDataRef dataToFind, CFRange searchRange, CFDataSearchFlags compareOptions) CF_AVAILABLE(10_6, 4_0);
 
+/* A CFDataSearcher holds a needle prepared for repeated CFDataFind-style searches in one direction. */
+typedef const struct __CFDataSearcher * CFDataSearcherRef;
+
+CF_EXPORT
+CFTypeID CFDataSearcherGetTypeID(void);
+
+CF_EXPORT
+CFDataSearcherRef CFDataSearcherCreate(CFAllocatorRef allocator, CFDataRef dataToFind, CFDataSearchFlags compareOptions);
+    /* The needle bytes are copied. compareOptions apply to every search made with the searcher. */
+
+CF_EXPORT
+CFRange CFDataSearcherFind(CFDataSearcherRef searcher, CFDataRef theData, CFRange searchRange);
+    /* Same result as CFDataFind(theData, dataToFind, searchRange, compareOptions) with the searcher's needle and options. */
+
 CF_EXTERN_C_END
 CF_IMPLICIT_BRIDGING_DISABLED
 
@@ -103,21 +103,61 @@ struct __CFDate {
     CFAbsoluteTime _time;       /* immutable */
 };
 
+#if CF_TAGGED_POINTERS
+/* A tagged date holds its time in the 60-bit payload: the sign, the
+   exponent narrowed to 7 bits, and the full 52-bit fraction. Zero and
+   every time of magnitude 2^-62 to 2^65 seconds fit without loss.
+*/
+#define __kCFTaggedDateExponentBias 960
+#define __kCFTaggedDateFractionMask 0xFFFFFFFFFFFFFULL
+
+static CFDateRef __CFDateCreateTagged(CFAbsoluteTime at) {
+    uint64_t bits;
+    memmove(&bits, &at, sizeof(bits));
+    uint64_t exponent = (bits >> 52) & 0x7FF;
+    uint64_t fraction = bits & __kCFTaggedDateFractionMask;
+    uint64_t narrowed;
+    if (0 == exponent && 0 == fraction) {
+        narrowed = 0;
+    } else if (__kCFTaggedDateExponentBias < exponent && exponent < __kCFTaggedDateExponentBias + 0x80) {
+        narrowed = exponent - __kCFTaggedDateExponentBias;
+    } else {
+        return NULL;
+    }
+    return (CFDateRef)__CFTaggedPointerCreate(__kCFTaggedPointerDate, ((bits >> 63) << 59) | (narrowed << 52) | fraction);
+}
+#endif
+
+CF_INLINE CFAbsoluteTime __CFDateGetTime(CFDateRef date) {
+#if CF_TAGGED_POINTERS
+    if (__CFIsTaggedPointer(date)) {
+        uint64_t payload = __CFTaggedPointerGetPayload(date);
+        uint64_t narrowed = (payload >> 52) & 0x7F;
+        uint64_t exponent = narrowed ? narrowed + __kCFTaggedDateExponentBias : 0;
+        uint64_t bits = ((payload >> 59) << 63) | (exponent << 52) | (payload & __kCFTaggedDateFractionMask);
+        CFAbsoluteTime at;
+        memmove(&at, &bits, sizeof(at));
+        return at;
+    }
+#endif
+    return date->_time;
+}
+
 static Boolean __CFDateEqual(CFTypeRef cf1, CFTypeRef cf2) {
     CFDateRef date1 = (CFDateRef)cf1;
     CFDateRef date2 = (CFDateRef)cf2;
-    if (date1->_time != date2->_time) return false;
+    if (__CFDateGetTime(date1) != __CFDateGetTime(date2)) return false;
     return true;
 }
 
 static CFHashCode __CFDateHash(CFTypeRef cf) {
     CFDateRef date = (CFDateRef)cf;
-    return (CFHashCode)(float)floor(date->_time);
+    return (CFHashCode)(float)floor(__CFDateGetTime(date));
 }
 
 static CFStringRef __CFDateCopyDescription(CFTypeRef cf) {
     CFDateRef date = (CFDateRef)cf;
-    return CFStringCreateWithFormat(CFGetAllocator(date), NULL, CFSTR("<CFDate %p [%p]>{time = %0.09g}"), cf, CFGetAllocator(date), date->_time);
+    return CFStringCreateWithFormat(CFGetAllocator(date), NULL, CFSTR("<CFDate %p [%p]>{time = %0.09g}"), cf, CFGetAllocator(date), __CFDateGetTime(date));
 }
 
 static CFTypeID __kCFDateTypeID = _kCFRuntimeNotATypeID;
@@ -138,6 +178,9 @@ CFTypeID CFDateGetTypeID(void) {
     static dispatch_once_t initOnce;
     dispatch_once(&initOnce, ^{
         __kCFDateTypeID = _CFRuntimeRegisterClass(&__CFDateClass); 
+#if CF_TAGGED_POINTERS
+        __CFTaggedPointerTypeIDs[__kCFTaggedPointerDate] = __kCFDateTypeID;
+#endif
 
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI
     struct mach_timebase_info info;
@@ -168,6 +211,13 @@ CFTypeID CFDateGetTypeID(void) {
 CFDateRef CFDateCreate(CFAllocatorRef allocator, CFAbsoluteTime at) {
     CFDateRef memory; 
     uint32_t size;
+#if CF_TAGGED_POINTERS
+    if (_CFAllocatorIsSystemDefault(allocator)) {
+        CFDateGetTypeID();	// registers the tag
+        memory = __CFDateCreateTagged(at);
+        if (memory) return memory;
+    }
+#endif
     size = sizeof(struct __CFDate) - sizeof(CFRuntimeBase);
     memory = (CFDateRef)_CFRuntimeCreateInstance(allocator, CFDateGetTypeID(), size, NULL);
     if (NULL == memory) {
@@ -180,22 +230,23 @@ CFDateRef CFDateCreate(CFAllocatorRef allocator, CFAbsoluteTime at) {
 CFTimeInterval CFDateGetAbsoluteTime(CFDateRef date) {
     CF_OBJC_FUNCDISPATCHV(CFDateGetTypeID(), CFTimeInterval, (NSDate *)date, timeIntervalSinceReferenceDate);
     __CFGenericValidateType(date, CFDateGetTypeID());
-    return date->_time;
+    return __CFDateGetTime(date);
 }
 
 CFTimeInterval CFDateGetTimeIntervalSinceDate(CFDateRef date, CFDateRef otherDate) {
     CF_OBJC_FUNCDISPATCHV(CFDateGetTypeID(), CFTimeInterval, (NSDate *)date, timeIntervalSinceDate:(NSDate *)otherDate);
     __CFGenericValidateType(date, CFDateGetTypeID());
     __CFGenericValidateType(otherDate, CFDateGetTypeID());
-    return date->_time - otherDate->_time;
+    return __CFDateGetTime(date) - __CFDateGetTime(otherDate);
 }   
     
 CFComparisonResult CFDateCompare(CFDateRef date, CFDateRef otherDate, void *context) {
     CF_OBJC_FUNCDISPATCHV(CFDateGetTypeID(), CFComparisonResult, (NSDate *)date, compare:(NSDate *)otherDate);
     __CFGenericValidateType(date, CFDateGetTypeID());
     __CFGenericValidateType(otherDate, CFDateGetTypeID());
-    if (date->_time < otherDate->_time) return kCFCompareLessThan;
-    if (date->_time > otherDate->_time) return kCFCompareGreaterThan;
+    CFAbsoluteTime time = __CFDateGetTime(date), otherTime = __CFDateGetTime(otherDate);
+    if (time < otherTime) return kCFCompareLessThan;
+    if (time > otherTime) return kCFCompareGreaterThan;
     return kCFCompareEqualTo;
 }
 
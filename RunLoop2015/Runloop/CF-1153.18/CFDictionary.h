@@ -146,6 +146,19 @@ const CFDictionaryKeyCallBacks kCFTypeDictionaryKeyCallBacks;
 CF_EXPORT
 const CFDictionaryKeyCallBacks kCFCopyStringDictionaryKeyCallBacks;
 
+/*!
+	@constant kCFLongStringDictionaryKeyCallBacks
+	Predefined CFDictionaryKeyCallBacks structure containing a
+	set of callbacks appropriate for use when the keys of a
+	CFDictionary are all CFStrings which may be long and share
+	long common prefixes or suffixes, such as URLs or paths.
+	The keys are copied as with kCFCopyStringDictionaryKeyCallBacks,
+	but they are hashed over all of their characters rather than
+	over their first, middle and last 32 characters only.
+*/
+CF_EXPORT
+const CFDictionaryKeyCallBacks kCFLongStringDictionaryKeyCallBacks;
+
 /*!
 	@typedef CFDictionaryValueCallBacks
 	Structure containing the callbacks for values of a CFDictionary.
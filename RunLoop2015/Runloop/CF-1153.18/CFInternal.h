@@ -217,7 +217,10 @@ enum {
 	__CFTSDKeyRunLoopCntr = 11,
         __CFTSDKeyMachMessageBoost = 12, // valid only in the context of a CFMachPort callout
         __CFTSDKeyMachMessageHasVoucher = 13,
+	__CFTSDKeyObjectCache = 14,
+	__CFTSDKeyBiasedRefCount = 15,
 	// autorelease pool stuff must be higher than run loop constants
+	__CFTSDKeyReleasePool = 60,
 	__CFTSDKeyAutoreleaseData2 = 61,
 	__CFTSDKeyAutoreleaseData1 = 62,
 	__CFTSDKeyExceptionData = 63,
@@ -287,6 +290,16 @@ CF_EXPORT void _CFAllocatorDeallocateGC(CFAllocatorRef allocator, void *ptr);
 
 CF_EXPORT CFAllocatorRef _CFTemporaryMemoryAllocator(void);
 
+// True for arenas created with kCFAllocatorArenaOwnsObjects: their objects neither retain the allocator nor get finalized
+CF_PRIVATE Boolean __CFAllocatorIsObjectOwningArena(CFAllocatorRef allocator);
+
+// True if nothing has been autoreleased into the given pool of the calling thread since it was pushed
+CF_PRIVATE Boolean __CFReleasePoolIsEmpty(void *pool);
+
+// Called by classes with _kCFRuntimeFinalizesOnAnyThread for each allocator an instance's finalizer will free memory
+// with or release; unless it is one of CF's own, CFReleasePoolPop() then always finalizes the instance in place
+CF_PRIVATE void __CFRuntimeNoteFinalizerAllocator(CFTypeRef cf, CFAllocatorRef allocator);
+
 extern uint64_t __CFTimeIntervalToTSR(CFTimeInterval ti);
 extern CFTimeInterval __CFTSRToTimeInterval(uint64_t tsr);
 // use this instead of attempting to subtract mach_absolute_time() directly, because that can underflow and give an unexpected answer
@@ -364,6 +377,46 @@ CF_PRIVATE const CFStringRef S = (CFStringRef) & __ ## S ## __;
 CF_EXPORT bool __CFOASafe;
 CF_EXPORT void __CFSetLastAllocationEventName(void *ptr, const char *classname);
 
+#if DEPLOYMENT_TARGET_LINUX
+#define __CFRUNTIME_ALLOCATION_PROFILER 1
+#endif
+
+#if __CFRUNTIME_ALLOCATION_PROFILER
+#define __kCFAllocationProfilerFilterSize (1 << 14)
+
+extern Boolean __CFAllocationProfilerEnabled;
+// Counted down on every allocation, profiling or not; the one that exhausts
+// it calls __CFAllocationProfilerSample(), which refills it. Initial-exec, so
+// that the check does not call __tls_get_addr.
+extern __thread int64_t __CFAllocationProfilerBudget __attribute__((tls_model("initial-exec")));
+// Frees only look at the filter while some sample is live
+extern CFIndex __CFAllocationProfilerLiveSamples;
+// A bit per hash of the addresses of live samples, so most frees check a single bit
+extern volatile uint8_t __CFAllocationProfilerFilter[__kCFAllocationProfilerFilterSize / 8];
+CF_PRIVATE void __CFAllocationProfilerSample(void *ptr, CFIndex size);
+CF_PRIVATE void __CFAllocationProfilerRecordFree(void *ptr);
+
+CF_INLINE uintptr_t __CFAllocationProfilerHashPointer(void *ptr) {
+    uintptr_t h = (uintptr_t)ptr;
+    return ((h >> 4) ^ (h >> 18)) % __kCFAllocationProfilerFilterSize;
+}
+
+CF_INLINE Boolean __CFAllocationProfilerMayBeSampled(void *ptr) {
+    uintptr_t h = __CFAllocationProfilerHashPointer(ptr);
+    return (__CFAllocationProfilerFilter[h >> 3] >> (h & 7)) & 1;
+}
+
+#define __CFAllocationProfilerAllocate(P, S) do { \
+    if (__builtin_expect((__CFAllocationProfilerBudget -= (S)) <= 0, 0)) __CFAllocationProfilerSample(P, S); \
+} while (0)
+#define __CFAllocationProfilerDeallocate(P) do { \
+    if (__builtin_expect(0 != __CFAllocationProfilerLiveSamples, 0) && (P) && __builtin_expect(__CFAllocationProfilerMayBeSampled(P), 0)) __CFAllocationProfilerRecordFree(P); \
+} while (0)
+#else
+#define __CFAllocationProfilerAllocate(P, S) do { } while (0)
+#define __CFAllocationProfilerDeallocate(P) do { } while (0)
+#endif
+
 
 
 /* Comparators are passed the address of the values; this is somewhat different than CFComparatorFunction is used in public API usually. */
@@ -379,6 +432,27 @@ extern const void *__CFStringCollectionCopy(CFAllocatorRef allocator, const void
 extern const void *__CFTypeCollectionRetain(CFAllocatorRef allocator, const void *ptr);
 extern void __CFTypeCollectionRelease(CFAllocatorRef allocator, const void *ptr);
 
+/* Releases the contents of a collection whose release callback is
+   __CFTypeCollectionRelease. Unless batching is off (the default; see
+   _CFRuntimeSetBatchedCollectionReleaseEnabled), each object added is
+   decremented right away unless that drops its last reference; those are
+   held until Finish, then finalized grouped by type, so each finalizer
+   runs over its objects together instead of interleaved with the rest of
+   the teardown. With batching off, each object is released as it is
+   added. */
+typedef struct {
+    CFAllocatorRef _allocator;
+    Boolean _direct;		// release each object as it is added
+    CFIndex _count;
+    CFIndex _capacity;
+    CFTypeRef *_objects;
+    CFTypeRef _buffer[32];
+} __CFTypeCollectionReleaseBatch;
+
+CF_PRIVATE void __CFTypeCollectionReleaseBatchInit(__CFTypeCollectionReleaseBatch *batch, CFAllocatorRef allocator, CFIndex countHint);
+CF_PRIVATE void __CFTypeCollectionReleaseBatchAdd(__CFTypeCollectionReleaseBatch *batch, CFTypeRef cf);
+CF_PRIVATE void __CFTypeCollectionReleaseBatchFinish(__CFTypeCollectionReleaseBatch *batch);
+
 extern CFTypeRef CFMakeUncollectable(CFTypeRef cf);
 
 CF_PRIVATE void _CFRaiseMemoryException(CFStringRef reason);
@@ -661,6 +735,47 @@ CF_PRIVATE CFComparisonResult _CFCompareStringsWithLocale(CFStringInlineBuffer *
 CF_PRIVATE CFArrayRef _CFBundleCopyUserLanguages();
 
 
+/* Tagged pointers. On 64-bit Linux no Objective-C runtime claims the low
+   bits of object pointers, so small immutable values are encoded in the
+   pointer itself: bit 0 is set, bits 3..1 hold the tag, and bits 63..4 the
+   payload. Real instances are at least 8-byte aligned and never have bit 0
+   set. Tagged instances have no CFRuntimeBase; they are never allocated,
+   and retaining or releasing them does nothing. Only the runtime and the
+   class that owns a tag may look inside one.
+*/
+#if DEPLOYMENT_TARGET_LINUX && __LP64__
+#define CF_TAGGED_POINTERS 1
+#endif
+
+enum {
+    __kCFTaggedPointerNumber = 1,	// integers of up to 56 bits; see CFNumber.c
+    __kCFTaggedPointerDate = 2,		// see CFDate.c
+    __kCFTaggedPointerTagCount = 8
+};
+
+#if CF_TAGGED_POINTERS
+extern CFTypeID __CFTaggedPointerTypeIDs[__kCFTaggedPointerTagCount];	// set when the owning class registers
+
+CF_INLINE Boolean __CFIsTaggedPointer(const void *cf) {
+    return ((uintptr_t)cf & 0x1) != 0;
+}
+
+CF_INLINE uintptr_t __CFTaggedPointerGetTag(const void *cf) {
+    return ((uintptr_t)cf >> 1) & 0x7;
+}
+
+CF_INLINE uint64_t __CFTaggedPointerGetPayload(const void *cf) {
+    return (uint64_t)(uintptr_t)cf >> 4;
+}
+
+// Bits of payload above the low 60 are dropped
+CF_INLINE const void *__CFTaggedPointerCreate(uintptr_t tag, uint64_t payload) {
+    return (const void *)(uintptr_t)((payload << 4) | (tag << 1) | 0x1);
+}
+#else
+#define __CFIsTaggedPointer(cf) (0)
+#endif
+
 // This should only be used in CF types, not toll-free bridged objects!
 // It should not be used with CFAllocator arguments!
 // Use CFGetAllocator() in the general case, and this inline function in a few limited (but often called) situations.
@@ -669,6 +784,11 @@ CF_INLINE CFAllocatorRef __CFGetAllocator(CFTypeRef cf) {	// !!! Use with CF typ
     if (_objc_isTaggedPointer(cf)) {
         return kCFAllocatorSystemDefault;
     }
+#endif
+#if CF_TAGGED_POINTERS
+    if (__CFIsTaggedPointer(cf)) {
+        return kCFAllocatorSystemDefault;
+    }
 #endif
     if (__builtin_expect(__CFBitfieldGetValue(((const CFRuntimeBase *)cf)->_cfinfo[CF_INFO_BITS], 7, 7), 1)) {
 	return kCFAllocatorSystemDefault;
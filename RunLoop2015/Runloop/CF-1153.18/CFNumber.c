@@ -423,10 +423,32 @@ static const struct {
     /* kCFNumberSInt128Type */	{kCFNumberSInt128Type, 0, 1, 4, 0},
 };
 
+#if CF_TAGGED_POINTERS
+/* A tagged number is an integer of up to 56 bits. Its canonical type
+   is in bits 7..4 of the pointer and its value in bits 63..8.
+*/
+#define __kCFTaggedNumberMin (-(1LL << 55))
+#define __kCFTaggedNumberMax ((1LL << 55) - 1)
+#endif
+
 CF_INLINE CFNumberType __CFNumberGetType(CFNumberRef num) {
+#if CF_TAGGED_POINTERS
+    if (__CFIsTaggedPointer(num)) return (CFNumberType)(__CFTaggedPointerGetPayload(num) & 0xF);
+#endif
     return __CFBitfieldGetValue(num->_base._cfinfo[CF_INFO_BITS], 4, 0);
 }
 
+// The value of a tagged number is unpacked into *buffer, which it fills as _pad would
+CF_INLINE const void *__CFNumberGetStorage(CFNumberRef num, int64_t *buffer) {
+#if CF_TAGGED_POINTERS
+    if (__CFIsTaggedPointer(num)) {
+        *buffer = (int64_t)(intptr_t)num >> 8;
+        return buffer;
+    }
+#endif
+    return &(num->_pad);
+}
+
 #define CVT(SRC_TYPE, DST_TYPE, DST_MIN, DST_MAX) do { \
 	SRC_TYPE sv; memmove(&sv, data, sizeof(SRC_TYPE)); \
 	DST_TYPE dv = (sv < DST_MIN) ? (DST_TYPE)DST_MIN : (DST_TYPE)(((DST_MAX < sv) ? DST_MAX : sv)); \
@@ -454,7 +476,8 @@ CF_INLINE CFNumberType __CFNumberGetType(CFNumberRef num) {
 static Boolean __CFNumberGetValue(CFNumberRef number, CFNumberType type, void *valuePtr) {
     type = __CFNumberTypeTable[type].canonicalType;
     CFNumberType ntype = __CFNumberGetType(number);
-    const void *data = &(number->_pad);
+    int64_t tagged;
+    const void *data = __CFNumberGetStorage(number, &tagged);
     switch (type) {
     case kCFNumberSInt8Type:
 	if (__CFNumberTypeTable[ntype].floatBit) {
@@ -644,7 +667,8 @@ static Boolean __CFNumberGetValue(CFNumberRef number, CFNumberType type, void *v
 static Boolean __CFNumberGetValueCompat(CFNumberRef number, CFNumberType type, void *valuePtr) {
     type = __CFNumberTypeTable[type].canonicalType;
     CFNumberType ntype = __CFNumberGetType(number);
-    const void *data = &(number->_pad);
+    int64_t tagged;
+    const void *data = __CFNumberGetStorage(number, &tagged);
     switch (type) {
     case kCFNumberSInt8Type:
 	if (__CFNumberTypeTable[ntype].floatBit) {
@@ -1011,6 +1035,9 @@ CFTypeID CFNumberGetTypeID(void) {
     static dispatch_once_t initOnce;
     dispatch_once(&initOnce, ^{
         __kCFNumberTypeID = _CFRuntimeRegisterClass(&__CFNumberClass); // initOnce covered
+#if CF_TAGGED_POINTERS
+        __CFTaggedPointerTypeIDs[__kCFTaggedPointerNumber] = __kCFNumberTypeID;
+#endif
 
         _CFRuntimeSetInstanceTypeIDAndIsa(&__kCFNumberNaN, __kCFNumberTypeID);
         __CFBitfieldSetValue(__kCFNumberNaN._base._cfinfo[CF_INFO_BITS], 4, 0, kCFNumberFloat64Type);
@@ -1051,6 +1078,24 @@ CFNumberRef CFNumberCreate(CFAllocatorRef allocator, CFNumberType type, const vo
     // been done (and now must for compatibility).
     int64_t valToBeCached = NotToBeCached;
 
+#if CF_TAGGED_POINTERS
+    // Integers that fit need no instance at all
+    if (!__CFNumberTypeTable[type].floatBit && _CFAllocatorIsSystemDefault(allocator) && (__CFNumberCaching != kCFNumberCachingFullyDisabled)) {
+	int64_t val = __kCFTaggedNumberMax + 1;
+	CFNumberType canonicalType = __CFNumberTypeTable[type].canonicalType;
+	switch (canonicalType) {
+	case kCFNumberSInt8Type:   val = *(int8_t *)valuePtr; break;
+	case kCFNumberSInt16Type:  val = *(int16_t *)valuePtr; break;
+	case kCFNumberSInt32Type:  val = *(int32_t *)valuePtr; break;
+	case kCFNumberSInt64Type:  val = *(int64_t *)valuePtr; break;
+	}
+	if (__kCFTaggedNumberMin <= val && val <= __kCFTaggedNumberMax) {
+	    CFNumberGetTypeID();	// registers the tag
+	    return (CFNumberRef)__CFTaggedPointerCreate(__kCFTaggedPointerNumber, ((uint64_t)val << 4) | (uint64_t)canonicalType);
+	}
+    }
+#endif
+
     if (__CFNumberTypeTable[type].floatBit) {
 	CFNumberRef cached = NULL;
 	if (0 == __CFNumberTypeTable[type].storageBit) {
@@ -564,6 +564,10 @@ CF_PRIVATE void __CFTSDLinuxInitialize() {
     (void)pthread_key_create(&__CFTSDIndexKey, __CFTSDFinalize);
 }
 
+// Mirrors the key's value so _CFGetTSD and _CFSetTSD reach the table with one static TLS load.
+// The key stays authoritative and still runs __CFTSDFinalize at thread exit.
+static __thread __CFTSDTable *__CFTSDCurrentTable __attribute__((tls_model("initial-exec"))) = NULL;
+
 #endif
 
 static void __CFTSDSetSpecific(void *arg) {
@@ -571,6 +575,7 @@ static void __CFTSDSetSpecific(void *arg) {
     _pthread_setspecific_direct(CF_TSD_KEY, arg);
 #elif DEPLOYMENT_TARGET_LINUX
     pthread_setspecific(__CFTSDIndexKey, arg);
+    __CFTSDCurrentTable = (__CFTSDTable *)arg;
 #elif DEPLOYMENT_TARGET_WINDOWS
     TlsSetValue(__CFTSDIndexKey, arg);
 #endif
@@ -717,6 +722,10 @@ CF_EXPORT void *_CFGetTSD(uint32_t slot) {
         _CFLogSimple(kCFLogLevelError, "Error: TSD slot %d out of range (get)", slot);
         HALT;
     }
+#if DEPLOYMENT_TARGET_LINUX
+    __CFTSDTable *cached = __CFTSDCurrentTable;
+    if (__builtin_expect(cached && cached != CF_TSD_BAD_PTR, 1)) return (void *)cached->data[slot];
+#endif
     __CFTSDTable *table = __CFTSDGetTable();
     if (!table) {
         // Someone is getting TSD during thread destruction. The table is gone, so we can't get any data anymore.
@@ -733,7 +742,12 @@ CF_EXPORT void *_CFSetTSD(uint32_t slot, void *newVal, tsdDestructor destructor)
         _CFLogSimple(kCFLogLevelError, "Error: TSD slot %d out of range (set)", slot);
         HALT;
     }
+#if DEPLOYMENT_TARGET_LINUX
+    __CFTSDTable *table = __CFTSDCurrentTable;
+    if (!table || table == CF_TSD_BAD_PTR) table = __CFTSDGetTable();
+#else
     __CFTSDTable *table = __CFTSDGetTable();
+#endif
     if (!table) {
         // Someone is setting TSD during thread destruction. The table is gone, so we can't get any data anymore.
         _CFLogSimple(kCFLogLevelWarning, "Warning: TSD slot %d set but the thread data has already been torn down.", slot);
@@ -1149,6 +1163,10 @@ bool OSAtomicCompareAndSwap64Barrier(int64_t oldValue, int64_t newValue, volatil
     return __sync_bool_compare_and_swap(theValue, oldValue, newValue);
 }
 
+int64_t OSAtomicAdd64Barrier( int64_t theAmount, volatile int64_t *theValue ) {
+    return __sync_fetch_and_add(theValue, theAmount) + theAmount;
+}
+
 int32_t OSAtomicDecrement32Barrier(volatile int32_t *dst)
 {
     return OSAtomicAdd32Barrier(-1, dst);
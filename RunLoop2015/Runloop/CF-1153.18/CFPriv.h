@@ -253,6 +253,14 @@ CF_EXPORT const CFStringRef _kCFSystemVersionBuildStringKey;		// Localized strin
 CF_EXPORT void CFMergeSortArray(void *list, CFIndex count, CFIndex elementSize, CFComparatorFunction comparator, void *context);
 CF_EXPORT void CFQSortArray(void *list, CFIndex count, CFIndex elementSize, CFComparatorFunction comparator, void *context);
 
+typedef CF_OPTIONS(CFOptionFlags, CFSortOptions) {
+    kCFSortConcurrent = (1UL << 0),	// lists of 65536 or more values are sorted on several threads at once; the comparator must be safe to call concurrently
+    kCFSortStable = (1UL << 4),		// values which compare equal keep their order
+};
+
+/* CFSortArray(..., kCFSortStable, ...) is CFMergeSortArray(), and CFSortArray(..., 0, ...) is CFQSortArray(). Only kCFSortConcurrent sorts on more than the calling thread. */
+CF_EXPORT void CFSortArray(void *list, CFIndex count, CFIndex elementSize, CFOptionFlags opts, CFComparatorFunction comparator, void *context);
+
 /* _CFExecutableLinkedOnOrAfter(releaseVersionName) will return YES if the current executable seems to be linked on or after the specified release. Example: If you specify CFSystemVersionPuma (10.1), you will get back true for executables linked on Puma or Jaguar(10.2), but false for those linked on Cheetah (10.0) or any of its software updates (10.0.x). You will also get back false for any app whose version info could not be figured out.
     This function caches its results, so no need to cache at call sites.
 
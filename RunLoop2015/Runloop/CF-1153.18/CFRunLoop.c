@@ -1114,6 +1114,7 @@ struct __CFRunLoopTimer {
 /* Bit 0 of the base reserved bits is used for firing state */
 /* Bit 1 of the base reserved bits is used for fired-during-callout state */
 /* Bit 2 of the base reserved bits is used for waking state */
+/* Bit 3 of the base reserved bits is used for reusable state */
 
 CF_INLINE Boolean __CFRunLoopTimerIsFiring(CFRunLoopTimerRef rlt) {
     return (Boolean)__CFBitfieldGetValue(rlt->_bits, 0, 0);
@@ -1135,6 +1136,14 @@ CF_INLINE void __CFRunLoopTimerSetDeallocating(CFRunLoopTimerRef rlt) {
     __CFBitfieldSetValue(rlt->_bits, 2, 2, 1);
 }
 
+CF_INLINE Boolean __CFRunLoopTimerIsReusable(CFRunLoopTimerRef rlt) {
+    return (Boolean)__CFBitfieldGetValue(rlt->_bits, 3, 3);
+}
+
+CF_INLINE void __CFRunLoopTimerSetReusable(CFRunLoopTimerRef rlt) {
+    __CFBitfieldSetValue(rlt->_bits, 3, 3, 1);
+}
+
 CF_INLINE void __CFRunLoopTimerLock(CFRunLoopTimerRef rlt) {
     pthread_mutex_lock(&(rlt->_lock));
 //    CFLog(6, CFSTR("__CFRunLoopTimerLock locked %p"), rlt);
@@ -2080,6 +2089,7 @@ static void __CFRepositionTimerInMode(CFRunLoopModeRef rlm, CFRunLoopTimerRef rl
 // mode and rl are locked on entry and exit
 static Boolean __CFRunLoopDoTimer(CFRunLoopRef rl, CFRunLoopModeRef rlm, CFRunLoopTimerRef rlt) {	/* DOES CALLOUT */
     Boolean timerHandled = false;
+    Boolean doInvalidate = false;
     uint64_t oldFireTSR = 0;
 
     /* Fire a timer */
@@ -2095,7 +2105,7 @@ static Boolean __CFRunLoopDoTimer(CFRunLoopRef rl, CFRunLoopModeRef rlm, CFRunLo
         } else {
             context_info = rlt->_context.info;
         }
-        Boolean doInvalidate = (0.0 == rlt->_interval);
+        doInvalidate = (0.0 == rlt->_interval);
 	__CFRunLoopTimerSetFiring(rlt);
         // Just in case the next timer has exactly the same deadlines as this one, we reset these values so that the arm next timer code can correctly find the next timer in the list and arm the underlying timer.
         rlm->_timerSoftDeadline = UINT64_MAX;
@@ -2123,7 +2133,11 @@ static Boolean __CFRunLoopDoTimer(CFRunLoopRef rl, CFRunLoopModeRef rlm, CFRunLo
 	timerHandled = true;
 	__CFRunLoopTimerUnsetFiring(rlt);
     }
-    if (__CFIsValid(rlt) && timerHandled) {
+    // A one-shot timer was invalidated after its callout, which undoes a
+    // reset made inside the callout. If it is valid here, another thread
+    // reset it since; it keeps the fire date the reset gave it rather
+    // than being rescheduled as a repeating timer with no interval.
+    if (__CFIsValid(rlt) && timerHandled && !doInvalidate) {
         /* This is just a little bit tricky: we want to support calling
          * CFRunLoopTimerSetNextFireDate() from within the callout and
          * honor that new time here if it is a later date, otherwise
@@ -2249,6 +2263,20 @@ CF_EXPORT Boolean _CFRunLoopFinished(CFRunLoopRef rl, CFStringRef modeName) {
     return result;
 }
 
+// Releases what has been autoreleased into this pass's pool. Finalizers
+// may call back into the run loop, so the locks are dropped while they run.
+static void __CFRunLoopPopReleasePool(CFRunLoopRef rl, CFRunLoopModeRef rlm, void *pool) {
+    if (__CFReleasePoolIsEmpty(pool)) {
+        CFReleasePoolPop(pool);
+        return;
+    }
+    __CFRunLoopModeUnlock(rlm);
+    __CFRunLoopUnlock(rl);
+    CFReleasePoolPop(pool);
+    __CFRunLoopLock(rl);
+    __CFRunLoopModeLock(rlm);
+}
+
 static int32_t __CFRunLoopRun(CFRunLoopRef rl, CFRunLoopModeRef rlm, CFTimeInterval seconds, Boolean stopAfterHandle, CFRunLoopModeRef previousMode) __attribute__((noinline));
 
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI
@@ -2631,6 +2659,12 @@ static int32_t __CFRunLoopRun(CFRunLoopRef rl, CFRunLoopModeRef rlm, CFTimeInter
         //将 run loop 从忽略唤醒消息的状态 unset ,开始接受唤醒消息
         __CFRunLoopUnsetIgnoreWakeUps(rl);
 
+        // Merge releases other threads made on objects biased to this thread
+        _CFRuntimeDrainBiasedReleases();
+
+        // Callouts in this pass autorelease into this pool; it is drained before sleeping and at the end of the pass
+        void *releasePool = CFReleasePoolPush();
+
         //2. 通知 Observers: RunLoop 即将触发 Timer 回调
         if (rlm->_observerMask & kCFRunLoopBeforeTimers) __CFRunLoopDoObservers(rl, rlm, kCFRunLoopBeforeTimers);
         //3. 通知 Observers: RunLoop 即将触发 Source0 (非port) 回调。
@@ -2674,6 +2708,9 @@ static int32_t __CFRunLoopRun(CFRunLoopRef rl, CFRunLoopModeRef rlm, CFTimeInter
         //6, 通知 Observers: RunLoop 的线程即将进入休眠(sleep)
         // 注意到如果实际处理了 source0 或者超时，不会进入睡眠，所以不会通知。
 	if (!poll && (rlm->_observerMask & kCFRunLoopBeforeWaiting)) __CFRunLoopDoObservers(rl, rlm, kCFRunLoopBeforeWaiting);
+        // Nothing autoreleased so far should be kept alive while we sleep
+        __CFRunLoopPopReleasePool(rl, rlm, releasePool);
+        releasePool = CFReleasePoolPush();
         //设置标志位，正在睡眠（实际上没有开始睡）
        // 设置RunLoop为休眠状态
         // 设置标志位， Run Loop 休眠
@@ -2927,6 +2964,8 @@ static int32_t __CFRunLoopRun(CFRunLoopRef rl, CFRunLoopModeRef rlm, CFTimeInter
         
         //12. 再一次处理 blocks
 	__CFRunLoopDoBlocks(rl, rlm);
+
+        __CFRunLoopPopReleasePool(rl, rlm, releasePool);
         
 
         // 13. 判断是否退出，不需要退出则跳转回第 2 步  //根据一次循环后的状态，给 retVal 赋值 。状态不变则继续循环
@@ -4007,6 +4046,24 @@ CFTypeID CFRunLoopTimerGetTypeID(void) {
     return __kCFRunLoopTimerTypeID;
 }
 
+static void __CFRunLoopTimerSetContext(CFRunLoopTimerRef rlt, CFRunLoopTimerContext *context) {
+    if (NULL != context) {
+	if (context->retain) {
+	    rlt->_context.info = (void *)context->retain(context->info);
+	} else {
+	    rlt->_context.info = context->info;
+	}
+	rlt->_context.retain = context->retain;
+	rlt->_context.release = context->release;
+	rlt->_context.copyDescription = context->copyDescription;
+    } else {
+	rlt->_context.info = 0;
+	rlt->_context.retain = 0;
+	rlt->_context.release = 0;
+	rlt->_context.copyDescription = 0;
+    }
+}
+
 CFRunLoopTimerRef CFRunLoopTimerCreate(CFAllocatorRef allocator, CFAbsoluteTime fireDate, CFTimeInterval interval, CFOptionFlags flags, CFIndex order, CFRunLoopTimerCallBack callout, CFRunLoopTimerContext *context) {
     CHECK_FOR_FORK();
     if (isnan(interval)) {
@@ -4042,21 +4099,7 @@ CFRunLoopTimerRef CFRunLoopTimerCreate(CFAllocatorRef allocator, CFAbsoluteTime
 	memory->_fireTSR = now2 + __CFTimeIntervalToTSR(fireDate - now1);
     }
     memory->_callout = callout;
-    if (NULL != context) {
-	if (context->retain) {
-	    memory->_context.info = (void *)context->retain(context->info);
-	} else {
-	    memory->_context.info = context->info;
-	}
-	memory->_context.retain = context->retain;
-	memory->_context.release = context->release;
-	memory->_context.copyDescription = context->copyDescription;
-    } else {
-	memory->_context.info = 0;
-	memory->_context.retain = 0;
-	memory->_context.release = 0;
-	memory->_context.copyDescription = 0;
-    }
+    __CFRunLoopTimerSetContext(memory, context);
     return memory;
 }
 
@@ -4078,6 +4121,126 @@ CFRunLoopTimerRef CFRunLoopTimerCreateWithHandler(CFAllocatorRef allocator, CFAb
     return CFRunLoopTimerCreate(allocator, fireDate, interval, flags, order, _runLoopTimerWithBlockContext, &blockContext);
 }
 
+/* Invalidating a reusable timer puts it in a small pool, which holds a
+ * reference to it; its lock and mode set are kept. The pool hands a
+ * timer out again only once that reference is the last one, so a timer
+ * its owner still holds is never reused behind its back; the owner can
+ * instead rearm it with CFRunLoopTimerReset(), which takes it back out.
+ */
+
+#define __kCFRunLoopTimerPoolCapacity 64
+
+static CFLock_t __CFRunLoopTimerPoolLock = CFLockInit;
+static CFRunLoopTimerRef __CFRunLoopTimerPool[__kCFRunLoopTimerPoolCapacity];
+static CFIndex __CFRunLoopTimerPoolCount = 0;
+
+static void __CFRunLoopTimerPoolPut(CFRunLoopTimerRef rlt) {
+    if (!_CFAllocatorIsSystemDefault(CFGetAllocator(rlt))) return;
+    __CFLock(&__CFRunLoopTimerPoolLock);
+    CFIndex idx = 0;
+    while (idx < __CFRunLoopTimerPoolCount && __CFRunLoopTimerPool[idx] != rlt) idx++;
+    if (idx == __CFRunLoopTimerPoolCount && __CFRunLoopTimerPoolCount < __kCFRunLoopTimerPoolCapacity) {
+        __CFRunLoopTimerPool[__CFRunLoopTimerPoolCount++] = (CFRunLoopTimerRef)CFRetain(rlt);
+    }
+    __CFUnlock(&__CFRunLoopTimerPoolLock);
+}
+
+// Returns a pooled timer nobody else holds, with the pool's reference
+static CFRunLoopTimerRef __CFRunLoopTimerPoolTake(void) {
+    CFRunLoopTimerRef result = NULL;
+    __CFLock(&__CFRunLoopTimerPoolLock);
+    for (CFIndex idx = __CFRunLoopTimerPoolCount; 0 < idx--; ) {
+        CFRunLoopTimerRef rlt = __CFRunLoopTimerPool[idx];
+        if (1 == CFGetRetainCount(rlt) && !__CFIsValid(rlt)) {
+            __CFRunLoopTimerPool[idx] = __CFRunLoopTimerPool[--__CFRunLoopTimerPoolCount];
+            result = rlt;
+            break;
+        }
+    }
+    __CFUnlock(&__CFRunLoopTimerPoolLock);
+    return result;
+}
+
+static void __CFRunLoopTimerPoolRemove(CFRunLoopTimerRef rlt) {
+    Boolean found = false;
+    __CFLock(&__CFRunLoopTimerPoolLock);
+    for (CFIndex idx = 0; idx < __CFRunLoopTimerPoolCount; idx++) {
+        if (__CFRunLoopTimerPool[idx] == rlt) {
+            __CFRunLoopTimerPool[idx] = __CFRunLoopTimerPool[--__CFRunLoopTimerPoolCount];
+            found = true;
+            break;
+        }
+    }
+    __CFUnlock(&__CFRunLoopTimerPoolLock);
+    if (found) CFRelease(rlt);
+}
+
+CFRunLoopTimerRef CFRunLoopTimerCreateReusable(CFAllocatorRef allocator, CFAbsoluteTime fireDate, CFTimeInterval interval, CFOptionFlags flags, CFIndex order, CFRunLoopTimerCallBack callout, CFRunLoopTimerContext *context) {
+    CHECK_FOR_FORK();
+    if (isnan(interval)) {
+        CRSetCrashLogMessage("NaN was used as an interval for a CFRunLoopTimer");
+        HALT;
+    }
+    CFRunLoopTimerRef rlt = NULL;
+    if (_CFAllocatorIsSystemDefault(allocator ? allocator : __CFGetDefaultAllocator())) {
+        rlt = __CFRunLoopTimerPoolTake();
+    }
+    if (NULL == rlt) {
+        rlt = CFRunLoopTimerCreate(allocator, fireDate, interval, flags, order, callout, context);
+        if (NULL != rlt) __CFRunLoopTimerSetReusable(rlt);
+        return rlt;
+    }
+    // Invalidation left the timer out of every run loop, with an empty mode set and no context
+    if (TIMER_DATE_LIMIT < fireDate) fireDate = TIMER_DATE_LIMIT;
+    uint64_t fireTSR = 0ULL;
+    uint64_t now2 = mach_absolute_time();
+    CFAbsoluteTime now1 = CFAbsoluteTimeGetCurrent();
+    if (fireDate < now1) {
+	fireTSR = now2;
+    } else if (TIMER_INTERVAL_LIMIT < fireDate - now1) {
+	fireTSR = now2 + __CFTimeIntervalToTSR(TIMER_INTERVAL_LIMIT);
+    } else {
+	fireTSR = now2 + __CFTimeIntervalToTSR(fireDate - now1);
+    }
+    __CFRunLoopTimerLock(rlt);
+    rlt->_order = order;
+    if (interval < 0.0) interval = 0.0;
+    rlt->_interval = interval;
+    rlt->_tolerance = 0.0;
+    rlt->_callout = callout;
+    __CFRunLoopTimerSetContext(rlt, context);
+    __CFRunLoopTimerFireTSRLock();
+    rlt->_nextFireDate = fireDate;
+    rlt->_fireTSR = fireTSR;
+    __CFRunLoopTimerFireTSRUnlock();
+    __CFSetValid(rlt);
+    __CFRunLoopTimerUnlock(rlt);
+    return rlt;
+}
+
+void CFRunLoopTimerReset(CFRunLoopTimerRef rlt, CFAbsoluteTime fireDate, CFRunLoopTimerContext *context) {	/* DOES CALLOUT */
+    CHECK_FOR_FORK();
+    __CFGenericValidateType(rlt, CFRunLoopTimerGetTypeID());
+    if (!__CFRunLoopTimerIsReusable(rlt)) {
+        CFLog(kCFLogLevelError, CFSTR("*** CFRunLoopTimerReset(): timer %p was not created with CFRunLoopTimerCreateReusable()"), rlt);
+        return;
+    }
+    // The caller holds the timer, so it does not belong in the pool
+    __CFRunLoopTimerPoolRemove(rlt);
+    __CFRunLoopTimerLock(rlt);
+    Boolean wasValid = __CFIsValid(rlt);
+    void *info = rlt->_context.info;
+    void (*release)(const void *) = rlt->_context.release;
+    __CFRunLoopTimerSetContext(rlt, context);
+    __CFSetValid(rlt);
+    __CFRunLoopTimerUnlock(rlt);
+    // Invalidation has already released the context of an invalid timer
+    if (wasValid && NULL != release) {
+        release(info);	/* CALLOUT */
+    }
+    CFRunLoopTimerSetNextFireDate(rlt, fireDate);
+}
+
 CFAbsoluteTime CFRunLoopTimerGetNextFireDate(CFRunLoopTimerRef rlt) {
     CHECK_FOR_FORK();
     CF_OBJC_FUNCDISPATCHV(CFRunLoopTimerGetTypeID(), CFAbsoluteTime, (NSTimer *)rlt, _cffireTime);
@@ -4184,7 +4347,9 @@ void CFRunLoopTimerInvalidate(CFRunLoopTimerRef rlt) {	/* DOES CALLOUT */
     if (!__CFRunLoopTimerIsDeallocating(rlt)) {
         CFRetain(rlt);
     }
+    Boolean pool = false;
     if (__CFIsValid(rlt)) {
+	pool = __CFRunLoopTimerIsReusable(rlt) && !__CFRunLoopTimerIsDeallocating(rlt);
 	CFRunLoopRef rl = rlt->_runLoop;
 	void *info = rlt->_context.info;
 	rlt->_context.info = NULL;
@@ -4222,6 +4387,9 @@ void CFRunLoopTimerInvalidate(CFRunLoopTimerRef rlt) {	/* DOES CALLOUT */
 	}
     }
     __CFRunLoopTimerUnlock(rlt);
+    if (pool) {
+        __CFRunLoopTimerPoolPut(rlt);
+    }
     if (!__CFRunLoopTimerIsDeallocating(rlt)) {
         CFRelease(rlt);
     }
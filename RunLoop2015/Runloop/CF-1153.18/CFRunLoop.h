@@ -185,6 +185,20 @@ CF_EXPORT CFRunLoopTimerRef CFRunLoopTimerCreate(CFAllocatorRef allocator, CFAbs
 CF_EXPORT CFRunLoopTimerRef CFRunLoopTimerCreateWithHandler(CFAllocatorRef allocator, CFAbsoluteTime fireDate, CFTimeInterval interval, CFOptionFlags flags, CFIndex order, void (^block) (CFRunLoopTimerRef timer)) CF_AVAILABLE(10_7, 5_0);
 #endif
 
+/* A reusable timer is meant for code that arms a short-lived timer
+   per request. Invalidating it, which happens after a one-shot timer
+   fires, puts it in a pool, and CFRunLoopTimerCreateReusable() hands
+   out a pooled timer once nothing else holds it, without building a
+   new one. Only timers using the system default allocator are pooled.
+   CFRunLoopTimerReset() rearms a reusable timer the caller still
+   holds, valid or not, with a new fire date and context; the interval,
+   order and callout stay. An invalidated timer has left its run loop
+   and must be added to one again after the reset. A one-shot timer is
+   still invalidated once its callout returns, so reset it from
+   elsewhere. */
+CF_EXPORT CFRunLoopTimerRef CFRunLoopTimerCreateReusable(CFAllocatorRef allocator, CFAbsoluteTime fireDate, CFTimeInterval interval, CFOptionFlags flags, CFIndex order, CFRunLoopTimerCallBack callout, CFRunLoopTimerContext *context);
+CF_EXPORT void CFRunLoopTimerReset(CFRunLoopTimerRef timer, CFAbsoluteTime fireDate, CFRunLoopTimerContext *context);
+
 CF_EXPORT CFAbsoluteTime CFRunLoopTimerGetNextFireDate(CFRunLoopTimerRef timer);
 CF_EXPORT void CFRunLoopTimerSetNextFireDate(CFRunLoopTimerRef timer, CFAbsoluteTime fireDate);
 CF_EXPORT CFTimeInterval CFRunLoopTimerGetInterval(CFRunLoopTimerRef timer);
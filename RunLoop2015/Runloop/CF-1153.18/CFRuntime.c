@@ -54,6 +54,15 @@ OBJC_EXPORT void *objc_destructInstance(id obj);
 #if DEPLOYMENT_TARGET_WINDOWS
 #include <Shellapi.h>
 #endif
+#if __CFRUNTIME_ALLOCATION_PROFILER
+#include <execinfo.h>
+#include <math.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#endif
 
 enum {
 // retain/release recording constants -- must match values
@@ -123,6 +132,20 @@ void __CFSetLastAllocationEventName(void *ptr, const char *classname) {
     fprintf(stdout, "name,%p,%s\n", ptr, classname ? classname : "(no class)");
 }
 
+#elif __CFRUNTIME_ALLOCATION_PROFILER
+
+// Set while the allocation profiler runs, which is the only consumer of names here
+bool __CFOASafe = false;
+
+static void __CFAllocationProfilerLabel(void *ptr, CFTypeID typeID, const char *name);
+
+void __CFOAInitialize(void) { }
+void __CFRecordAllocationEvent(int eventnum, void *ptr, int64_t size, uint64_t data, const char *classname) { }
+
+void __CFSetLastAllocationEventName(void *ptr, const char *classname) {
+    if (classname) __CFAllocationProfilerLabel(ptr, _kCFRuntimeNotATypeID, classname);
+}
+
 #else
 
 bool __CFOASafe = false;
@@ -133,6 +156,13 @@ void __CFSetLastAllocationEventName(void *ptr, const char *classname) { }
 
 #endif
 
+// Retain and release events are only of use to ObjectAlloc; the allocation profiler ignores them
+#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || FAKE_INSTRUMENTS
+#define __CFOARecordsRefCountEvents __CFOASafe
+#else
+#define __CFOARecordsRefCountEvents 0
+#endif
+
 extern void __HALT(void);
 
 static CFTypeID __kCFNotATypeTypeID = _kCFRuntimeNotATypeID;
@@ -288,6 +318,779 @@ CF_INLINE CFOptionFlags CF_GET_COLLECTABLE_MEMORY_TYPE(const CFRuntimeClass *cls
 #define CF_GET_COLLECTABLE_MEMORY_TYPE(x) (0)
 #endif
 
+/* Per-thread object caches. Small instances created with the system
+ * default allocator are recycled through per-thread magazines, one per
+ * 16 byte size class, instead of going back to malloc on every
+ * CFRelease. A magazine is a free list threaded through the first word
+ * of each cached object. A thread whose magazine overflows hands the
+ * whole list to a bounded per-class depot, and an empty magazine is
+ * refilled from the depot, so objects freed on another thread come
+ * back into circulation. Cached objects remain ordinary malloc blocks,
+ * and the size class on release is derived from malloc_size(), so any
+ * block is safe to cache or to free.
+ */
+
+#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI || DEPLOYMENT_TARGET_LINUX
+#define __CFRUNTIME_OBJECT_CACHE 1
+#endif
+
+#if __CFRUNTIME_OBJECT_CACHE
+
+#define __kCFObjectCacheClassCount	16	// size classes of 16, 32, ... 256 bytes
+#define __kCFObjectCacheMaxSize		(__kCFObjectCacheClassCount * 16)
+#define __kCFObjectCacheMagazineSize	32
+#define __kCFObjectCacheDepotSize	16	// full magazines kept per size class
+
+typedef struct {
+    void *_head;
+    uint32_t _count;
+} __CFObjectCacheMagazine;
+
+typedef struct {
+    __CFObjectCacheMagazine _magazines[__kCFObjectCacheClassCount];
+} __CFObjectCache;
+
+static struct {
+    CFLock_t _lock;
+    uint32_t _count;
+    void *_magazines[__kCFObjectCacheDepotSize];
+} __CFObjectCacheDepot[__kCFObjectCacheClassCount];
+
+// Stored in the TSD slot once the thread's cache has been torn down
+#define __kCFObjectCacheTornDown ((__CFObjectCache *)0x1)
+
+static Boolean __CFObjectCacheDisabled = false;
+
+static void __CFObjectCacheFreeList(void *head) {
+    while (head) {
+        void *next = *(void **)head;
+        free(head);
+        head = next;
+    }
+}
+
+static void __CFObjectCacheFlushMagazine(__CFObjectCacheMagazine *mag, CFIndex sizeClass) {
+    void *head = mag->_head;
+    if (__kCFObjectCacheMagazineSize == mag->_count) {
+        __CFLock(&__CFObjectCacheDepot[sizeClass]._lock);
+        if (__CFObjectCacheDepot[sizeClass]._count < __kCFObjectCacheDepotSize) {
+            __CFObjectCacheDepot[sizeClass]._magazines[__CFObjectCacheDepot[sizeClass]._count++] = head;
+            head = NULL;
+        }
+        __CFUnlock(&__CFObjectCacheDepot[sizeClass]._lock);
+    }
+    __CFObjectCacheFreeList(head);
+    mag->_head = NULL;
+    mag->_count = 0;
+}
+
+static void __CFObjectCacheDestroy(void *arg) {
+    __CFObjectCache *cache = (__CFObjectCache *)arg;
+    for (CFIndex idx = 0; idx < __kCFObjectCacheClassCount; idx++) {
+        __CFObjectCacheFlushMagazine(&cache->_magazines[idx], idx);
+    }
+    free(cache);
+    // Objects released later in thread teardown go straight to free()
+    _CFSetTSD(__CFTSDKeyObjectCache, __kCFObjectCacheTornDown, NULL);
+}
+
+static __CFObjectCache *__CFObjectCacheGet(void) {
+    __CFObjectCache *cache = (__CFObjectCache *)_CFGetTSD(__CFTSDKeyObjectCache);
+    if (__builtin_expect(NULL == cache, 0)) {
+        cache = (__CFObjectCache *)calloc(1, sizeof(__CFObjectCache));
+        if (NULL == cache) return NULL;
+        _CFSetTSD(__CFTSDKeyObjectCache, cache, __CFObjectCacheDestroy);
+        if (_CFGetTSD(__CFTSDKeyObjectCache) != cache) {	// thread data already gone
+            free(cache);
+            return NULL;
+        }
+    }
+    return (__kCFObjectCacheTornDown == cache) ? NULL : cache;
+}
+
+CF_INLINE void *__CFObjectCacheAllocate(CFIndex size) {
+    __CFObjectCache *cache = __CFObjectCacheGet();
+    if (NULL == cache) return NULL;
+    CFIndex sizeClass = (size >> 4) - 1;
+    __CFObjectCacheMagazine *mag = &cache->_magazines[sizeClass];
+    if (NULL == mag->_head) {
+        __CFLock(&__CFObjectCacheDepot[sizeClass]._lock);
+        if (0 < __CFObjectCacheDepot[sizeClass]._count) {
+            mag->_head = __CFObjectCacheDepot[sizeClass]._magazines[--__CFObjectCacheDepot[sizeClass]._count];
+            mag->_count = __kCFObjectCacheMagazineSize;
+        }
+        __CFUnlock(&__CFObjectCacheDepot[sizeClass]._lock);
+        if (NULL == mag->_head) return NULL;
+    }
+    void *result = mag->_head;
+    mag->_head = *(void **)result;
+    mag->_count--;
+    return result;
+}
+
+CF_INLINE Boolean __CFObjectCacheDeallocate(void *ptr) {
+    CFIndex sizeClass = (CFIndex)(malloc_size(ptr) >> 4) - 1;
+    if (sizeClass < 0) return false;
+    if (__kCFObjectCacheClassCount <= sizeClass) return false;
+    __CFObjectCache *cache = __CFObjectCacheGet();
+    if (NULL == cache) return false;
+    __CFObjectCacheMagazine *mag = &cache->_magazines[sizeClass];
+    if (__kCFObjectCacheMagazineSize == mag->_count) {
+        __CFObjectCacheFlushMagazine(mag, sizeClass);
+    }
+    *(void **)ptr = mag->_head;
+    mag->_head = ptr;
+    mag->_count++;
+    return true;
+}
+
+#endif
+
+/* Per-type instance statistics, collected only when enabled since
+ * the shared counters would otherwise cost every allocation a
+ * contended atomic operation.
+ */
+
+static Boolean __CFRuntimeInstanceStatisticsEnabled = false;
+static _CFRuntimeInstanceStatistics __CFRuntimeInstanceStatistics[__CFRuntimeClassTableSize];
+
+#define __CFRuntimeCountInstanceEvent(typeID, field) do { \
+    if (__builtin_expect(__CFRuntimeInstanceStatisticsEnabled, 0)) OSAtomicAdd64Barrier(1, &__CFRuntimeInstanceStatistics[typeID].field); \
+} while (0)
+
+void _CFRuntimeSetInstanceStatisticsEnabled(Boolean enabled) {
+    __CFRuntimeInstanceStatisticsEnabled = enabled;
+}
+
+Boolean _CFRuntimeGetInstanceStatistics(CFTypeID typeID, _CFRuntimeInstanceStatistics *stats) {
+    if (!__CFRuntimeInstanceStatisticsEnabled || __CFRuntimeClassTableSize <= typeID) return false;
+    stats->allocations = __CFRuntimeInstanceStatistics[typeID].allocations;
+    stats->cachedAllocations = __CFRuntimeInstanceStatistics[typeID].cachedAllocations;
+    stats->deallocations = __CFRuntimeInstanceStatistics[typeID].deallocations;
+    stats->cachedDeallocations = __CFRuntimeInstanceStatistics[typeID].cachedDeallocations;
+    return true;
+}
+
+/* Sampling allocation profiler. Every CFAllocator allocation and
+ * instance creation counts its size against a per-thread budget, and
+ * the allocation that exhausts it is sampled: its call stack is
+ * recorded together with the type and category it is later labeled
+ * with, and the sample stays live until the block is freed. Budgets
+ * are drawn from an exponential distribution whose mean is the
+ * sampling interval, so each byte has the same chance of being
+ * sampled wherever it falls. The budget runs down whether or not
+ * the profiler is on, and an exhausted budget is simply refilled
+ * while it is off, so an allocation costs one thread-local
+ * subtraction either way. Everything past the budget check is rare
+ * enough to run under a single lock.
+ */
+
+#if __CFRUNTIME_ALLOCATION_PROFILER
+
+#define __kCFAllocationProfilerDefaultInterval	(2 * 1024 * 1024)
+#define __kCFAllocationProfilerMaxDepth		32
+#define __kCFAllocationProfilerSampleSlots	4096
+
+typedef struct {
+    double _allocObjects;	// estimated, counting unsampled allocations
+    double _allocBytes;
+    double _liveObjects;
+    double _liveBytes;
+} __CFAllocationCounts;
+
+typedef struct __CFAllocationStack {
+    struct __CFAllocationStack *_next;
+    uintptr_t _hash;
+    int64_t _allocObjects;	// sampled; pprof does the scaling
+    int64_t _allocBytes;
+    int64_t _liveObjects;
+    int64_t _liveBytes;
+    int _depth;
+    void *_frames[];
+} __CFAllocationStack;
+
+typedef struct __CFAllocationCategory {
+    struct __CFAllocationCategory *_next;
+    const char *_name;
+    __CFAllocationCounts _counts;
+} __CFAllocationCategory;
+
+typedef struct __CFAllocationSample {
+    struct __CFAllocationSample *_next;
+    void *_ptr;
+    int64_t _size;
+    double _weight;		// allocations this sample stands for
+    __CFAllocationStack *_stack;
+    __CFAllocationCategory *_category;
+    CFTypeID _typeID;
+} __CFAllocationSample;
+
+Boolean __CFAllocationProfilerEnabled = false;
+__thread int64_t __CFAllocationProfilerBudget = 0;
+CFIndex __CFAllocationProfilerLiveSamples = 0;
+volatile uint8_t __CFAllocationProfilerFilter[__kCFAllocationProfilerFilterSize / 8];
+static int64_t __CFAllocationProfilerInterval = __kCFAllocationProfilerDefaultInterval;
+static CFLock_t __CFAllocationProfilerLock = CFLockInit;
+static __CFAllocationSample *__CFAllocationProfilerSamples[__kCFAllocationProfilerSampleSlots];
+static __CFAllocationStack *__CFAllocationProfilerStacks[__kCFAllocationProfilerSampleSlots];
+static __CFAllocationCategory *__CFAllocationProfilerCategories = NULL;
+static __CFAllocationCounts __CFAllocationProfilerTypeCounts[__CFRuntimeClassTableSize];
+// Live samples per bit of __CFAllocationProfilerFilter
+static uint16_t __CFAllocationProfilerFilterCounts[__kCFAllocationProfilerFilterSize];
+
+static __thread uint64_t __CFAllocationProfilerRandom = 0;
+// Read on every instance creation while profiling, so initial-exec like the budget
+static __thread void *__CFAllocationProfilerLastSample __attribute__((tls_model("initial-exec"))) = NULL;
+
+// Call with the lock held
+static void __CFAllocationProfilerFilterUpdate(void *ptr, int delta) {
+    uintptr_t h = __CFAllocationProfilerHashPointer(ptr);
+    __CFAllocationProfilerLiveSamples += delta;
+    __CFAllocationProfilerFilterCounts[h] += delta;
+    if (__CFAllocationProfilerFilterCounts[h]) {
+        __CFAllocationProfilerFilter[h >> 3] |= (1 << (h & 7));
+    } else {
+        __CFAllocationProfilerFilter[h >> 3] &= ~(1 << (h & 7));
+    }
+}
+
+// Call with the lock held
+static __CFAllocationSample **__CFAllocationProfilerFindSample(void *ptr) {
+    __CFAllocationSample **link = &__CFAllocationProfilerSamples[__CFAllocationProfilerHashPointer(ptr) % __kCFAllocationProfilerSampleSlots];
+    while (*link && (*link)->_ptr != ptr) link = &(*link)->_next;
+    return link;
+}
+
+// Call with the lock held
+static __CFAllocationStack *__CFAllocationProfilerFindStack(void **frames, int depth) {
+    uintptr_t hash = depth;
+    for (int idx = 0; idx < depth; idx++) hash = (hash * 31) ^ (uintptr_t)frames[idx];
+    __CFAllocationStack **link = &__CFAllocationProfilerStacks[hash % __kCFAllocationProfilerSampleSlots];
+    for (; *link; link = &(*link)->_next) {
+        __CFAllocationStack *stack = *link;
+        if (stack->_hash == hash && stack->_depth == depth && 0 == memcmp(stack->_frames, frames, depth * sizeof(void *))) return stack;
+    }
+    __CFAllocationStack *stack = (__CFAllocationStack *)calloc(1, sizeof(__CFAllocationStack) + depth * sizeof(void *));
+    if (NULL == stack) return NULL;
+    stack->_hash = hash;
+    stack->_depth = depth;
+    memmove(stack->_frames, frames, depth * sizeof(void *));
+    *link = stack;
+    return stack;
+}
+
+// Call with the lock held
+static __CFAllocationCategory *__CFAllocationProfilerFindCategory(const char *name) {
+    __CFAllocationCategory *category = __CFAllocationProfilerCategories;
+    while (category && category->_name != name && strcmp(category->_name, name)) category = category->_next;
+    if (NULL == category) {
+        category = (__CFAllocationCategory *)calloc(1, sizeof(__CFAllocationCategory));
+        if (NULL == category) return NULL;
+        category->_name = name;
+        category->_next = __CFAllocationProfilerCategories;
+        __CFAllocationProfilerCategories = category;
+    }
+    return category;
+}
+
+static void __CFAllocationProfilerCount(__CFAllocationCounts *counts, __CFAllocationSample *sample, double sign, Boolean liveOnly) {
+    if (NULL == counts) return;
+    if (!liveOnly) {
+        counts->_allocObjects += sign * sample->_weight;
+        counts->_allocBytes += sign * sample->_weight * sample->_size;
+    }
+    counts->_liveObjects += sign * sample->_weight;
+    counts->_liveBytes += sign * sample->_weight * sample->_size;
+}
+
+// Call with the lock held
+static void __CFAllocationProfilerRemove(__CFAllocationSample **link) {
+    __CFAllocationSample *sample = *link;
+    *link = sample->_next;
+    __CFAllocationProfilerFilterUpdate(sample->_ptr, -1);
+    if (sample->_stack) {
+        sample->_stack->_liveObjects--;
+        sample->_stack->_liveBytes -= sample->_size;
+    }
+    __CFAllocationProfilerCount(&__CFAllocationProfilerTypeCounts[sample->_typeID], sample, -1.0, true);
+    __CFAllocationProfilerCount(sample->_category ? &sample->_category->_counts : NULL, sample, -1.0, true);
+    free(sample);
+}
+
+static int64_t __CFAllocationProfilerNextBudget(void) {
+    uint64_t x = __CFAllocationProfilerRandom;
+    if (0 == x) x = ((uint64_t)(uintptr_t)&x * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)CFAbsoluteTimeGetCurrent() ^ 1;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    __CFAllocationProfilerRandom = x;
+    double u = (double)(((x * 2685821657736338717ULL) >> 11) + 1) * (1.0 / 9007199254740992.0);
+    double budget = -log(u) * (double)__CFAllocationProfilerInterval;
+    return (budget < 1.0) ? 1 : (budget < 1e18) ? (int64_t)budget : (int64_t)1e18;
+}
+
+// Called once an allocation has used up this thread's budget
+CF_PRIVATE void __CFAllocationProfilerSample(void *ptr, CFIndex size) __attribute__((noinline));
+CF_PRIVATE void __CFAllocationProfilerSample(void *ptr, CFIndex size) {
+    if (!__CFAllocationProfilerEnabled) {
+        // Come back in a while to see whether profiling has started
+        __CFAllocationProfilerBudget = __kCFAllocationProfilerDefaultInterval;
+        return;
+    }
+    // The budget stays spent, so the next allocation is sampled instead
+    if (NULL == ptr) return;
+    if (__builtin_expect(0 == __CFAllocationProfilerRandom, 0)) {
+        // First allocation on this thread; start counting from here
+        __CFAllocationProfilerBudget = __CFAllocationProfilerNextBudget();
+        return;
+    }
+    __CFAllocationProfilerBudget = __CFAllocationProfilerNextBudget();
+    // Skip this function
+    void *frames[__kCFAllocationProfilerMaxDepth + 1];
+    int depth = backtrace(frames, __kCFAllocationProfilerMaxDepth + 1);
+    depth = (1 < depth) ? depth - 1 : 0;
+    __CFAllocationSample *sample = (__CFAllocationSample *)calloc(1, sizeof(__CFAllocationSample));
+    if (NULL == sample) return;
+    sample->_ptr = ptr;
+    sample->_size = size;
+    sample->_weight = 1.0 / (1.0 - exp(-(double)size / (double)__CFAllocationProfilerInterval));
+    sample->_typeID = _kCFRuntimeNotATypeID;
+
+    __CFLock(&__CFAllocationProfilerLock);
+    __CFAllocationSample **link = __CFAllocationProfilerFindSample(ptr);
+    // A block freed while the profiler was off may have been handed out again
+    if (*link) __CFAllocationProfilerRemove(link);
+    sample->_stack = __CFAllocationProfilerFindStack(frames + 1, depth);
+    if (sample->_stack) {
+        sample->_stack->_allocObjects++;
+        sample->_stack->_allocBytes += size;
+        sample->_stack->_liveObjects++;
+        sample->_stack->_liveBytes += size;
+    }
+    __CFAllocationProfilerCount(&__CFAllocationProfilerTypeCounts[_kCFRuntimeNotATypeID], sample, 1.0, false);
+    sample->_next = *link;
+    *link = sample;
+    __CFAllocationProfilerFilterUpdate(ptr, 1);
+    __CFUnlock(&__CFAllocationProfilerLock);
+    __CFAllocationProfilerLastSample = ptr;
+}
+
+CF_PRIVATE void __CFAllocationProfilerRecordFree(void *ptr) {
+    __CFLock(&__CFAllocationProfilerLock);
+    __CFAllocationSample **link = __CFAllocationProfilerFindSample(ptr);
+    if (*link) __CFAllocationProfilerRemove(link);
+    __CFUnlock(&__CFAllocationProfilerLock);
+    if (__CFAllocationProfilerLastSample == ptr) __CFAllocationProfilerLastSample = NULL;
+}
+
+// Names are only attached to the sample this thread took last, which is
+// where they land: callers label a block right after allocating it.
+// Pass _kCFRuntimeNotATypeID or NULL to leave the type or category as is.
+static void __CFAllocationProfilerLabel(void *ptr, CFTypeID typeID, const char *name) {
+    if (NULL == ptr || ptr != __CFAllocationProfilerLastSample) return;
+    __CFLock(&__CFAllocationProfilerLock);
+    __CFAllocationSample *sample = *__CFAllocationProfilerFindSample(ptr);
+    if (sample) {
+        if (_kCFRuntimeNotATypeID != typeID && typeID < __CFRuntimeClassTableSize) {
+            __CFAllocationProfilerCount(&__CFAllocationProfilerTypeCounts[sample->_typeID], sample, -1.0, false);
+            sample->_typeID = typeID;
+            __CFAllocationProfilerCount(&__CFAllocationProfilerTypeCounts[typeID], sample, 1.0, false);
+        }
+        __CFAllocationCategory *category = name ? __CFAllocationProfilerFindCategory(name) : NULL;
+        if (category && category != sample->_category) {
+            __CFAllocationProfilerCount(sample->_category ? &sample->_category->_counts : NULL, sample, -1.0, false);
+            sample->_category = category;
+            __CFAllocationProfilerCount(&category->_counts, sample, 1.0, false);
+        }
+    }
+    __CFUnlock(&__CFAllocationProfilerLock);
+}
+
+typedef struct {
+    int _fd;
+    Boolean _failed;
+    CFIndex _length;
+    char _buffer[4096];
+} __CFAllocationProfileWriter;
+
+static void __CFAllocationProfileFlush(__CFAllocationProfileWriter *writer) {
+    char *bytes = writer->_buffer;
+    while (!writer->_failed && 0 < writer->_length) {
+        ssize_t written = write(writer->_fd, bytes, writer->_length);
+        if (written < 0 && EINTR == errno) continue;
+        if (written <= 0) writer->_failed = true;
+        else {
+            bytes += written;
+            writer->_length -= written;
+        }
+    }
+    writer->_length = 0;
+}
+
+static void __CFAllocationProfilePrintf(__CFAllocationProfileWriter *writer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void __CFAllocationProfilePrintf(__CFAllocationProfileWriter *writer, const char *format, ...) {
+    va_list args;
+    if (sizeof(writer->_buffer) - writer->_length < 256) __CFAllocationProfileFlush(writer);
+    va_start(args, format);
+    int length = vsnprintf(writer->_buffer + writer->_length, sizeof(writer->_buffer) - writer->_length, format, args);
+    va_end(args);
+    if (0 < length) writer->_length += (length < (int)(sizeof(writer->_buffer) - writer->_length)) ? length : (CFIndex)sizeof(writer->_buffer) - writer->_length - 1;
+}
+
+static void __CFAllocationProfilePrintCounts(__CFAllocationProfileWriter *writer, const char *kind, const char *name, CFIndex number, __CFAllocationCounts *counts) {
+    if (counts->_allocObjects < 0.5) return;
+    __CFAllocationProfilePrintf(writer, "# %s %ld %s: %.0f: %.0f [%.0f: %.0f]\n", kind, (long)number, name, counts->_liveObjects, counts->_liveBytes, counts->_allocObjects, counts->_allocBytes);
+}
+
+/* Writes the legacy text heap profile pprof reads: a sample line of
+ * live and total counts per call stack, then the memory map pprof
+ * needs to symbolize the addresses. The per-type and per-category
+ * estimates go in between as comment lines, which pprof skips.
+ */
+Boolean _CFRuntimeWriteAllocationProfile(int fd) {
+    __CFAllocationProfileWriter *writer = (__CFAllocationProfileWriter *)malloc(sizeof(__CFAllocationProfileWriter));
+    if (NULL == writer) return false;
+    writer->_fd = fd;
+    writer->_failed = false;
+    writer->_length = 0;
+
+    __CFLock(&__CFAllocationProfilerLock);
+    int64_t liveObjects = 0, liveBytes = 0, allocObjects = 0, allocBytes = 0;
+    for (CFIndex slot = 0; slot < __kCFAllocationProfilerSampleSlots; slot++) {
+        for (__CFAllocationStack *stack = __CFAllocationProfilerStacks[slot]; stack; stack = stack->_next) {
+            liveObjects += stack->_liveObjects;
+            liveBytes += stack->_liveBytes;
+            allocObjects += stack->_allocObjects;
+            allocBytes += stack->_allocBytes;
+        }
+    }
+    __CFAllocationProfilePrintf(writer, "heap profile: %lld: %lld [%lld: %lld] @ heap_v2/%lld\n", (long long)liveObjects, (long long)liveBytes, (long long)allocObjects, (long long)allocBytes, (long long)__CFAllocationProfilerInterval);
+    for (CFIndex slot = 0; slot < __kCFAllocationProfilerSampleSlots; slot++) {
+        for (__CFAllocationStack *stack = __CFAllocationProfilerStacks[slot]; stack; stack = stack->_next) {
+            __CFAllocationProfilePrintf(writer, "%lld: %lld [%lld: %lld] @", (long long)stack->_liveObjects, (long long)stack->_liveBytes, (long long)stack->_allocObjects, (long long)stack->_allocBytes);
+            for (int idx = 0; idx < stack->_depth; idx++) __CFAllocationProfilePrintf(writer, " %p", stack->_frames[idx]);
+            __CFAllocationProfilePrintf(writer, "\n");
+        }
+    }
+    __CFAllocationProfilePrintf(writer, "\n# Estimated live objects: live bytes [allocated objects: allocated bytes]\n");
+    for (CFTypeID typeID = 0; typeID < __CFRuntimeClassTableSize; typeID++) {
+        CFRuntimeClass *cls = __CFRuntimeClassTable[typeID];
+        __CFAllocationProfilePrintCounts(writer, "type", (_kCFRuntimeNotATypeID == typeID) ? "(not an instance)" : (cls ? cls->className : "(unknown)"), typeID, &__CFAllocationProfilerTypeCounts[typeID]);
+    }
+    CFIndex categoryNumber = 0;
+    for (__CFAllocationCategory *category = __CFAllocationProfilerCategories; category; category = category->_next) {
+        __CFAllocationProfilePrintCounts(writer, "category", category->_name, categoryNumber++, &category->_counts);
+    }
+    __CFUnlock(&__CFAllocationProfilerLock);
+
+    __CFAllocationProfilePrintf(writer, "\nMAPPED_LIBRARIES:\n");
+    __CFAllocationProfileFlush(writer);
+    int maps = open("/proc/self/maps", O_RDONLY);
+    if (0 <= maps) {
+        ssize_t length;
+        while (0 < (length = read(maps, writer->_buffer, sizeof(writer->_buffer))) || (length < 0 && EINTR == errno)) {
+            if (length < 0) continue;
+            writer->_length = length;
+            __CFAllocationProfileFlush(writer);
+        }
+        close(maps);
+    }
+    Boolean result = !writer->_failed;
+    free(writer);
+    return result;
+}
+
+void _CFRuntimeSetAllocationProfilerEnabled(Boolean enabled, CFIndex sampleInterval) {
+    __CFAllocationProfilerInterval = (0 < sampleInterval) ? sampleInterval : __kCFAllocationProfilerDefaultInterval;
+    __CFAllocationProfilerEnabled = enabled;
+    // Lets CF report the names of the blocks it allocates
+    __CFOASafe = enabled;
+    // Other threads start counting once they next run out of budget
+    if (enabled) __CFAllocationProfilerBudget = __CFAllocationProfilerNextBudget();
+}
+
+static int __CFAllocationProfilerSignalPipe[2] = {-1, -1};
+static const char *__CFAllocationProfilerPathPrefix = NULL;
+
+static void __CFAllocationProfilerSignalHandler(int signo) {
+    int savedErrno = errno;
+    char byte = 0;
+    (void)write(__CFAllocationProfilerSignalPipe[1], &byte, 1);
+    errno = savedErrno;
+}
+
+// Profiles cannot be written from the handler, so a thread does it
+static void *__CFAllocationProfilerDumpThread(void *arg) {
+    int sequence = 0;
+    for (;;) {
+        char byte;
+        ssize_t length = read(__CFAllocationProfilerSignalPipe[0], &byte, 1);
+        if (length < 0 && EINTR == errno) continue;
+        if (length <= 0) break;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.%d.%04d.heap", __CFAllocationProfilerPathPrefix, (int)getpid(), ++sequence);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            CFLog(kCFLogLevelWarning, CFSTR("*** Could not write allocation profile to %s"), path);
+            continue;
+        }
+        _CFRuntimeWriteAllocationProfile(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void __CFAllocationProfilerInstallSignal(int signo, const char *prefix) {
+    __CFAllocationProfilerPathPrefix = prefix ? prefix : "/tmp/cf";
+    if (0 != pipe(__CFAllocationProfilerSignalPipe)) return;
+    fcntl(__CFAllocationProfilerSignalPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(__CFAllocationProfilerSignalPipe[1], F_SETFD, FD_CLOEXEC);
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    Boolean started = (0 == pthread_create(&thread, &attr, __CFAllocationProfilerDumpThread, NULL));
+    pthread_attr_destroy(&attr);
+    if (!started) return;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = __CFAllocationProfilerSignalHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(signo, &action, NULL);
+}
+
+#else
+
+void _CFRuntimeSetAllocationProfilerEnabled(Boolean enabled, CFIndex sampleInterval) {
+}
+
+Boolean _CFRuntimeWriteAllocationProfile(int fd) {
+    return false;
+}
+
+#endif
+
+/* Biased reference counting. When enabled, instances created with the
+ * system default allocator get a hidden header in front of their
+ * CFRuntimeBase and are biased towards the creating thread: that thread
+ * retains and releases by bumping a plain counter, and only other
+ * threads pay for atomic updates of a separate shared counter.
+ *
+ * The shared counter may go negative when another thread releases a
+ * reference the owner counted; the first such release marks the object
+ * queued and hands it to the owner, which merges the two counts the
+ * next time it releases a biased object, runs its run loop, or exits.
+ * The owner also merges when its own count drops to zero. Merging
+ * moves the total into _rc and marks the object normal, after which it
+ * is reference counted and deallocated exactly like any other
+ * instance. If the owner has already exited, the thread that queues
+ * the object merges it on the spot.
+ */
+
+#define __kCFFinalizesInPlaceInfoBit	0x080000	// in _cfinfo; see __CFRuntimeNoteFinalizerAllocator()
+
+#if __LP64__ && !DEPLOYMENT_TARGET_WINDOWS && (DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_LINUX)
+#define __CFRUNTIME_BIASED_RC 1
+#endif
+
+#if __CFRUNTIME_BIASED_RC
+
+#define __kCFBiasedRCInfoBit	0x100000	// in _cfinfo; instance has a __CFBiasedRC header
+
+// _shared holds a count in its upper 30 bits and these flags
+#define __kCFBiasedRCQueued	0x1
+#define __kCFBiasedRCNormal	0x2
+#define __kCFBiasedRCOne	0x4
+
+#define __kCFBiasedRCMerged	0xFFFFFFFFU	// _biased once merged
+
+typedef struct __CFBiasedRCThread {
+    CFLock_t _lock;
+    Boolean _alive;
+    volatile Boolean _pending;
+    int32_t _refs;			// the thread itself, plus every instance biased to it
+    CFIndex _count;
+    CFIndex _capacity;
+    CFTypeRef *_queue;
+} __CFBiasedRCThread;
+
+typedef struct {
+    __CFBiasedRCThread *_thread;	// never changes
+    uint32_t _biased;			// only touched by the owner thread
+    volatile int32_t _shared;
+} __CFBiasedRC;
+
+static Boolean __CFBiasedRCEnabled = false;
+static __thread __CFBiasedRCThread *__CFBiasedRCCurrentThread = NULL;
+
+static void _CFRelease(CFTypeRef cf);
+
+CF_INLINE __CFBiasedRC *__CFBiasedRCGet(CFTypeRef cf) {
+    return (__CFBiasedRC *)((uint8_t *)cf - sizeof(__CFBiasedRC));
+}
+
+static void __CFBiasedRCThreadRelease(__CFBiasedRCThread *thread) {
+    if (0 == OSAtomicAdd32Barrier(-1, &thread->_refs)) {
+        free(thread->_queue);
+        free(thread);
+    }
+}
+
+enum {
+    __kCFBiasedRCNotMerged = 0,
+    __kCFBiasedRCMergedLive,
+    __kCFBiasedRCMergedDead
+};
+
+// Moves the combined count into _rc. Only the owner may call this, or
+// whoever holds the object's queue entry. An object without its queue
+// entry is not merged while another thread is queueing it.
+static int32_t __CFBiasedRCMerge(CFTypeRef cf, Boolean queued) {
+    __CFBiasedRC *brc = __CFBiasedRCGet(cf);
+    uint32_t biased = brc->_biased;
+    int32_t old, total;
+    do {
+        old = brc->_shared;
+        if (!queued && (old & __kCFBiasedRCQueued)) return __kCFBiasedRCNotMerged;
+        total = (old >> 2) + (int32_t)biased;
+        ((CFRuntimeBase *)cf)->_rc = (0 < total) ? total : 1;
+    } while (!OSAtomicCompareAndSwap32Barrier(old, __kCFBiasedRCNormal, &brc->_shared));
+    brc->_biased = __kCFBiasedRCMerged;
+    return (0 < total) ? __kCFBiasedRCMergedLive : __kCFBiasedRCMergedDead;
+}
+
+static void __CFBiasedRCMergeQueued(CFTypeRef cf) {
+    // A dead merge left _rc at 1; releasing it deallocates through the normal path
+    if (__kCFBiasedRCMergedDead == __CFBiasedRCMerge(cf, true)) _CFRelease(cf);
+}
+
+static void __CFBiasedRCDrain(__CFBiasedRCThread *thread) {
+    __CFLock(&thread->_lock);
+    CFTypeRef *queue = thread->_queue;
+    CFIndex count = thread->_count;
+    thread->_queue = NULL;
+    thread->_count = 0;
+    thread->_capacity = 0;
+    thread->_pending = false;
+    __CFUnlock(&thread->_lock);
+    for (CFIndex idx = 0; idx < count; idx++) {
+        __CFBiasedRCMergeQueued(queue[idx]);
+    }
+    free(queue);
+}
+
+static void __CFBiasedRCEnqueue(__CFBiasedRCThread *thread, CFTypeRef cf) {
+    __CFLock(&thread->_lock);
+    if (!thread->_alive) {
+        // The owner can no longer touch _biased, so merge here
+        __CFUnlock(&thread->_lock);
+        __CFBiasedRCMergeQueued(cf);
+        return;
+    }
+    if (thread->_count == thread->_capacity) {
+        thread->_capacity = thread->_capacity ? 2 * thread->_capacity : 16;
+        thread->_queue = (CFTypeRef *)realloc(thread->_queue, thread->_capacity * sizeof(CFTypeRef));
+        if (NULL == thread->_queue) HALT;
+    }
+    thread->_queue[thread->_count++] = cf;
+    thread->_pending = true;
+    __CFUnlock(&thread->_lock);
+}
+
+static void __CFBiasedRCThreadExit(void *arg) {
+    __CFBiasedRCThread *thread = (__CFBiasedRCThread *)arg;
+    __CFBiasedRCCurrentThread = NULL;
+    __CFLock(&thread->_lock);
+    thread->_alive = false;
+    __CFUnlock(&thread->_lock);
+    // Nothing is added once the thread is marked dead
+    __CFBiasedRCDrain(thread);
+    __CFBiasedRCThreadRelease(thread);
+}
+
+static __CFBiasedRCThread *__CFBiasedRCGetCurrentThread(void) {
+    __CFBiasedRCThread *thread = __CFBiasedRCCurrentThread;
+    if (__builtin_expect(NULL == thread, 0)) {
+        thread = (__CFBiasedRCThread *)calloc(1, sizeof(__CFBiasedRCThread));
+        if (NULL == thread) return NULL;
+        CF_LOCK_INIT_FOR_STRUCTS(thread->_lock);
+        thread->_alive = true;
+        thread->_refs = 1;
+        _CFSetTSD(__CFTSDKeyBiasedRefCount, thread, __CFBiasedRCThreadExit);
+        if (_CFGetTSD(__CFTSDKeyBiasedRefCount) != thread) {	// thread data already gone
+            free(thread);
+            return NULL;
+        }
+        __CFBiasedRCCurrentThread = thread;
+    }
+    return thread;
+}
+
+// Returns false if the retain must be applied to _rc instead
+CF_INLINE Boolean __CFBiasedRCRetain(CFTypeRef cf) {
+    __CFBiasedRC *brc = __CFBiasedRCGet(cf);
+    if (brc->_thread == __CFBiasedRCCurrentThread && __kCFBiasedRCMerged != brc->_biased) {
+        brc->_biased++;
+        return true;
+    }
+    int32_t now = OSAtomicAdd32Barrier(__kCFBiasedRCOne, &brc->_shared);
+    return !(now & __kCFBiasedRCNormal);	// a normal object ignores the shared count
+}
+
+// Returns false if the release must be applied to _rc instead
+static Boolean __CFBiasedRCRelease(CFTypeRef cf) {
+    __CFBiasedRC *brc = __CFBiasedRCGet(cf);
+    __CFBiasedRCThread *thread = __CFBiasedRCCurrentThread;
+    if (brc->_thread == thread && __kCFBiasedRCMerged != brc->_biased && 0 < brc->_biased) {
+        if (0 < --brc->_biased) {
+            if (__builtin_expect(thread->_pending, 0)) __CFBiasedRCDrain(thread);
+            return true;
+        }
+        switch (__CFBiasedRCMerge(cf, false)) {
+        case __kCFBiasedRCMergedLive:
+            return true;
+        case __kCFBiasedRCMergedDead:
+            return false;
+        default:
+            // Another thread queued this object; the drain merges it
+            __CFBiasedRCDrain(thread);
+            return true;
+        }
+    }
+    int32_t now = OSAtomicAdd32Barrier(-__kCFBiasedRCOne, &brc->_shared);
+    if (now & __kCFBiasedRCNormal) return false;
+    if ((now >> 2) < 0 && !(now & __kCFBiasedRCQueued)) {
+        int32_t old;
+        do {
+            old = brc->_shared;
+        } while (!OSAtomicCompareAndSwap32Barrier(old, old | __kCFBiasedRCQueued, &brc->_shared));
+        if (!(old & (__kCFBiasedRCQueued | __kCFBiasedRCNormal))) {
+            __CFBiasedRCEnqueue(brc->_thread, cf);
+        }
+    }
+    return true;
+}
+
+void _CFRuntimeSetBiasedRefCountEnabled(Boolean enabled) {
+    __CFBiasedRCEnabled = enabled;
+}
+
+void _CFRuntimeDrainBiasedReleases(void) {
+    __CFBiasedRCThread *thread = __CFBiasedRCCurrentThread;
+    if (thread && thread->_pending) __CFBiasedRCDrain(thread);
+}
+
+#else
+
+void _CFRuntimeSetBiasedRefCountEnabled(Boolean enabled) {
+}
+
+void _CFRuntimeDrainBiasedReleases(void) {
+}
+
+#endif
+
 CFTypeRef _CFRuntimeCreateInstance(CFAllocatorRef allocator, CFTypeID typeID, CFIndex extraBytes, unsigned char *category) {
     if (__CFRuntimeClassTableSize <= typeID) HALT;
     CFAssert1(typeID != _kCFRuntimeNotATypeID, __kCFLogAssertion, "%s(): Uninitialized type id", __PRETTY_FUNCTION__);
@@ -310,32 +1113,69 @@ CFTypeRef _CFRuntimeCreateInstance(CFAllocatorRef allocator, CFTypeID typeID, CF
     Boolean usesSystemDefaultAllocator = _CFAllocatorIsSystemDefault(realAllocator);
     size_t align = (cls->version & _kCFRuntimeRequiresAlignment) ? cls->requiredAlignment : 16;
     CFIndex size = sizeof(CFRuntimeBase) + extraBytes + (usesSystemDefaultAllocator ? 0 : sizeof(CFAllocatorRef));
+#if __CFRUNTIME_BIASED_RC
+    __CFBiasedRCThread *biasThread = NULL;
+    if (__CFBiasedRCEnabled && usesSystemDefaultAllocator && !customRC && !(cls->version & _kCFRuntimeRequiresAlignment) && !kCFUseCollectableAllocator) {
+        biasThread = __CFBiasedRCGetCurrentThread();
+        if (biasThread) size += sizeof(__CFBiasedRC);
+    }
+#endif
     size = (size + 0xF) & ~0xF;	// CF objects are multiples of 16 in size
     // CFType version 0 objects are unscanned by default since they don't have write-barriers and hard retain their innards
     // CFType version 1 objects are scanned and use hand coded write-barriers to store collectable storage within
     CFRuntimeBase *memory = NULL;
+    Boolean cached = false;
     if (cls->version & _kCFRuntimeRequiresAlignment) {
         memory = malloc_zone_memalign(malloc_default_zone(), align, size);
     } else {
+#if __CFRUNTIME_OBJECT_CACHE
+        if (usesSystemDefaultAllocator && size <= __kCFObjectCacheMaxSize && !kCFUseCollectableAllocator && !__CFObjectCacheDisabled) {
+            memory = (CFRuntimeBase *)__CFObjectCacheAllocate(size);
+            cached = (NULL != memory);
+        }
+        if (NULL == memory)
+#endif
         memory = (CFRuntimeBase *)CFAllocatorAllocate(allocator, size, CF_GET_COLLECTABLE_MEMORY_TYPE(cls));
     }
     if (NULL == memory) {
 	return NULL;
     }
+    __CFRuntimeCountInstanceEvent(typeID, allocations);
+    if (cached) __CFRuntimeCountInstanceEvent(typeID, cachedAllocations);
     if (!kCFUseCollectableAllocator || !CF_IS_COLLECTABLE_ALLOCATOR(allocator) || !(CF_GET_COLLECTABLE_MEMORY_TYPE(cls) & __kCFAllocatorGCScannedMemory)) {
 	memset(memory, 0, size);
     }
+#if __CFRUNTIME_ALLOCATION_PROFILER
+    // Cached and aligned blocks do not come through CFAllocatorAllocate()
+    if (cached || (cls->version & _kCFRuntimeRequiresAlignment)) __CFAllocationProfilerAllocate(memory, size);
+    // Names only ever land on this thread's last sample, so the calls below are not needed
+    if (__builtin_expect(memory == __CFAllocationProfilerLastSample, 0)) __CFAllocationProfilerLabel(memory, typeID, category ? (const char *)category : cls->className);
+#else
     if (__CFOASafe && category) {
 	__CFSetLastAllocationEventName(memory, (char *)category);
     } else if (__CFOASafe) {
 	__CFSetLastAllocationEventName(memory, (char *)cls->className);
     }
+#endif
     if (!usesSystemDefaultAllocator) {
         // add space to hold allocator ref for non-standard allocators.
         // (this screws up 8 byte alignment but seems to work)
-	*(CFAllocatorRef *)((char *)memory) = (CFAllocatorRef)CFRetain(realAllocator);
+	// Objects owned by an arena do not keep it alive; the arena's owner does.
+	*(CFAllocatorRef *)((char *)memory) = __CFAllocatorIsObjectOwningArena(realAllocator) ? realAllocator : (CFAllocatorRef)CFRetain(realAllocator);
 	memory = (CFRuntimeBase *)((char *)memory + sizeof(CFAllocatorRef));
     }
+    uint32_t biasBit = 0;
+#if __CFRUNTIME_BIASED_RC
+    if (biasThread) {
+        // The creating reference is counted by the owner
+        __CFBiasedRC *brc = (__CFBiasedRC *)memory;
+        OSAtomicAdd32Barrier(1, &biasThread->_refs);
+        brc->_thread = biasThread;
+        brc->_biased = 1;
+        memory = (CFRuntimeBase *)((char *)memory + sizeof(__CFBiasedRC));
+        biasBit = __kCFBiasedRCInfoBit;
+    }
+#endif
     uint32_t rc = 0;
 #if __LP64__
     if (!kCFUseCollectableAllocator || (1 && 1)) {
@@ -354,7 +1194,7 @@ CFTypeRef _CFRuntimeCreateInstance(CFAllocatorRef allocator, CFTypeID typeID, CF
     }
 #endif
     uint32_t *cfinfop = (uint32_t *)&(memory->_cfinfo);
-    *cfinfop = (uint32_t)((rc << 24) | (customRC ? 0x800000 : 0x0) | ((uint32_t)typeID << 8) | (usesSystemDefaultAllocator ? 0x80 : 0x00));
+    *cfinfop = (uint32_t)((rc << 24) | (customRC ? 0x800000 : 0x0) | biasBit | ((uint32_t)typeID << 8) | (usesSystemDefaultAllocator ? 0x80 : 0x00));
     memory->_cfisa = 0;
     if (NULL != cls->init) {
 	(cls->init)(memory);
@@ -400,7 +1240,7 @@ void _CFRuntimeSetInstanceTypeID(CFTypeRef cf, CFTypeID newTypeID) {
     // is to a class doing custom ref counting, the ref count isn't
     // transferred and there will probably be a crash later when the
     // object is freed too early.
-    *cfinfop = (*cfinfop & 0xFFF000FFU) | ((uint32_t)newTypeID << 8);
+    *cfinfop = (*cfinfop & (0xFFF000FFU | __kCFFinalizesInPlaceInfoBit)) | ((uint32_t)newTypeID << 8);
 }
 
 CF_PRIVATE void _CFRuntimeSetInstanceTypeIDAndIsa(CFTypeRef cf, CFTypeID newTypeID) {
@@ -445,10 +1285,10 @@ CF_EXPORT uintptr_t __CFDoExternRefOperation(uintptr_t op, id obj) {
         __CFLock(lock);
 	CFBasicHashAddValue(table, disguised, disguised);
         __CFUnlock(lock);
-        if (__CFOASafe && op != 350) __CFRecordAllocationEvent(__kCFObjectRetainedEvent, obj, 0, 0, NULL);
+        if (__CFOARecordsRefCountEvents && op != 350) __CFRecordAllocationEvent(__kCFObjectRetainedEvent, obj, 0, 0, NULL);
         return (uintptr_t)obj;
     case 400:   // decrement
-        if (__CFOASafe) __CFRecordAllocationEvent(__kCFObjectReleasedEvent, obj, 0, 0, NULL);
+        if (__CFOARecordsRefCountEvents) __CFRecordAllocationEvent(__kCFObjectReleasedEvent, obj, 0, 0, NULL);
     case 450:   // decrement, no event
         __CFLock(lock);
         count = (uintptr_t)CFBasicHashRemoveValue(table, disguised);
@@ -465,7 +1305,14 @@ CF_EXPORT uintptr_t __CFDoExternRefOperation(uintptr_t op, id obj) {
 
 CF_EXPORT CFTypeID CFNumberGetTypeID(void);
 
+#if CF_TAGGED_POINTERS
+CF_PRIVATE CFTypeID __CFTaggedPointerTypeIDs[__kCFTaggedPointerTagCount] = {0};
+#endif
+
 CF_INLINE CFTypeID __CFGenericTypeID_inline(const void *cf) {
+#if CF_TAGGED_POINTERS
+    if (__CFIsTaggedPointer(cf)) return __CFTaggedPointerTypeIDs[__CFTaggedPointerGetTag(cf)];
+#endif
     // yes, 10 bits masked off, though 12 bits are there for the type field; __CFRuntimeClassTableSize is 1024
     uint32_t *cfinfop = (uint32_t *)&(((CFRuntimeBase *)cf)->_cfinfo);
     CFTypeID typeID = (*cfinfop >> 8) & 0x03FF; // mask up to 0x0FFF
@@ -515,12 +1362,17 @@ static CFTypeRef _CFRetain(CFTypeRef cf, Boolean tryR);
 
 CFTypeRef CFRetain(CFTypeRef cf) {
     if (NULL == cf) { CRSetCrashLogMessage("*** CFRetain() called with NULL ***"); HALT; }
+    if (__CFIsTaggedPointer(cf)) return cf;
     if (cf) __CFGenericAssertIsCF(cf);
     return _CFRetain(cf, false);
 }
 
+static Boolean __CFReleasePoolAdd(CFTypeRef cf);
+
 CFTypeRef CFAutorelease(CFTypeRef __attribute__((cf_consumed)) cf) {
     if (NULL == cf) { CRSetCrashLogMessage("*** CFAutorelease() called with NULL ***"); HALT; }
+    if (__CFIsTaggedPointer(cf)) return cf;
+    __CFReleasePoolAdd(cf);
     return cf;
 }
 
@@ -528,6 +1380,7 @@ static void _CFRelease(CFTypeRef cf);
 
 void CFRelease(CFTypeRef cf) {
     if (NULL == cf) { CRSetCrashLogMessage("*** CFRelease() called with NULL ***"); HALT; }
+    if (__CFIsTaggedPointer(cf)) return;
 #if 0
     void **addrs[2] = {&&start, &&end};
     start:;
@@ -632,6 +1485,19 @@ static CFLock_t __CFRuntimeExternRefCountTableLock = CFLockInit;
 
 static uint64_t __CFGetFullRetainCount(CFTypeRef cf) {
     if (NULL == cf) { CRSetCrashLogMessage("*** __CFGetFullRetainCount() called with NULL ***"); HALT; }
+    if (__CFIsTaggedPointer(cf)) return (uint64_t)0x0fffffffffffffffULL;	// like a constant object
+#if __CFRUNTIME_BIASED_RC
+    if ((*(uint32_t *)&(((CFRuntimeBase *)cf)->_cfinfo) & __kCFBiasedRCInfoBit) && 0 != ((CFRuntimeBase *)cf)->_rc) {
+        // Exact on the owner thread; elsewhere the owner's count may be in flux
+        __CFBiasedRC *brc = __CFBiasedRCGet(cf);
+        int32_t shared = brc->_shared;
+        uint32_t biased = brc->_biased;
+        if (!(shared & __kCFBiasedRCNormal) && __kCFBiasedRCMerged != biased) {
+            int64_t total = (int64_t)(shared >> 2) + biased;
+            return (0 < total) ? (uint64_t)total : 0;
+        }
+    }
+#endif
 #if __LP64__
     uint32_t lowBits = ((CFRuntimeBase *)cf)->_rc;
     if (0 == lowBits) {
@@ -654,6 +1520,7 @@ static uint64_t __CFGetFullRetainCount(CFTypeRef cf) {
 
 CFIndex CFGetRetainCount(CFTypeRef cf) {
     if (NULL == cf) { CRSetCrashLogMessage("*** CFGetRetainCount() called with NULL ***"); HALT; }
+    if (__CFIsTaggedPointer(cf)) return LONG_MAX;
     uint32_t cfinfo = *(uint32_t *)&(((CFRuntimeBase *)cf)->_cfinfo);
     if (cfinfo & 0x800000) { // custom ref counting for object
         CFTypeID typeID = (cfinfo >> 8) & 0x03FF; // mask up to 0x0FFF
@@ -678,6 +1545,219 @@ CFIndex CFGetRetainCount(CFTypeRef cf) {
     return (rc < (uint64_t)LONG_MAX) ? (CFIndex)rc : (CFIndex)LONG_MAX;
 }
 
+/* Release pools. Each thread keeps a single stack of the objects it
+ * autoreleased, with a NULL entry marking where each pool begins. A
+ * pool token is one past the index of its boundary, so it is never
+ * NULL, and popping a pool releases every entry from its boundary up.
+ */
+
+typedef struct {
+    CFIndex _count;
+    CFIndex _capacity;
+    CFTypeRef *_objects;
+} __CFReleasePoolStack;
+
+#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI || DEPLOYMENT_TARGET_LINUX
+#define __CFRUNTIME_BACKGROUND_RECLAIM 1
+#endif
+
+#if __CFRUNTIME_BACKGROUND_RECLAIM
+
+/* The reclaimer is a single detached thread, started by the first pop
+ * that has something to hand it. Pops pass it whole batches so a pop
+ * takes the queue lock once per batch, not once per object.
+ */
+
+#define __kCFReclaimBatchSize 62
+
+typedef struct __CFReclaimBatch {
+    struct __CFReclaimBatch *_next;
+    CFIndex _count;
+    CFTypeRef _objects[__kCFReclaimBatchSize];
+} __CFReclaimBatch;
+
+static Boolean __CFReclaimEnabled = false;
+static Boolean __CFReclaimThreadStarted = false;
+static pthread_mutex_t __CFReclaimLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __CFReclaimCondition = PTHREAD_COND_INITIALIZER;
+static __CFReclaimBatch *__CFReclaimQueue = NULL;
+
+static void __CFReclaimReleaseBatches(__CFReclaimBatch *batch) {
+    while (batch) {
+        __CFReclaimBatch *next = batch->_next;
+        for (CFIndex idx = 0; idx < batch->_count; idx++) {
+            CFRelease(batch->_objects[idx]);
+        }
+        free(batch);
+        batch = next;
+    }
+}
+
+static void *__CFReclaimThread(void *arg) {
+    for (;;) {
+        pthread_mutex_lock(&__CFReclaimLock);
+        while (NULL == __CFReclaimQueue) {
+            pthread_cond_wait(&__CFReclaimCondition, &__CFReclaimLock);
+        }
+        __CFReclaimBatch *batch = __CFReclaimQueue;
+        __CFReclaimQueue = NULL;
+        pthread_mutex_unlock(&__CFReclaimLock);
+        // Finalizers that autorelease get a pool here as well
+        void *pool = CFReleasePoolPush();
+        __CFReclaimReleaseBatches(batch);
+        CFReleasePoolPop(pool);
+    }
+    return NULL;
+}
+
+static void __CFReclaimSubmit(__CFReclaimBatch *batch) {
+    pthread_mutex_lock(&__CFReclaimLock);
+    if (!__CFReclaimThreadStarted) {
+        pthread_attr_t attr;
+        pthread_t thread;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        __CFReclaimThreadStarted = (0 == pthread_create(&thread, &attr, __CFReclaimThread, NULL));
+        pthread_attr_destroy(&attr);
+        if (!__CFReclaimThreadStarted) {
+            // Without a reclaimer the popping thread does the work itself
+            pthread_mutex_unlock(&__CFReclaimLock);
+            __CFReclaimReleaseBatches(batch);
+            return;
+        }
+    }
+    batch->_next = __CFReclaimQueue;
+    __CFReclaimQueue = batch;
+    pthread_cond_signal(&__CFReclaimCondition);
+    pthread_mutex_unlock(&__CFReclaimLock);
+}
+
+// True if releasing cf here would most likely deallocate it, and doing that on another thread is safe
+static Boolean __CFReclaimCanHandOff(CFTypeRef cf) {
+    uint32_t cfinfo = *(uint32_t *)&(((CFRuntimeBase *)cf)->_cfinfo);
+#if __CFRUNTIME_BIASED_RC
+    // Releasing a biased instance elsewhere only queues it back to its owner
+    if (cfinfo & __kCFBiasedRCInfoBit) return false;
+#endif
+    if (cfinfo & (0x200000 | 0x400000 | 0x800000 | __kCFFinalizesInPlaceInfoBit)) return false;
+    // Custom allocators, arenas in particular, may be reset by their owner at any time
+    if (!__CFBitfieldGetValue(((const CFRuntimeBase *)cf)->_cfinfo[CF_INFO_BITS], 7, 7)) return false;
+    CFRuntimeClass *cls = __CFRuntimeClassTable[(cfinfo >> 8) & 0x03FF];
+    if (!cls || !(cls->version & _kCFRuntimeFinalizesOnAnyThread)) return false;
+    return 1 == __CFGetFullRetainCount(cf);
+}
+
+void _CFRuntimeSetBackgroundReclaimEnabled(Boolean enabled) {
+    __CFReclaimEnabled = enabled;
+}
+
+#else
+
+void _CFRuntimeSetBackgroundReclaimEnabled(Boolean enabled) {
+}
+
+#endif
+
+void __CFRuntimeNoteFinalizerAllocator(CFTypeRef cf, CFAllocatorRef allocator) {
+    if (NULL == allocator || kCFAllocatorNull == allocator || kCFAllocatorMalloc == allocator || kCFAllocatorSystemDefault == allocator) return;
+    // Other allocators may call back into their client, which may expect to be on this thread
+    volatile int32_t *cfinfop = (volatile int32_t *)&(((CFRuntimeBase *)cf)->_cfinfo);
+    int32_t cfinfo;
+    do {
+        cfinfo = *cfinfop;
+    } while (!OSAtomicCompareAndSwap32Barrier(cfinfo, cfinfo | __kCFFinalizesInPlaceInfoBit, cfinfop));
+}
+
+// Releases the entries at index and above, newest first. Objects that
+// finalizers autorelease meanwhile land on top and are released too.
+static void __CFReleasePoolReleaseFrom(__CFReleasePoolStack *stack, CFIndex index) {
+#if __CFRUNTIME_BACKGROUND_RECLAIM
+    __CFReclaimBatch *batch = NULL;
+    Boolean reclaim = __CFReclaimEnabled;
+#endif
+    while (index < stack->_count) {
+        CFTypeRef cf = stack->_objects[--stack->_count];
+        if (NULL == cf) continue;
+#if __CFRUNTIME_BACKGROUND_RECLAIM
+        if (reclaim && __CFReclaimCanHandOff(cf)) {
+            if (batch && __kCFReclaimBatchSize == batch->_count) {
+                __CFReclaimSubmit(batch);
+                batch = NULL;
+            }
+            if (NULL == batch) {
+                batch = (__CFReclaimBatch *)malloc(sizeof(__CFReclaimBatch));
+                if (NULL == batch) HALT;
+                batch->_next = NULL;
+                batch->_count = 0;
+            }
+            batch->_objects[batch->_count++] = cf;
+            continue;
+        }
+#endif
+        CFRelease(cf);
+    }
+#if __CFRUNTIME_BACKGROUND_RECLAIM
+    if (batch) __CFReclaimSubmit(batch);
+#endif
+}
+
+static void __CFReleasePoolStackFinalize(void *arg) {
+    __CFReleasePoolStack *stack = (__CFReleasePoolStack *)arg;
+    // The slot is already clear, so anything autoreleased from here on is not pooled
+    __CFReleasePoolReleaseFrom(stack, 0);
+    free(stack->_objects);
+    free(stack);
+}
+
+static void __CFReleasePoolAppend(__CFReleasePoolStack *stack, CFTypeRef cf) {
+    if (stack->_count == stack->_capacity) {
+        stack->_capacity = stack->_capacity ? 2 * stack->_capacity : 64;
+        stack->_objects = (CFTypeRef *)realloc(stack->_objects, stack->_capacity * sizeof(CFTypeRef));
+        if (NULL == stack->_objects) HALT;
+    }
+    stack->_objects[stack->_count++] = cf;
+}
+
+// Returns false if the calling thread has no pool, in which case the object is not released
+static Boolean __CFReleasePoolAdd(CFTypeRef cf) {
+    __CFReleasePoolStack *stack = (__CFReleasePoolStack *)_CFGetTSD(__CFTSDKeyReleasePool);
+    if (NULL == stack || 0 == stack->_count) return false;
+    __CFReleasePoolAppend(stack, cf);
+    return true;
+}
+
+void *CFReleasePoolPush(void) {
+    __CFReleasePoolStack *stack = (__CFReleasePoolStack *)_CFGetTSD(__CFTSDKeyReleasePool);
+    if (NULL == stack) {
+        stack = (__CFReleasePoolStack *)calloc(1, sizeof(__CFReleasePoolStack));
+        if (NULL == stack) HALT;
+        _CFSetTSD(__CFTSDKeyReleasePool, stack, __CFReleasePoolStackFinalize);
+        if (_CFGetTSD(__CFTSDKeyReleasePool) != stack) {
+            // The thread's data is gone; the pool stays empty and popping it does nothing
+            free(stack);
+            return (void *)(uintptr_t)1;
+        }
+    }
+    __CFReleasePoolAppend(stack, NULL);
+    return (void *)(uintptr_t)stack->_count;
+}
+
+void CFReleasePoolPop(void *pool) {
+    __CFReleasePoolStack *stack = (__CFReleasePoolStack *)_CFGetTSD(__CFTSDKeyReleasePool);
+    CFIndex index = (CFIndex)(uintptr_t)pool - 1;
+    if (NULL == stack) return;
+    if (index < 0 || stack->_count <= index || NULL != stack->_objects[index]) {
+        CRSetCrashLogMessage("*** CFReleasePoolPop() called with a pool that was not pushed on this thread, or was already popped ***");
+        HALT;
+    }
+    __CFReleasePoolReleaseFrom(stack, index);
+}
+
+CF_PRIVATE Boolean __CFReleasePoolIsEmpty(void *pool) {
+    __CFReleasePoolStack *stack = (__CFReleasePoolStack *)_CFGetTSD(__CFTSDKeyReleasePool);
+    return NULL == stack || stack->_count <= (CFIndex)(uintptr_t)pool;
+}
+
 CFTypeRef CFMakeCollectable(CFTypeRef cf) {
     if (NULL == cf) return NULL;
     return cf;
@@ -847,6 +1927,14 @@ static struct {
     {"CF_CHARSET_PATH", NULL},
     {"__CF_USER_TEXT_ENCODING", NULL},
     {"CFNumberDisableCache", NULL},
+    {"CFRuntimeDisableObjectCache", NULL},
+    {"CFRuntimeInstanceStatistics", NULL},
+    {"CFRuntimeBiasedRefCount", NULL},
+    {"CFRuntimeBackgroundReclaim", NULL},
+    {"CFRuntimeBatchedCollectionRelease", NULL},
+    {"CFRuntimeAllocationProfile", NULL},
+    {"CFRuntimeAllocationProfileSignal", NULL},
+    {"CFRuntimeAllocationProfilePrefix", NULL},
     {"__CFPREFERENCES_AVOID_DAEMON", NULL},
     {"APPLE_FRAMEWORKS_ROOT", NULL},
     {NULL, NULL}, // the last one is for optional "COMMAND_MODE" "legacy", do not use this slot, insert before
@@ -921,6 +2009,28 @@ void __CFInitialize(void) {
         for (CFIndex idx = 0; idx < sizeof(__CFEnv) / sizeof(__CFEnv[0]); idx++) {
             __CFEnv[idx].value = __CFEnv[idx].name ? getenv(__CFEnv[idx].name) : NULL;
         }
+
+#if __CFRUNTIME_OBJECT_CACHE
+        for (CFIndex idx = 0; idx < __kCFObjectCacheClassCount; idx++) {
+            CF_LOCK_INIT_FOR_STRUCTS(__CFObjectCacheDepot[idx]._lock);
+        }
+        if (__CFgetenv("CFRuntimeDisableObjectCache")) __CFObjectCacheDisabled = true;
+#endif
+        if (__CFgetenv("CFRuntimeInstanceStatistics")) __CFRuntimeInstanceStatisticsEnabled = true;
+#if __CFRUNTIME_BIASED_RC
+        if (__CFgetenv("CFRuntimeBiasedRefCount")) __CFBiasedRCEnabled = true;
+#endif
+#if __CFRUNTIME_BACKGROUND_RECLAIM
+        if (__CFgetenv("CFRuntimeBackgroundReclaim")) __CFReclaimEnabled = true;
+#endif
+        if (__CFgetenv("CFRuntimeBatchedCollectionRelease")) _CFRuntimeSetBatchedCollectionReleaseEnabled(true);
+#if __CFRUNTIME_ALLOCATION_PROFILER
+        if (__CFgetenv("CFRuntimeAllocationProfile")) {
+            _CFRuntimeSetAllocationProfilerEnabled(true, (CFIndex)strtol(__CFgetenv("CFRuntimeAllocationProfile"), NULL, 0));
+            const char *signo = __CFgetenv("CFRuntimeAllocationProfileSignal");
+            if (signo && 0 < atoi(signo)) __CFAllocationProfilerInstallSignal(atoi(signo), __CFgetenv("CFRuntimeAllocationProfilePrefix"));
+        }
+#endif
         
 #if !defined(kCFUseCollectableAllocator)
         kCFUseCollectableAllocator = objc_collectingEnabled();
@@ -1224,6 +2334,13 @@ static CFTypeRef _CFRetain(CFTypeRef cf, Boolean tryR) {
 
     Boolean didAuto = false;
     if (tryR && (cfinfo & (0x400000 | 0x200000))) return NULL; // deallocating or deallocated
+#if __CFRUNTIME_BIASED_RC
+    // Constants keep the bias bit they were created with (runtime CFSTRs zero _rc); they are never counted
+    if ((cfinfo & __kCFBiasedRCInfoBit) && 0 != ((CFRuntimeBase *)cf)->_rc && __CFBiasedRCRetain(cf)) {
+        if (__builtin_expect(__CFOARecordsRefCountEvents, 0)) __CFRecordAllocationEvent(__kCFRetainEvent, (void *)cf, 0, CFGetRetainCount(cf), NULL);
+        return cf;
+    }
+#endif
 #if __LP64__
     if (0 == ((CFRuntimeBase *)cf)->_rc && !CF_IS_COLLECTABLE(cf)) return cf;	// Constant CFTypeRef
 #if !DEPLOYMENT_TARGET_WINDOWS
@@ -1291,7 +2408,7 @@ static CFTypeRef _CFRetain(CFTypeRef cf, Boolean tryR) {
         }
     } while (__builtin_expect(!success, 0));
 #endif
-    if (!didAuto && __builtin_expect(__CFOASafe, 0)) {
+    if (!didAuto && __builtin_expect(__CFOARecordsRefCountEvents, 0)) {
 	__CFRecordAllocationEvent(__kCFRetainEvent, (void *)cf, 0, CFGetRetainCount(cf), NULL);
     }
     return cf;
@@ -1303,6 +2420,7 @@ CFTypeRef _CFTryRetain(CFTypeRef cf) {
 #if OBJC_HAVE_TAGGED_POINTERS
     if (_objc_isTaggedPointer(cf)) return cf; // success
 #endif
+    if (__CFIsTaggedPointer(cf)) return cf;
     return _CFRetain(cf, true);
 }
 
@@ -1311,6 +2429,7 @@ Boolean _CFIsDeallocating(CFTypeRef cf) {
 #if OBJC_HAVE_TAGGED_POINTERS
     if (_objc_isTaggedPointer(cf)) return false;
 #endif
+    if (__CFIsTaggedPointer(cf)) return false;
     uint32_t cfinfo = *(uint32_t *)&(((CFRuntimeBase *)cf)->_cfinfo);
     if (cfinfo & 0x800000) { // custom ref counting for object
         return true;   // lie for now; this weak references to these objects cannot be formed
@@ -1318,6 +2437,12 @@ Boolean _CFIsDeallocating(CFTypeRef cf) {
     return (cfinfo & 0x400000) ? true : false;
 }
 
+// Finalizers of objects owned by an arena are skipped; the arena reclaims the whole graph at once
+CF_INLINE Boolean __CFIsArenaOwnedObject(CFTypeRef cf) {
+    if (__CFBitfieldGetValue(((const CFRuntimeBase *)cf)->_cfinfo[CF_INFO_BITS], 7, 7)) return false;
+    return __CFAllocatorIsObjectOwningArena(CFGetAllocator(cf));
+}
+
 static void _CFRelease(CFTypeRef cf) {
 
     uint32_t cfinfo = *(uint32_t *)&(((CFRuntimeBase *)cf)->_cfinfo);
@@ -1338,7 +2463,14 @@ static void _CFRelease(CFTypeRef cf) {
         return;
     }
 
-    CFIndex start_rc = __builtin_expect(__CFOASafe, 0) ? CFGetRetainCount(cf) : 0;
+    CFIndex start_rc = __builtin_expect(__CFOARecordsRefCountEvents, 0) ? CFGetRetainCount(cf) : 0;
+#if __CFRUNTIME_BIASED_RC
+    // A biased object made constant, like a runtime CFSTR, must never reach the owner's count and merge
+    if ((cfinfo & __kCFBiasedRCInfoBit) && 0 != ((CFRuntimeBase *)cf)->_rc && __CFBiasedRCRelease(cf)) {
+        if (__builtin_expect(__CFOARecordsRefCountEvents, 0)) __CFRecordAllocationEvent(__kCFReleaseEvent, (void *)cf, 0, start_rc - 1, NULL);
+        return;
+    }
+#endif
     Boolean isAllocator = (__kCFAllocatorTypeID_CONST == typeID);
     Boolean didAuto = false;
 #if __LP64__
@@ -1364,7 +2496,7 @@ static void _CFRelease(CFTypeRef cf) {
 		    goto again;
 		}
                 void (*func)(CFTypeRef) = __CFRuntimeClassTable[typeID]->finalize;
-	        if (NULL != func) {
+	        if (NULL != func && !__CFIsArenaOwnedObject(cf)) {
 		    func(cf);
 	        }
 		// Any further ref-count changes after this point are operating on a finalized object
@@ -1407,7 +2539,7 @@ static void _CFRelease(CFTypeRef cf) {
             }
 	    if (!CF_IS_COLLECTABLE(cf)) {
                 void (*func)(CFTypeRef) = __CFRuntimeClassTable[typeID]->finalize;
-	        if (NULL != func) {
+	        if (NULL != func && !__CFIsArenaOwnedObject(cf)) {
 		    func(cf);
 	        }
 	        if (isAllocator || CAS32(1, 0, (int32_t *)&((CFRuntimeBase *)cf)->_rc)) {
@@ -1482,7 +2614,7 @@ static void _CFRelease(CFTypeRef cf) {
                     goto really_free;
                 } else {
                     void (*func)(CFTypeRef) = __CFRuntimeClassTable[typeID]->finalize;
-                    if (NULL != func) {
+                    if (NULL != func && !__CFIsArenaOwnedObject(cf)) {
                         func(cf);
                     }
 		    // Any further ref-count changes after this point are operating on a finalized object
@@ -1533,7 +2665,7 @@ static void _CFRelease(CFTypeRef cf) {
 		    goto really_free;
 		} else {
                     void (*func)(CFTypeRef) = __CFRuntimeClassTable[typeID]->finalize;
-                    if (NULL != func) {
+                    if (NULL != func && !__CFIsArenaOwnedObject(cf)) {
 		        func(cf);
                     }
 		    // We recheck rcLowBits to see if the object has been retained again during
@@ -1574,13 +2706,13 @@ static void _CFRelease(CFTypeRef cf) {
     } while (!success);
 #endif
 #endif
-    if (!didAuto && __builtin_expect(__CFOASafe, 0)) {
+    if (!didAuto && __builtin_expect(__CFOARecordsRefCountEvents, 0)) {
 	__CFRecordAllocationEvent(__kCFReleaseEvent, (void *)cf, 0, start_rc - 1, NULL);
     }
     return;
 
     really_free:;
-    if (!didAuto && __builtin_expect(__CFOASafe, 0)) {
+    if (!didAuto && __builtin_expect(__CFOARecordsRefCountEvents, 0)) {
 	// do not use CFGetRetainCount() because cf has been freed if it was an allocator
 	__CFRecordAllocationEvent(__kCFReleaseEvent, (void *)cf, 0, 0, NULL);
     }
@@ -1596,16 +2728,146 @@ static void _CFRelease(CFTypeRef cf) {
             usesSystemDefaultAllocator = _CFAllocatorIsSystemDefault(allocator);
 	}
 
+	uint8_t *block = (uint8_t *)cf - (usesSystemDefaultAllocator ? 0 : sizeof(CFAllocatorRef));
+#if __CFRUNTIME_BIASED_RC
+	if (cfinfo & __kCFBiasedRCInfoBit) {
+	    __CFBiasedRCThreadRelease(__CFBiasedRCGet(cf)->_thread);
+	    block -= sizeof(__CFBiasedRC);
+	}
+#endif
+
+	__CFRuntimeCountInstanceEvent(typeID, deallocations);
+#if __CFRUNTIME_OBJECT_CACHE
+	Boolean cacheable = (kCFAllocatorSystemDefault == allocator && !kCFUseCollectableAllocator && !__CFObjectCacheDisabled);
+	// Its sample goes before the cache can hand the block out again; should the cache decline it, CFAllocatorDeallocate() finds no sample
+	if (cacheable) __CFAllocationProfilerDeallocate(block);
+	if (cacheable && __CFObjectCacheDeallocate(block)) {
+	    __CFRuntimeCountInstanceEvent(typeID, cachedDeallocations);
+	} else
+#endif
 	{
-	    CFAllocatorDeallocate(allocator, (uint8_t *)cf - (usesSystemDefaultAllocator ? 0 : sizeof(CFAllocatorRef)));
+	    CFAllocatorDeallocate(allocator, block);
 	}
 
-	if (kCFAllocatorSystemDefault != allocator) {
+	if (kCFAllocatorSystemDefault != allocator && !__CFAllocatorIsObjectOwningArena(allocator)) {
 	    CFRelease(allocator);
 	}
     }
 }
 
+// Objects flagged with any of these take the full _CFRelease path: custom ref counting, deallocating, deallocated, biased
+#define __kCFReleaseBatchSlowInfoBits	(0x800000 | 0x400000 | 0x200000 | 0x100000)
+
+#if __LP64__ && !DEPLOYMENT_TARGET_WINDOWS
+// Off until the plist teardown tests show batching to be faster on device; see _CFRuntimeSetBatchedCollectionReleaseEnabled()
+static Boolean __CFTypeCollectionReleaseBatching = false;
+#endif
+
+void _CFRuntimeSetBatchedCollectionReleaseEnabled(Boolean enabled) {
+#if __LP64__ && !DEPLOYMENT_TARGET_WINDOWS
+    __CFTypeCollectionReleaseBatching = enabled;
+#endif
+}
+
+CF_PRIVATE void __CFTypeCollectionReleaseBatchInit(__CFTypeCollectionReleaseBatch *batch, CFAllocatorRef allocator, CFIndex countHint) {
+    batch->_allocator = allocator;
+    batch->_count = 0;
+    batch->_capacity = sizeof(batch->_buffer) / sizeof(batch->_buffer[0]);
+    batch->_objects = batch->_buffer;
+#if __LP64__ && !DEPLOYMENT_TARGET_WINDOWS
+    // GC collections and retain/release event recording keep the one-at-a-time path
+    batch->_direct = !__CFTypeCollectionReleaseBatching || CF_IS_COLLECTABLE_ALLOCATOR(allocator) || __builtin_expect(__CFOARecordsRefCountEvents, 0);
+#else
+    batch->_direct = true;
+#endif
+    if (!batch->_direct && batch->_capacity < countHint) {
+        // Without the room, Add finalizes a full buffer early, which is still correct
+        CFTypeRef *objects = (CFTypeRef *)malloc(countHint * sizeof(CFTypeRef));
+        if (objects) {
+            batch->_objects = objects;
+            batch->_capacity = countHint;
+        }
+    }
+}
+
+static int __CFTypeCollectionReleaseBatchCompare(const void *a, const void *b) {
+    CFTypeRef cf1 = *(CFTypeRef *)a, cf2 = *(CFTypeRef *)b;
+    CFTypeID type1 = __CFGenericTypeID_inline(cf1), type2 = __CFGenericTypeID_inline(cf2);
+    if (type1 != type2) return (type1 < type2) ? -1 : 1;
+    // within a type, walk the heap forward
+    return (cf1 < cf2) ? -1 : ((cf1 > cf2) ? 1 : 0);
+}
+
+static void __CFTypeCollectionReleaseBatchFlush(__CFTypeCollectionReleaseBatch *batch) {
+    CFIndex count = batch->_count;
+    // Finalizers may release nested collections, which use a batch of their own
+    batch->_count = 0;
+    CFTypeRef *objects = batch->_objects;
+    CFIndex sorted = 1;
+    while (sorted < count && __CFGenericTypeID_inline(objects[sorted - 1]) <= __CFGenericTypeID_inline(objects[sorted])) sorted++;
+    if (sorted < count && count <= (CFIndex)(sizeof(batch->_buffer) / sizeof(batch->_buffer[0]))) {
+        // A dictionary's worth: a stable insertion sort by type alone keeps the parse (and so address) order within each type, for much less than qsort
+        for (CFIndex idx = sorted; idx < count; idx++) {
+            CFTypeRef cf = objects[idx];
+            CFTypeID type = __CFGenericTypeID_inline(cf);
+            CFIndex pos = idx;
+            while (0 < pos && type < __CFGenericTypeID_inline(objects[pos - 1])) {
+                objects[pos] = objects[pos - 1];
+                pos--;
+            }
+            objects[pos] = cf;
+        }
+    } else if (sorted < count) {
+        qsort(objects, count, sizeof(CFTypeRef), __CFTypeCollectionReleaseBatchCompare);
+    }
+    for (CFIndex idx = 0; idx < count; idx++) {
+        _CFRelease(batch->_objects[idx]);
+    }
+}
+
+CF_PRIVATE void __CFTypeCollectionReleaseBatchAdd(__CFTypeCollectionReleaseBatch *batch, CFTypeRef cf) {
+    if (batch->_direct) {
+        __CFTypeCollectionRelease(batch->_allocator, cf);
+        return;
+    }
+    if (NULL == cf) { CRSetCrashLogMessage("*** __CFTypeCollectionRelease() called with NULL; likely a collection has been corrupted ***"); HALT; }
+    if (__CFIsTaggedPointer(cf)) return;
+    __CFGenericAssertIsCF(cf);
+#if __LP64__ && !DEPLOYMENT_TARGET_WINDOWS
+    uint32_t cfinfo = *(uint32_t *)&(((CFRuntimeBase *)cf)->_cfinfo);
+    if (cfinfo & __kCFReleaseBatchSlowInfoBits) {
+        _CFRelease(cf);
+        return;
+    }
+    uint64_t allBits;
+    uint32_t lowBits;
+    do {
+        allBits = *(uint64_t *)&(((CFRuntimeBase *)cf)->_cfinfo);
+        lowBits = RC_GET(allBits);
+        if (0 == lowBits) {
+            if (CF_IS_COLLECTABLE(cf)) _CFRelease(cf);
+            return;        // Constant CFTypeRef
+        }
+        if (1 == lowBits) {
+            // Last reference: hold it until Finish, when _CFRelease finalizes the object
+            if (batch->_count == batch->_capacity) __CFTypeCollectionReleaseBatchFlush(batch);
+            batch->_objects[batch->_count++] = cf;
+            return;
+        }
+    } while (!CAS64(allBits, allBits - RC_INCREMENT, (int64_t *)&((CFRuntimeBase *)cf)->_cfinfo));
+#else
+    _CFRelease(cf);
+#endif
+}
+
+CF_PRIVATE void __CFTypeCollectionReleaseBatchFinish(__CFTypeCollectionReleaseBatch *batch) {
+    __CFTypeCollectionReleaseBatchFlush(batch);
+    if (batch->_objects != batch->_buffer) free(batch->_objects);
+    batch->_objects = batch->_buffer;
+    batch->_capacity = sizeof(batch->_buffer) / sizeof(batch->_buffer[0]);
+}
+
+#undef __kCFReleaseBatchSlowInfoBits
 #undef __kCFAllocatorTypeID_CONST
 #undef __CFGenericAssertIsCF
 
@@ -82,6 +82,7 @@ enum { // Version field constants
     _kCFRuntimeResourcefulObject = (1UL << 2),  // tells CFRuntime to make use of the reclaim field
     _kCFRuntimeCustomRefCount =    (1UL << 3),  // tells CFRuntime to make use of the refcount field
     _kCFRuntimeRequiresAlignment = (1UL << 4),  // tells CFRuntime to make use of the requiredAlignment field
+    _kCFRuntimeFinalizesOnAnyThread = (1UL << 5),  // finalize has no thread affinity; CFReleasePoolPop() may deallocate instances on a background thread
 };
 
 typedef struct __CFRuntimeClass {
@@ -251,6 +252,102 @@ CF_EXPORT CFTypeRef _CFRuntimeCreateInstance(CFAllocatorRef allocator, CFTypeID
 	 * of a class.  Pass NULL for the category parameter.
 	 */
 
+typedef struct {
+    int64_t allocations;
+    int64_t cachedAllocations;		// served from a per-thread object cache
+    int64_t deallocations;
+    int64_t cachedDeallocations;	// returned to a per-thread object cache
+} _CFRuntimeInstanceStatistics;
+
+CF_EXPORT void _CFRuntimeSetInstanceStatisticsEnabled(Boolean enabled);
+	/* Turns collection of per-type instance statistics on or off.
+	 * Collection is off by default since it costs every allocation
+	 * and deallocation an atomic update of a shared counter; the
+	 * CFRuntimeInstanceStatistics environment variable turns it on
+	 * at launch. Counts are not reset when collection is turned off.
+	 */
+
+CF_EXPORT Boolean _CFRuntimeGetInstanceStatistics(CFTypeID typeID, _CFRuntimeInstanceStatistics *stats);
+	/* Fills in the counts of instances of the given type created
+	 * and destroyed since statistics collection was turned on, and
+	 * how many of those went through the per-thread object caches
+	 * (which can be disabled with the CFRuntimeDisableObjectCache
+	 * environment variable). Returns false, leaving stats untouched,
+	 * if collection is off or the type ID is out of range.
+	 */
+
+CF_EXPORT void _CFRuntimeSetBiasedRefCountEnabled(Boolean enabled);
+	/* Turns biased reference counting on or off for instances
+	 * created afterwards; the CFRuntimeBiasedRefCount environment
+	 * variable turns it on at launch. A biased instance is retained
+	 * and released without atomic operations on the thread that
+	 * created it, at the cost of 16 bytes per instance. Only
+	 * instances of classes without custom reference counting or
+	 * alignment requirements, created with the system default
+	 * allocator, are biased. Where biasing is not supported (32-bit
+	 * and Windows) this function does nothing. CFGetRetainCount()
+	 * stays exact on the creating thread; other threads may see a
+	 * count that is in flux.
+	 */
+
+CF_EXPORT void _CFRuntimeDrainBiasedReleases(void);
+	/* Releases of biased instances made by other threads are
+	 * merged by the creating thread, whenever it releases a biased
+	 * instance, runs its run loop, or exits. Threads that own biased
+	 * instances but do neither for long stretches can call this
+	 * function to merge sooner.
+	 */
+
+CF_EXPORT void _CFRuntimeSetBackgroundReclaimEnabled(Boolean enabled);
+	/* Lets CFReleasePoolPop() hand the last release of an instance
+	 * to a background thread, so the finalizer and deallocation do
+	 * not run on the popping thread. Only instances of classes with
+	 * _kCFRuntimeFinalizesOnAnyThread in their version, created with
+	 * the system default allocator and without biased or custom
+	 * reference counting, are handed off. CFData and CFString set the
+	 * flag, but those of their instances whose bytes are freed by a
+	 * client supplied deallocator are always finalized in place. Off
+	 * by default; the CFRuntimeBackgroundReclaim environment variable
+	 * turns it on at launch. Where the reclaimer is not supported
+	 * (Windows) this function does nothing.
+	 */
+
+CF_EXPORT void _CFRuntimeSetBatchedCollectionReleaseEnabled(Boolean enabled);
+	/* Makes arrays, dictionaries, sets and bags holding CFTypes
+	 * drop all their references before finalizing any of the
+	 * values, then finalize those grouped by type. Off by default,
+	 * since it has not yet measured faster than releasing values one
+	 * at a time; the CFRuntimeBatchedCollectionRelease environment
+	 * variable turns it on at launch. Only supported on 64-bit
+	 * platforms other than Windows; elsewhere this function does
+	 * nothing.
+	 */
+
+CF_EXPORT void _CFRuntimeSetAllocationProfilerEnabled(Boolean enabled, CFIndex sampleInterval);
+	/* Turns the sampling allocation profiler on or off. While it is
+	 * on, one allocation per sampleInterval bytes (on average) made
+	 * through CFAllocatorAllocate() or _CFRuntimeCreateInstance() is
+	 * sampled: its call stack, CFTypeID and allocation category are
+	 * recorded, and it counts as live until it is freed. Pass 0 for
+	 * the default interval of 2MB. Threads other than the caller
+	 * may allocate up to 2MB more before they start counting. Frees
+	 * of sampled blocks are noticed even after the profiler is
+	 * turned off. The CFRuntimeAllocationProfile environment
+	 * variable turns it on at launch, with its value as the interval;
+	 * CFRuntimeAllocationProfileSignal then names a signal that writes
+	 * a profile to <CFRuntimeAllocationProfilePrefix>.<pid>.<n>.heap
+	 * (the prefix defaults to /tmp/cf). Only supported on Linux;
+	 * elsewhere this function does nothing.
+	 */
+
+CF_EXPORT Boolean _CFRuntimeWriteAllocationProfile(int fd);
+	/* Writes the samples taken so far to the given file descriptor
+	 * as a heap profile pprof can read, followed by comment lines
+	 * with estimated live and total counts for each CFTypeID and
+	 * allocation category. Returns false if the profile could not
+	 * be written or profiling is not supported.
+	 */
+
 CF_EXPORT void _CFRuntimeSetInstanceTypeID(CFTypeRef cf, CFTypeID typeID);
 	/* This function changes the typeID of the given instance.
 	 * If the specified CFTypeID is unknown to the CF runtime,
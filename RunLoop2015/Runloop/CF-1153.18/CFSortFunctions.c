@@ -35,9 +35,9 @@
 #include <dispatch/private.h>
 #endif
 
+/* CFSortArray() sorts at least this many values concurrently when asked to */
 enum {
-    kCFSortConcurrent = (1 << 0),
-    kCFSortStable = (1 << 4),
+    __kCFSortConcurrentMinCount = 65536
 };
 
 typedef CFIndex VALUE_TYPE;
@@ -134,122 +134,171 @@ static void __CFSimpleMergeSort(VALUE_TYPE listp[], INDEX_TYPE cnt, VALUE_TYPE t
 }
 
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS
-// Excluded from linux for dispatch dependency
+#define __CFSortApply(cnt, nthreads, work) dispatch_apply((cnt), __CFDispatchQueueGetGenericMatchingCurrent(), (work))
+#else
+/* Without libdispatch, work(0) through work(cnt - 1) are run by a team of up to nthreads threads, the calling thread included. Each thread claims the next unclaimed index until there are none left, so that uneven tasks even out across the team. The other members of the team come from a pool of worker threads which is started on first use, grows to the largest team asked for, and is kept for every later level and sort, so a sort does not pay for creating and joining threads at each merge level.
+*/
+struct __CFSortTeam {
+    void (^work)(size_t);
+    int32_t cnt;
+    volatile int32_t next;
+};
 
-// if !right, put the cnt1 smallest values in tmp, else put the cnt2 largest values in tmp
-static void __CFSortIndexesNMerge(VALUE_TYPE listp1[], INDEX_TYPE cnt1, VALUE_TYPE listp2[], INDEX_TYPE cnt2, VALUE_TYPE tmp[], size_t right, COMPARATOR_BLOCK cmp) {
-    // if the last element of listp1 <= the first of listp2, lists are already ordered
-    if (16 < cnt1 + cnt2 && cmp(listp1[cnt1 - 1], listp2[0]) <= 0) {
-        memmove(tmp, (right ? listp2 : listp1), (right ? cnt2 : cnt1) * sizeof(VALUE_TYPE));
+static void __CFSortTeamWork(struct __CFSortTeam *team) {
+    int32_t idx;
+    while ((idx = OSAtomicIncrement32Barrier(&team->next) - 1) < team->cnt) {
+        team->work((size_t)idx);
+    }
+}
+
+enum {
+    __kCFSortPoolMaxWorkers = 63	// ncores is at most 64, and the calling thread makes one more
+};
+
+static pthread_mutex_t __CFSortPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __CFSortPoolWake = PTHREAD_COND_INITIALIZER;	// a new team was posted
+static pthread_cond_t __CFSortPoolDone = PTHREAD_COND_INITIALIZER;	// the last worker left the team
+static int32_t __CFSortPoolWorkers = 0;		// threads in the pool
+static Boolean __CFSortPoolBusy = false;	// a team is posted; other sorts run alone until it is done
+static uint32_t __CFSortPoolGeneration = 0;	// bumped for each team
+static struct __CFSortTeam *__CFSortPoolTeam = NULL;
+static int32_t __CFSortPoolOpenings = 0;	// workers the current team still takes
+static int32_t __CFSortPoolActive = 0;		// workers still in the current team
+
+static void *__CFSortPoolWorker(void *arg) {
+    uint32_t seen = (uint32_t)(uintptr_t)arg;
+    pthread_mutex_lock(&__CFSortPoolLock);
+    for (;;) {
+        while (seen == __CFSortPoolGeneration) {
+            pthread_cond_wait(&__CFSortPoolWake, &__CFSortPoolLock);
+        }
+        seen = __CFSortPoolGeneration;
+        if (0 < __CFSortPoolOpenings) {
+            __CFSortPoolOpenings--;
+            __CFSortPoolActive++;
+            struct __CFSortTeam *team = __CFSortPoolTeam;
+            pthread_mutex_unlock(&__CFSortPoolLock);
+            __CFSortTeamWork(team);
+            pthread_mutex_lock(&__CFSortPoolLock);
+            if (0 == --__CFSortPoolActive) pthread_cond_signal(&__CFSortPoolDone);
+        }
+    }
+    return NULL;
+}
+
+static void __CFSortApply(size_t cnt, int32_t nthreads, void (^work)(size_t)) {
+    if (0 == cnt) return;
+    struct __CFSortTeam team = {work, (int32_t)cnt, 0};
+    if (cnt < (size_t)nthreads) nthreads = (int32_t)cnt;
+    int32_t helpers = __CFMin(nthreads - 1, (int32_t)__kCFSortPoolMaxWorkers);
+    pthread_mutex_lock(&__CFSortPoolLock);
+    if (__CFSortPoolBusy || helpers < 1) {
+        // Another sort has the pool, or this is a sort started from inside a comparator; the calling thread does all the work
+        pthread_mutex_unlock(&__CFSortPoolLock);
+        __CFSortTeamWork(&team);
         return;
     }
+    __CFSortPoolBusy = true;
+    __CFSortPoolGeneration++;
+    while (__CFSortPoolWorkers < helpers) {
+        pthread_attr_t attr;
+        pthread_t thread;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        // A new worker starts out as having seen the previous teams, so it joins this one
+        int err = pthread_create(&thread, &attr, __CFSortPoolWorker, (void *)(uintptr_t)(__CFSortPoolGeneration - 1));
+        pthread_attr_destroy(&attr);
+        if (0 != err) break;	// if a thread can't be created, the ones we have do all the work
+        __CFSortPoolWorkers++;
+    }
+    __CFSortPoolTeam = &team;
+    __CFSortPoolOpenings = __CFMin(helpers, __CFSortPoolWorkers);
+    pthread_cond_broadcast(&__CFSortPoolWake);
+    pthread_mutex_unlock(&__CFSortPoolLock);
+    __CFSortTeamWork(&team);
+    pthread_mutex_lock(&__CFSortPoolLock);
+    // Every index is claimed; workers that have not joined yet would find nothing to do, so they are not waited for
+    __CFSortPoolOpenings = 0;
+    while (0 < __CFSortPoolActive) {
+        pthread_cond_wait(&__CFSortPoolDone, &__CFSortPoolLock);
+    }
+    __CFSortPoolTeam = NULL;
+    __CFSortPoolBusy = false;
+    pthread_mutex_unlock(&__CFSortPoolLock);
+}
+#endif
 
-    if (right) {
-        VALUE_TYPE *listp1_end = listp1;
-        VALUE_TYPE *listp2_end = listp2;
-        VALUE_TYPE *tmp_end = tmp;
-        listp1 += cnt1 - 1;
-        listp2 += cnt2 - 1;
-        tmp += cnt2;
-        while (tmp_end < tmp) {
-            tmp--;
-            if (listp2 < listp2_end) {
-                listp1--;
-                *tmp = *listp1;
-            } else if (listp1 < listp1_end) {
-                listp2--;
-                *tmp = *listp2;
-            } else {
-                VALUE_TYPE v1 = *listp1, v2 = *listp2;
-                CMP_RESULT_TYPE res = cmp(v1, v2);
-                if (res <= 0) {
-                    *tmp = v2;
-                    listp2--;
-                } else {
-                    *tmp = v1;
-                    listp1--;
-                }
-            }
+// returns how many of the first diag values of the merge of listp1 and listp2 come from listp1; on ties, values from listp1 go first
+static INDEX_TYPE __CFSortMergePathSplit(const VALUE_TYPE listp1[], INDEX_TYPE cnt1, const VALUE_TYPE listp2[], INDEX_TYPE cnt2, INDEX_TYPE diag, COMPARATOR_BLOCK cmp) {
+    INDEX_TYPE lo = (cnt2 < diag) ? diag - cnt2 : 0;
+    INDEX_TYPE hi = (cnt1 < diag) ? cnt1 : diag;
+    while (lo < hi) {
+        INDEX_TYPE mid = lo + (hi - lo) / 2;
+        if (cmp(listp1[mid], listp2[diag - mid - 1]) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
-    } else {
-        VALUE_TYPE *listp1_end = listp1 + cnt1;
-        VALUE_TYPE *listp2_end = listp2 + cnt2;
-        VALUE_TYPE *tmp_end = tmp + cnt1;
-        while (tmp < tmp_end) {
-            if (listp2_end <= listp2) {
-                *tmp = *listp1;
-                listp1++;
-            } else if (listp1_end <= listp1) {
-                *tmp = *listp2;
-                listp2++;
-            } else {
-                VALUE_TYPE v1 = *listp1, v2 = *listp2;
-                CMP_RESULT_TYPE res = cmp(v1, v2);
-                if (res <= 0) {
-                    *tmp = v1;
-                    listp1++;
-                } else {
-                    *tmp = v2;
-                    listp2++;
-                }
-            }
-            tmp++;
+    }
+    return lo;
+}
+
+static void __CFSortMergeInto(const VALUE_TYPE listp1[], INDEX_TYPE cnt1, const VALUE_TYPE listp2[], INDEX_TYPE cnt2, VALUE_TYPE dst[], COMPARATOR_BLOCK cmp) {
+    INDEX_TYPE idx1 = 0, idx2 = 0;
+    while (idx1 < cnt1 && idx2 < cnt2) {
+        VALUE_TYPE v1 = listp1[idx1], v2 = listp2[idx2];
+        if (cmp(v1, v2) <= 0) {
+            *dst++ = v1;
+            idx1++;
+        } else {
+            *dst++ = v2;
+            idx2++;
         }
     }
+    memmove(dst, listp1 + idx1, (cnt1 - idx1) * sizeof(VALUE_TYPE));
+    memmove(dst + (cnt1 - idx1), listp2 + idx2, (cnt2 - idx2) * sizeof(VALUE_TYPE));
 }
 
-/* Merging algorithm based on
-    "A New Parallel Sorting Algorithm based on Odd-Even Mergesort", Ezequiel Herruzo, et al
+/* Sorts about four runs per core, then merges pairs of runs level by level, back and forth between listp and one scratch buffer of count values. At every level each pair is cut by merge path ("Merge Path - Parallel Merging Made Simple", Odeh, et al) into pieces of equal output length, so there are as many tasks for the last merge as for the first; every value is moved once per level.
 */
-static void __CFSortIndexesN(VALUE_TYPE listp[], INDEX_TYPE count, int32_t ncores, CMP_RESULT_TYPE (^cmp)(INDEX_TYPE, INDEX_TYPE)) {
-    /* Divide the array up into up to ncores, multiple-of-16-sized, chunks */
-    INDEX_TYPE sz = ((((count + ncores - 1) / ncores) + 15) / 16) * 16;
+static void __CFSortIndexesN(VALUE_TYPE listp[], INDEX_TYPE count, int32_t ncores, COMPARATOR_BLOCK cmp) {
+    VALUE_TYPE *scratch = (VALUE_TYPE *)malloc(count * sizeof(VALUE_TYPE));
+    /* Divide the array up into up to 4 * ncores, multiple-of-16-sized, runs */
+    INDEX_TYPE sz = ((((count + 4 * ncores - 1) / (4 * ncores)) + 15) / 16) * 16;
     INDEX_TYPE num_sect = (count + sz - 1) / sz;
-    INDEX_TYPE last_sect_len = count + sz - sz * num_sect;
-
-    STACK_BUFFER_DECL(VALUE_TYPE *, stack_tmps, num_sect);
-    for (INDEX_TYPE idx = 0; idx < num_sect; idx++) {
-        stack_tmps[idx] = (VALUE_TYPE *)malloc(sz * sizeof(VALUE_TYPE));
-    }
-    VALUE_TYPE **tmps = stack_tmps;
 
-    dispatch_queue_t q = __CFDispatchQueueGetGenericMatchingCurrent();
-    dispatch_apply(num_sect, q, ^(size_t sect) {
-            INDEX_TYPE sect_len = (sect < num_sect - 1) ? sz : last_sect_len;
-            __CFSimpleMergeSort(listp + sect * sz, sect_len, tmps[sect], cmp); // naturally stable
+    __CFSortApply(num_sect, ncores, ^(size_t sect) {
+            INDEX_TYPE base = sect * sz;
+            __CFSimpleMergeSort(listp + base, __CFMin(sz, count - base), scratch + base, cmp); // naturally stable
         });
 
-    INDEX_TYPE even_phase_cnt = ((num_sect / 2) * 2);
-    INDEX_TYPE odd_phase_cnt = (((num_sect - 1) / 2) * 2);
-    for (INDEX_TYPE idx = 0; idx < (num_sect + 1) / 2; idx++) {
-        dispatch_apply(even_phase_cnt, q, ^(size_t sect) { // merge even
-                size_t right = sect & (size_t)0x1;
-                VALUE_TYPE *left_base = listp + sect * sz - (right ? sz : 0);
-                VALUE_TYPE *right_base = listp + sect * sz + (right ? 0 : sz);
-                INDEX_TYPE sect2_len = (sect + 1 + (right ? 0 : 1) == num_sect) ? last_sect_len : sz;
-                __CFSortIndexesNMerge(left_base, sz, right_base, sect2_len, tmps[sect], right, cmp);
+    VALUE_TYPE *src = listp, *dst = scratch;
+    for (INDEX_TYPE width = sz; width < count; width *= 2) {
+        INDEX_TYPE num_pairs = (count + 2 * width - 1) / (2 * width);
+        INDEX_TYPE pieces = (num_sect + num_pairs - 1) / num_pairs;
+        INDEX_TYPE piece_len = (2 * width + pieces - 1) / pieces;
+        const VALUE_TYPE *from = src;
+        VALUE_TYPE *to = dst;
+        __CFSortApply(num_pairs * pieces, ncores, ^(size_t task) {
+                INDEX_TYPE base = (task / pieces) * 2 * width;
+                INDEX_TYPE cnt1 = __CFMin(width, count - base);
+                INDEX_TYPE cnt2 = __CFMin(width, count - base - cnt1);
+                INDEX_TYPE diag0 = __CFMin((INDEX_TYPE)(task % pieces) * piece_len, cnt1 + cnt2);
+                INDEX_TYPE diag1 = __CFMin(diag0 + piece_len, cnt1 + cnt2);
+                if (diag0 == diag1) return;
+                const VALUE_TYPE *listp1 = from + base, *listp2 = from + base + cnt1;
+                INDEX_TYPE split0 = __CFSortMergePathSplit(listp1, cnt1, listp2, cnt2, diag0, cmp);
+                INDEX_TYPE split1 = __CFSortMergePathSplit(listp1, cnt1, listp2, cnt2, diag1, cmp);
+                __CFSortMergeInto(listp1 + split0, split1 - split0, listp2 + (diag0 - split0), (diag1 - split1) - (diag0 - split0), to + base + diag0, cmp); // ties go left, so stable
             });
-        if (num_sect & 0x1) {
-            memmove(tmps[num_sect - 1], listp + (num_sect - 1) * sz, last_sect_len * sizeof(VALUE_TYPE));
-        }
-        dispatch_apply(odd_phase_cnt, q, ^(size_t sect) { // merge odd
-                size_t right = sect & (size_t)0x1;
-                VALUE_TYPE *left_base = tmps[sect + (right ? 0 : 1)];
-                VALUE_TYPE *right_base = tmps[sect + (right ? 1 : 2)];
-                INDEX_TYPE sect2_len = (sect + 1 + (right ? 1 : 2) == num_sect) ? last_sect_len : sz;
-                __CFSortIndexesNMerge(left_base, sz, right_base, sect2_len, listp + sect * sz + sz, right, cmp);
-            });
-        memmove(listp + 0 * sz, tmps[0], sz * sizeof(VALUE_TYPE));
-        if (!(num_sect & 0x1)) {
-            memmove(listp + (num_sect - 1) * sz, tmps[num_sect - 1], last_sect_len * sizeof(VALUE_TYPE));
-        }
+        src = dst;
+        dst = (VALUE_TYPE *)from;
     }
-
-    for (INDEX_TYPE idx = 0; idx < num_sect; idx++) {
-        free(stack_tmps[idx]);
+    if (src != listp) {
+        memmove(listp, src, count * sizeof(VALUE_TYPE));
     }
+    free(scratch);
 }
-#endif
 
 // fills an array of indexes (of length count) giving the indexes 0 - count-1, as sorted by the comparator block
 void CFSortIndexes(CFIndex *indexBuffer, CFIndex count, CFOptionFlags opts, CFComparisonResult (^cmp)(CFIndex, CFIndex)) {
@@ -267,30 +316,24 @@ void CFSortIndexes(CFIndex *indexBuffer, CFIndex count, CFOptionFlags opts, CFCo
         } else if (count < 16000 && 8 < ncores) {
             ncores = 8;
         }
-        if (16 < ncores) {
-            ncores = 16;
+        if (64 < ncores) {
+            ncores = 64;
         }
     }
-#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS
-    if (count <= 65536) {
+    if (count <= 65536 || !(opts & kCFSortConcurrent)) {
         for (CFIndex idx = 0; idx < count; idx++) indexBuffer[idx] = idx;
     } else {
         /* Specifically hard-coded to 8; the count has to be very large before more chunks and/or cores is worthwhile. */
         CFIndex sz = ((((size_t)count + 15) / 16) * 16) / 8;
-        dispatch_apply(8, __CFDispatchQueueGetGenericMatchingCurrent(), ^(size_t n) {
+        __CFSortApply(8, ncores, ^(size_t n) {
                 CFIndex idx = n * sz, lim = __CFMin(idx + sz, count);
                 for (; idx < lim; idx++) indexBuffer[idx] = idx;
             });
     }
-#else
-    for (CFIndex idx = 0; idx < count; idx++) indexBuffer[idx] = idx;
-#endif
-#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS
     if (opts & kCFSortConcurrent) {
         __CFSortIndexesN(indexBuffer, count, ncores, cmp); // naturally stable
         return;
     }
-#endif
     STACK_BUFFER_DECL(VALUE_TYPE, local, count <= 4096 ? count : 1);
     VALUE_TYPE *tmp = (count <= 4096) ? local : (VALUE_TYPE *)malloc(count * sizeof(VALUE_TYPE));
     __CFSimpleMergeSort(indexBuffer, count, tmp, cmp); // naturally stable
@@ -298,11 +341,12 @@ void CFSortIndexes(CFIndex *indexBuffer, CFIndex count, CFOptionFlags opts, CFCo
 }
 
 /* Comparator is passed the address of the values. */
-void CFQSortArray(void *list, CFIndex count, CFIndex elementSize, CFComparatorFunction comparator, void *context) {
+void CFSortArray(void *list, CFIndex count, CFIndex elementSize, CFOptionFlags opts, CFComparatorFunction comparator, void *context) {
     if (count < 2 || elementSize < 1) return;
+    if (count < __kCFSortConcurrentMinCount) opts &= ~kCFSortConcurrent;
     STACK_BUFFER_DECL(CFIndex, locali, count <= 4096 ? count : 1);
     CFIndex *indexes = (count <= 4096) ? locali : (CFIndex *)malloc(count * sizeof(CFIndex));
-    CFSortIndexes(indexes, count, 0, ^(CFIndex a, CFIndex b) { return comparator((char *)list + a * elementSize, (char *)list + b * elementSize, context); });
+    CFSortIndexes(indexes, count, opts, ^(CFIndex a, CFIndex b) { return comparator((char *)list + a * elementSize, (char *)list + b * elementSize, context); });
     STACK_BUFFER_DECL(uint8_t, locals, count <= (16 * 1024 / elementSize) ? count * elementSize : 1);
     void *store = (count <= (16 * 1024 / elementSize)) ? locals : malloc(count * elementSize);
     for (CFIndex idx = 0; idx < count; idx++) {
@@ -320,27 +364,14 @@ void CFQSortArray(void *list, CFIndex count, CFIndex elementSize, CFComparatorFu
     if (locali != indexes) free(indexes);
 }
 
+/* Comparator is passed the address of the values. */
+void CFQSortArray(void *list, CFIndex count, CFIndex elementSize, CFComparatorFunction comparator, void *context) {
+    CFSortArray(list, count, elementSize, 0, comparator, context);
+}
+
 /* Comparator is passed the address of the values. */
 void CFMergeSortArray(void *list, CFIndex count, CFIndex elementSize, CFComparatorFunction comparator, void *context) {
-    if (count < 2 || elementSize < 1) return;
-    STACK_BUFFER_DECL(CFIndex, locali, count <= 4096 ? count : 1);
-    CFIndex *indexes = (count <= 4096) ? locali : (CFIndex *)malloc(count * sizeof(CFIndex));
-    CFSortIndexes(indexes, count, kCFSortStable, ^(CFIndex a, CFIndex b) { return comparator((char *)list + a * elementSize, (char *)list + b * elementSize, context); });
-    STACK_BUFFER_DECL(uint8_t, locals, count <= (16 * 1024 / elementSize) ? count * elementSize : 1);
-    void *store = (count <= (16 * 1024 / elementSize)) ? locals : malloc(count * elementSize);
-    for (CFIndex idx = 0; idx < count; idx++) {
-        if (sizeof(uintptr_t) == elementSize) {
-            uintptr_t *a = (uintptr_t *)list + indexes[idx];
-            uintptr_t *b = (uintptr_t *)store + idx;
-            *b = *a;
-        } else {
-            memmove((char *)store + idx * elementSize, (char *)list + indexes[idx] * elementSize, elementSize);
-        }
-    }
-    // no swapping or modification of the original list has occurred until this point
-    objc_memmove_collectable(list, store, count * elementSize);
-    if (locals != store) free(store);
-    if (locali != indexes) free(indexes);
+    CFSortArray(list, count, elementSize, kCFSortStable, comparator, context);
 }
 
 
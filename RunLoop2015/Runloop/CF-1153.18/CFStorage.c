@@ -32,6 +32,8 @@
  ??? Currently elementSize cannot be greater than storage->maxLeafCapacity, which is less than or equal to __CFStorageMaxLeafCapacity
  
  CFStorage is thread-safe for multiple readers, but not thread safe for simultaneous reading and  writing.
+ 
+ Non-mutating reads (CFStorageGetConstValueAtIndex(), CFStorageGetValues(), the apply functions and cursors) do not write to the storage or its nodes: they bypass the last-leaf cache, which lives partly in the nodes, and read leaves whose memory has not been allocated yet as zeros rather than allocating it. This is what lets a snapshot (CFStorageCreateSnapshot()) be read from other threads while its source, which shares its frozen nodes, keeps mutating.
  */
 
 
@@ -74,6 +76,9 @@
 #define COPYMEM(src,dst,n) objc_memmove_collectable((dst), (src), (n))
 #define PAGE_LIMIT ((CFIndex)PAGE_SIZE / 2)
 
+/* Stands in for the memory of leaves which have not been allocated yet, when reading without mutating */
+static const uint8_t __CFStorageZeroLeafMemory[__CFStorageMaxLeafCapacity] = {0};
+
 CF_INLINE int32_t roundToPage(int32_t num) {
     return (num + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 }
@@ -356,6 +361,11 @@ static void *__CFStorageFindByte(CFStorageRef storage, CFStorageNode *node, CFIn
     if (node->isLeaf) {
         *validConsecutiveByteRange = CFRangeMake(absoluteByteOffsetOfNode, node->numBytes);
 	*resultNode = node;
+	if (! requireUnfreezing) {
+	    /* The leaf may be shared with a storage being read on another thread, so don't allocate its memory here */
+	    uint8_t *memory = node->info.leaf.memory;
+	    return (memory ? memory : (uint8_t *)__CFStorageZeroLeafMemory) + byteNum;
+	}
         __CFStorageAllocLeafNodeMemory(CFGetAllocator(storage), storage, node, node->numBytes, false);
         return node->info.leaf.memory + byteNum;
     } else {
@@ -375,11 +385,16 @@ static void *__CFStorageFindByte(CFStorageRef storage, CFStorageNode *node, CFIn
 }
 
 /* Guts of CFStorageGetValueAtIndex(); note that validConsecutiveValueRange is not optional.
- Consults and updates cache.
+ Consults and updates cache when mutating; non-mutating lookups go straight down the tree and write nothing.
  */
 CF_INLINE void *__CFStorageGetValueAtIndex(CFStorageRef storage, CFIndex idx, CFRange *validConsecutiveValueRange, bool requireUnfreezing) {
     uint8_t *result;
-    if (!(result = __CFStorageGetFromCache(storage, idx, validConsecutiveValueRange, requireUnfreezing))) {
+    if (! requireUnfreezing) {
+	CFStorageNode *resultNode;
+	CFRange rangeInBytes;
+	result = (uint8_t *)__CFStorageFindByte(storage, &storage->rootNode, __CFStorageConvertValueToByte(storage, idx), 0, &resultNode, &rangeInBytes, false);
+	*validConsecutiveValueRange = __CFStorageConvertBytesToValueRange(storage, rangeInBytes.location, rangeInBytes.length);
+    } else if (!(result = __CFStorageGetFromCache(storage, idx, validConsecutiveValueRange, requireUnfreezing))) {
 	CFStorageNode *resultNode;
 	CFRange rangeInBytes;
 	result = (uint8_t *)__CFStorageFindByte(storage, &storage->rootNode, __CFStorageConvertValueToByte(storage, idx), 0, &resultNode, &rangeInBytes, requireUnfreezing);
@@ -987,10 +1002,8 @@ static bool __CFStorageEnumerateNodesInByteRangeWithBlock(CFStorageRef storage,
     if (node->isLeaf) {
 	CFIndex start = range.location;
 	CFIndex length = __CFMin(range.length, node->numBytes - start);
-	if (! node->info.leaf.memory) {
-	    __CFStorageAllocLeafNodeMemory(CFGetAllocator(storage), storage, node, node->numBytes, false);
-	}
-	applier(node->info.leaf.memory + start, __CFStorageConvertBytesToValueRange(storage, globalOffsetOfNode + start, length), &stop);
+	const uint8_t *memory = node->info.leaf.memory;
+	applier((memory ? memory : __CFStorageZeroLeafMemory) + start, __CFStorageConvertBytesToValueRange(storage, globalOffsetOfNode + start, length), &stop);
     }
     else {
 	CFStorageNode *children[3] = {node->info.notLeaf.child[0], node->info.notLeaf.child[1], node->info.notLeaf.child[2]};
@@ -1162,6 +1175,9 @@ CFStorageRef CFStorageCreateWithSubrange(CFStorageRef mutStorage, CFRange range)
 	CFStorageNode *nodeContainingEntireRange = _CFStorageFindNodeContainingByteRange(storage, &storage->rootNode, byteRange, 0, &byteRangeOfContainingNode);
 	ASSERT(nodeContainingEntireRange != NULL);
 	
+	/* The cached leaf may be below a node we are about to freeze, without being marked frozen itself; a write through the cache would then show up in the copy */
+	if (! nodeContainingEntireRange->isLeaf) __CFStorageSetCache(mutStorage, NULL, 0);
+	
 	/* If the result is a leaf, insert the portion we care about */
 	if (nodeContainingEntireRange->isLeaf) {
 	    CFStorageInsertValues(result, CFRangeMake(0, range.length));
@@ -1200,6 +1216,34 @@ CFStorageRef CFStorageCreateWithSubrange(CFStorageRef mutStorage, CFRange range)
     return result;
 }
 
+CFStorageRef CFStorageCreateSnapshot(CFStorageRef storage) {
+    CFStorageRef result = CFStorageCreate(CFGetAllocator(storage), storage->valueSize);
+    if (NULL == result) return NULL;
+    result->maxLeafCapacity = storage->maxLeafCapacity;
+    result->nodeHint = storage->nodeHint;
+    if (storage->rootNode.isLeaf) {
+	/* A root leaf is inline in the storage and can't be shared; it holds at most maxLeafCapacity bytes, so copying it is bounded */
+	CFIndex count = __CFStorageGetCount(storage);
+	if (count > 0) {
+	    CFStorageInsertValues(result, CFRangeMake(0, count));
+	    if (storage->rootNode.info.leaf.memory) CFStorageReplaceValues(result, CFRangeMake(0, count), storage->rootNode.info.leaf.memory);
+	}
+    } else {
+	/* Freeze the root's children and share them.  Frozen nodes are copied by whichever storage next mutates them, so the source can keep mutating while the snapshot is read.  The source's cached leaf may be below one of these children without being marked frozen, so drop it. */
+	__CFStorageSetCache(storage, NULL, 0);
+	result->rootNode.isLeaf = false;
+	result->rootNode.numBytes = storage->rootNode.numBytes;
+	result->rootNode.info.notLeaf.child[0] = result->rootNode.info.notLeaf.child[1] = result->rootNode.info.notLeaf.child[2] = NULL;
+	for (CFIndex i = 0; i < 3; i++) {
+	    CFStorageNode *child = storage->rootNode.info.notLeaf.child[i];
+	    if (! child) break;
+	    __CFStorageFreezeNode(child);
+	    __CFStorageSetChild(&result->rootNode, i, __CFStorageRetainNode(child));
+	}
+    }
+    return result;
+}
+
 CFTypeID CFStorageGetTypeID(void) {
     static dispatch_once_t initOnce;
     dispatch_once(&initOnce, ^{ __kCFStorageTypeID = _CFRuntimeRegisterClass(&__CFStorageClass); });
@@ -1223,6 +1267,21 @@ const void *CFStorageGetConstValueAtIndex(CFStorageRef storage, CFIndex idx, CFR
     return __CFStorageGetValueAtIndex(storage, idx, validConsecutiveValueRange ? validConsecutiveValueRange : &dummy, false/*requireUnfreezing*/);
 }
 
+void CFStorageInitCursor(CFStorageRef storage, CFStorageCursor *cursor) {
+    cursor->storage = storage;
+    cursor->range = CFRangeMake(0, 0);
+    cursor->bytes = NULL;
+}
+
+const void *CFStorageCursorGetValueAtIndex(CFStorageCursor *cursor, CFIndex idx, CFRange *validConsecutiveValueRange) {
+    CFStorageRef storage = cursor->storage;
+    if (idx < cursor->range.location || idx >= cursor->range.location + cursor->range.length) {
+	cursor->bytes = (const uint8_t *)__CFStorageGetValueAtIndex(storage, idx, &cursor->range, false/*requireUnfreezing*/) - __CFStorageConvertValueToByte(storage, idx - cursor->range.location);
+    }
+    if (validConsecutiveValueRange) *validConsecutiveValueRange = cursor->range;
+    return cursor->bytes + __CFStorageConvertValueToByte(storage, idx - cursor->range.location);
+}
+
 
 /* Makes space for range.length values at location range.location
  This function deepens the tree if necessary...
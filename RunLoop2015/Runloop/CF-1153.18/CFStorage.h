@@ -64,6 +64,21 @@ CF_EXTERN_C_BEGIN
 */
 typedef struct __CFStorage *CFStorageRef;
 
+/*!
+	@typedef CFStorageCursor
+	Remembers the leaf of the last lookup made through it, so that
+	lookups near each other skip the walk down the tree.  A cursor is
+	owned by one reader, so unlike the storage's own cache it can be
+	used from any number of threads at once, one cursor each.  A cursor
+	is invalidated by any mutation of its storage.  The fields are
+	private.
+*/
+typedef struct {
+    CFStorageRef storage;
+    CFRange range;
+    const UInt8 *bytes;
+} CFStorageCursor;
+
 /*!
 	@typedef CFStorageApplierFunction
 	Type of the callback function used by the apply functions of
@@ -177,9 +192,8 @@ CF_EXPORT void *CFStorageGetValueAtIndex(CFStorageRef storage, CFIndex idx, CFRa
 	@function CFStorageGetConstValueAtIndex
 		Returns a pointer to the specified value.  The pointer is immutable and may
 		only be used to get the value.  This is not considered to be a mutating function,
-		so it is safe to call this concurrently with other non-mutating functions.  Furthermore,
- 		this is often more efficient than CFStorageGetValueAtIndex(), so it should be used
-  		in preference to that function when possible.
+		so it is safe to call this concurrently with other non-mutating functions.  It does not
+		use the storage's last-leaf cache; use a CFStorageCursor for runs of nearby lookups.
 	@param storage The storage to be queried. If this parameter is not a
 		valid CFStorage, the behavior is undefined.
 	@param idx The index of the value to retrieve. If the index is
@@ -195,6 +209,27 @@ CF_EXPORT void *CFStorageGetValueAtIndex(CFStorageRef storage, CFIndex idx, CFRa
 */
 CF_EXPORT const void *CFStorageGetConstValueAtIndex(CFStorageRef storage, CFIndex idx, CFRange *validConsecutiveValueRange);
 
+/*!
+	@function CFStorageInitCursor
+	Prepares a cursor for non-mutating lookups in the storage.
+	@param storage The storage to be read.
+	@param cursor The cursor to initialize.
+*/
+CF_EXPORT void CFStorageInitCursor(CFStorageRef storage, CFStorageCursor *cursor);
+
+/*!
+	@function CFStorageCursorGetValueAtIndex
+		Same as CFStorageGetConstValueAtIndex(), but returns without
+		walking the tree when the value is in the leaf of the cursor's
+		last lookup.  This is not a mutating function.
+	@param cursor A cursor initialized with CFStorageInitCursor().
+	@param idx The index of the value to retrieve.
+	@param validConsecutiveValueRange Optional; set as by
+		CFStorageGetConstValueAtIndex().
+	@result The value with the given index in the storage.
+*/
+CF_EXPORT const void *CFStorageCursorGetValueAtIndex(CFStorageCursor *cursor, CFIndex idx, CFRange *validConsecutiveValueRange);
+
 /*!
         @function CFStorageGetValues
 	Fills the buffer with values from the storage.
@@ -278,6 +313,21 @@ CF_EXPORT void CFStorageApplyBlock(CFStorageRef storage, CFRange range, CFStorag
  */
 CF_EXPORT CFStorageRef CFStorageCreateWithSubrange(CFStorageRef storage, CFRange range);
 
+/*!
+	@function CFStorageCreateSnapshot
+	Returns a new CFStorage with the same contents as an existing one, in
+	constant time.  The two share the nodes of the tree, which are frozen
+	and copied by whichever storage next modifies them.
+	Any number of threads may read the snapshot with the non-mutating
+	functions (CFStorageGetConstValueAtIndex(), CFStorageGetValues(),
+	CFStorageApplyBlock(), cursors) while the original storage continues
+	to be mutated on its own thread.
+	@param storage The storage to be operated upon. If this parameter is not
+		a valid CFStorage, the behavior is undefined.
+	@result A reference to a new CFStorage with the same values.
+*/
+CF_EXPORT CFStorageRef CFStorageCreateSnapshot(CFStorageRef storage);
+
 /*!
         @function CFStorageReplaceValues
 	Replaces a range of values in the storage.
@@ -117,9 +117,6 @@ static void __CFStringAppendFormatCore(CFMutableStringRef outputString, CFString
 // We put this into C & Pascal strings if we can't convert
 #define CONVERSIONFAILURESTR "CFString conversion failed"
 
-// We set this to true when purging the constant string table, so CFStringDeallocate doesn't assert
-static Boolean __CFConstantStringTableBeingFreed = false;
-
 #endif
 
 
@@ -188,8 +185,7 @@ U = is Unicode
 N = has NULL byte
 L = has length byte
 D = explicit deallocator for contents (for mutable objects, allocator)
-C = length field is CFIndex (rather than UInt32); only meaningful for 64-bit, really
-    if needed this bit (valuable real-estate) can be given up for another bit elsewhere, since this info is needed just for 64-bit
+H = has hash cache word after the contents (immutable, non-constant strings only)
 
 Also need (only for mutable)
 F = is fixed
@@ -197,7 +193,7 @@ G = has gap
 Cap, DesCap = capacity
 
 B7 B6 B5 B4 B3 B2 B1 B0
-         U  N  L  C  I
+         U  N  L  H  I
 
 B6 B5
  0  0   inline contents
@@ -231,9 +227,14 @@ enum {
 	__kCFHasNullByte = 0x08,
     __kCFHasLengthByteMask = 0x04,
 	__kCFHasLengthByte = 0x04,
-    // !!! Bit 0x02 has been freed up
+    __kCFHasHashCacheMask = 0x02,
+	__kCFHasHashCache = 0x02,
 };
 
+/* Immutable strings created through __CFStringCreateImmutableFunnel3() with at least this many bytes of contents get a word, following the variant fields and the inline contents, in which the first computed hash is kept; dictionary and set probes with long-lived keys then skip rehashing.
+*/
+#define __kCFStrHashCacheMinBytes 16
+
 
 // !!! Assumptions:
 // Mutable strings are not inline
@@ -252,6 +253,7 @@ CF_INLINE Boolean __CFStrIsUnicode(CFStringRef str)                 {return (str
 CF_INLINE Boolean __CFStrIsEightBit(CFStringRef str)                {return (str->base._cfinfo[CF_INFO_BITS] & __kCFIsUnicodeMask) != __kCFIsUnicode;}
 CF_INLINE Boolean __CFStrHasNullByte(CFStringRef str)               {return (str->base._cfinfo[CF_INFO_BITS] & __kCFHasNullByteMask) == __kCFHasNullByte;}
 CF_INLINE Boolean __CFStrHasLengthByte(CFStringRef str)             {return (str->base._cfinfo[CF_INFO_BITS] & __kCFHasLengthByteMask) == __kCFHasLengthByte;}
+CF_INLINE Boolean __CFStrHasHashCache(CFStringRef str)              {return (str->base._cfinfo[CF_INFO_BITS] & __kCFHasHashCacheMask) == __kCFHasHashCache;}
 CF_INLINE Boolean __CFStrHasExplicitLength(CFStringRef str)         {return (str->base._cfinfo[CF_INFO_BITS] & (__kCFIsMutableMask | __kCFHasLengthByteMask)) != __kCFHasLengthByte;}	// Has explicit length if (1) mutable or (2) not mutable and no length byte
 CF_INLINE Boolean __CFStrIsConstant(CFStringRef str) {
 #if __LP64__
@@ -285,6 +287,7 @@ CF_INLINE CFAllocatorRef __CFStrContentsDeallocator(CFStringRef str) {
 CF_INLINE void __CFStrSetContentsDeallocator(CFStringRef str, CFAllocatorRef allocator) {
     if (!(0 || 0)) CFRetain(allocator);
     *__CFStrContentsDeallocatorPtr(str) = allocator;
+    __CFRuntimeNoteFinalizerAllocator(str, allocator);
 }
 
 static CFAllocatorRef *__CFStrContentsAllocatorPtr(CFStringRef str) {
@@ -302,6 +305,7 @@ CF_INLINE CFAllocatorRef __CFStrContentsAllocator(CFMutableStringRef str) {
 CF_INLINE void __CFStrSetContentsAllocator(CFMutableStringRef str, CFAllocatorRef allocator) {
     if (!(0 || 0)) CFRetain(allocator);
     *(__CFStrContentsAllocatorPtr(str)) = allocator;
+    __CFRuntimeNoteFinalizerAllocator(str, allocator);
 }
 
 /* Returns length; use __CFStrLength2 if contents buffer pointer has already been computed.
@@ -330,6 +334,18 @@ CF_INLINE CFIndex __CFStrLength2(CFStringRef str, const void *buffer) {
     }
 }
 
+/* Returns ptr to the hash cache word of a string which has one; this is the first word boundary after the variant fields, or after the contents for inline strings. Since the runtime zero-fills new instances, a zero word means the hash has not been computed yet.
+*/
+CF_INLINE CFHashCode *__CFStrHashCachePtr(CFStringRef str, const void *buffer, CFIndex len) {
+    uintptr_t end;
+    if (__CFStrIsInline(str)) {
+        end = (uintptr_t)buffer + __CFStrSkipAnyLengthByte(str) + len * (__CFStrIsUnicode(str) ? sizeof(UniChar) : sizeof(uint8_t)) + (__CFStrHasNullByte(str) ? 1 : 0);
+    } else {
+        end = (uintptr_t)&(str->variants) + sizeof(void *) + (__CFStrHasExplicitLength(str) ? sizeof(CFIndex) : 0) + (__CFStrHasContentsDeallocator(str) ? sizeof(CFAllocatorRef) : 0);
+    }
+    return (CFHashCode *)((end + sizeof(CFHashCode) - 1) & ~(uintptr_t)(sizeof(CFHashCode) - 1));
+}
+
 
 Boolean __CFStringIsEightBit(CFStringRef str) {
     return __CFStrIsEightBit(str);
@@ -945,7 +961,7 @@ static void __CFStringDeallocate(CFTypeRef cf) {
     CFStringRef str = (CFStringRef)cf;
 
     // If in DEBUG mode, check to see if the string a CFSTR, and complain.
-    CFAssert1(__CFConstantStringTableBeingFreed || !__CFStrIsConstantString((CFStringRef)cf), __kCFLogAssertion, "Tried to deallocate CFSTR(\"%@\")", str);
+    CFAssert1(!__CFStrIsConstantString((CFStringRef)cf), __kCFLogAssertion, "Tried to deallocate CFSTR(\"%@\")", str);
 
     if (!__CFStrIsInline(str)) {
         uint8_t *contents;
@@ -1172,13 +1188,153 @@ CFHashCode __CFStringHash(CFTypeRef cf) {
     CFStringRef str = (CFStringRef)cf;
     const uint8_t *contents = (uint8_t *)__CFStrContents(str);
     CFIndex len = __CFStrLength2(str, contents);
+    CFHashCode *cache = __CFStrHasHashCache(str) ? __CFStrHashCachePtr(str, contents, len) : NULL;
+    CFHashCode result;
 
+    if (cache && (result = *cache)) return result;
     if (__CFStrIsEightBit(str)) {
         contents += __CFStrSkipAnyLengthByte(str);
-        return __CFStrHashEightBit(contents, len);
+        result = __CFStrHashEightBit(contents, len);
     } else {
-        return __CFStrHashCharacters((const UniChar *)contents, len, len);
+        result = __CFStrHashCharacters((const UniChar *)contents, len, len);
     }
+    if (cache) *cache = result;	// Racing stores all write the same value
+    return result;
+}
+
+/* Full-content string hashing: an alternative to the hash above for strings, such as URLs and paths, which are long and share long prefixes or suffixes, and so collide when only their first, middle, and last 32 characters are hashed.
+
+Every character is hashed. The characters are consumed four at a time as 64-bit words, with the first character in the low 16 bits and the fourth in the high 16 bits on every host, and each 16 character stripe feeds four independent accumulators. Eight-bit contents are widened to the same words, so equal contents give equal hashes whatever the storage. As in XXH3, each word is keyed and the product of its two 32-bit halves is added to its own accumulator, together with the unkeyed word of the neighbouring lane, so nothing is lost to a zero product. A 32x32->64 bit multiply is what SSE2 (pmuludq), AVX2 and NEON (umull) do per vector lane, so the compiler can keep the accumulators in vector registers; the 64x64->128 bit multiply has no vector form. The keys move along a table of secrets from stripe to stripe and the accumulators are scrambled every __kCFStrFullHashStripesPerBlock stripes, so stripes that are swapped do not hash alike. Only the final fold of the four accumulators uses the 64x64->128 bit multiply of wyhash.
+
+The result is not the same as that of CFHash(), so it must only be used where all hashing of the keys is done with it, for instance through kCFLongStringDictionaryKeyCallBacks.
+*/
+#define __kCFStrFullHashStripesPerBlock 8
+
+// Stripe n of a block is keyed with entries n to n + 3; the scramble uses the last four
+static const uint64_t __CFStrFullHashSecret[__kCFStrFullHashStripesPerBlock + 4] = {
+    0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+    0x82c9ca71140f95a7ULL, 0x71d29247e07cbea8ULL, 0x3df81b0480620ed2ULL, 0xf3f121bb6d42b03eULL,
+    0x1afadeacb66fc8afULL, 0x794d05874931e3c4ULL, 0x16cf8b10e0cfd107ULL, 0x574f5355b57f28a5ULL
+};
+
+CF_INLINE uint64_t __CFStrFullHashMix(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+CF_INLINE uint64_t __CFStrFullHashLoadUniChars(const UniChar *chars) {
+#if __BIG_ENDIAN__
+    return (uint64_t)chars[0] | ((uint64_t)chars[1] << 16) | ((uint64_t)chars[2] << 32) | ((uint64_t)chars[3] << 48);
+#else
+    uint64_t word;
+    memmove(&word, chars, sizeof(word));
+    return word;
+#endif
+}
+
+/* Loads four eight-bit characters as the word their UniChar equivalents would load as. ASCII is widened in place; anything else goes through __CFCharToUniCharTable, as in __CFStrHashEightBit().
+*/
+CF_INLINE uint64_t __CFStrFullHashLoadEightBit(const uint8_t *bytes) {
+    uint32_t quad;
+    memmove(&quad, bytes, sizeof(quad));
+    quad = CFSwapInt32LittleToHost(quad);	// first character in the low byte, to widen into the low lane
+    if (quad & 0x80808080U) {
+        UniChar chars[4] = {__CFCharToUniCharTable[bytes[0]], __CFCharToUniCharTable[bytes[1]], __CFCharToUniCharTable[bytes[2]], __CFCharToUniCharTable[bytes[3]]};
+        return __CFStrFullHashLoadUniChars(chars);
+    }
+    uint64_t word = quad;
+    word = (word | (word << 16)) & 0x0000FFFF0000FFFFULL;
+    word = (word | (word << 8)) & 0x00FF00FF00FF00FFULL;
+    return word;
+}
+
+CF_INLINE void __CFStrFullHashAccumulate(uint64_t *acc, const uint64_t *words, CFIndex stripe) {
+    const uint64_t *secret = __CFStrFullHashSecret + stripe;
+    uint64_t k0 = words[0] ^ secret[0], k1 = words[1] ^ secret[1], k2 = words[2] ^ secret[2], k3 = words[3] ^ secret[3];
+    acc[0] += words[1] + (uint64_t)(uint32_t)k0 * (uint32_t)(k0 >> 32);
+    acc[1] += words[0] + (uint64_t)(uint32_t)k1 * (uint32_t)(k1 >> 32);
+    acc[2] += words[3] + (uint64_t)(uint32_t)k2 * (uint32_t)(k2 >> 32);
+    acc[3] += words[2] + (uint64_t)(uint32_t)k3 * (uint32_t)(k3 >> 32);
+}
+
+CF_INLINE void __CFStrFullHashScramble(uint64_t *acc) {
+    const uint64_t *secret = __CFStrFullHashSecret + __kCFStrFullHashStripesPerBlock;
+    for (CFIndex lane = 0; lane < 4; lane++) {
+        uint64_t a = acc[lane];
+        a ^= a >> 47;
+        a ^= secret[lane];
+        acc[lane] = a * 0x9E3779B1U;
+    }
+}
+
+CF_INLINE CFHashCode __CFStrFullHashFinish(uint64_t *acc, CFIndex len) {
+    uint64_t h = (uint64_t)len * 0x9E3779B185EBCA87ULL;
+    h += __CFStrFullHashMix(acc[0] ^ __CFStrFullHashSecret[0], acc[1] ^ __CFStrFullHashSecret[1]);
+    h += __CFStrFullHashMix(acc[2] ^ __CFStrFullHashSecret[2], acc[3] ^ __CFStrFullHashSecret[3]);
+    return (CFHashCode)__CFStrFullHashMix(h ^ __CFStrFullHashSecret[4], (uint64_t)len ^ __CFStrFullHashSecret[5]);
+}
+
+static CFHashCode __CFStrHashCharactersFullContents(const UniChar *uContents, CFIndex len) {
+    uint64_t acc[4] = {__CFStrFullHashSecret[8], __CFStrFullHashSecret[9], __CFStrFullHashSecret[10], __CFStrFullHashSecret[11]};
+    uint64_t words[4];
+    const UniChar *end16 = uContents + (len & ~15);
+    const UniChar *end = uContents + len;
+    CFIndex stripe = 0;
+    while (uContents < end16) {
+        for (CFIndex lane = 0; lane < 4; lane++) words[lane] = __CFStrFullHashLoadUniChars(uContents + 4 * lane);
+        __CFStrFullHashAccumulate(acc, words, stripe);
+        uContents += 16;
+        if (__kCFStrFullHashStripesPerBlock == ++stripe) {
+            __CFStrFullHashScramble(acc);
+            stripe = 0;
+        }
+    }
+    if (uContents < end) {
+        // The last stripe is padded with zeros; the length tells it apart
+        UniChar rest[16] = {0};
+        memmove(rest, uContents, (end - uContents) * sizeof(UniChar));
+        for (CFIndex lane = 0; lane < 4; lane++) words[lane] = __CFStrFullHashLoadUniChars(rest + 4 * lane);
+        __CFStrFullHashAccumulate(acc, words, stripe);
+    }
+    return __CFStrFullHashFinish(acc, len);
+}
+
+static CFHashCode __CFStrHashEightBitFullContents(const uint8_t *cContents, CFIndex len) {
+    uint64_t acc[4] = {__CFStrFullHashSecret[8], __CFStrFullHashSecret[9], __CFStrFullHashSecret[10], __CFStrFullHashSecret[11]};
+    uint64_t words[4];
+    const uint8_t *end16 = cContents + (len & ~15);
+    const uint8_t *end = cContents + len;
+    CFIndex stripe = 0;
+    while (cContents < end16) {
+        for (CFIndex lane = 0; lane < 4; lane++) words[lane] = __CFStrFullHashLoadEightBit(cContents + 4 * lane);
+        __CFStrFullHashAccumulate(acc, words, stripe);
+        cContents += 16;
+        if (__kCFStrFullHashStripesPerBlock == ++stripe) {
+            __CFStrFullHashScramble(acc);
+            stripe = 0;
+        }
+    }
+    if (cContents < end) {
+        UniChar rest[16] = {0};
+        for (CFIndex idx = 0; cContents < end; idx++) rest[idx] = __CFCharToUniCharTable[*cContents++];
+        for (CFIndex lane = 0; lane < 4; lane++) words[lane] = __CFStrFullHashLoadUniChars(rest + 4 * lane);
+        __CFStrFullHashAccumulate(acc, words, stripe);
+    }
+    return __CFStrFullHashFinish(acc, len);
+}
+
+CFHashCode CFStringHashCharactersFullContents(const UniChar *characters, CFIndex len) {
+    return __CFStrHashCharactersFullContents(characters, len);
 }
 
 
@@ -1195,7 +1351,7 @@ static CFTypeID __kCFStringTypeID = _kCFRuntimeNotATypeID;
 typedef CFTypeRef (*CF_STRING_CREATE_COPY)(CFAllocatorRef alloc, CFTypeRef theString);
 
 static const CFRuntimeClass __CFStringClass = {
-    _kCFRuntimeScannedObject,
+    _kCFRuntimeScannedObject | _kCFRuntimeFinalizesOnAnyThread,
     "CFString",
     NULL,      // init
     (CF_STRING_CREATE_COPY)CFStringCreateCopy,
@@ -1216,6 +1372,28 @@ CFTypeID CFStringGetTypeID(void) {
     return __kCFStringTypeID;
 }
 
+CFHashCode __CFStringHashFullContents(CFTypeRef cf) {
+    CFStringRef str = (CFStringRef)cf;
+    if (CF_IS_OBJC(__kCFStringTypeID, str)) {
+        CFIndex len = CFStringGetLength(str);
+        UniChar stackBuffer[HashEverythingLimit];
+        UniChar *buffer = (len <= HashEverythingLimit) ? stackBuffer : (UniChar *)CFAllocatorAllocate(kCFAllocatorSystemDefault, len * sizeof(UniChar), 0);
+        CFStringGetCharacters(str, CFRangeMake(0, len), buffer);
+        CFHashCode result = __CFStrHashCharactersFullContents(buffer, len);
+        if (buffer != stackBuffer) CFAllocatorDeallocate(kCFAllocatorSystemDefault, buffer);
+        return result;
+    }
+    const uint8_t *contents = (uint8_t *)__CFStrContents(str);
+    CFIndex len = __CFStrLength2(str, contents);
+
+    if (__CFStrIsEightBit(str)) {
+        contents += __CFStrSkipAnyLengthByte(str);
+        return __CFStrHashEightBitFullContents(contents, len);
+    } else {
+        return __CFStrHashCharactersFullContents((const UniChar *)contents, len);
+    }
+}
+
 
 static Boolean CFStrIsUnicode(CFStringRef str) {
     CF_OBJC_FUNCDISPATCHV(__kCFStringTypeID, Boolean, (NSString *)str, _encodingCantBeStoredInEightBitCFString);
@@ -1250,6 +1428,7 @@ CF_PRIVATE CFStringRef __CFStringCreateImmutableFunnel3(
     Boolean useLengthByte = false;
     Boolean useNullByte = false;
     Boolean useInlineData = false;
+    Boolean useHashCache = false;
 
 #if INSTRUMENT_SHARED_STRINGS
     const char *recordedEncoding;
@@ -1485,6 +1664,9 @@ CF_PRIVATE CFStringRef __CFStringCreateImmutableFunnel3(
                 }
             }
 
+            useHashCache = (numBytes >= __kCFStrHashCacheMinBytes);
+            if (useHashCache) size = ((size + sizeof(CFHashCode) - 1) & ~(CFIndex)(sizeof(CFHashCode) - 1)) + sizeof(CFHashCode);
+
 #ifdef STRING_SIZE_STATS
             // Dump alloced CFString size info every so often
             static int cnt = 0;
@@ -1508,7 +1690,8 @@ CF_PRIVATE CFStringRef __CFStringCreateImmutableFunnel3(
                                     (useInlineData ? __kCFHasInlineContents : allocBits) |
                                     ((encoding == kCFStringEncodingUnicode) ? __kCFIsUnicode : 0) |
                                     (useNullByte ? __kCFHasNullByte : 0) |
-                                    (useLengthByte ? __kCFHasLengthByte : 0));
+                                    (useLengthByte ? __kCFHasLengthByte : 0) |
+                                    (useHashCache ? __kCFHasHashCache : 0));
 
                 if (!useLengthByte) {
                     CFIndex length = numBytes - (hasLengthByte ? 1 : 0);
@@ -1677,62 +1860,97 @@ CFStringRef CFStringCreateCopy(CFAllocatorRef alloc, CFStringRef str) {
 
 /*** Constant string stuff... ***/
 
-/* Table which holds constant strings created with CFSTR, when -fconstant-cfstrings option is not used. These dynamically created constant strings are stored in constantStringTable. The keys are the 8-bit constant C-strings from the compiler; the values are the CFStrings created for them. _CFSTRLock protects this table.
+/* Table which holds constant strings created with CFSTR, when -fconstant-cfstrings option is not used. These dynamically created constant strings are stored in constantStringTable. The keys are the 8-bit constant C-strings from the compiler; the values are the CFStrings created for them.
+
+The table is an insert-only open addressing hash which is probed without locking; _CFSTRLock serializes inserts. A slot is filled in before its key is published, and a reader that finds a key whose string is not yet visible falls back to the locked path. When the table gets half full it is copied into one twice the size, which is then published in its place; the old table is kept, since readers may still be probing it.
 */
-static CFMutableDictionaryRef constantStringTable = NULL;
+typedef struct {
+    const char *volatile _key;
+    CFHashCode _hash;
+    CFStringRef volatile _string;
+} __CFConstantStringSlot;
+
+typedef struct __CFConstantStringTable {
+    struct __CFConstantStringTable *_previous;
+    CFIndex _count;
+    CFIndex _capacity;		// Power of 2
+    __CFConstantStringSlot _slots[];
+} __CFConstantStringTable;
+
+static __CFConstantStringTable *volatile constantStringTable = NULL;
 static CFLock_t _CFSTRLock = CFLockInit;
 
-static CFStringRef __cStrCopyDescription(const void *ptr) {
-    return CFStringCreateWithCStringNoCopy(kCFAllocatorSystemDefault, (const char *)ptr, __CFStringGetEightBitStringEncoding(), kCFAllocatorNull);
-}
-
-static Boolean __cStrEqual(const void *ptr1, const void *ptr2) {
-    return (strcmp((const char *)ptr1, (const char *)ptr2) == 0);
+static CFHashCode __cStrHash(const char *cStr) {
+    // It doesn't quite matter if we convert to Unicode correctly, as long as we do it consistently
+    CFHashCode result = 2166136261U;
+    while (*cStr) result = (result ^ (uint8_t)*cStr++) * 16777619U;
+    return result;
 }
 
-static CFHashCode __cStrHash(const void *ptr) {
-    // It doesn't quite matter if we convert to Unicode correctly, as long as we do it consistently    
-    const char *cStr = (const char *)ptr;
-    CFIndex len = strlen(cStr);
-    CFHashCode result = 0;
-    if (len <= 4) {	// All chars
-        unsigned cnt = len;
-        while (cnt--) result += (result << 8) + *cStr++;
-    } else {		// First and last 2 chars
-        result += (result << 8) + cStr[0];
-        result += (result << 8) + cStr[1];
-        result += (result << 8) + cStr[len-2];
-        result += (result << 8) + cStr[len-1];
+static CFStringRef __CFConstantStringTableFind(__CFConstantStringTable *table, const char *cStr, CFHashCode hash) {
+    if (!table) return NULL;
+    CFIndex mask = table->_capacity - 1;
+    for (CFIndex idx = hash & mask; ; idx = (idx + 1) & mask) {
+        __CFConstantStringSlot *slot = &table->_slots[idx];
+        const char *key = slot->_key;
+        if (!key) return NULL;
+        if (slot->_hash == hash && (key == cStr || strcmp(key, cStr) == 0)) return slot->_string;
+    }
+}
+
+static __CFConstantStringTable *__CFConstantStringTableCreate(CFIndex capacity) {
+    CFIndex size = sizeof(__CFConstantStringTable) + capacity * sizeof(__CFConstantStringSlot);
+    __CFConstantStringTable *table = (__CFConstantStringTable *)CFAllocatorAllocate(kCFAllocatorSystemDefault, size, 0);
+    if (!table) HALT;
+    if (__CFOASafe) __CFSetLastAllocationEventName(table, "CFString (CFSTR table)");
+    memset(table, 0, size);
+    table->_capacity = capacity;
+    return table;
+}
+
+// Call with _CFSTRLock held. The slot is complete before its key becomes visible to readers.
+static void __CFConstantStringTableStore(__CFConstantStringTable *table, const char *key, CFHashCode hash, CFStringRef str) {
+    CFIndex mask = table->_capacity - 1;
+    CFIndex idx = hash & mask;
+    while (table->_slots[idx]._key) idx = (idx + 1) & mask;
+    table->_slots[idx]._hash = hash;
+    table->_slots[idx]._string = str;
+    OSMemoryBarrier();
+    table->_slots[idx]._key = key;
+    table->_count++;
+}
+
+// Call with _CFSTRLock held
+static void __CFConstantStringTableAdd(const char *key, CFHashCode hash, CFStringRef str) {
+    __CFConstantStringTable *table = constantStringTable;
+    if (!table || table->_capacity < 2 * (table->_count + 1)) {
+        __CFConstantStringTable *newTable = __CFConstantStringTableCreate(table ? 2 * table->_capacity : 4096);
+        if (table) {
+            for (CFIndex idx = 0; idx < table->_capacity; idx++) {
+                __CFConstantStringSlot *slot = &table->_slots[idx];
+                if (slot->_key) __CFConstantStringTableStore(newTable, slot->_key, slot->_hash, slot->_string);
+            }
+        }
+        newTable->_previous = table;
+        OSMemoryBarrier();
+        constantStringTable = table = newTable;
     }
-    result += (result << (len & 31));
-    return result;    
+    __CFConstantStringTableStore(table, key, hash, str);
 }
 
-
 CFStringRef __CFStringMakeConstantString(const char *cStr) {
     CFStringRef result;
 #if defined(DEBUG)
     // StringTest checks that we share kCFEmptyString, which is defeated by constantStringAllocatorForDebugging 
     if ('\0' == *cStr) return kCFEmptyString;
 #endif
-    if (constantStringTable == NULL) {
-        CFDictionaryKeyCallBacks constantStringCallBacks = {0, NULL, NULL, __cStrCopyDescription, __cStrEqual, __cStrHash};
-        CFDictionaryValueCallBacks constantStringValueCallBacks = kCFTypeDictionaryValueCallBacks;
-        constantStringValueCallBacks.equal = NULL;      // So that we only find strings that are ==
-	CFMutableDictionaryRef table = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, &constantStringCallBacks, &constantStringValueCallBacks);
-	_CFDictionarySetCapacity(table, 2500);          // avoid lots of rehashing
-	__CFLock(&_CFSTRLock);
-	if (constantStringTable == NULL) constantStringTable = table;
-	__CFUnlock(&_CFSTRLock);
-	if (constantStringTable != table) CFRelease(table);
-    }
+    CFHashCode hash = __cStrHash(cStr);
+    if ((result = __CFConstantStringTableFind(constantStringTable, cStr, hash))) return result;
 
     __CFLock(&_CFSTRLock);
-    if ((result = (CFStringRef)CFDictionaryGetValue(constantStringTable, cStr))) {
-	__CFUnlock(&_CFSTRLock);
-    } else {
-	__CFUnlock(&_CFSTRLock);
-
+    result = __CFConstantStringTableFind(constantStringTable, cStr, hash);
+    __CFUnlock(&_CFSTRLock);
+    if (!result) {
         {
             char *key = NULL;
             Boolean isASCII = true;
@@ -1775,18 +1993,19 @@ CFStringRef __CFStringMakeConstantString(const char *cStr) {
 
             {
                 CFStringRef resultToBeReleased = result;
-                CFIndex count;
+                CFStringRef existing;
                 __CFLock(&_CFSTRLock);
-                count = CFDictionaryGetCount(constantStringTable);
-                CFDictionaryAddValue(constantStringTable, key, result);
-                if (CFDictionaryGetCount(constantStringTable) == count) { // add did nothing, someone already put it there
-                    result = (CFStringRef)CFDictionaryGetValue(constantStringTable, key);
-                } else if (!isTaggedPointerString) {
+                if ((existing = __CFConstantStringTableFind(constantStringTable, key, hash))) { // someone already put it there
+                    result = existing;
+                } else {
+                    if (!isTaggedPointerString) {
 #if __LP64__
-                    ((struct __CFString *)result)->base._rc = 0;
+                        ((struct __CFString *)result)->base._rc = 0;
 #else
-                    ((struct __CFString *)result)->base._cfinfo[CF_RC_BITS] = 0;
+                        ((struct __CFString *)result)->base._cfinfo[CF_RC_BITS] = 0;
 #endif
+                    }
+                    __CFConstantStringTableAdd(key, hash, result);
                 }
                 __CFUnlock(&_CFSTRLock);
                 // This either eliminates the extra retain on the freshly created string, or frees it, if it was actually not inserted into the table
@@ -1800,11 +2019,14 @@ CFStringRef __CFStringMakeConstantString(const char *cStr) {
 #if defined(DEBUG)
 static Boolean __CFStrIsConstantString(CFStringRef str) {
     Boolean found = false;
-    if (constantStringTable) {
-	__CFLock(&_CFSTRLock);
-	found = CFDictionaryContainsValue(constantStringTable, str);
-	__CFUnlock(&_CFSTRLock);
+    __CFLock(&_CFSTRLock);
+    __CFConstantStringTable *table = constantStringTable;
+    if (table) {
+        for (CFIndex idx = 0; !found && idx < table->_capacity; idx++) {
+            found = (table->_slots[idx]._key && table->_slots[idx]._string == str);
+        }
     }
+    __CFUnlock(&_CFSTRLock);
     return found;
 }
 #endif
@@ -1813,15 +2035,12 @@ static Boolean __CFStrIsConstantString(CFStringRef str) {
 #if DEPLOYMENT_TARGET_WINDOWS
 void __CFStringCleanup (void) {
     /* in case library is unloaded, release store for the constant string table */
-    if (constantStringTable != NULL) {
-#if defined(DEBUG)
-    	__CFConstantStringTableBeingFreed = true;
-        CFRelease(constantStringTable);
-        __CFConstantStringTableBeingFreed = false;
-#else 
-        CFRelease(constantStringTable);
-#endif
-        constantStringTable = NULL;
+    __CFConstantStringTable *table = constantStringTable;
+    constantStringTable = NULL;
+    while (table != NULL) {
+        __CFConstantStringTable *previous = table->_previous;
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, table);
+        table = previous;
     }
 }
 #endif
@@ -170,6 +170,9 @@ since it is the default choice with Mac OS X developer tools.
 
 #ifdef __CONSTANT_CFSTRINGS__
 #define CFSTR(cStr)  ((CFStringRef) __builtin___CFStringMakeConstantString ("" cStr ""))
+#elif defined(__GNUC__) && !defined(__cplusplus)
+/* Each use of CFSTR() caches its string, so only the first evaluation at a given site looks it up. C++ keeps the plain call: a statement expression cannot appear in a namespace-scope initializer. */
+#define CFSTR(cStr)  (__extension__ ({ static CFStringRef __cfstrCache = NULL; CFStringRef __cfstr = __cfstrCache; if (__builtin_expect(NULL == __cfstr, 0)) __cfstr = __cfstrCache = __CFStringMakeConstantString("" cStr ""); __cfstr; }))
 #else
 #define CFSTR(cStr)  __CFStringMakeConstantString("" cStr "")
 #endif
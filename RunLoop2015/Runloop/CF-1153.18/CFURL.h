@@ -418,6 +418,24 @@ CFStringRef CFURLCreateStringByReplacingPercentEscapesUsingEncoding(CFAllocatorR
 CF_EXPORT
 CFStringRef CFURLCreateStringByAddingPercentEscapes(CFAllocatorRef allocator, CFStringRef originalString, CFStringRef charactersToLeaveUnescaped, CFStringRef legalURLCharactersToBeEscaped, CFStringEncoding encoding);
 
+typedef CF_OPTIONS(CFOptionFlags, CFDataMappingOptions) {
+    kCFDataMappingSequential = 1UL << 0,	/* The bytes will be read front to back; read ahead aggressively */
+    kCFDataMappingRandom = 1UL << 1,		/* The bytes will be read in no particular order; do not read ahead */
+    kCFDataMappingWillNeed = 1UL << 2,		/* Start paging the whole file in now */
+    kCFDataMappingUncached = 1UL << 3		/* Ask the file system not to cache the file, where supported */
+};
+
+/* Creates an immutable CFData whose bytes are a read-only memory mapping of */
+/* the file at url, or NULL if the file cannot be opened or mapped. Opening */
+/* costs the same regardless of the file's size; pages are read on first */
+/* access and the mapping is removed when the data is deallocated. The byte */
+/* pointer is stable for the data's lifetime, so readers can reference the */
+/* bytes (for instance with CFStringCreateWithBytesNoCopy() and */
+/* kCFAllocatorNull) while they retain the data. The file must not be */
+/* truncated while mapped. On platforms without mmap() the file is read. */
+CF_EXPORT
+CFDataRef CFDataCreateWithContentsOfFileMapped(CFAllocatorRef allocator, CFURLRef url, CFDataMappingOptions options);
+
 
 #if (TARGET_OS_MAC || TARGET_OS_EMBEDDED || TARGET_OS_IPHONE) || CF_BUILDING_CF || NSBUILDINGFOUNDATION
 CF_IMPLICIT_BRIDGING_DISABLED
@@ -170,6 +170,7 @@ bool OSAtomicCompareAndSwapPtr(void *oldp, void *newp, void *volatile *dst);
 bool OSAtomicCompareAndSwapLong(long oldl, long newl, long volatile *dst);
 bool OSAtomicCompareAndSwapPtrBarrier(void *oldp, void *newp, void *volatile *dst);
 bool OSAtomicCompareAndSwap64Barrier( int64_t __oldValue, int64_t __newValue, volatile int64_t *__theValue );
+int64_t OSAtomicAdd64Barrier( int64_t __theAmount, volatile int64_t *__theValue );
     
 int32_t OSAtomicDecrement32Barrier(volatile int32_t *dst);
 int32_t OSAtomicIncrement32Barrier(volatile int32_t *dst);
@@ -367,6 +367,11 @@ CF_EXPORT CFHashCode CFStringHashCString(const uint8_t *bytes, CFIndex len);
 CF_EXPORT CFHashCode CFStringHashCharacters(const UniChar *characters, CFIndex len);
 CF_EXPORT CFHashCode CFStringHashNSString(CFStringRef str);
 
+/* Hash over every character of the string; see kCFLongStringDictionaryKeyCallBacks. Not interchangeable with CFHash().
+*/
+CF_EXPORT CFHashCode __CFStringHashFullContents(CFTypeRef cf);
+CF_EXPORT CFHashCode CFStringHashCharactersFullContents(const UniChar *characters, CFIndex len);
+
 
 CF_EXTERN_C_END
 
@@ -7,6 +7,50 @@
 //
 
 #import <XCTest/XCTest.h>
+#import <CoreFoundation/CoreFoundation.h>
+#import <pthread.h>
+#import <float.h>
+#import <math.h>
+
+// Runtime SPI from CF-1153.18/CFRuntime.h, built into the host app
+extern void _CFRuntimeSetBiasedRefCountEnabled(Boolean enabled);
+extern void _CFRuntimeSetBatchedCollectionReleaseEnabled(Boolean enabled);
+extern void _CFRuntimeSetAllocationProfilerEnabled(Boolean enabled, CFIndex sampleInterval);
+extern Boolean _CFRuntimeWriteAllocationProfile(int fd);
+typedef struct {
+    int64_t allocations;
+    int64_t cachedAllocations;
+    int64_t deallocations;
+    int64_t cachedDeallocations;
+} _CFRuntimeInstanceStatistics;
+extern void _CFRuntimeSetInstanceStatisticsEnabled(Boolean enabled);
+extern Boolean _CFRuntimeGetInstanceStatistics(CFTypeID typeID, _CFRuntimeInstanceStatistics *stats);
+extern void _CFRuntimeSetBackgroundReclaimEnabled(Boolean enabled);
+
+// Data searchers from CF-1153.18/CFData.h
+typedef const struct __CFDataSearcher * CFDataSearcherRef;
+extern CFDataSearcherRef CFDataSearcherCreate(CFAllocatorRef allocator, CFDataRef dataToFind, CFDataSearchFlags compareOptions);
+extern CFRange CFDataSearcherFind(CFDataSearcherRef searcher, CFDataRef theData, CFRange searchRange);
+
+// Reusable timers from CF-1153.18/CFRunLoop.h
+extern CFRunLoopTimerRef CFRunLoopTimerCreateReusable(CFAllocatorRef allocator, CFAbsoluteTime fireDate, CFTimeInterval interval, CFOptionFlags flags, CFIndex order, CFRunLoopTimerCallBack callout, CFRunLoopTimerContext *context);
+
+// Release pools from CF-1153.18/CFBase.h
+extern void *CFReleasePoolPush(void);
+extern void CFReleasePoolPop(void *pool);
+
+// String hashing SPI from CF-1153.18/ForFoundationOnly.h
+extern CFHashCode __CFStringHashFullContents(CFTypeRef cf);
+extern CFHashCode CFStringHashCharactersFullContents(const UniChar *characters, CFIndex len);
+
+// Sorting SPI from CF-1153.18/CFPriv.h
+enum {
+    kCFSortConcurrent = (1UL << 0),
+    kCFSortStable = (1UL << 4),
+};
+extern void CFSortArray(void *list, CFIndex count, CFIndex elementSize, CFOptionFlags opts, CFComparatorFunction comparator, void *context);
+extern void CFMergeSortArray(void *list, CFIndex count, CFIndex elementSize, CFComparatorFunction comparator, void *context);
+extern void CFQSortArray(void *list, CFIndex count, CFIndex elementSize, CFComparatorFunction comparator, void *context);
 
 @interface RunloopTests : XCTestCase
 
@@ -36,4 +80,1275 @@
     }];
 }
 
+#pragma mark - Reference counting
+
+static const NSInteger kRetainReleasePairs = 10000000;
+
+- (void)measureRetainReleaseWithBiasedRefCount:(Boolean)biased {
+    _CFRuntimeSetBiasedRefCountEnabled(biased);
+    CFMutableArrayRef object = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeArrayCallBacks);
+    _CFRuntimeSetBiasedRefCountEnabled(false);
+    [self measureBlock:^{
+        for (NSInteger i = 0; i < kRetainReleasePairs; i++) {
+            CFRelease(CFRetain(object));
+        }
+    }];
+    XCTAssertEqual(CFGetRetainCount(object), 1);
+    CFRelease(object);
+}
+
+- (void)testRetainReleasePerformance {
+    [self measureRetainReleaseWithBiasedRefCount:false];
+}
+
+- (void)testBiasedRetainReleasePerformance {
+    [self measureRetainReleaseWithBiasedRefCount:true];
+}
+
+- (void)testBiasedRefCountLeavesRuntimeConstantStringsAlone {
+    _CFRuntimeSetBiasedRefCountEnabled(true);
+    char name[32];
+    snprintf(name, sizeof(name), "biased-%u", arc4random());
+    // Made constant after creation on this thread, so it carries the bias header
+    CFStringRef constant = __CFStringMakeConstantString(name);
+    CFRelease(constant);
+    CFRelease(constant);
+    CFRetain(constant);
+    XCTAssertEqual(__CFStringMakeConstantString(name), constant);
+    XCTAssertEqual(CFStringGetLength(constant), (CFIndex)strlen(name));
+    _CFRuntimeSetBiasedRefCountEnabled(false);
+}
+
+#pragma mark - CFArray
+
+// Either side of __CF_MIN_BUCKETS_FOR_STORAGE (262144) in CFArray.c
+static const CFIndex kSmallDequeArrayCount = 200000;
+static const CFIndex kLargeStorageArrayCount = 400000;
+static const CFIndex kArrayMiddleEdits = 2000;
+
+static CFMutableArrayRef CreateArrayOfCount(CFIndex count) {
+    CFMutableArrayRef array = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, NULL);
+    for (CFIndex idx = 0; idx < count; idx++) {
+        CFArrayAppendValue(array, (const void *)(idx + 1));
+    }
+    return array;
+}
+
+// Only the work is timed; each iteration gets a freshly built array
+- (void)measureArrayOfCount:(CFIndex)count work:(void (^)(CFMutableArrayRef array))work {
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        CFMutableArrayRef array = CreateArrayOfCount(count);
+        [self startMeasuring];
+        work(array);
+        [self stopMeasuring];
+        CFRelease(array);
+    }];
+}
+
+- (void)measureMiddleInsertsInArrayOfCount:(CFIndex)count {
+    [self measureArrayOfCount:count work:^(CFMutableArrayRef array) {
+        for (CFIndex idx = 0; idx < kArrayMiddleEdits; idx++) {
+            CFArrayInsertValueAtIndex(array, CFArrayGetCount(array) / 2, (const void *)idx);
+        }
+    }];
+}
+
+- (void)measureMiddleRemovesInArrayOfCount:(CFIndex)count {
+    [self measureArrayOfCount:count work:^(CFMutableArrayRef array) {
+        for (CFIndex idx = 0; idx < kArrayMiddleEdits; idx++) {
+            CFArrayRemoveValueAtIndex(array, CFArrayGetCount(array) / 2);
+        }
+    }];
+}
+
+- (void)measureGetValuesInArrayOfCount:(CFIndex)count {
+    const void **values = (const void **)malloc(count * sizeof(const void *));
+    [self measureArrayOfCount:count work:^(CFMutableArrayRef array) {
+        // One middle edit first, so that a large array has moved to its CFStorage store
+        CFArrayInsertValueAtIndex(array, count / 2, (const void *)1);
+        CFArrayRemoveValueAtIndex(array, count / 2);
+        for (NSInteger pass = 0; pass < 20; pass++) {
+            CFArrayGetValues(array, CFRangeMake(0, count), values);
+        }
+    }];
+    XCTAssertEqual(values[count - 1], (const void *)count);
+    free(values);
+}
+
+- (void)testArrayMiddleInsertBelowStorageThresholdPerformance {
+    [self measureMiddleInsertsInArrayOfCount:kSmallDequeArrayCount];
+}
+
+- (void)testArrayMiddleInsertAboveStorageThresholdPerformance {
+    [self measureMiddleInsertsInArrayOfCount:kLargeStorageArrayCount];
+}
+
+- (void)testArrayMiddleRemoveBelowStorageThresholdPerformance {
+    [self measureMiddleRemovesInArrayOfCount:kSmallDequeArrayCount];
+}
+
+- (void)testArrayMiddleRemoveAboveStorageThresholdPerformance {
+    [self measureMiddleRemovesInArrayOfCount:kLargeStorageArrayCount];
+}
+
+- (void)testArrayGetValuesBelowStorageThresholdPerformance {
+    [self measureGetValuesInArrayOfCount:kSmallDequeArrayCount];
+}
+
+- (void)testArrayGetValuesAboveStorageThresholdPerformance {
+    [self measureGetValuesInArrayOfCount:kLargeStorageArrayCount];
+}
+
+#pragma mark - CFBinaryHeap
+
+static const CFIndex kHeapCount = 200000;
+static const CFIndex kHeapReschedules = 200000;
+
+typedef struct {
+    CFIndex priority;
+    CFIndex handle;
+} HeapEntry;
+
+static CFComparisonResult CompareHeapEntries(const void *ptr1, const void *ptr2, void *context) {
+    CFIndex p1 = ((const HeapEntry *)ptr1)->priority, p2 = ((const HeapEntry *)ptr2)->priority;
+    return (p1 < p2) ? kCFCompareLessThan : ((p1 > p2) ? kCFCompareGreaterThan : kCFCompareEqualTo);
+}
+
+static const CFBinaryHeapCallBacks kHeapEntryCallBacks = {0, NULL, NULL, NULL, CompareHeapEntries};
+
+static HeapEntry *CreateHeapEntries(CFIndex count) {
+    HeapEntry *entries = (HeapEntry *)malloc(count * sizeof(HeapEntry));
+    srandom(33);
+    for (CFIndex idx = 0; idx < count; idx++) {
+        entries[idx].priority = random();
+        entries[idx].handle = idx;
+    }
+    return entries;
+}
+
+// Timed work gets fresh entries and a heap built outside the timed region by setup
+- (void)measureHeapWithSetup:(CFBinaryHeapRef (^)(HeapEntry *entries))setup work:(void (^)(CFBinaryHeapRef heap, HeapEntry *entries))work {
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        HeapEntry *entries = CreateHeapEntries(kHeapCount);
+        CFBinaryHeapRef heap = setup ? setup(entries) : NULL;
+        [self startMeasuring];
+        work(heap, entries);
+        [self stopMeasuring];
+        if (heap) CFRelease(heap);
+        free(entries);
+    }];
+}
+
+static CFBinaryHeapRef CreateHeapOfEntries(HeapEntry *entries, CFOptionFlags options) {
+    const void **values = (const void **)malloc(kHeapCount * sizeof(const void *));
+    for (CFIndex idx = 0; idx < kHeapCount; idx++) values[idx] = &entries[idx];
+    CFBinaryHeapRef heap = CFBinaryHeapCreateWithValues(kCFAllocatorSystemDefault, options, values, kHeapCount, &kHeapEntryCallBacks, NULL);
+    free(values);
+    return heap;
+}
+
+// Building: adding values one at a time, as CFBinaryHeapCreateWithValues used to, against bottom-up heapify
+
+- (void)testHeapBuildByAddingPerformance {
+    [self measureHeapWithSetup:nil work:^(CFBinaryHeapRef unused, HeapEntry *entries) {
+        CFBinaryHeapRef heap = CFBinaryHeapCreate(kCFAllocatorSystemDefault, 0, &kHeapEntryCallBacks, NULL);
+        for (CFIndex idx = 0; idx < kHeapCount; idx++) CFBinaryHeapAddValue(heap, &entries[idx]);
+        CFRelease(heap);
+    }];
+}
+
+- (void)testHeapBuildByHeapifyPerformance {
+    [self measureHeapWithSetup:nil work:^(CFBinaryHeapRef unused, HeapEntry *entries) {
+        CFRelease(CreateHeapOfEntries(entries, 0));
+    }];
+}
+
+- (void)testFourAryHeapBuildByHeapifyPerformance {
+    [self measureHeapWithSetup:nil work:^(CFBinaryHeapRef unused, HeapEntry *entries) {
+        CFRelease(CreateHeapOfEntries(entries, kCFBinaryHeapFourAry));
+    }];
+}
+
+// Rescheduling the earliest entry: remove the minimum and add it back, the only way before handles, against an in-place update
+
+- (void)measureRemoveAndAddRescheduleWithOptions:(CFOptionFlags)options {
+    [self measureHeapWithSetup:^CFBinaryHeapRef(HeapEntry *entries) {
+        return CreateHeapOfEntries(entries, options);
+    } work:^(CFBinaryHeapRef heap, HeapEntry *entries) {
+        for (CFIndex idx = 0; idx < kHeapReschedules; idx++) {
+            HeapEntry *entry = (HeapEntry *)CFBinaryHeapGetMinimum(heap);
+            CFBinaryHeapRemoveMinimumValue(heap);
+            entry->priority += random() % 1000000;
+            CFBinaryHeapAddValue(heap, entry);
+        }
+    }];
+}
+
+- (void)measureUpdateRescheduleWithOptions:(CFOptionFlags)options {
+    [self measureHeapWithSetup:^CFBinaryHeapRef(HeapEntry *entries) {
+        return CreateHeapOfEntries(entries, options | kCFBinaryHeapTracksHandles);
+    } work:^(CFBinaryHeapRef heap, HeapEntry *entries) {
+        for (CFIndex idx = 0; idx < kHeapReschedules; idx++) {
+            HeapEntry *entry = (HeapEntry *)CFBinaryHeapGetMinimum(heap);
+            entry->priority += random() % 1000000;
+            CFBinaryHeapUpdateValue(heap, entry->handle, entry);
+        }
+    }];
+}
+
+- (void)testHeapRescheduleByRemoveAndAddPerformance {
+    [self measureRemoveAndAddRescheduleWithOptions:0];
+}
+
+- (void)testHeapRescheduleByUpdatePerformance {
+    [self measureUpdateRescheduleWithOptions:0];
+}
+
+- (void)testFourAryHeapRescheduleByRemoveAndAddPerformance {
+    [self measureRemoveAndAddRescheduleWithOptions:kCFBinaryHeapFourAry];
+}
+
+- (void)testFourAryHeapRescheduleByUpdatePerformance {
+    [self measureUpdateRescheduleWithOptions:kCFBinaryHeapFourAry];
+}
+
+// Cancelling arbitrary entries by handle
+
+- (void)measureRemoveByHandleWithOptions:(CFOptionFlags)options {
+    [self measureHeapWithSetup:^CFBinaryHeapRef(HeapEntry *entries) {
+        return CreateHeapOfEntries(entries, options | kCFBinaryHeapTracksHandles);
+    } work:^(CFBinaryHeapRef heap, HeapEntry *entries) {
+        // Every third entry, in creation order, so the removals land all over the heap
+        for (CFIndex idx = 0; idx < kHeapCount; idx += 3) {
+            CFBinaryHeapRemoveValue(heap, entries[idx].handle);
+        }
+    }];
+}
+
+- (void)testHeapRemoveByHandlePerformance {
+    [self measureRemoveByHandleWithOptions:0];
+}
+
+- (void)testFourAryHeapRemoveByHandlePerformance {
+    [self measureRemoveByHandleWithOptions:kCFBinaryHeapFourAry];
+}
+
+#pragma mark - Full-content string hash
+
+static const CFIndex kLongKeyCount = 2000;
+
+// Keys which differ only in characters 32 to 36, which the prefix hash does not look at
+static CFArrayRef CreateLongStringKeys(void) {
+    CFMutableArrayRef keys = CFArrayCreateMutable(kCFAllocatorSystemDefault, kLongKeyCount, &kCFTypeArrayCallBacks);
+    for (CFIndex idx = 0; idx < kLongKeyCount; idx++) {
+        CFStringRef key = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("https://example.com/common/path/%05ld/followed/by/a/long/suffix/which/every/key/shares/so/that/the/middle/and/last/thirty/two/characters/are/the/same/for/all/of/them.html"), (long)idx);
+        CFArrayAppendValue(keys, key);
+        CFRelease(key);
+    }
+    return keys;
+}
+
+- (void)testFullContentHashIgnoresStorage {
+    UInt8 bytes[300];
+    UniChar characters[300];
+    for (CFIndex len = 0; len < 300; len++) {
+        for (CFIndex nonASCII = 0; nonASCII < 2; nonASCII++) {
+            for (CFIndex idx = 0; idx < len; idx++) {
+                bytes[idx] = (nonASCII && 3 == idx % 7) ? 0xE9 : 'a' + (idx * 7) % 26;
+                characters[idx] = bytes[idx];	// Latin-1 is the first 256 code points
+            }
+            CFStringRef eightBit = CFStringCreateWithBytes(kCFAllocatorSystemDefault, bytes, len, kCFStringEncodingISOLatin1, false);
+            CFStringRef unicode = CFStringCreateWithCharacters(kCFAllocatorSystemDefault, characters, len);
+            XCTAssertEqual(__CFStringHashFullContents(eightBit), __CFStringHashFullContents(unicode), @"length %ld", (long)len);
+            XCTAssertEqual(__CFStringHashFullContents(unicode), CFStringHashCharactersFullContents(characters, len), @"length %ld", (long)len);
+            CFRelease(eightBit);
+            CFRelease(unicode);
+        }
+    }
+}
+
+- (void)testFullContentHashSeesEveryCharacter {
+    UniChar characters[512], swapped[512];
+    for (CFIndex idx = 0; idx < 512; idx++) characters[idx] = 'a' + idx % 26;
+    CFHashCode hash = CFStringHashCharactersFullContents(characters, 512);
+    for (CFIndex idx = 0; idx < 512; idx++) {
+        characters[idx] ^= 1;
+        XCTAssertNotEqual(CFStringHashCharactersFullContents(characters, 512), hash, @"index %ld", (long)idx);
+        characters[idx] ^= 1;
+    }
+    // The first two 16 character stripes swapped
+    memcpy(swapped, characters, sizeof(swapped));
+    memcpy(swapped, characters + 16, 16 * sizeof(UniChar));
+    memcpy(swapped + 16, characters, 16 * sizeof(UniChar));
+    XCTAssertNotEqual(CFStringHashCharactersFullContents(swapped, 512), hash);
+
+    CFArrayRef keys = CreateLongStringKeys();
+    CFMutableSetRef hashes = CFSetCreateMutable(kCFAllocatorSystemDefault, 0, NULL);
+    for (CFIndex idx = 0; idx < kLongKeyCount; idx++) CFSetAddValue(hashes, (const void *)__CFStringHashFullContents(CFArrayGetValueAtIndex(keys, idx)));
+    XCTAssertEqual(CFSetGetCount(hashes), kLongKeyCount);
+    CFRelease(hashes);
+    CFRelease(keys);
+}
+
+- (void)measureLongStringKeyLookupsWithCallBacks:(const CFDictionaryKeyCallBacks *)callBacks {
+    CFArrayRef keys = CreateLongStringKeys();
+    CFMutableDictionaryRef dictionary = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, callBacks, &kCFTypeDictionaryValueCallBacks);
+    for (CFIndex idx = 0; idx < kLongKeyCount; idx++) CFDictionarySetValue(dictionary, CFArrayGetValueAtIndex(keys, idx), kCFBooleanTrue);
+    // Copies, so that the lookups hash the keys rather than hit cached hashes
+    CFMutableArrayRef probes = CFArrayCreateMutable(kCFAllocatorSystemDefault, kLongKeyCount, &kCFTypeArrayCallBacks);
+    for (CFIndex idx = 0; idx < kLongKeyCount; idx++) {
+        CFStringRef probe = CFStringCreateMutableCopy(kCFAllocatorSystemDefault, 0, CFArrayGetValueAtIndex(keys, idx));
+        CFArrayAppendValue(probes, probe);
+        CFRelease(probe);
+    }
+    [self measureBlock:^{
+        for (CFIndex idx = 0; idx < kLongKeyCount; idx++) {
+            XCTAssert(CFDictionaryContainsKey(dictionary, CFArrayGetValueAtIndex(probes, idx)));
+        }
+    }];
+    CFRelease(probes);
+    CFRelease(dictionary);
+    CFRelease(keys);
+}
+
+// Every one of these keys has the same prefix hash
+- (void)testLongStringKeyLookupWithPrefixHashPerformance {
+    [self measureLongStringKeyLookupsWithCallBacks:&kCFCopyStringDictionaryKeyCallBacks];
+}
+
+- (void)testLongStringKeyLookupWithFullContentHashPerformance {
+    [self measureLongStringKeyLookupsWithCallBacks:&kCFLongStringDictionaryKeyCallBacks];
+}
+
+#pragma mark - Property list teardown
+
+static const CFIndex kPlistRecordCount = 20000;
+static const CFIndex kPlistRecordDepth = 2;
+
+static CFDictionaryRef CreatePlistRecord(CFIndex depth, CFIndex *seq) {
+    CFMutableDictionaryRef record = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    for (CFIndex idx = 0; idx < 12; idx++) {
+        CFStringRef key = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("key%ld"), (long)idx);
+        CFTypeRef value;
+        if (idx < 6) {
+            value = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, (idx & 1) ? CFSTR("value %ld of a parsed property list, long enough to spill") : CFSTR("v%ld"), (long)(*seq)++);
+        } else if (idx < 9) {
+            long number = (*seq)++;
+            value = CFNumberCreate(kCFAllocatorSystemDefault, kCFNumberLongType, &number);
+        } else if (idx < 11 || 0 == depth) {
+            CFMutableArrayRef items = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeArrayCallBacks);
+            for (CFIndex item = 0; item < 8; item++) {
+                long number = (*seq)++;
+                CFTypeRef element = (item & 1) ? (CFTypeRef)CFNumberCreate(kCFAllocatorSystemDefault, kCFNumberLongType, &number) : (CFTypeRef)CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("item %ld"), number);
+                CFArrayAppendValue(items, element);
+                CFRelease(element);
+            }
+            value = items;
+        } else {
+            value = CreatePlistRecord(depth - 1, seq);
+        }
+        CFDictionarySetValue(record, key, value);
+        CFRelease(key);
+        CFRelease(value);
+    }
+    return record;
+}
+
+// Records of strings, numbers, arrays and nested dictionaries, written as a binary plist
+static CFDataRef CreatePlistData(void) {
+    CFMutableArrayRef records = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeArrayCallBacks);
+    CFIndex seq = 0;
+    for (CFIndex idx = 0; idx < kPlistRecordCount; idx++) {
+        CFDictionaryRef record = CreatePlistRecord(kPlistRecordDepth, &seq);
+        CFArrayAppendValue(records, record);
+        CFRelease(record);
+    }
+    CFDataRef data = CFPropertyListCreateData(kCFAllocatorSystemDefault, records, kCFPropertyListBinaryFormat_v1_0, 0, NULL);
+    CFRelease(records);
+    return data;
+}
+
+- (void)measurePlistTeardownWithOptions:(CFOptionFlags)options batched:(Boolean)batched {
+    CFDataRef data = CreatePlistData();
+    XCTAssert(NULL != data);
+    _CFRuntimeSetBatchedCollectionReleaseEnabled(batched);
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        CFPropertyListRef plist = CFPropertyListCreateWithData(kCFAllocatorSystemDefault, data, options, NULL, NULL);
+        XCTAssert(NULL != plist);
+        [self startMeasuring];
+        CFRelease(plist);
+        [self stopMeasuring];
+    }];
+    _CFRuntimeSetBatchedCollectionReleaseEnabled(false);
+    CFRelease(data);
+}
+
+- (void)testImmutablePlistTeardownPerformance {
+    [self measurePlistTeardownWithOptions:kCFPropertyListImmutable batched:false];
+}
+
+- (void)testMutablePlistTeardownPerformance {
+    [self measurePlistTeardownWithOptions:kCFPropertyListMutableContainersAndLeaves batched:false];
+}
+
+- (void)testImmutablePlistBatchedTeardownPerformance {
+    [self measurePlistTeardownWithOptions:kCFPropertyListImmutable batched:true];
+}
+
+- (void)testMutablePlistBatchedTeardownPerformance {
+    [self measurePlistTeardownWithOptions:kCFPropertyListMutableContainersAndLeaves batched:true];
+}
+
+#pragma mark - Sorting
+
+// CFSortArray() sorts this many values or more concurrently when asked to
+static const CFIndex kConcurrentSortMinCount = 65536;
+
+typedef struct {
+    uint32_t key;
+    uint32_t order;
+} SortRecord;
+
+static pthread_t sSortingThread;
+static volatile int32_t sComparedOffSortingThread;
+
+static CFComparisonResult CompareSortRecords(const void *ptr1, const void *ptr2, void *context) {
+    if (!pthread_equal(pthread_self(), sSortingThread)) {
+        __atomic_store_n(&sComparedOffSortingThread, 1, __ATOMIC_RELAXED);
+    }
+    uint32_t key1 = ((const SortRecord *)ptr1)->key, key2 = ((const SortRecord *)ptr2)->key;
+    return (key1 < key2) ? kCFCompareLessThan : (key2 < key1) ? kCFCompareGreaterThan : kCFCompareEqualTo;
+}
+
+// Sorts count records with many equal keys; returns whether the comparator ran on another thread
+- (BOOL)sortRecordsOfCount:(CFIndex)count options:(CFOptionFlags)options {
+    SortRecord *records = (SortRecord *)malloc(count * sizeof(SortRecord));
+    uint32_t seed = 12345;
+    for (CFIndex idx = 0; idx < count; idx++) {
+        seed = seed * 1103515245 + 12345;
+        records[idx].key = (seed >> 8) % (uint32_t)(count / 8 + 1);
+        records[idx].order = (uint32_t)idx;
+    }
+    sSortingThread = pthread_self();
+    sComparedOffSortingThread = 0;
+    CFSortArray(records, count, sizeof(SortRecord), options, CompareSortRecords, NULL);
+    uint64_t orderSum = records[0].order;
+    for (CFIndex idx = 1; idx < count; idx++) {
+        XCTAssertLessThanOrEqual(records[idx - 1].key, records[idx].key, @"count %ld options %lx index %ld", (long)count, (unsigned long)options, (long)idx);
+        if ((options & kCFSortStable) && records[idx - 1].key == records[idx].key) {
+            XCTAssertLessThan(records[idx - 1].order, records[idx].order, @"count %ld options %lx index %ld", (long)count, (unsigned long)options, (long)idx);
+        }
+        orderSum += records[idx].order;
+    }
+    XCTAssertEqual(orderSum, (uint64_t)count * (count - 1) / 2);
+    free(records);
+    return 0 != sComparedOffSortingThread;
+}
+
+- (void)testSortStaysOnCallingThreadUnlessAsked {
+    CFIndex counts[] = {2, 4097, kConcurrentSortMinCount - 1, kConcurrentSortMinCount, 4 * kConcurrentSortMinCount + 3};
+    for (size_t idx = 0; idx < sizeof(counts) / sizeof(counts[0]); idx++) {
+        XCTAssertFalse([self sortRecordsOfCount:counts[idx] options:0]);
+        XCTAssertFalse([self sortRecordsOfCount:counts[idx] options:kCFSortStable]);
+    }
+}
+
+- (void)testConcurrentSortAroundThreshold {
+    BOOL multicore = 1 < [[NSProcessInfo processInfo] activeProcessorCount];
+    CFIndex below[] = {2, 4097, kConcurrentSortMinCount - 1};
+    for (size_t idx = 0; idx < sizeof(below) / sizeof(below[0]); idx++) {
+        XCTAssertFalse([self sortRecordsOfCount:below[idx] options:kCFSortConcurrent]);
+        XCTAssertFalse([self sortRecordsOfCount:below[idx] options:kCFSortConcurrent | kCFSortStable]);
+    }
+    CFIndex above[] = {kConcurrentSortMinCount, kConcurrentSortMinCount + 1, 4 * kConcurrentSortMinCount + 3};
+    for (size_t idx = 0; idx < sizeof(above) / sizeof(above[0]); idx++) {
+        XCTAssertEqual([self sortRecordsOfCount:above[idx] options:kCFSortConcurrent], multicore);
+        XCTAssertEqual([self sortRecordsOfCount:above[idx] options:kCFSortConcurrent | kCFSortStable], multicore);
+    }
+}
+
+- (void)testQSortAndMergeSortArraysStayOnCallingThread {
+    CFIndex count = 2 * kConcurrentSortMinCount;
+    SortRecord *records = (SortRecord *)malloc(count * sizeof(SortRecord));
+    for (CFIndex idx = 0; idx < count; idx++) {
+        records[idx].key = (uint32_t)(idx * 2654435761u);
+        records[idx].order = (uint32_t)idx;
+    }
+    sSortingThread = pthread_self();
+    sComparedOffSortingThread = 0;
+    CFQSortArray(records, count, sizeof(SortRecord), CompareSortRecords, NULL);
+    for (CFIndex idx = 1; idx < count; idx++) {
+        XCTAssertLessThanOrEqual(records[idx - 1].key, records[idx].key);
+    }
+    CFMergeSortArray(records, count, sizeof(SortRecord), CompareSortRecords, NULL);
+    XCTAssertFalse(sComparedOffSortingThread);
+    free(records);
+}
+
+#pragma mark - CFCompressedBitVector
+
+// Bits per container, and the most set bits a container keeps as an array
+static const CFIndex kBitsPerContainer = 65536;
+static const CFIndex kMaxContainerArray = 4096;
+
+// Sizes in the image CFCompressedBitVectorCreateData() writes; the offset of a chunk's payload is the last field of its descriptor
+static const CFIndex kImageHeaderSize = 24;
+static const CFIndex kImageDescriptorSize = 16;
+
+// Whether the description lists a container of the given form ("array", "bitmap" or "run") at index
+static Boolean CompressedBitVectorHasContainer(CFCompressedBitVectorRef bv, CFIndex index, const char *form) {
+    CFStringRef description = CFCopyDescription(bv);
+    CFStringRef line = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("\t%ld : %s,"), (long)index, form);
+    Boolean found = CFStringFind(description, line, 0).location != kCFNotFound;
+    CFRelease(line);
+    CFRelease(description);
+    return found;
+}
+
+static void AssertSameBits(RunloopTests *self, CFCompressedBitVectorRef bv, CFBitVectorRef oracle) {
+    CFIndex count = CFBitVectorGetCount(oracle);
+    XCTAssertEqual(CFCompressedBitVectorGetCount(bv), count);
+    XCTAssertEqual(CFCompressedBitVectorGetCountOfBit(bv, CFRangeMake(0, count), 1), CFBitVectorGetCountOfBit(oracle, CFRangeMake(0, count), 1));
+    for (CFIndex idx = 0; idx < count; idx++) {
+        if (CFCompressedBitVectorGetBitAtIndex(bv, idx) != CFBitVectorGetBitAtIndex(oracle, idx)) {
+            XCTFail(@"bit %ld differs", (long)idx);
+            return;
+        }
+    }
+}
+
+// Fills a compressed vector and a plain one identically: a sparse chunk, a dense chunk and a chunk of long runs
+static void FillBitVectors(CFMutableCompressedBitVectorRef bv, CFMutableBitVectorRef oracle, uint32_t seed) {
+    CFIndex count = 4 * kBitsPerContainer;
+    CFCompressedBitVectorSetCount(bv, count);
+    CFBitVectorSetCount(oracle, count);
+    for (CFIndex idx = 0; idx < 3000; idx++) {
+        seed = seed * 1103515245 + 12345;
+        CFIndex bit = (seed >> 8) % kBitsPerContainer;
+        CFCompressedBitVectorSetBitAtIndex(bv, bit, 1);
+        CFBitVectorSetBitAtIndex(oracle, bit, 1);
+    }
+    for (CFIndex idx = 0; idx < 30000; idx++) {
+        seed = seed * 1103515245 + 12345;
+        CFIndex bit = kBitsPerContainer + (seed >> 8) % kBitsPerContainer;
+        CFCompressedBitVectorSetBitAtIndex(bv, bit, 1);
+        CFBitVectorSetBitAtIndex(oracle, bit, 1);
+    }
+    for (CFIndex run = 0; run < 8; run++) {
+        seed = seed * 1103515245 + 12345;
+        CFRange range = CFRangeMake(3 * kBitsPerContainer + run * 8192 + (seed >> 8) % 1024, 1000 + (seed >> 16) % 4000);
+        CFCompressedBitVectorSetBits(bv, range, 1);
+        CFBitVectorSetBits(oracle, range, 1);
+    }
+}
+
+- (void)testCompressedBitVectorContainerForms {
+    CFMutableCompressedBitVectorRef bv = CFCompressedBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+    CFMutableBitVectorRef oracle = CFBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+    FillBitVectors(bv, oracle, 1);
+    XCTAssertTrue(CompressedBitVectorHasContainer(bv, 0, "array"));
+    XCTAssertTrue(CompressedBitVectorHasContainer(bv, kBitsPerContainer, "bitmap"));
+    XCTAssertFalse(CompressedBitVectorHasContainer(bv, 2 * kBitsPerContainer, "array"));
+    XCTAssertTrue(CompressedBitVectorHasContainer(bv, 3 * kBitsPerContainer, "run"));
+    AssertSameBits(self, bv, oracle);
+    XCTAssertEqual(CFCompressedBitVectorGetFirstIndexOfBit(bv, CFRangeMake(2 * kBitsPerContainer, 2 * kBitsPerContainer), 1), CFBitVectorGetFirstIndexOfBit(oracle, CFRangeMake(2 * kBitsPerContainer, 2 * kBitsPerContainer), 1));
+    XCTAssertEqual(CFCompressedBitVectorGetLastIndexOfBit(bv, CFRangeMake(0, 3 * kBitsPerContainer), 1), CFBitVectorGetLastIndexOfBit(oracle, CFRangeMake(0, 3 * kBitsPerContainer), 1));
+    XCTAssertEqual(CFCompressedBitVectorGetFirstIndexOfBit(bv, CFRangeMake(3 * kBitsPerContainer, kBitsPerContainer), 0), CFBitVectorGetFirstIndexOfBit(oracle, CFRangeMake(3 * kBitsPerContainer, kBitsPerContainer), 0));
+    CFRelease(oracle);
+    CFRelease(bv);
+}
+
+- (void)testCompressedBitVectorArrayThreshold {
+    CFMutableCompressedBitVectorRef bv = CFCompressedBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+    CFCompressedBitVectorSetCount(bv, kBitsPerContainer);
+    // every other bit, so that runs are never the smallest form
+    for (CFIndex idx = 0; idx < kMaxContainerArray; idx++) {
+        CFCompressedBitVectorSetBitAtIndex(bv, 2 * idx, 1);
+    }
+    XCTAssertTrue(CompressedBitVectorHasContainer(bv, 0, "array"));
+    CFCompressedBitVectorSetBitAtIndex(bv, 2 * kMaxContainerArray, 1);
+    XCTAssertTrue(CompressedBitVectorHasContainer(bv, 0, "bitmap"));
+    XCTAssertEqual(CFCompressedBitVectorGetCountOfBit(bv, CFRangeMake(0, kBitsPerContainer), 1), kMaxContainerArray + 1);
+    CFCompressedBitVectorSetBitAtIndex(bv, 0, 0);
+    XCTAssertTrue(CompressedBitVectorHasContainer(bv, 0, "array"));
+    XCTAssertEqual(CFCompressedBitVectorGetCountOfBit(bv, CFRangeMake(0, kBitsPerContainer), 1), kMaxContainerArray);
+    XCTAssertEqual(CFCompressedBitVectorGetFirstIndexOfBit(bv, CFRangeMake(0, kBitsPerContainer), 1), 2);
+    // a full chunk is one run, and clearing its last bits removes it
+    CFCompressedBitVectorSetAllBits(bv, 1);
+    XCTAssertTrue(CompressedBitVectorHasContainer(bv, 0, "run"));
+    XCTAssertEqual(CFCompressedBitVectorGetCountOfBit(bv, CFRangeMake(0, kBitsPerContainer), 1), kBitsPerContainer);
+    CFCompressedBitVectorSetBits(bv, CFRangeMake(0, kBitsPerContainer), 0);
+    XCTAssertFalse(CFCompressedBitVectorContainsBit(bv, CFRangeMake(0, kBitsPerContainer), 1));
+    CFRelease(bv);
+}
+
+- (void)testCompressedBitVectorOperationsMatchBitVector {
+    void (*compressedOps[])(CFMutableCompressedBitVectorRef, CFCompressedBitVectorRef) = {CFCompressedBitVectorAnd, CFCompressedBitVectorOr, CFCompressedBitVectorXor, CFCompressedBitVectorAndNot};
+    void (*plainOps[])(CFMutableBitVectorRef, CFBitVectorRef) = {CFBitVectorAnd, CFBitVectorOr, CFBitVectorXor, CFBitVectorAndNot};
+    for (size_t op = 0; op < sizeof(plainOps) / sizeof(plainOps[0]); op++) {
+        CFMutableCompressedBitVectorRef bv = CFCompressedBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+        CFMutableCompressedBitVectorRef other = CFCompressedBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+        CFMutableBitVectorRef oracle = CFBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+        CFMutableBitVectorRef otherOracle = CFBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+        FillBitVectors(bv, oracle, 1);
+        FillBitVectors(other, otherOracle, 2);
+        // shift one chunk of other so that arrays meet bitmaps and runs
+        CFCompressedBitVectorFlipBits(other, CFRangeMake(kBitsPerContainer / 2, kBitsPerContainer));
+        CFBitVectorFlipBits(otherOracle, CFRangeMake(kBitsPerContainer / 2, kBitsPerContainer));
+        compressedOps[op](bv, other);
+        plainOps[op](oracle, otherOracle);
+        AssertSameBits(self, bv, oracle);
+        CFRelease(otherOracle);
+        CFRelease(oracle);
+        CFRelease(other);
+        CFRelease(bv);
+    }
+}
+
+- (void)testCompressedBitVectorDataRoundTrip {
+    CFMutableCompressedBitVectorRef bv = CFCompressedBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+    CFMutableBitVectorRef oracle = CFBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+    FillBitVectors(bv, oracle, 3);
+    CFDataRef data = CFCompressedBitVectorCreateData(kCFAllocatorSystemDefault, bv);
+    XCTAssert(NULL != data);
+    CFCompressedBitVectorRef copy = CFCompressedBitVectorCreateWithData(kCFAllocatorSystemDefault, data);
+    XCTAssert(NULL != copy);
+    XCTAssertTrue(CFEqual(copy, bv));
+    AssertSameBits(self, copy, oracle);
+    // a mutable copy of an image-backed vector owns its containers
+    CFMutableCompressedBitVectorRef mutableCopy = CFCompressedBitVectorCreateMutableCopy(kCFAllocatorSystemDefault, 0, copy);
+    CFRelease(copy);
+    CFRelease(data);
+    CFCompressedBitVectorFlipBitAtIndex(mutableCopy, kBitsPerContainer + 7);
+    CFBitVectorFlipBitAtIndex(oracle, kBitsPerContainer + 7);
+    AssertSameBits(self, mutableCopy, oracle);
+    CFRelease(mutableCopy);
+    CFRelease(oracle);
+    CFRelease(bv);
+}
+
+- (void)testCompressedBitVectorRejectsBadImages {
+    CFMutableCompressedBitVectorRef bv = CFCompressedBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+    CFMutableBitVectorRef oracle = CFBitVectorCreateMutable(kCFAllocatorSystemDefault, 0);
+    FillBitVectors(bv, oracle, 4);
+    CFDataRef data = CFCompressedBitVectorCreateData(kCFAllocatorSystemDefault, bv);
+    CFIndex length = CFDataGetLength(data);
+    // every truncation is rejected
+    for (CFIndex cut = 0; cut < length; cut += (cut < 256) ? 1 : 509) {
+        CFDataRef truncated = CFDataCreate(kCFAllocatorSystemDefault, CFDataGetBytePtr(data), cut);
+        CFCompressedBitVectorRef result = CFCompressedBitVectorCreateWithData(kCFAllocatorSystemDefault, truncated);
+        XCTAssert(NULL == result, @"image cut to %ld bytes accepted", (long)cut);
+        if (result) CFRelease(result);
+        CFRelease(truncated);
+    }
+    // corrupting a header or descriptor byte must not crash, and whatever is accepted must be usable
+    for (CFIndex offset = 0; offset < kImageHeaderSize + 4 * kImageDescriptorSize && offset < length; offset++) {
+        CFMutableDataRef corrupt = CFDataCreateMutableCopy(kCFAllocatorSystemDefault, 0, data);
+        CFDataGetMutableBytePtr(corrupt)[offset] ^= 0x5A;
+        CFCompressedBitVectorRef result = CFCompressedBitVectorCreateWithData(kCFAllocatorSystemDefault, corrupt);
+        if (result) {
+            CFIndex count = CFCompressedBitVectorGetCount(result);
+            XCTAssertLessThanOrEqual(CFCompressedBitVectorGetCountOfBit(result, CFRangeMake(0, count), 1), count);
+            CFRelease(result);
+        }
+        CFRelease(corrupt);
+    }
+    // an unsorted array payload is rejected
+    CFMutableDataRef unsorted = CFDataCreateMutableCopy(kCFAllocatorSystemDefault, 0, data);
+    uint8_t *bytes = CFDataGetMutableBytePtr(unsorted);
+    const uint8_t *descriptor = bytes + kImageHeaderSize;
+    uint32_t offset = (uint32_t)descriptor[12] | ((uint32_t)descriptor[13] << 8) | ((uint32_t)descriptor[14] << 16) | ((uint32_t)descriptor[15] << 24);
+    XCTAssertEqual(descriptor[2], 0);	// the first chunk is an array
+    uint8_t swap[2] = {bytes[offset], bytes[offset + 1]};
+    bytes[offset] = bytes[offset + 2];
+    bytes[offset + 1] = bytes[offset + 3];
+    bytes[offset + 2] = swap[0];
+    bytes[offset + 3] = swap[1];
+    XCTAssert(NULL == CFCompressedBitVectorCreateWithData(kCFAllocatorSystemDefault, unsorted));
+    CFRelease(unsorted);
+    CFRelease(data);
+    CFRelease(oracle);
+    CFRelease(bv);
+}
+
+- (void)testCompressedBitVectorCapacity {
+    CFMutableCompressedBitVectorRef bv = CFCompressedBitVectorCreateMutable(kCFAllocatorSystemDefault, 100);
+    CFCompressedBitVectorSetCount(bv, 100);
+    CFCompressedBitVectorSetBitAtIndex(bv, 99, 1);
+    CFMutableCompressedBitVectorRef copy = CFCompressedBitVectorCreateMutableCopy(kCFAllocatorSystemDefault, 3 * kBitsPerContainer, bv);
+    CFCompressedBitVectorSetCount(copy, 3 * kBitsPerContainer);
+    CFCompressedBitVectorSetBitAtIndex(copy, 3 * kBitsPerContainer - 1, 1);
+    XCTAssertEqual(CFCompressedBitVectorGetCountOfBit(copy, CFRangeMake(0, 3 * kBitsPerContainer), 1), 2);
+    CFRelease(copy);
+    CFRelease(bv);
+}
+
+#pragma mark - Allocation profiler
+
+static const CFIndex kChurnRingSize = 1024;
+static const CFIndex kChurnOperations = 1000000;
+
+// Frees and reallocates blocks of 16-271 bytes in a ring, so the allocator is the whole cost
+static void ChurnAllocations(void) {
+    void *ring[kChurnRingSize];
+    memset(ring, 0, sizeof(ring));
+    uint32_t seed = 12345;
+    for (CFIndex idx = 0; idx < kChurnOperations; idx++) {
+        seed = seed * 1664525 + 1013904223;
+        CFIndex slot = idx % kChurnRingSize;
+        if (ring[slot]) CFAllocatorDeallocate(kCFAllocatorSystemDefault, ring[slot]);
+        ring[slot] = CFAllocatorAllocate(kCFAllocatorSystemDefault, 16 + (seed >> 24), 0);
+    }
+    for (CFIndex slot = 0; slot < kChurnRingSize; slot++) {
+        if (ring[slot]) CFAllocatorDeallocate(kCFAllocatorSystemDefault, ring[slot]);
+    }
+}
+
+- (void)measureAllocationChurnWithProfiler:(Boolean)profiling {
+    _CFRuntimeSetAllocationProfilerEnabled(profiling, 0);
+    [self measureBlock:^{
+        ChurnAllocations();
+    }];
+    _CFRuntimeSetAllocationProfilerEnabled(false, 0);
+}
+
+// Compare the two to see what the profiler costs at its default interval
+- (void)testAllocationChurnPerformance {
+    [self measureAllocationChurnWithProfiler:false];
+}
+
+- (void)testAllocationChurnWithProfilerPerformance {
+    [self measureAllocationChurnWithProfiler:true];
+}
+
+typedef struct {
+    long long liveObjects;
+    long long liveBytes;
+    long long allocObjects;
+    long long allocBytes;
+    long long interval;
+    long long stackObjects;	// live objects summed over the call stack lines
+    CFIndex stackCount;
+    Boolean hasDataType;
+} AllocationProfileSummary;
+
+// Returns false where the profiler is not supported
+static Boolean ReadAllocationProfile(XCTestCase *self, AllocationProfileSummary *summary) {
+    memset(summary, 0, sizeof(*summary));
+    FILE *file = tmpfile();
+    XCTAssert(NULL != file);
+    if (!_CFRuntimeWriteAllocationProfile(fileno(file))) {
+        fclose(file);
+        return false;
+    }
+    rewind(file);
+    char line[4096];
+    XCTAssert(NULL != fgets(line, sizeof(line), file));
+    XCTAssertEqual(sscanf(line, "heap profile: %lld: %lld [%lld: %lld] @ heap_v2/%lld", &summary->liveObjects, &summary->liveBytes, &summary->allocObjects, &summary->allocBytes, &summary->interval), 5, @"%s", line);
+    // One line per call stack, up to the blank line before the comments
+    while (fgets(line, sizeof(line), file) && '\n' != line[0]) {
+        long long liveObjects, liveBytes, allocObjects, allocBytes;
+        int length = 0;
+        XCTAssertEqual(sscanf(line, "%lld: %lld [%lld: %lld] @%n", &liveObjects, &liveBytes, &allocObjects, &allocBytes, &length), 4, @"%s", line);
+        XCTAssert(0 < length && 0 == strncmp(line + length, " 0x", 3), @"%s", line);
+        XCTAssertLessThanOrEqual(liveObjects, allocObjects);
+        summary->stackObjects += liveObjects;
+        summary->stackCount++;
+    }
+    while (fgets(line, sizeof(line), file) && 0 != strcmp(line, "MAPPED_LIBRARIES:\n")) {
+        long number;
+        char name[256];
+        if (2 == sscanf(line, "# type %ld %255[^:]:", &number, name) && 0 == strcmp(name, "CFData")) summary->hasDataType = true;
+    }
+    XCTAssertFalse(feof(file), @"no MAPPED_LIBRARIES section");
+    fclose(file);
+    return true;
+}
+
+- (void)testAllocationProfileListsLiveSamples {
+    const CFIndex count = 1024;
+    CFDataRef datas[count];
+    UInt8 bytes[1024];
+    memset(bytes, 0x5A, sizeof(bytes));
+    // About 256 samples at one per 4KB
+    _CFRuntimeSetAllocationProfilerEnabled(true, 4096);
+    for (CFIndex idx = 0; idx < count; idx++) datas[idx] = CFDataCreate(kCFAllocatorSystemDefault, bytes, sizeof(bytes));
+    AllocationProfileSummary live;
+    if (!ReadAllocationProfile(self, &live)) {
+        _CFRuntimeSetAllocationProfilerEnabled(false, 0);
+        for (CFIndex idx = 0; idx < count; idx++) CFRelease(datas[idx]);
+        return;
+    }
+    _CFRuntimeSetAllocationProfilerEnabled(false, 0);
+    XCTAssertEqual(live.interval, 4096);
+    XCTAssertLessThan(0, live.stackCount);
+    XCTAssertEqual(live.stackObjects, live.liveObjects);
+    XCTAssertLessThanOrEqual(live.liveObjects, live.allocObjects);
+    XCTAssertLessThanOrEqual(live.liveBytes, live.allocBytes);
+    // Chance of fewer than 100 samples for 1MB is negligible
+    XCTAssertLessThan(100, live.liveObjects);
+    XCTAssertLessThanOrEqual(1024 * live.liveObjects / 2, live.liveBytes);
+    XCTAssert(live.hasDataType);
+
+    // Frees of sampled blocks still count with the profiler off
+    for (CFIndex idx = 0; idx < count; idx++) CFRelease(datas[idx]);
+    AllocationProfileSummary freed;
+    XCTAssert(ReadAllocationProfile(self, &freed));
+    XCTAssertLessThan(freed.liveObjects, live.liveObjects - 50);
+    XCTAssertEqual(freed.allocObjects, live.allocObjects);
+}
+
+#pragma mark - Tagged pointers
+
+// CF_TAGGED_POINTERS in CF-1153.18/CFInternal.h
+#if __linux__ && __LP64__
+static const Boolean kTaggedPointers = true;
+#else
+static const Boolean kTaggedPointers = false;
+#endif
+
+static Boolean IsTaggedPointer(CFTypeRef cf) {
+    return ((uintptr_t)cf & 0x1) != 0;
+}
+
+static const int64_t kTaggedNumberMax = (1LL << 55) - 1;
+static const int64_t kTaggedNumberMin = -(1LL << 55);
+
+- (void)testTaggedNumberRoundTrips {
+    const int64_t values[] = {0, 1, -1, -123456789, kTaggedNumberMax, kTaggedNumberMin, kTaggedNumberMax + 1, kTaggedNumberMin - 1, INT64_MAX, INT64_MIN};
+    for (size_t idx = 0; idx < sizeof(values) / sizeof(values[0]); idx++) {
+        int64_t value = values[idx];
+        CFNumberRef number = CFNumberCreate(kCFAllocatorSystemDefault, kCFNumberSInt64Type, &value);
+        // Never tagged: allocated by another allocator
+        CFNumberRef heap = CFNumberCreate(kCFAllocatorMalloc, kCFNumberSInt64Type, &value);
+        XCTAssertEqual(IsTaggedPointer(number), kTaggedPointers && kTaggedNumberMin <= value && value <= kTaggedNumberMax);
+        XCTAssertFalse(IsTaggedPointer(heap));
+        XCTAssertEqual(CFGetTypeID(number), CFNumberGetTypeID());
+        XCTAssertEqual(CFNumberGetType(number), kCFNumberSInt64Type);
+        XCTAssertFalse(CFNumberIsFloatType(number));
+        int64_t out = 0;
+        XCTAssert(CFNumberGetValue(number, kCFNumberSInt64Type, &out));
+        XCTAssertEqual(out, value);
+        XCTAssert(CFEqual(number, heap));
+        XCTAssert(CFEqual(heap, number));
+        XCTAssertEqual(CFHash(number), CFHash(heap));
+        XCTAssertEqual(CFNumberCompare(number, heap, NULL), kCFCompareEqualTo);
+        CFRelease(heap);
+        CFRelease(number);
+    }
+
+    // Narrower types keep their type and sign
+    int8_t small = -7;
+    CFNumberRef number = CFNumberCreate(kCFAllocatorSystemDefault, kCFNumberSInt8Type, &small);
+    XCTAssertEqual(IsTaggedPointer(number), kTaggedPointers);
+    XCTAssertEqual(CFNumberGetType(number), kCFNumberSInt8Type);
+    int32_t wide = 0;
+    XCTAssert(CFNumberGetValue(number, kCFNumberSInt32Type, &wide));
+    XCTAssertEqual(wide, -7);
+    double real = 0.0;
+    XCTAssert(CFNumberGetValue(number, kCFNumberDoubleType, &real));
+    XCTAssert(-7.0 == real);
+    double half = -6.5;
+    CFNumberRef other = CFNumberCreate(kCFAllocatorSystemDefault, kCFNumberDoubleType, &half);
+    XCTAssertEqual(CFNumberCompare(number, other, NULL), kCFCompareLessThan);
+    XCTAssertEqual(CFNumberCompare(other, number, NULL), kCFCompareGreaterThan);
+    CFRelease(other);
+    CFRelease(number);
+}
+
+- (void)testTaggedDateRoundTrips {
+    const CFAbsoluteTime times[] = {0.0, -0.0, DBL_MIN / 4, ldexp(1.0, 65), nextafter(ldexp(1.0, 65), 0.0), ldexp(1.0, -62), 561234567.125, -978307200.0};
+    const Boolean tagged[] = {true, true, false, false, true, true, true, true};
+    for (size_t idx = 0; idx < sizeof(times) / sizeof(times[0]); idx++) {
+        CFAbsoluteTime at = times[idx];
+        CFDateRef date = CFDateCreate(kCFAllocatorSystemDefault, at);
+        CFDateRef heap = CFDateCreate(kCFAllocatorMalloc, at);
+        XCTAssertEqual(IsTaggedPointer(date), kTaggedPointers && tagged[idx]);
+        XCTAssertFalse(IsTaggedPointer(heap));
+        XCTAssertEqual(CFGetTypeID(date), CFDateGetTypeID());
+        // Compare bits, so that -0.0 and 0.0 differ
+        CFAbsoluteTime out = CFDateGetAbsoluteTime(date);
+        XCTAssertEqual(memcmp(&out, &at, sizeof(at)), 0);
+        XCTAssert(CFEqual(date, heap));
+        XCTAssert(CFEqual(heap, date));
+        XCTAssertEqual(CFHash(date), CFHash(heap));
+        XCTAssertEqual(CFDateCompare(date, heap, NULL), kCFCompareEqualTo);
+        CFRelease(heap);
+        CFRelease(date);
+    }
+}
+
+- (void)testTaggedValuesAsDictionaryKeysAndValues {
+    CFMutableDictionaryRef dict = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    for (int64_t idx = -500; idx < 500; idx++) {
+        CFNumberRef key = CFNumberCreate(kCFAllocatorSystemDefault, kCFNumberSInt64Type, &idx);
+        CFDateRef value = CFDateCreate(kCFAllocatorSystemDefault, (CFAbsoluteTime)idx * 60.0);
+        CFDictionarySetValue(dict, key, value);
+        CFRelease(value);
+        CFRelease(key);
+    }
+    XCTAssertEqual(CFDictionaryGetCount(dict), 1000);
+    for (int64_t idx = -500; idx < 500; idx++) {
+        // Look up with an equal number which is not tagged
+        CFNumberRef key = CFNumberCreate(kCFAllocatorMalloc, kCFNumberSInt64Type, &idx);
+        CFDateRef value = (CFDateRef)CFDictionaryGetValue(dict, key);
+        XCTAssert(NULL != value);
+        XCTAssertEqual(CFGetTypeID(value), CFDateGetTypeID());
+        XCTAssertEqual((int64_t)CFDateGetAbsoluteTime(value), idx * 60);
+        if (idx & 1) CFDictionaryRemoveValue(dict, key);
+        CFRelease(key);
+    }
+    XCTAssertEqual(CFDictionaryGetCount(dict), 500);
+    CFRelease(dict);
+}
+
+- (void)testTaggedNumberPlistAllocatesAlmostNothing {
+    const CFIndex count = 1000000;
+    CFMutableArrayRef numbers = CFArrayCreateMutable(kCFAllocatorSystemDefault, count, &kCFTypeArrayCallBacks);
+    _CFRuntimeSetInstanceStatisticsEnabled(true);
+    _CFRuntimeInstanceStatistics before, after;
+    XCTAssert(_CFRuntimeGetInstanceStatistics(CFNumberGetTypeID(), &before));
+    for (CFIndex idx = 0; idx < count; idx++) {
+        int64_t value = (idx & 1) ? -idx * 1000 : idx;
+        CFNumberRef number = CFNumberCreate(kCFAllocatorSystemDefault, kCFNumberSInt64Type, &value);
+        CFArrayAppendValue(numbers, number);
+        CFRelease(number);
+    }
+    CFDataRef data = CFPropertyListCreateData(kCFAllocatorSystemDefault, numbers, kCFPropertyListBinaryFormat_v1_0, 0, NULL);
+    XCTAssert(NULL != data);
+    CFPropertyListRef plist = CFPropertyListCreateWithData(kCFAllocatorSystemDefault, data, kCFPropertyListImmutable, NULL, NULL);
+    XCTAssert(NULL != plist);
+    XCTAssert(CFEqual(plist, numbers));
+    XCTAssert(_CFRuntimeGetInstanceStatistics(CFNumberGetTypeID(), &after));
+    _CFRuntimeSetInstanceStatisticsEnabled(false);
+    if (kTaggedPointers) {
+        XCTAssertLessThan(after.allocations - before.allocations, 100);
+    } else {
+        XCTAssertGreaterThan(after.allocations - before.allocations, count);
+    }
+    CFRelease(plist);
+    CFRelease(data);
+    CFRelease(numbers);
+}
+
+#pragma mark - Release pools
+
+static CFDataRef CreateHeldData(void) {
+    const uint8_t bytes[64] = {0};
+    CFDataRef data = CFDataCreate(kCFAllocatorSystemDefault, bytes, sizeof(bytes));
+    CFRetain(data);
+    return data;
+}
+
+// Runs on a thread of its own, which has no pool
+static void *AutoreleaseOutsidePool(void *data) {
+    CFAutorelease((CFDataRef)data);
+    return (void *)(uintptr_t)CFGetRetainCount((CFDataRef)data);
+}
+
+- (void)testReleasePoolNesting {
+    // Each data is retained once more than the pool will release it
+    void *outer = CFReleasePoolPush();
+    XCTAssert(NULL != outer);
+    CFDataRef first = CreateHeldData();
+    CFAutorelease(first);
+    void *inner = CFReleasePoolPush();
+    XCTAssert(inner != outer);
+    CFDataRef second = CreateHeldData();
+    CFAutorelease(second);
+    CFAutorelease(CFRetain(second));
+    XCTAssertEqual(CFGetRetainCount(second), 3);
+    CFReleasePoolPop(inner);
+    XCTAssertEqual(CFGetRetainCount(second), 1);
+    XCTAssertEqual(CFGetRetainCount(first), 2);
+
+    // Popping the outer pool also pops the pools pushed in it
+    CFDataRef third = CreateHeldData();
+    CFAutorelease(third);
+    void *innermost = CFReleasePoolPush();
+    CFDataRef fourth = CreateHeldData();
+    CFAutorelease(fourth);
+    (void)innermost;
+    CFReleasePoolPop(outer);
+    XCTAssertEqual(CFGetRetainCount(first), 1);
+    XCTAssertEqual(CFGetRetainCount(third), 1);
+    XCTAssertEqual(CFGetRetainCount(fourth), 1);
+
+    CFRelease(fourth);
+    CFRelease(third);
+    CFRelease(second);
+    CFRelease(first);
+
+    // Outside any pool nothing is released
+    CFDataRef unpooled = CreateHeldData();
+    pthread_t thread;
+    void *retainCount = NULL;
+    XCTAssertEqual(pthread_create(&thread, NULL, AutoreleaseOutsidePool, (void *)unpooled), 0);
+    pthread_join(thread, &retainCount);
+    XCTAssertEqual((CFIndex)(uintptr_t)retainCount, 2);
+    CFRelease(unpooled);
+    CFRelease(unpooled);
+}
+
+typedef struct {
+    pthread_t thread;
+    CFIndex frees;
+    Boolean freedOnOtherThread;
+} DeallocationRecord;
+
+static void RecordingDeallocate(void *ptr, void *info) {
+    DeallocationRecord *record = (DeallocationRecord *)info;
+    if (!pthread_equal(record->thread, pthread_self())) record->freedOnOtherThread = true;
+    record->frees++;
+    free(ptr);
+}
+
+- (void)testReleasePoolFinalizesClientDeallocatorsInPlace {
+    DeallocationRecord record = {pthread_self(), 0, false};
+    CFAllocatorContext context = {0, &record, NULL, NULL, NULL, NULL, NULL, RecordingDeallocate, NULL};
+    CFAllocatorRef deallocator = CFAllocatorCreate(kCFAllocatorSystemDefault, &context);
+    _CFRuntimeSetBackgroundReclaimEnabled(true);
+    for (CFIndex round = 0; round < 100; round++) {
+        void *pool = CFReleasePoolPush();
+        const CFIndex length = 256;
+        uint8_t *bytes = (uint8_t *)malloc(length);
+        memset(bytes, 'a', length);
+        CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorSystemDefault, bytes, length, deallocator);
+        // Shares the bytes, so its release frees them
+        CFDataRef subrange = CFDataCreateWithSubrange(kCFAllocatorSystemDefault, data, CFRangeMake(1, length - 2));
+        CFRelease(data);
+        CFAutorelease(subrange);
+
+        char *chars = (char *)malloc(length + 1);
+        memset(chars, 'b', length);
+        chars[length] = 0;
+        CFAutorelease(CFStringCreateWithCStringNoCopy(kCFAllocatorSystemDefault, chars, kCFStringEncodingASCII, deallocator));
+
+        UniChar *characters = (UniChar *)malloc(length * sizeof(UniChar));
+        CFMutableStringRef string = CFStringCreateMutableWithExternalCharactersNoCopy(kCFAllocatorSystemDefault, characters, 0, length, deallocator);
+        CFStringAppendCString(string, "external", kCFStringEncodingASCII);
+        CFAutorelease(string);
+
+        // Datas and strings without a client deallocator may go to the reclaimer
+        for (CFIndex idx = 0; idx < 64; idx++) {
+            CFAutorelease(CFDataCreate(kCFAllocatorSystemDefault, bytes, length));
+            CFAutorelease(CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("string %ld of a pooled batch"), (long)idx));
+        }
+        CFReleasePoolPop(pool);
+        XCTAssertEqual(record.frees, 3 * (round + 1));
+    }
+    _CFRuntimeSetBackgroundReclaimEnabled(false);
+    XCTAssertFalse(record.freedOnOtherThread);
+    CFRelease(deallocator);
+}
+
+typedef struct {
+    CFRunLoopSourceRef source;
+    CFDataRef previous;
+    CFIndex passes;
+    CFIndex drainedPasses;
+} ReleasePoolPassState;
+
+// Autoreleases one held data per pass and checks the previous pass released its own
+static void ReleasePoolPassPerform(void *info) {
+    ReleasePoolPassState *state = (ReleasePoolPassState *)info;
+    if (state->previous) {
+        if (1 == CFGetRetainCount(state->previous)) state->drainedPasses++;
+        CFRelease(state->previous);
+    }
+    state->previous = CreateHeldData();
+    CFAutorelease(state->previous);
+    if (++state->passes < 10) {
+        CFRunLoopSourceSignal(state->source);
+    } else {
+        CFRunLoopStop(CFRunLoopGetCurrent());
+    }
+}
+
+- (void)testRunLoopDrainsReleasePoolEachPass {
+    CFStringRef mode = CFSTR("RunloopTestsReleasePoolMode");
+    ReleasePoolPassState state = {NULL, NULL, 0, 0};
+    CFRunLoopSourceContext context = {0, &state, NULL, NULL, NULL, NULL, NULL, NULL, NULL, ReleasePoolPassPerform};
+    state.source = CFRunLoopSourceCreate(kCFAllocatorSystemDefault, 0, &context);
+    CFRunLoopAddSource(CFRunLoopGetCurrent(), state.source, mode);
+    CFRunLoopSourceSignal(state.source);
+    CFRunLoopRunInMode(mode, 5.0, false);
+    XCTAssertEqual(state.passes, 10);
+    XCTAssertEqual(state.drainedPasses, 9);
+    // The last pass drained its pool before the run returned
+    XCTAssert(NULL != state.previous);
+    XCTAssertEqual(CFGetRetainCount(state.previous), 1);
+    CFRelease(state.previous);
+    CFRunLoopRemoveSource(CFRunLoopGetCurrent(), state.source, mode);
+    CFRelease(state.source);
+}
+
+#pragma mark - CFDataFind
+
+static CFIndex NaiveDataFind(CFDataRef data, CFDataRef needle, CFRange range, Boolean backwards) {
+    const uint8_t *bytes = CFDataGetBytePtr(data);
+    CFIndex needleLength = CFDataGetLength(needle);
+    for (CFIndex idx = 0; idx + needleLength <= range.length; idx++) {
+        CFIndex location = backwards ? range.location + range.length - needleLength - idx : range.location + idx;
+        if (0 == memcmp(bytes + location, CFDataGetBytePtr(needle), needleLength)) return location;
+    }
+    return kCFNotFound;
+}
+
+// Checks CFDataFind and a CFDataSearcher against a byte-by-byte search
+static void CheckDataFind(XCTestCase *self, CFDataRef data, CFDataRef needle, CFRange range, CFDataSearchFlags options, CFIndex expected) {
+    CFIndex needleLength = CFDataGetLength(needle);
+    if (!(options & kCFDataSearchAnchored)) XCTAssertEqual(NaiveDataFind(data, needle, range, (options & kCFDataSearchBackwards) != 0), expected);
+    CFRange found = CFDataFind(data, needle, range, options);
+    XCTAssertEqual(found.location, expected, @"needle length %ld, options %lx", (long)needleLength, (unsigned long)options);
+    XCTAssertEqual(found.length, kCFNotFound == expected ? 0 : needleLength);
+    CFDataSearcherRef searcher = CFDataSearcherCreate(kCFAllocatorSystemDefault, needle, options);
+    CFRange searched = CFDataSearcherFind(searcher, data, range);
+    XCTAssertEqual(searched.location, found.location, @"needle length %ld, options %lx", (long)needleLength, (unsigned long)options);
+    XCTAssertEqual(searched.length, found.length);
+    CFRelease(searcher);
+}
+
+static const CFIndex kFindHaystackLength = 4096;
+
+- (void)testDataFindMatchesAtEitherEnd {
+    // Needle bytes are 0x80 and up, the rest of the haystack below
+    const CFIndex needleLengths[] = {1, 2, 15, 16, 17, 32, 33, 300};
+    for (size_t idx = 0; idx < sizeof(needleLengths) / sizeof(needleLengths[0]); idx++) {
+        CFIndex needleLength = needleLengths[idx];
+        uint8_t *bytes = (uint8_t *)malloc(kFindHaystackLength);
+        for (CFIndex pos = 0; pos < kFindHaystackLength; pos++) bytes[pos] = 'a' + pos % 13;
+        uint8_t *needleBytes = (uint8_t *)malloc(needleLength);
+        for (CFIndex pos = 0; pos < needleLength; pos++) needleBytes[pos] = 0x80 + pos % 0x80;
+        memmove(bytes, needleBytes, needleLength);
+        memmove(bytes + kFindHaystackLength - needleLength, needleBytes, needleLength);
+        CFDataRef data = CFDataCreate(kCFAllocatorSystemDefault, bytes, kFindHaystackLength);
+        CFDataRef needle = CFDataCreate(kCFAllocatorSystemDefault, needleBytes, needleLength);
+        CFIndex end = kFindHaystackLength - needleLength;
+        CFRange all = CFRangeMake(0, kFindHaystackLength);
+        CheckDataFind(self, data, needle, all, 0, 0);
+        CheckDataFind(self, data, needle, all, kCFDataSearchBackwards, end);
+        CheckDataFind(self, data, needle, all, kCFDataSearchAnchored, 0);
+        CheckDataFind(self, data, needle, all, kCFDataSearchBackwards | kCFDataSearchAnchored, end);
+        // Cutting one byte off either end leaves only the other match
+        CheckDataFind(self, data, needle, CFRangeMake(1, kFindHaystackLength - 1), 0, end);
+        CheckDataFind(self, data, needle, CFRangeMake(0, kFindHaystackLength - 1), kCFDataSearchBackwards, 0);
+        CheckDataFind(self, data, needle, CFRangeMake(1, kFindHaystackLength - 1), kCFDataSearchAnchored, kCFNotFound);
+        // And cutting both leaves none
+        CheckDataFind(self, data, needle, CFRangeMake(1, kFindHaystackLength - 2), 0, kCFNotFound);
+        CheckDataFind(self, data, needle, CFRangeMake(1, kFindHaystackLength - 2), kCFDataSearchBackwards, kCFNotFound);
+        // Exactly the needle
+        CheckDataFind(self, data, needle, CFRangeMake(end, needleLength), 0, end);
+        CheckDataFind(self, data, needle, CFRangeMake(end, needleLength - 1), 0, kCFNotFound);
+        CFRelease(needle);
+        CFRelease(data);
+        free(needleBytes);
+        free(bytes);
+    }
+}
+
+- (void)testDataFindAgreesWithByteSearch {
+    // Few distinct bytes, so candidates with matching first and last bytes are common
+    uint8_t *bytes = (uint8_t *)malloc(kFindHaystackLength);
+    uint32_t seed = 1;
+    for (CFIndex pos = 0; pos < kFindHaystackLength; pos++) {
+        seed = seed * 1103515245 + 12345;
+        bytes[pos] = 'a' + (seed >> 16) % 3;
+    }
+    CFDataRef data = CFDataCreate(kCFAllocatorSystemDefault, bytes, kFindHaystackLength);
+    const CFIndex needleLengths[] = {1, 2, 3, 5, 8, 16, 31, 32, 33, 64, 257, 300};
+    for (size_t idx = 0; idx < sizeof(needleLengths) / sizeof(needleLengths[0]); idx++) {
+        CFIndex needleLength = needleLengths[idx];
+        for (CFIndex round = 0; round < 20; round++) {
+            seed = seed * 1103515245 + 12345;
+            CFIndex start = (seed >> 8) % (kFindHaystackLength - needleLength);
+            uint8_t *needleBytes = (uint8_t *)malloc(needleLength);
+            memmove(needleBytes, bytes + start, needleLength);
+            // Every other needle differs from the haystack in one byte
+            if (round & 1) needleBytes[(seed >> 4) % needleLength] = 'd';
+            CFDataRef needle = CFDataCreate(kCFAllocatorSystemDefault, needleBytes, needleLength);
+            CFRange range = CFRangeMake(round, kFindHaystackLength - 2 * round);
+            CheckDataFind(self, data, needle, range, 0, NaiveDataFind(data, needle, range, false));
+            CheckDataFind(self, data, needle, range, kCFDataSearchBackwards, NaiveDataFind(data, needle, range, true));
+            if (!(round & 1)) {
+                XCTAssertNotEqual(NaiveDataFind(data, needle, CFRangeMake(0, kFindHaystackLength), false), kCFNotFound);
+            }
+            CFRelease(needle);
+            free(needleBytes);
+        }
+    }
+    CFRelease(data);
+    free(bytes);
+}
+
+#pragma mark - Reusable timers
+
+typedef struct {
+    CFIndex retains;
+    CFIndex releases;
+    CFIndex fires;
+} ReusableTimerCounts;
+
+static const void *ReusableTimerRetain(const void *info) {
+    ((ReusableTimerCounts *)info)->retains++;
+    return info;
+}
+
+static void ReusableTimerRelease(const void *info) {
+    ((ReusableTimerCounts *)info)->releases++;
+}
+
+static void ReusableTimerFired(CFRunLoopTimerRef timer, void *info) {
+    ((ReusableTimerCounts *)info)->fires++;
+    CFRunLoopStop(CFRunLoopGetCurrent());
+}
+
+// Adds the timer to its own mode and runs the current run loop until it fires
+static void FireTimerOnce(CFRunLoopTimerRef timer) {
+    CFStringRef mode = CFSTR("RunloopTestsReusableTimerMode");
+    CFRunLoopAddTimer(CFRunLoopGetCurrent(), timer, mode);
+    CFRunLoopRunInMode(mode, 5.0, false);
+}
+
+- (void)testReusableTimerIsPooledAfterItsOwnerReleasesIt {
+    ReusableTimerCounts first = {0, 0, 0};
+    CFRunLoopTimerContext firstContext = {0, &first, ReusableTimerRetain, ReusableTimerRelease, NULL};
+    CFRunLoopTimerRef timer = CFRunLoopTimerCreateReusable(kCFAllocatorSystemDefault, CFAbsoluteTimeGetCurrent(), 0.0, 0, 0, ReusableTimerFired, &firstContext);
+    XCTAssert(NULL != timer);
+    FireTimerOnce(timer);
+    XCTAssertEqual(first.fires, 1);
+    // A one-shot timer is invalidated after its callout, which drops its context
+    XCTAssertFalse(CFRunLoopTimerIsValid(timer));
+    XCTAssertEqual(first.retains, first.releases);
+
+    // The fired timer is pooled, but not handed out while its owner still holds it
+    ReusableTimerCounts second = {0, 0, 0};
+    CFRunLoopTimerContext secondContext = {0, &second, ReusableTimerRetain, ReusableTimerRelease, NULL};
+    CFRunLoopTimerRef other = CFRunLoopTimerCreateReusable(kCFAllocatorSystemDefault, CFAbsoluteTimeGetCurrent() + 60.0, 0.0, 0, 0, ReusableTimerFired, &secondContext);
+    XCTAssert(other != timer);
+    XCTAssertFalse(CFRunLoopTimerIsValid(timer));
+    // Still valid, so it is deallocated rather than pooled
+    CFRelease(other);
+    XCTAssertEqual(second.retains, second.releases);
+
+    // Once the owner lets go, the pool's reference is the last and the timer comes back with the new context
+    const void *released = timer;
+    CFRelease(timer);
+    ReusableTimerCounts third = {0, 0, 0};
+    CFRunLoopTimerContext thirdContext = {0, &third, ReusableTimerRetain, ReusableTimerRelease, NULL};
+    timer = CFRunLoopTimerCreateReusable(kCFAllocatorSystemDefault, CFAbsoluteTimeGetCurrent(), 0.0, 0, 7, ReusableTimerFired, &thirdContext);
+    XCTAssertEqual((const void *)timer, released);
+    XCTAssert(CFRunLoopTimerIsValid(timer));
+    XCTAssertEqual(CFRunLoopTimerGetOrder(timer), 7);
+    CFRunLoopTimerContext context;
+    CFRunLoopTimerGetContext(timer, &context);
+    XCTAssertEqual(context.info, (void *)&third);
+    XCTAssertEqual(third.retains, 1);
+    FireTimerOnce(timer);
+    XCTAssertEqual(third.fires, 1);
+    XCTAssertEqual(first.fires, 1);
+    XCTAssertEqual(third.retains, third.releases);
+    CFRelease(timer);
+}
+
 @end